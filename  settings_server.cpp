@@ -15,9 +15,47 @@
 //   GET  /history/export?user_id=...    -> get JSON export of chat history & settings
 //   POST /history/import                -> import JSON payload (merge/replace)
 //   GET  /health                        -> simple health check
+//   GET  /metrics                       -> request counters, per-lane and per-phase latency stats
+//   GET  /admin/slow-queries?limit=N    -> slowest SQL statements with EXPLAIN QUERY PLAN
+//   GET  /admin/active-users?granularity=hour|day&windows=N&dimension=...&metric=users|devices
+//                                       -> distinct users/devices per window and merged over the range
+//   GET  /debug/locks                   -> lock wait/hold times per call site, top contenders
+//   GET  /debug/pprof/profile?seconds=N -> CPU profile of all worker threads as folded stacks
+//   GET  /debug/memory                  -> live heap bytes per subsystem, SQLite memory, top allocation sites
+//   GET  /debug/memory/heap             -> sampled live heap as folded stacks (bytes)
+//   GET  /debug/hotkeys                 -> heaviest users overall, per route and by bytes written
 //
-// Build (example):
-// g++ settings_server.cpp -std=c++17 -O2 -lsqlite3 -pthread -o settings_server
+// Any request may send "X-Server-Timing: 1" to get a Server-Timing response
+// header breaking its latency into auth/parse/queue/lock/db/stmt/serialize.
+// Set LUMA_TRACE_FILE=<path> to also export sampled request traces as
+// OTLP-compatible JSON lines (see trace_export.h).
+//
+// Invalid UTF-8 in chat text is replaced with U+FFFD at ingest
+// (LUMA_UTF8_INVALID=reject refuses it instead); see utf8.h.
+//
+// Set LUMA_CAPTURE_FILE=<path> to record anonymized client traffic for the
+// replay tool (see traffic_capture.h and replay.cpp).
+//
+// Logs (one JSON object per line, including an access log entry per request)
+// go to stderr, or to LUMA_LOG_FILE=<path>; LUMA_LOG_LEVEL=debug|info|warn|error.
+//
+// Storage goes through luma_store.h/.cpp, a library (C++ and C API) that other
+// services on the host can link to read and write the same database in-process.
+// With LUMA_SETTINGS_CACHE=<users> set, GET /settings is answered from the
+// store's settings cache, which readers search without locks; hits are counted
+// off the request path by a drainer thread. The cache is off by default: it is
+// only kept current by writes made through this server, so enable it only
+// where the server is the database's sole writer (no other luma_store users).
+// Request and response bodies of the API routes go through compile-time schema
+// codecs (api_codecs.h, json_codec.h): one pass, no DOM, no exceptions.
+//
+// Build: cmake -S . -B build && cmake --build build (see CMakeLists.txt; builds the
+// tools too), or ./pgo_build.sh for a PGO+LTO binary benchmarked against the plain one.
+// By hand:
+// g++ settings_server.cpp luma_store.cpp -std=c++17 -O2 -rdynamic -lsqlite3 -pthread -o settings_server
+// (-rdynamic lets the CPU profiler name functions in the binary)
+//
+// SIGINT/SIGTERM stop the server cleanly.
 //
 // Requirements:
 // - httplib.h (cpp-httplib single header) in include path
@@ -36,11 +74,41 @@
 #include <chrono>
 #include <ctime>
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <future>
+#include <deque>
+#include <functional>
+#include <condition_variable>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <cstdlib>
+#include <cctype>
+#include <map>
+#include <set>
+#include <tuple>
+#include <cmath>
+#include <csignal>
+#include <pthread.h>
 
 #include "httplib.h"     // https://github.com/yhirose/cpp-httplib (single header)
 #include "json.hpp"      // nlohmann::json (single header)
 #include <sqlite3.h>
 
+#include "trace_export.h"
+#include "slow_query_log.h"
+#include "lock_profiler.h"
+#include "cpu_profiler.h"
+#define MEMORY_PROFILER_HOOK_NEW
+#include "memory_profiler.h"
+#include "async_logger.h"
+#include "heavy_hitters.h"
+#include "hyperloglog.h"
+#include "traffic_capture.h"
+#include "luma_store.h"
+#include "api_codecs.h"
+
 using json = nlohmann::json;
 using namespace httplib;
 
@@ -50,8 +118,109 @@ static const std::string VALID_API_KEY  = "secret-api-key"; // replace in prod
 // Database filename
 static const char* DB_FILE = "luma_settings.db";
 
-// Thread-safety for sqlite usage in this example
-std::mutex db_mutex;
+// How long a connection waits on SQLite's own file lock before SQLITE_BUSY
+static const int BUSY_TIMEOUT_MS = 5000;
+
+// Execution lanes: interactive requests never queue behind bulk work.
+// Each worker owns one SQLite connection; pending = queued + running.
+static const size_t INTERACTIVE_WORKERS = 4;
+static const size_t INTERACTIVE_MAX_PENDING = 256;
+static const size_t BULK_WORKERS = 2;
+static const size_t BULK_MAX_PENDING = 4;
+// HTTP threads; bulk requests can hold at most BULK_MAX_PENDING of these while they wait
+static const size_t HTTP_THREADS = 32;
+
+// Per-route time budgets. Once a request runs past its budget (or the client
+// hangs up) its in-flight SQLite statement is interrupted.
+static const std::chrono::milliseconds DEFAULT_DEADLINE(5000);
+static const std::chrono::milliseconds HISTORY_DEADLINE(10000);
+static const std::chrono::milliseconds EXPORT_DEADLINE(30000);
+static const std::chrono::milliseconds IMPORT_DEADLINE(30000);
+
+// SQLite calls the progress handler every N virtual machine instructions
+static const int PROGRESS_HANDLER_OPS = 1000;
+// Minimum gap between client-disconnect probes (each probe is a poll() on the socket)
+static const std::chrono::milliseconds DISCONNECT_PROBE_INTERVAL(25);
+
+// Request header asking for a Server-Timing breakdown in the response
+static const std::string TIMING_REQUEST_HEADER = "X-Server-Timing";
+// 1 in N requests feeds the per-phase histograms; the rest skip span bookkeeping
+static const uint64_t TIMING_SAMPLE_EVERY = 128;
+
+// Tracing is on when LUMA_TRACE_FILE names an output file. Every request then
+// records spans; a trace is kept if it is head-sampled, failed with 5xx, or
+// is at least as slow as the running p99 (tail sampling).
+static const char* TRACE_FILE_ENV = "LUMA_TRACE_FILE";
+static const uint64_t TRACE_SAMPLE_EVERY = 100;
+static const double TRACE_TAIL_PERCENTILE = 99.0;
+static const uint64_t TRACE_THRESHOLD_REFRESH = 256;  // requests between p99 recomputations
+static const size_t TRACE_RING_SIZE = 4096;
+static const size_t TRACE_MAX_FILE_BYTES = 64 * 1024 * 1024;
+static const int TRACE_KEEP_FILES = 4;
+
+// Statements slower than this are logged and aggregated at /admin/slow-queries.
+// LUMA_SLOW_QUERY_MS overrides the threshold.
+static const std::chrono::milliseconds SLOW_QUERY_THRESHOLD(50);
+static const char* SLOW_QUERY_ENV = "LUMA_SLOW_QUERY_MS";
+static const size_t SLOW_QUERY_RECENT = 256;  // recent slow runs kept for the report
+
+// /debug/pprof/profile defaults and limits (hz = samples per second of thread CPU time)
+static const long PROFILE_DEFAULT_SECONDS = 10;
+static const long PROFILE_MAX_SECONDS = 60;
+static const long PROFILE_DEFAULT_HZ = 99;
+static const long PROFILE_MAX_HZ = 1000;
+
+// /debug/memory: allocation sites listed in the JSON report
+static const size_t MEMORY_TOP_SITES = 10;
+
+// Hot users (see heavy_hitters.h). A user is hot when it sends at least
+// HOT_USER_SHARE of all requests in the window (and HOT_USER_MIN_REQUESTS);
+// hot users may only fill HOT_USER_QUEUE_SHARE of a lane's queue.
+static const std::chrono::seconds HOTKEY_WINDOW(60);
+static const size_t HOTKEY_TOP_K = 20;
+static const double HOT_USER_SHARE = 0.05;
+static const uint64_t HOT_USER_MIN_REQUESTS = 200;
+static const double HOT_USER_QUEUE_SHARE = 0.5;
+
+// Active users/devices (see hyperloglog.h). Clients identify the device and
+// app build with these headers; sketches are flushed to SQLite periodically.
+static const std::string DEVICE_ID_HEADER = "X-Device-Id";
+static const std::string APP_VERSION_HEADER = "X-App-Version";
+static const std::chrono::seconds ACTIVITY_FLUSH_INTERVAL(60);
+static const int ACTIVITY_HOURLY_RETENTION_DAYS = 14;
+static const size_t ACTIVITY_MAX_APP_VERSIONS = 64;  // further versions count as "app:other"
+
+// Structured logging (see async_logger.h)
+static const char* LOG_FILE_ENV = "LUMA_LOG_FILE";
+static const char* LOG_LEVEL_ENV = "LUMA_LOG_LEVEL";
+
+// Traffic capture (see traffic_capture.h); only client routes are recorded,
+// not health, metrics, admin or debug
+static const char* CAPTURE_FILE_ENV = "LUMA_CAPTURE_FILE";
+static const size_t CAPTURE_RING_SIZE = 8192;
+
+// Chat text (POST /history, /history/import) comes from speech-to-text and
+// occasionally holds invalid UTF-8. By default each invalid sequence is
+// replaced with U+FFFD at ingest so the message is kept and exports never
+// meet bad bytes; LUMA_UTF8_INVALID=reject answers 400 instead. The other
+// routes always reject.
+static const char* UTF8_INVALID_ENV = "LUMA_UTF8_INVALID";
+static bool utf8_repair_chat = true;
+
+// LUMA_SETTINGS_CACHE=<users> (e.g. 16384) turns on the store's settings
+// cache: GET /settings then answers from it when it can, on the HTTP thread
+// without a lane or a SQLite read. Entries have no TTL and the store only
+// updates them on its own writes, so a write from another process or another
+// in-process luma_store user would leave the server serving the old row. Off
+// (0) unless the server is the only writer.
+static const char* SETTINGS_CACHE_ENV = "LUMA_SETTINGS_CACHE";
+static size_t settings_cache_slots = 0;
+
+// Cache hits are counted (hot users, active users) off the request: each HTTP
+// thread queues them in its own ring of HIT_RING_SIZE, drained every
+// HIT_DRAIN_INTERVAL. A hit that finds its ring full is counted inline.
+static const size_t HIT_RING_SIZE = 1024;
+static const std::chrono::milliseconds HIT_DRAIN_INTERVAL(100);
 
 // Helper: get current ISO timestamp
 std::string iso_now() {
@@ -68,362 +237,948 @@ std::string iso_now() {
     return std::string(buf);
 }
 
+// --- Latency histograms --- //
+
+// Lock-free log-linear histogram of microsecond latencies: four sub-buckets
+// per power of two, so percentiles are within ~25% of the true value.
+struct LatencyHistogram {
+    static const int BUCKETS = 160;
+    std::atomic<uint64_t> counts[BUCKETS] = {};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum_us{0};
+    std::atomic<uint64_t> max_us{0};
+
+    static int bucket_of(uint64_t us) {
+        if (us < 4) return static_cast<int>(us);
+        int msb = 63 - __builtin_clzll(us);
+        int b = (msb - 1) * 4 + static_cast<int>((us >> (msb - 2)) & 3);
+        return b < BUCKETS ? b : BUCKETS - 1;
+    }
+
+    // Exclusive upper bound of bucket b
+    static uint64_t bucket_limit(int b) {
+        if (b < 4) return static_cast<uint64_t>(b) + 1;
+        int msb = b / 4 + 1;
+        return static_cast<uint64_t>(5 + b % 4) << (msb - 2);
+    }
+
+    void record(uint64_t us) {
+        counts[bucket_of(us)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum_us.fetch_add(us, std::memory_order_relaxed);
+        uint64_t prev = max_us.load(std::memory_order_relaxed);
+        while (us > prev && !max_us.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {}
+    }
+
+    void record(std::chrono::steady_clock::duration d) {
+        record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(d).count()));
+    }
+
+    // Upper bound of the bucket containing the p-th percentile (0..100)
+    uint64_t percentile(double p) const {
+        uint64_t n = total.load(std::memory_order_relaxed);
+        if (n == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(n - 1)) + 1;
+        uint64_t seen = 0;
+        for (int b = 0; b < BUCKETS; b++) {
+            seen += counts[b].load(std::memory_order_relaxed);
+            if (seen >= rank) return std::min(bucket_limit(b), max_us.load(std::memory_order_relaxed));
+        }
+        return max_us.load(std::memory_order_relaxed);
+    }
+
+    json to_json() const {
+        uint64_t n = total.load(std::memory_order_relaxed);
+        return {
+                {"count", n},
+                {"mean_us", n ? sum_us.load(std::memory_order_relaxed) / n : 0},
+                {"p50_us", percentile(50)},
+                {"p90_us", percentile(90)},
+                {"p99_us", percentile(99)},
+                {"max_us", max_us.load(std::memory_order_relaxed)}
+        };
+    }
+};
+
+// --- Request timing spans --- //
+
+// Phases a request is broken into. "db" is the whole DB task on the lane
+// worker and includes "lock" (waiting for db_mutex) and "stmt" (each SQLite
+// statement, reported by the connection's profile callback).
+enum class Phase { Auth = 0, Parse, Queue, Lock, Db, Statement, Serialize, Count };
+static const char* PHASE_NAMES[] = {"auth", "parse", "queue", "lock", "db", "stmt", "serialize"};
+static const int PHASE_COUNT = static_cast<int>(Phase::Count);
+
+struct Span {
+    Phase phase;
+    std::chrono::steady_clock::time_point begin;
+    std::chrono::steady_clock::time_point end;
+    std::string detail;  // SQL text for statement spans
+};
+
+// Spans of one request. Only filled when the request is sampled or asked for
+// a Server-Timing header; written by the HTTP thread and the lane worker in
+// turn, never concurrently.
+struct RequestTiming {
+    static const int MAX_SPANS = 64;
+    bool enabled = false;
+    bool requested = false;  // client sent X-Server-Timing
+    bool sampled = false;    // head-sampled for histograms / traces
+    std::chrono::steady_clock::time_point start;
+    std::chrono::system_clock::time_point wall_start;  // anchors spans for trace export
+    Span spans[MAX_SPANS];
+    int count = 0;
+
+    void add(Phase phase, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end,
+             const char* detail = nullptr) {
+        if (!enabled || count == MAX_SPANS) return;
+        Span& span = spans[count++];
+        span.phase = phase;
+        span.begin = begin;
+        span.end = end;
+        if (detail) span.detail = detail;
+    }
+};
+
+// --- Request deadlines & cancellation --- //
+
+enum class CancelReason { None = 0, ClientGone, DeadlineExceeded };
+
+// State for the request being served. Lives on the HTTP handler's stack; the
+// lane worker running its DB work points current_request at it, and SQLite's
+// progress handler polls it to abort long statements.
+struct RequestContext {
+    const Request* req = nullptr;
+    std::chrono::steady_clock::time_point deadline;
+    std::chrono::steady_clock::time_point next_probe;
+    std::atomic<CancelReason> reason{CancelReason::None};
+    RequestTiming timing;
+
+    // True once the request should stop doing work. Safe from any thread
+    // (lane workers, SQLite's progress handler).
+    bool interrupted() {
+        if (reason.load(std::memory_order_relaxed) != CancelReason::None) return true;
+        if (std::chrono::steady_clock::now() >= deadline) {
+            reason.store(CancelReason::DeadlineExceeded, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    // Check whether the client hung up. Only called on the thread serving the
+    // request, at most once per DISCONNECT_PROBE_INTERVAL.
+    void probe_client() {
+        auto now = std::chrono::steady_clock::now();
+        if (now < next_probe) return;
+        next_probe = now + DISCONNECT_PROBE_INTERVAL;
+        if (req && req->is_connection_closed && req->is_connection_closed()) {
+            CancelReason expected = CancelReason::None;
+            reason.compare_exchange_strong(expected, CancelReason::ClientGone);
+        }
+    }
+};
+
+thread_local RequestContext* current_request = nullptr;
+
+// Server-wide counters exposed at /metrics
+struct Metrics {
+    std::atomic<uint64_t> requests_total{0};
+    std::atomic<uint64_t> requests_cancelled{0};
+    std::atomic<uint64_t> requests_timed_out{0};
+    std::atomic<uint64_t> requests_timed{0};
+    std::atomic<uint64_t> trace_slow_threshold_us{0};
+    std::atomic<uint64_t> utf8_rejected{0};      // bodies refused for invalid UTF-8
+    std::atomic<uint64_t> utf8_repaired{0};      // bodies whose invalid UTF-8 was replaced
+    std::atomic<uint64_t> utf8_replacements{0};  // invalid sequences replaced in them
+    std::atomic<uint64_t> settings_cache_hits{0};
+    std::atomic<uint64_t> settings_cache_hits_inline{0};  // counted on the request, ring full
+    LatencyHistogram phases[PHASE_COUNT];
+    LatencyHistogram request_total;  // end-to-end, sampled requests only
+};
+Metrics metrics;
+
+// Records a span of the current request for its lifetime (no-op unless sampled)
+class ScopedSpan {
+public:
+    explicit ScopedSpan(Phase phase) : phase_(phase) {
+        if (current_request && current_request->timing.enabled) {
+            timing_ = &current_request->timing;
+            begin_ = std::chrono::steady_clock::now();
+        }
+    }
+    ~ScopedSpan() {
+        if (timing_) timing_->add(phase_, begin_, std::chrono::steady_clock::now());
+    }
+    ScopedSpan(const ScopedSpan&) = delete;
+    ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+private:
+    Phase phase_;
+    RequestTiming* timing_ = nullptr;
+    std::chrono::steady_clock::time_point begin_;
+};
+
+// True if the current request was cancelled (client gone or deadline passed)
+bool request_cancelled() {
+    return current_request && current_request->interrupted();
+}
+
+// Non-zero return makes the running statement fail with SQLITE_INTERRUPT
+static int on_sqlite_progress(void* ctx) {
+    return static_cast<RequestContext*>(ctx)->interrupted() ? 1 : 0;
+}
+
+// Statement start seen by the trace callback on this thread. SQLite's own
+// profile time is only millisecond-grained, so statements are timed here.
+thread_local sqlite3_stmt* stmt_running = nullptr;
+thread_local std::chrono::steady_clock::time_point stmt_begin;
+
+std::unique_ptr<SlowQueryLog> slow_queries;
+
+// Collapse runs of whitespace so multi-line SQL fits on one log line
+static std::string one_line(const char* sql) {
+    std::string out;
+    bool space = false;
+    for (const char* c = sql ? sql : ""; *c; c++) {
+        if (std::isspace(static_cast<unsigned char>(*c))) { space = !out.empty(); continue; }
+        if (space) out += ' ';
+        space = false;
+        out += *c;
+    }
+    return out;
+}
+
+// SQLITE_TRACE_STMT/PROFILE callback. Each finished statement becomes a
+// "stmt" span of the current request and, above the threshold, a slow log entry.
+static int on_sqlite_trace(unsigned type, void*, void* p, void* x) {
+    auto stmt = static_cast<sqlite3_stmt*>(p);
+    auto now = std::chrono::steady_clock::now();
+    if (type == SQLITE_TRACE_STMT) {
+        stmt_running = stmt;
+        stmt_begin = now;
+        return 0;
+    }
+    if (type != SQLITE_TRACE_PROFILE) return 0;
+
+    auto begin = now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::nanoseconds(*static_cast<sqlite3_int64*>(x)));
+    if (stmt_running == stmt) begin = stmt_begin;
+    stmt_running = nullptr;
+    StatementCounters counters = StatementCounters::take(stmt);
+
+    if (current_request && current_request->timing.enabled) {
+        current_request->timing.add(Phase::Statement, begin, now, sqlite3_sql(stmt));
+    }
+    if (slow_queries && now - begin >= slow_queries->threshold()) {
+        MemoryScope mem(MemTag::Diagnostics);
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - begin);
+        std::string shapes = SlowQueryLog::param_shapes(stmt);
+        slow_queries->record(stmt, elapsed, counters, shapes);
+        LOG_WARN_LIMITED("slow_query")
+                .num("duration_us", elapsed.count() / 1000)
+                .num("rows_scanned", counters.rows_scanned)
+                .num("rows_changed", counters.rows_changed)
+                .str("params", shapes)
+                .str("sql", one_line(sqlite3_sql(stmt)));
+    }
+    return 0;
+}
+
 // --- SQLite helper functions --- //
 
 static int exec_sql(sqlite3* db, const std::string& sql) {
     char* errmsg = nullptr;
     int rc = sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &errmsg);
     if (rc != SQLITE_OK) {
-        std::cerr << "[sqlite] exec error: " << (errmsg ? errmsg : "<null>") << "\n";
+        LOG_ERROR_LIMITED("sqlite_exec_failed").str("error", errmsg).str("sql", one_line(sql.c_str()));
         sqlite3_free(errmsg);
     }
     return rc;
 }
 
-// Initialize DB: create tables users, settings, chat_history
-void init_db() {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    sqlite3* db = nullptr;
-    if (sqlite3_open(DB_FILE, &db) != SQLITE_OK) {
-        std::cerr << "Failed to open DB\n";
-        return;
+// --- Storage --- //
+//
+// Settings and chat history live behind luma_store.h, the library other
+// services on the host link to read the same database. Its writer lock
+// ("db_mutex") serializes writers across all connections; readers don't take
+// it, the DB runs in WAL mode. The hooks below tie it into request timing,
+// cancellation, the slow query log and error logging.
+
+std::unique_ptr<LumaStore> store;
+
+static bool open_store() {
+    StoreOptions options;
+    options.busy_timeout_ms = BUSY_TIMEOUT_MS;
+    options.settings_cache_slots = settings_cache_slots;
+    options.on_open = [](sqlite3* db) {
+        sqlite3_trace_v2(db, SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE, on_sqlite_trace, nullptr);
+    };
+    // the wait shows up as the request's "lock" phase
+    options.on_lock_wait = [](std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) {
+        if (current_request) current_request->timing.add(Phase::Lock, begin, end);
+    };
+    options.cancelled = request_cancelled;
+    options.on_error = [](const char* op, const std::string& error) {
+        LOG_ERROR_LIMITED("store_failed").str("op", op).str("error", error);
+    };
+    store.reset(new LumaStore(DB_FILE, std::move(options)));
+    std::string error;
+    if (!store->init(&error)) {
+        LOG_ERROR("db_open_failed").str("file", DB_FILE).str("error", error);
+        return false;
     }
+    return true;
+}
 
-    // Users table (basic profile)
-    std::string users_sql = R"sql(
-    CREATE TABLE IF NOT EXISTS users (
-      user_id TEXT PRIMARY KEY,
-      name TEXT,
-      email TEXT,
-      avatar_url TEXT,
-      created_at TEXT
-    );
-    )sql";
-
-    // Settings table (one row per user)
-    std::string settings_sql = R"sql(
-    CREATE TABLE IF NOT EXISTS settings (
-      user_id TEXT PRIMARY KEY,
-      theme_mode TEXT DEFAULT 'System', -- System|Light|Dark
-      dark_mode INTEGER DEFAULT 0,
-      notifications_enabled INTEGER DEFAULT 1,
-      chat_notifications INTEGER DEFAULT 1,
-      update_notifications INTEGER DEFAULT 1,
-      reminder_notifications INTEGER DEFAULT 0,
-      language TEXT DEFAULT 'English',
-      biometric_lock INTEGER DEFAULT 0,
-      app_version TEXT DEFAULT '1.0.0',
-      updated_at TEXT,
-      FOREIGN KEY(user_id) REFERENCES users(user_id)
-    );
-    )sql";
-
-    // Chat history
-    std::string history_sql = R"sql(
-    CREATE TABLE IF NOT EXISTS chat_history (
-      id INTEGER PRIMARY KEY AUTOINCREMENT,
-      user_id TEXT,
-      role TEXT, -- user | bot
-      message TEXT,
-      created_at TEXT,
-      FOREIGN KEY(user_id) REFERENCES users(user_id)
-    );
-    )sql";
-
-    exec_sql(db, users_sql);
-    exec_sql(db, settings_sql);
-    exec_sql(db, history_sql);
-
-    sqlite3_close(db);
+// Take the writer lock for tables the store doesn't manage (activity_sketches)
+static ProfiledLock lock_db(const char* site) {
+    return store->write_lock(site);
 }
 
-// Ensure user exists in users/settings (create default rows)
-void ensure_user_exists(const std::string& user_id) {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    sqlite3* db = nullptr;
-    if (sqlite3_open(DB_FILE, &db) != SQLITE_OK) return;
+// --- Hot keys --- //
+//
+// Heavy hitters over user_id: overall (used for lane admission), per route
+// ("METHOD /path user_id") and weighted by request bytes written.
 
-    // begin transaction
-    exec_sql(db, "BEGIN TRANSACTION;");
+HotKeyTracker hot_users("hot_users", HOTKEY_TOP_K, HOTKEY_WINDOW);
+HotKeyTracker hot_routes("hot_routes", HOTKEY_TOP_K, HOTKEY_WINDOW);
+HotKeyTracker hot_writers("hot_writers", HOTKEY_TOP_K, HOTKEY_WINDOW);
 
-    // Insert into users if not exists
-    {
-        std::string sql = "INSERT OR IGNORE INTO users(user_id, name, email, avatar_url, created_at) VALUES(?, ?, ?, ?, ?);";
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
-            sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 2, "User Name", -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 3, "user@example.com", -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 4, "", -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 5, iso_now().c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_step(stmt);
+// Count a request by `user_id`; true if that user is currently hot
+static bool track_user(const std::string& user_id) {
+    if (user_id.empty()) return false;
+    hot_users.add(user_id);
+    if (current_request && current_request->req) {
+        const Request& req = *current_request->req;
+        hot_routes.add(req.method + " " + req.path + " " + user_id);
+        if (req.method == "POST") hot_writers.add(user_id, req.body.size());
+    }
+    return hot_users.is_hot(user_id, HOT_USER_SHARE, HOT_USER_MIN_REQUESTS);
+}
+
+// --- Active users --- //
+//
+// Distinct users and devices per hour and per day, overall, per route class
+// (the lane) and per app version. Requests feed HyperLogLog sketches for the
+// current windows, kept per recording thread so requests never share a lock;
+// flush() takes them, merges them register-wise into activity_sketches and
+// keeps whatever it couldn't write for the next flush.
+
+enum class Granularity { Hour, Day };
+
+class ActivityCounters {
+public:
+    void record(const char* route_class, const std::string& user_id, const std::string& device_id,
+                const std::string& app_version) {
+        int64_t secs = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        uint64_t user = HyperLogLog::hash(user_id);
+        uint64_t device = device_id.empty() ? 0 : HyperLogLog::hash(device_id);
+
+        Shard& shard = local_shard();
+        std::string dims[] = {"all", std::string("class:") + route_class, app_dimension(shard, app_version)};
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (Granularity g : {Granularity::Hour, Granularity::Day}) {
+            int64_t window = window_of(g, secs);
+            for (const auto& dim : dims) {
+                shard.sketch(g, window, dim, "users").add(user);
+                if (device) shard.sketch(g, window, dim, "devices").add(device);
+            }
         }
-        sqlite3_finalize(stmt);
     }
 
-    // Insert default settings if not exists
-    {
-        std::string sql = R"sql(
-        INSERT OR IGNORE INTO settings(
-          user_id, theme_mode, dark_mode, notifications_enabled,
-          chat_notifications, update_notifications, reminder_notifications,
-          language, biometric_lock, app_version, updated_at
-        ) VALUES(?, 'System', 0, 1, 1, 1, 0, 'English', 0, '1.0.0', ?);
-        )sql";
+    // Merge everything recorded since the last flush into the table, on the
+    // counters' own session (no request deadline applies). False if nothing
+    // could be written; the sketches are then kept and the next flush retries.
+    bool flush() {
+        ProfiledLock lock(flush_mutex_, "ActivityCounters::flush");
+        std::vector<Shard*> shards;
+        {
+            ProfiledLock shards_lock(shards_mutex_, "ActivityCounters::flush");
+            for (const auto& shard : shards_) shards.push_back(shard.get());
+        }
+        for (Shard* shard : shards) {
+            std::map<Key, std::unique_ptr<HyperLogLog>> taken;
+            {
+                std::lock_guard<std::mutex> shard_lock(shard->mutex);
+                taken.swap(shard->sketches);
+            }
+            for (auto& entry : taken) {
+                auto& slot = pending_[entry.first];
+                if (slot) slot->merge(*entry.second);
+                else slot = std::move(entry.second);
+            }
+        }
+        int64_t secs = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        int64_t cutoff = window_of(Granularity::Hour, secs) - ACTIVITY_HOURLY_RETENTION_DAYS * 24;
+        for (auto it = pending_.begin(); it != pending_.end();) {  // would be pruned on write anyway
+            it = it->first.g == Granularity::Hour && it->first.window < cutoff ? pending_.erase(it) : std::next(it);
+        }
+        if (pending_.empty()) return true;
+        if (!session_ || !write(session_->handle(), cutoff)) return false;
+        pending_.clear();
+        return true;
+    }
+
+    // Estimates for the last `windows` windows plus all of them merged
+    json report(sqlite3* db, Granularity g, int64_t windows, const std::string& dimension, const std::string& metric) {
+        flush();
+        int64_t secs = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        std::string from = window_label(g, window_of(g, secs) - windows + 1);
+
+        HyperLogLog merged;
+        json per_window = json::array();
         sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
-            sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 2, iso_now().c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_step(stmt);
+        if (sqlite3_prepare_v2(db, "SELECT window_start, registers FROM activity_sketches WHERE granularity = ? "
+                                   "AND dimension = ? AND metric = ? AND window_start >= ? AND hash_id = ? "
+                                   "ORDER BY window_start;", -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, granularity_name(g), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, dimension.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 3, metric.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 4, from.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 5, HyperLogLog::HASH_ID, -1, SQLITE_STATIC);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                HyperLogLog window;
+                window.merge_bytes(sqlite3_column_blob(stmt, 1), static_cast<size_t>(sqlite3_column_bytes(stmt, 1)));
+                merged.merge(window);
+                per_window.push_back({
+                        {"window_start", reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0))},
+                        {"estimate", std::llround(window.estimate())}
+                });
+            }
         }
         sqlite3_finalize(stmt);
+
+        json dimensions = json::array();
+        if (sqlite3_prepare_v2(db, "SELECT DISTINCT dimension FROM activity_sketches WHERE granularity = ? "
+                                   "AND window_start >= ? AND hash_id = ? ORDER BY dimension;", -1, &stmt, 0) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, granularity_name(g), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, from.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 3, HyperLogLog::HASH_ID, -1, SQLITE_STATIC);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                dimensions.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+            }
+        }
+        sqlite3_finalize(stmt);
+
+        return {
+                {"granularity", granularity_name(g)},
+                {"dimension", dimension},
+                {"metric", metric},
+                {"from", from},
+                {"windows", per_window},
+                {"distinct_over_range", std::llround(merged.estimate())},
+                {"relative_error", 1.04 / std::sqrt(static_cast<double>(HyperLogLog::M))},
+                {"dimensions", dimensions}
+        };
     }
 
-    exec_sql(db, "COMMIT;");
-    sqlite3_close(db);
-}
+    // Open the counters' connection and flush on a background thread
+    void start() {
+        std::string error;
+        session_ = store->open_session(&error);
+        if (!session_) {
+            LOG_ERROR("db_open_failed").str("file", DB_FILE).str("component", "activity").str("error", error);
+            return;
+        }
+        // tables created before hash_id was stored get the column; their rows
+        // (NULL hash_id) are ignored and overwritten
+        sqlite3_stmt* probe = nullptr;
+        if (sqlite3_prepare_v2(session_->handle(), "SELECT hash_id FROM activity_sketches LIMIT 0;", -1, &probe, 0) != SQLITE_OK) {
+            auto lock = lock_db(__func__);
+            exec_sql(session_->handle(), "ALTER TABLE activity_sketches ADD COLUMN hash_id TEXT;");
+        }
+        sqlite3_finalize(probe);
+        flusher_ = std::thread([this] {
+            bool stopping = false;
+            while (!stopping) {
+                {
+                    ProfiledLock lock(stop_mutex_, "ActivityCounters::flusher");
+                    stopping = stop_cv_.wait_for(lock, ACTIVITY_FLUSH_INTERVAL, [this] { return stopping_; });
+                }
+                flush();  // one last time on the way out
+            }
+        });
+    }
 
-// Fetch settings as JSON
-json get_user_settings(const std::string& user_id) {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    ensure_user_exists(user_id);
-
-    sqlite3* db = nullptr;
-    json out;
-    if (sqlite3_open(DB_FILE, &db) != SQLITE_OK) return out;
-
-    std::string sql = R"sql(
-      SELECT u.user_id, u.name, u.email, u.avatar_url,
-             s.theme_mode, s.dark_mode, s.notifications_enabled,
-             s.chat_notifications, s.update_notifications, s.reminder_notifications,
-             s.language, s.biometric_lock, s.app_version, s.updated_at
-      FROM users u
-      JOIN settings s ON u.user_id = s.user_id
-      WHERE u.user_id = ?;
-    )sql";
-
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_TRANSIENT);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            out["user_id"] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-            out["name"] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-            out["email"] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-            out["avatar_url"] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-            out["theme_mode"] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
-            out["dark_mode"] = sqlite3_column_int(stmt, 5) != 0;
-            out["notifications_enabled"] = sqlite3_column_int(stmt, 6) != 0;
-            out["chat_notifications"] = sqlite3_column_int(stmt, 7) != 0;
-            out["update_notifications"] = sqlite3_column_int(stmt, 8) != 0;
-            out["reminder_notifications"] = sqlite3_column_int(stmt, 9) != 0;
-            out["language"] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 10));
-            out["biometric_lock"] = sqlite3_column_int(stmt, 11) != 0;
-            out["app_version"] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 12));
-            out["updated_at"] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 13));
-        }
-    }
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
-    return out;
-}
+    void stop() {
+        if (!flusher_.joinable()) return;
+        {
+            ProfiledLock lock(stop_mutex_, "ActivityCounters::stop");
+            stopping_ = true;
+        }
+        stop_cv_.notify_all();
+        flusher_.join();
+    }
 
-// Update settings given JSON (partial allowed)
-bool upsert_settings(const std::string& user_id, const json& j) {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    ensure_user_exists(user_id);
+    static const char* granularity_name(Granularity g) { return g == Granularity::Hour ? "hour" : "day"; }
 
-    sqlite3* db = nullptr;
-    if (sqlite3_open(DB_FILE, &db) != SQLITE_OK) return false;
-    exec_sql(db, "BEGIN TRANSACTION;");
+private:
+    struct Key {
+        Granularity g;
+        int64_t window;
+        std::string dimension;
+        std::string metric;
+        bool operator<(const Key& o) const {
+            return std::tie(g, window, dimension, metric) < std::tie(o.g, o.window, o.dimension, o.metric);
+        }
+    };
 
-    // Update users if profile keys present
-    if (j.contains("name") || j.contains("email") || j.contains("avatar_url")) {
-        std::string sql = "UPDATE users SET name = COALESCE(?, name), email = COALESCE(?, email), avatar_url = COALESCE(?, avatar_url) WHERE user_id = ?;";
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
-            // bind in order: name, email, avatar, user_id
-            if (j.contains("name")) sqlite3_bind_text(stmt, 1, j["name"].get<std::string>().c_str(), -1, SQLITE_TRANSIENT);
-            else sqlite3_bind_null(stmt, 1);
-            if (j.contains("email")) sqlite3_bind_text(stmt, 2, j["email"].get<std::string>().c_str(), -1, SQLITE_TRANSIENT);
-            else sqlite3_bind_null(stmt, 2);
-            if (j.contains("avatar_url")) sqlite3_bind_text(stmt, 3, j["avatar_url"].get<std::string>().c_str(), -1, SQLITE_TRANSIENT);
-            else sqlite3_bind_null(stmt, 3);
-            sqlite3_bind_text(stmt, 4, user_id.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_step(stmt);
+    // Sketches recorded by one thread since the last flush. Only that thread
+    // and flush() lock it, so a plain std::mutex: a ProfiledMutex would have
+    // every request update the same shared stats slot.
+    struct Shard {
+        std::mutex mutex;
+        std::map<Key, std::unique_ptr<HyperLogLog>> sketches;
+        std::map<std::string, std::string> app_dimensions;  // raw X-App-Version -> dimension, owner thread only
+
+        // Caller holds mutex
+        HyperLogLog& sketch(Granularity g, int64_t window, const std::string& dimension, const char* metric) {
+            auto& slot = sketches[Key{g, window, dimension, metric}];
+            if (!slot) slot.reset(new HyperLogLog);
+            return *slot;
         }
-        sqlite3_finalize(stmt);
+    };
+
+    static int64_t window_of(Granularity g, int64_t unix_secs) {
+        return unix_secs / (g == Granularity::Hour ? 3600 : 86400);
     }
 
-    // Build settings update
-    std::string sql = R"sql(
-      INSERT INTO settings(user_id, theme_mode, dark_mode, notifications_enabled,
-        chat_notifications, update_notifications, reminder_notifications,
-        language, biometric_lock, app_version, updated_at)
-      VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
-      ON CONFLICT(user_id) DO UPDATE SET
-        theme_mode = COALESCE(excluded.theme_mode, settings.theme_mode),
-        dark_mode = COALESCE(excluded.dark_mode, settings.dark_mode),
-        notifications_enabled = COALESCE(excluded.notifications_enabled, settings.notifications_enabled),
-        chat_notifications = COALESCE(excluded.chat_notifications, settings.chat_notifications),
-        update_notifications = COALESCE(excluded.update_notifications, settings.update_notifications),
-        reminder_notifications = COALESCE(excluded.reminder_notifications, settings.reminder_notifications),
-        language = COALESCE(excluded.language, settings.language),
-        biometric_lock = COALESCE(excluded.biometric_lock, settings.biometric_lock),
-        app_version = COALESCE(excluded.app_version, settings.app_version),
-        updated_at = COALESCE(excluded.updated_at, settings.updated_at);
-    )sql";
-
-    // derive values (use json or default to NULL so COALESCE keeps existing)
-    std::string theme_mode = j.contains("theme_mode") ? j["theme_mode"].get<std::string>() : "";
-    int dark_mode = j.contains("dark_mode") ? (j["dark_mode"].get<bool>() ? 1 : 0) : -1;
-    int notifications_enabled = j.contains("notifications_enabled") ? (j["notifications_enabled"].get<bool>() ? 1 : 0) : -1;
-    int chat_notifications = j.contains("chat_notifications") ? (j["chat_notifications"].get<bool>() ? 1 : 0) : -1;
-    int update_notifications = j.contains("update_notifications") ? (j["update_notifications"].get<bool>() ? 1 : 0) : -1;
-    int reminder_notifications = j.contains("reminder_notifications") ? (j["reminder_notifications"].get<bool>() ? 1 : 0) : -1;
-    std::string language = j.contains("language") ? j["language"].get<std::string>() : "";
-    int biometric_lock = j.contains("biometric_lock") ? (j["biometric_lock"].get<bool>() ? 1 : 0) : -1;
-    std::string app_version = j.contains("app_version") ? j["app_version"].get<std::string>() : "";
-
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
-        // Bind in order as in VALUES
-        sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_TRANSIENT);
-
-        if (!theme_mode.empty()) sqlite3_bind_text(stmt, 2, theme_mode.c_str(), -1, SQLITE_TRANSIENT);
-        else sqlite3_bind_null(stmt, 2);
-
-        if (dark_mode != -1) sqlite3_bind_int(stmt, 3, dark_mode); else sqlite3_bind_null(stmt, 3);
-        if (notifications_enabled != -1) sqlite3_bind_int(stmt, 4, notifications_enabled); else sqlite3_bind_null(stmt, 4);
-        if (chat_notifications != -1) sqlite3_bind_int(stmt, 5, chat_notifications); else sqlite3_bind_null(stmt, 5);
-        if (update_notifications != -1) sqlite3_bind_int(stmt, 6, update_notifications); else sqlite3_bind_null(stmt, 6);
-        if (reminder_notifications != -1) sqlite3_bind_int(stmt, 7, reminder_notifications); else sqlite3_bind_null(stmt, 7);
-        if (!language.empty()) sqlite3_bind_text(stmt, 8, language.c_str(), -1, SQLITE_TRANSIENT); else sqlite3_bind_null(stmt, 8);
-        if (biometric_lock != -1) sqlite3_bind_int(stmt, 9, biometric_lock); else sqlite3_bind_null(stmt, 9);
-        if (!app_version.empty()) sqlite3_bind_text(stmt, 10, app_version.c_str(), -1, SQLITE_TRANSIENT); else sqlite3_bind_null(stmt, 10);
-        sqlite3_bind_text(stmt, 11, iso_now().c_str(), -1, SQLITE_TRANSIENT);
-
-        sqlite3_step(stmt);
-    }
-    sqlite3_finalize(stmt);
-
-    exec_sql(db, "COMMIT;");
-    sqlite3_close(db);
-    return true;
-}
+    static std::string window_label(Granularity g, int64_t window) {
+        std::time_t t = static_cast<std::time_t>(window * (g == Granularity::Hour ? 3600 : 86400));
+        std::tm tm{};
+        gmtime_r(&t, &tm);
+        char buf[32];
+        strftime(buf, sizeof(buf), g == Granularity::Hour ? "%Y-%m-%dT%H:00Z" : "%Y-%m-%d", &tm);
+        return buf;
+    }
 
-// Append chat message for user
-bool append_chat_message(const std::string& user_id, const std::string& role, const std::string& message) {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    ensure_user_exists(user_id);
-    sqlite3* db = nullptr;
-    if (sqlite3_open(DB_FILE, &db) != SQLITE_OK) return false;
-
-    std::string sql = "INSERT INTO chat_history(user_id, role, message, created_at) VALUES(?, ?, ?, ?);";
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, role.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 3, message.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 4, iso_now().c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_step(stmt);
-    }
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
-    return true;
-}
+    // The calling thread's shard, registered on first use. Shards live as
+    // long as the counters; the server's threads are long-lived pools.
+    Shard& local_shard() {
+        thread_local const ActivityCounters* owner = nullptr;
+        thread_local Shard* shard = nullptr;
+        if (owner != this) {
+            std::unique_ptr<Shard> fresh(new Shard);
+            shard = fresh.get();
+            owner = this;
+            ProfiledLock lock(shards_mutex_, "ActivityCounters::local_shard");
+            shards_.push_back(std::move(fresh));
+        }
+        return *shard;
+    }
 
-// Clear chat history for a user
-bool clear_chat_history(const std::string& user_id) {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    sqlite3* db = nullptr;
-    if (sqlite3_open(DB_FILE, &db) != SQLITE_OK) return false;
-    std::string sql = "DELETE FROM chat_history WHERE user_id = ?;";
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_step(stmt);
-    }
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
-    return true;
-}
+    // Write pending_ in one transaction. Every step is checked; on failure
+    // the transaction is rolled back and pending_ is left for the next try.
+    // Caller holds flush_mutex_.
+    bool write(sqlite3* db, int64_t hour_cutoff) {
+        auto lock = lock_db(__func__);
+        if (exec_sql(db, "BEGIN TRANSACTION;") != SQLITE_OK) return false;
+        sqlite3_stmt* select = nullptr;
+        sqlite3_stmt* upsert = nullptr;
+        sqlite3_stmt* prune = nullptr;
+        bool ok = sqlite3_prepare_v2(db, "SELECT registers, hash_id FROM activity_sketches WHERE granularity = ? "
+                                         "AND window_start = ? AND dimension = ? AND metric = ?;", -1, &select, 0) == SQLITE_OK &&
+                  sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO activity_sketches(granularity, window_start, dimension, "
+                                         "metric, registers, hash_id) VALUES(?, ?, ?, ?, ?, ?);", -1, &upsert, 0) == SQLITE_OK &&
+                  sqlite3_prepare_v2(db, "DELETE FROM activity_sketches WHERE granularity = 'hour' AND window_start < ?;",
+                                     -1, &prune, 0) == SQLITE_OK;
+        for (auto it = pending_.begin(); ok && it != pending_.end(); ++it) {
+            const Key& k = it->first;
+            std::string label = window_label(k.g, k.window);
+            HyperLogLog merged;
+            merged.merge(*it->second);
+            for (sqlite3_stmt* stmt : {select, upsert}) {
+                sqlite3_bind_text(stmt, 1, granularity_name(k.g), -1, SQLITE_STATIC);
+                sqlite3_bind_text(stmt, 2, label.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(stmt, 3, k.dimension.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(stmt, 4, k.metric.c_str(), -1, SQLITE_TRANSIENT);
+            }
+            int rc = sqlite3_step(select);
+            if (rc == SQLITE_ROW) {
+                // registers from another hash can't be merged; this window restarts
+                const char* hash_id = reinterpret_cast<const char*>(sqlite3_column_text(select, 1));
+                if (hash_id && std::string(hash_id) == HyperLogLog::HASH_ID) {
+                    merged.merge_bytes(sqlite3_column_blob(select, 0), static_cast<size_t>(sqlite3_column_bytes(select, 0)));
+                }
+            } else if (rc != SQLITE_DONE) {
+                ok = false;
+            }
+            sqlite3_reset(select);
+            std::string registers = merged.bytes();
+            sqlite3_bind_blob(upsert, 5, registers.data(), static_cast<int>(registers.size()), SQLITE_TRANSIENT);
+            sqlite3_bind_text(upsert, 6, HyperLogLog::HASH_ID, -1, SQLITE_STATIC);
+            if (ok && sqlite3_step(upsert) != SQLITE_DONE) ok = false;
+            sqlite3_reset(upsert);
+        }
+        if (ok) {
+            std::string cutoff = window_label(Granularity::Hour, hour_cutoff);
+            sqlite3_bind_text(prune, 1, cutoff.c_str(), -1, SQLITE_TRANSIENT);
+            ok = sqlite3_step(prune) == SQLITE_DONE;
+        }
+        if (!ok) {
+            LOG_ERROR_LIMITED("activity_flush_failed").str("error", sqlite3_errmsg(db)).num("sketches", pending_.size());
+        }
+        sqlite3_finalize(select);
+        sqlite3_finalize(upsert);
+        sqlite3_finalize(prune);
+        if (ok && exec_sql(db, "COMMIT;") == SQLITE_OK) return true;
+        if (!sqlite3_get_autocommit(db)) exec_sql(db, "ROLLBACK;");
+        return false;
+    }
 
-// Export chat history + settings as JSON
-json export_user_data(const std::string& user_id) {
-    json out;
-    out["exported_at"] = iso_now();
-    out["settings"] = get_user_settings(user_id);
-
-    // fetch chat_history rows
-    std::lock_guard<std::mutex> lock(db_mutex);
-    sqlite3* db = nullptr;
-    if (sqlite3_open(DB_FILE, &db) == SQLITE_OK) {
-        std::string sql = "SELECT role, message, created_at FROM chat_history WHERE user_id = ? ORDER BY id ASC;";
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
-            sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_TRANSIENT);
-            json arr = json::array();
-            while (sqlite3_step(stmt) == SQLITE_ROW) {
-                json m;
-                m["role"] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-                m["message"] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-                m["created_at"] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-                arr.push_back(m);
+    // "app:<version>", limited to a safe charset and a bounded number of
+    // versions. Known versions are answered from the shard's own map.
+    std::string app_dimension(Shard& shard, const std::string& version) {
+        auto cached = shard.app_dimensions.find(version);
+        if (cached != shard.app_dimensions.end()) return cached->second;
+        std::string clean;
+        for (char c : version) {
+            if (clean.size() == 32) break;
+            if (std::isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '-' || c == '+' || c == '_') clean += c;
+        }
+        std::string dimension = "app:unknown";
+        if (!clean.empty()) {
+            ProfiledLock lock(versions_mutex_, "ActivityCounters::app_dimension");
+            if (app_versions_.count(clean) || app_versions_.size() < ACTIVITY_MAX_APP_VERSIONS) {
+                app_versions_.insert(clean);
+                dimension = "app:" + clean;
+            } else {
+                dimension = "app:other";
             }
-            out["chat_history"] = arr;
         }
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
+        if (shard.app_dimensions.size() < 2 * ACTIVITY_MAX_APP_VERSIONS) shard.app_dimensions.emplace(version, dimension);
+        return dimension;
     }
 
-    return out;
+    ProfiledMutex shards_mutex_{"activity_shards"};
+    ProfiledMutex versions_mutex_{"activity_versions"};
+    ProfiledMutex flush_mutex_{"activity_flush"};
+    ProfiledMutex stop_mutex_{"activity_flusher"};
+    std::condition_variable_any stop_cv_;
+    bool stopping_ = false;
+    std::thread flusher_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::set<std::string> app_versions_;
+    std::unique_ptr<StoreSession> session_;  // guarded by flush_mutex_ once started
+    std::map<Key, std::unique_ptr<HyperLogLog>> pending_;  // taken from shards, not yet written
+};
+
+ActivityCounters activity;
+
+// Count an authenticated request towards the active user/device sketches
+static void record_activity(const char* route_class, const std::string& user_id) {
+    if (user_id.empty() || !current_request || !current_request->req) return;
+    const Request& req = *current_request->req;
+    activity.record(route_class, user_id, req.get_header_value(DEVICE_ID_HEADER), req.get_header_value(APP_VERSION_HEADER));
 }
 
-// Import user data (merge: if replace==true, wipe chat_history first)
-bool import_user_data(const std::string& user_id, const json& payload, bool replace = false) {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    ensure_user_exists(user_id);
-    sqlite3* db = nullptr;
-    if (sqlite3_open(DB_FILE, &db) != SQLITE_OK) return false;
-
-    exec_sql(db, "BEGIN TRANSACTION;");
-    if (payload.contains("settings")) {
-        upsert_settings(user_id, payload["settings"]);
-    }
-    if (payload.contains("chat_history")) {
-        if (replace) {
-            // wipe first
-            std::string sql = "DELETE FROM chat_history WHERE user_id = ?;";
-            sqlite3_stmt* stmt = nullptr;
-            if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, 0) == SQLITE_OK) {
-                sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_TRANSIENT);
-                sqlite3_step(stmt);
+// --- Cache hit accounting --- //
+//
+// A settings cache hit never enters a lane, and counting it on the request
+// would bring back the hot-key top-k lock, the activity shard and the string
+// building the cache avoids. Each HTTP thread appends its hits to a ring of
+// its own (one producer, one consumer, no lock); the drainer thread counts
+// them like lane work, at most HIT_DRAIN_INTERVAL later.
+
+class HitLedger {
+public:
+    // Queue a hit for the calling thread; false if its ring is full
+    bool append(const std::string& user_id, const Request& req) {
+        Ring& ring = local_ring();
+        uint64_t head = ring.head.load(std::memory_order_relaxed);
+        if (head - ring.tail.load(std::memory_order_acquire) == HIT_RING_SIZE) return false;
+        Hit& hit = ring.hits[head % HIT_RING_SIZE];  // strings keep their capacity across laps
+        hit.user_id.assign(user_id);
+        hit.device_id.assign(req.get_header_value(DEVICE_ID_HEADER));
+        hit.app_version.assign(req.get_header_value(APP_VERSION_HEADER));
+        ring.head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    void start() {
+        drainer_ = std::thread([this] {
+            bool stopping = false;
+            while (!stopping) {
+                {
+                    ProfiledLock lock(stop_mutex_, "HitLedger::drainer");
+                    stopping = stop_cv_.wait_for(lock, HIT_DRAIN_INTERVAL, [this] { return stopping_; });
+                }
+                drain();  // one last time on the way out
             }
-            sqlite3_finalize(stmt);
+        });
+    }
+
+    void stop() {
+        if (!drainer_.joinable()) return;
+        {
+            ProfiledLock lock(stop_mutex_, "HitLedger::stop");
+            stopping_ = true;
         }
-        // insert each message
-        std::string ins = "INSERT INTO chat_history(user_id, role, message, created_at) VALUES(?, ?, ?, ?);";
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(db, ins.c_str(), -1, &stmt, 0) == SQLITE_OK) {
-            for (auto& m : payload["chat_history"]) {
-                std::string role = m.value("role", "user");
-                std::string message = m.value("message", "");
-                std::string created_at = m.value("created_at", iso_now());
-                sqlite3_bind_text(stmt, 1, user_id.c_str(), -1, SQLITE_TRANSIENT);
-                sqlite3_bind_text(stmt, 2, role.c_str(), -1, SQLITE_TRANSIENT);
-                sqlite3_bind_text(stmt, 3, message.c_str(), -1, SQLITE_TRANSIENT);
-                sqlite3_bind_text(stmt, 4, created_at.c_str(), -1, SQLITE_TRANSIENT);
-                sqlite3_step(stmt);
-                sqlite3_reset(stmt);
+        stop_cv_.notify_all();
+        drainer_.join();
+    }
+
+private:
+    struct Hit {
+        std::string user_id;
+        std::string device_id;
+        std::string app_version;
+    };
+
+    struct Ring {
+        std::unique_ptr<Hit[]> hits{new Hit[HIT_RING_SIZE]};
+        alignas(64) std::atomic<uint64_t> head{0};  // next hit to write, owning thread only
+        alignas(64) std::atomic<uint64_t> tail{0};  // next hit to count, drainer only
+    };
+
+    // The calling thread's ring, registered on first use; rings live as long as the ledger
+    Ring& local_ring() {
+        thread_local const HitLedger* owner = nullptr;
+        thread_local Ring* ring = nullptr;
+        if (owner != this) {
+            std::unique_ptr<Ring> fresh(new Ring);
+            ring = fresh.get();
+            owner = this;
+            ProfiledLock lock(rings_mutex_, "HitLedger::local_ring");
+            rings_.push_back(std::move(fresh));
+        }
+        return *ring;
+    }
+
+    // Count every queued hit the way track_user() and record_activity() count lane work
+    void drain() {
+        std::vector<Ring*> rings;
+        {
+            ProfiledLock lock(rings_mutex_, "HitLedger::drain");
+            for (const auto& ring : rings_) rings.push_back(ring.get());
+        }
+        for (Ring* ring : rings) {
+            uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            for (; tail != head; tail++) {
+                const Hit& hit = ring->hits[tail % HIT_RING_SIZE];
+                hot_users.add(hit.user_id);
+                hot_routes.add("GET /settings " + hit.user_id);
+                activity.record("interactive", hit.user_id, hit.device_id, hit.app_version);
             }
+            ring->tail.store(tail, std::memory_order_release);
         }
-        sqlite3_finalize(stmt);
     }
 
-    exec_sql(db, "COMMIT;");
-    sqlite3_close(db);
-    return true;
-}
+    ProfiledMutex rings_mutex_{"hit_ledger_rings"};
+    ProfiledMutex stop_mutex_{"hit_ledger_drainer"};
+    std::condition_variable_any stop_cv_;
+    bool stopping_ = false;
+    std::thread drainer_;
+    std::vector<std::unique_ptr<Ring>> rings_;
+};
+
+HitLedger cache_hits;
+
+// --- Execution lanes --- //
+//
+// Requests are classified into lanes so bulk work (export, import, clear,
+// full history listing) can't starve interactive settings reads and writes.
+// Each lane has its own worker threads, one store session (SQLite connection)
+// per worker and an admission limit; the HTTP thread waits for its task and keeps probing
+// the client socket meanwhile.
+
+struct LaneTask {
+    std::function<bool(StoreSession&)> work;
+    RequestContext* ctx = nullptr;
+    std::chrono::steady_clock::time_point enqueued;
+    bool skipped = false;           // cancelled before a worker picked it up
+    bool ok = false;                // what `work` returned
+    std::promise<void> done;
+};
+
+class Lane {
+public:
+    Lane(const char* name, size_t workers, size_t max_pending)
+        : name_(name), workers_(workers), max_pending_(max_pending),
+          mutex_name_(std::string(name) + "_lane"), mutex_(mutex_name_.c_str()) {}
+
+    void start() {
+        for (size_t i = 0; i < workers_; i++) {
+            threads_.emplace_back([this] { worker_loop(); });
+        }
+    }
+
+    // Finish the queued tasks, then stop the workers and close their connections.
+    // Only called once the HTTP server has stopped, so nothing new arrives.
+    void stop() {
+        {
+            ProfiledLock lock(mutex_, "Lane::stop");
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : threads_) t.join();
+        threads_.clear();
+        ProfiledLock lock(mutex_, "Lane::stop");
+        sessions_.clear();
+    }
+
+    // Run `work` for `user_id` on one of this lane's workers with that
+    // worker's session. Returns false if the lane is full (res is set to
+    // 503, or 429 for a hot user over its share), the request was cancelled
+    // or `work` returned false (a store failure: res is set to 500);
+    // exceptions thrown by `work` are rethrown here.
+    bool run(Response& res, const std::string& user_id, std::function<bool(StoreSession&)> work) {
+        bool hot = track_user(user_id);
+        record_activity(name_, user_id);
+        size_t limit = hot ? std::max<size_t>(1, static_cast<size_t>(max_pending_ * HOT_USER_QUEUE_SHARE)) : max_pending_;
+        if (pending_.fetch_add(1) >= limit) {
+            pending_--;
+            if (hot) {
+                rejected_hot_++;
+                res.status = 429;
+                res.set_header("Retry-After", "1");
+                res.set_content(R"({"error":"too many requests"})", "application/json");
+            } else {
+                rejected_++;
+                res.status = 503;
+                res.set_content(R"({"error":"server busy"})", "application/json");
+            }
+            return false;
+        }
+
+        LaneTask task;
+        task.work = std::move(work);
+        task.ctx = current_request;
+        task.enqueued = std::chrono::steady_clock::now();
+        std::future<void> done = task.done.get_future();
+        {
+            ProfiledLock lock(mutex_, "Lane::run");
+            queue_.push_back(&task);
+        }
+        cv_.notify_one();
+
+        while (done.wait_for(DISCONNECT_PROBE_INTERVAL) != std::future_status::ready) {
+            if (task.ctx) task.ctx->probe_client();
+        }
+        pending_--;
+        completed_++;
+        latency_.record(std::chrono::steady_clock::now() - task.enqueued);
+
+        done.get(); // rethrows
+        if (task.skipped || (task.ctx && task.ctx->interrupted())) return false;
+        if (!task.ok) {
+            failed_++;
+            res.status = 500;
+            res.set_content(R"({"error":"storage error"})", "application/json");
+            return false;
+        }
+        return true;
+    }
+
+    json stats() const {
+        return {
+                {"workers", workers_},
+                {"max_pending", max_pending_},
+                {"pending", pending_.load()},
+                {"completed", completed_.load()},
+                {"rejected", rejected_.load()},
+                {"rejected_hot", rejected_hot_.load()},
+                {"failed", failed_.load()},
+                {"queue_wait", queue_wait_.to_json()},
+                {"latency", latency_.to_json()}
+        };
+    }
+
+    // SQLite memory held by this lane's connections (page cache, schema, statements)
+    json memory() {
+        int cache = 0, schema = 0, stmts = 0, unused = 0, value = 0;
+        ProfiledLock lock(mutex_, "Lane::memory");
+        for (const auto& session : sessions_) {
+            sqlite3* db = session->handle();
+            if (sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_USED, &value, &unused, 0) == SQLITE_OK) cache += value;
+            if (sqlite3_db_status(db, SQLITE_DBSTATUS_SCHEMA_USED, &value, &unused, 0) == SQLITE_OK) schema += value;
+            if (sqlite3_db_status(db, SQLITE_DBSTATUS_STMT_USED, &value, &unused, 0) == SQLITE_OK) stmts += value;
+        }
+        return {
+                {"connections", sessions_.size()},
+                {"page_cache_bytes", cache},
+                {"schema_bytes", schema},
+                {"statement_bytes", stmts}
+        };
+    }
+
+private:
+    void worker_loop() {
+        CpuProfiler::instance().register_thread(name_);
+        std::string error;
+        std::unique_ptr<StoreSession> opened = store->open_session(&error);
+        StoreSession* session = opened.get();
+        if (!session) {
+            LOG_ERROR("db_open_failed").str("file", DB_FILE).str("lane", name_).str("error", error);
+        } else {
+            ProfiledLock lock(mutex_, "Lane::worker_loop");
+            sessions_.push_back(std::move(opened));
+        }
+        sqlite3* db = session ? session->handle() : nullptr;
+        for (;;) {
+            LaneTask* task = nullptr;
+            {
+                ProfiledLock lock(mutex_, "Lane::worker_loop");
+                cv_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+                if (queue_.empty()) return;
+                task = queue_.front();
+                queue_.pop_front();
+            }
+            auto picked_up = std::chrono::steady_clock::now();
+            queue_wait_.record(picked_up - task->enqueued);
+            if (task->ctx) task->ctx->timing.add(Phase::Queue, task->enqueued, picked_up);
+
+            if (task->ctx && task->ctx->interrupted()) {
+                task->skipped = true;
+                task->done.set_value();
+                continue;
+            }
+
+            current_request = task->ctx;
+            if (task->ctx && db) sqlite3_progress_handler(db, PROGRESS_HANDLER_OPS, on_sqlite_progress, task->ctx);
+            try {
+                {
+                    ScopedSpan span(Phase::Db);
+                    task->ok = session && task->work(*session);
+                }
+                if (db) sqlite3_progress_handler(db, 0, nullptr, nullptr);
+                current_request = nullptr;
+                task->done.set_value();
+            } catch (...) {
+                if (db) sqlite3_progress_handler(db, 0, nullptr, nullptr);
+                current_request = nullptr;
+                task->done.set_exception(std::current_exception());
+            }
+        }
+    }
+
+    const char* name_;
+    size_t workers_;
+    size_t max_pending_;
+    std::string mutex_name_;
+    ProfiledMutex mutex_;
+    std::condition_variable_any cv_;
+    std::deque<LaneTask*> queue_;
+    std::vector<std::thread> threads_;
+    std::vector<std::unique_ptr<StoreSession>> sessions_;  // one per worker, for memory()
+    bool stopping_ = false;
+    std::atomic<size_t> pending_{0};
+    std::atomic<uint64_t> completed_{0};
+    std::atomic<uint64_t> rejected_{0};
+    std::atomic<uint64_t> rejected_hot_{0};
+    std::atomic<uint64_t> failed_{0};
+    LatencyHistogram queue_wait_;
+    LatencyHistogram latency_;
+};
+
+// Interactive: settings/profile/notifications/theme/biometric, history append.
+// Bulk: export, import, clear and the full history listing.
+Lane interactive_lane("interactive", INTERACTIVE_WORKERS, INTERACTIVE_MAX_PENDING);
+Lane bulk_lane("bulk", BULK_WORKERS, BULK_MAX_PENDING);
 
 // Basic API key check (replace with proper auth in prod)
 bool authorize(const Request& req, Response& res) {
@@ -436,26 +1191,369 @@ bool authorize(const Request& req, Response& res) {
     return true;
 }
 
+// --- Traffic capture --- //
+
+std::unique_ptr<CaptureWriter> capture;  // null unless LUMA_CAPTURE_FILE is set
+Anonymizer capture_anonymizer;
+
+// Called from the access-log hook, after the response has been written
+static void capture_request(const Request& req, const Response& res,
+                            std::chrono::steady_clock::time_point begin, std::chrono::microseconds latency) {
+    if (req.path.rfind("/admin/", 0) == 0 || req.path.rfind("/debug/", 0) == 0 ||
+        req.path == "/metrics" || req.path == "/health") return;
+    std::unique_ptr<CaptureRecord> r(new CaptureRecord);
+    r->offset_ns = capture->offset_ns(begin);
+    r->method = req.method;
+    r->path = req.path;
+    r->query = capture_anonymizer.query({req.params.begin(), req.params.end()});
+    r->body = capture_anonymizer.body(req.body);
+    r->app_version = req.get_header_value(APP_VERSION_HEADER);
+    r->device_id = capture_anonymizer.pseudonym(req.get_header_value(DEVICE_ID_HEADER));
+    r->status = static_cast<uint32_t>(res.status);
+    r->latency_us = static_cast<uint64_t>(latency.count());
+    r->response_bytes = res.body.size();
+    capture->submit(std::move(r));
+}
+
+// --- Trace export --- //
+
+std::unique_ptr<TraceExporter> tracer;  // null unless LUMA_TRACE_FILE is set
+
+// Request and auth check timestamps, set by the pre-routing handler on this HTTP thread
+thread_local std::chrono::steady_clock::time_point request_begin;
+thread_local std::chrono::steady_clock::time_point auth_begin;
+thread_local std::chrono::steady_clock::time_point auth_end;
+
+static uint64_t random_id() {
+    thread_local std::mt19937_64 rng(std::random_device{}());
+    uint64_t id = 0;
+    while (id == 0) id = rng();
+    return id;
+}
+
+// Tail sampling: keep traces at least as slow as the running p99
+static bool trace_is_slow(uint64_t seq, uint64_t total_us) {
+    if (seq % TRACE_THRESHOLD_REFRESH == 0) {
+        metrics.trace_slow_threshold_us = metrics.request_total.percentile(TRACE_TAIL_PERCENTILE);
+    }
+    uint64_t threshold = metrics.trace_slow_threshold_us.load(std::memory_order_relaxed);
+    return threshold > 0 && total_us >= threshold;
+}
+
+// Turn a finished request's spans into an OTLP trace: one server span for the
+// request, lock/stmt spans nested under the db span, the rest under the root.
+static void export_trace(const Request& req, const Response& res, const RequestTiming& timing,
+                         std::chrono::steady_clock::time_point end) {
+    auto wall_ns = [&timing](std::chrono::steady_clock::time_point t) {
+        auto since_start = std::chrono::duration_cast<std::chrono::nanoseconds>(t - timing.start);
+        auto wall = std::chrono::duration_cast<std::chrono::nanoseconds>(timing.wall_start.time_since_epoch());
+        return static_cast<uint64_t>((wall + since_start).count());
+    };
+    int status = res.status == -1 ? 200 : res.status;
+
+    MemoryScope mem(MemTag::Trace);
+    auto trace = std::make_unique<TraceRecord>();
+    trace->trace_id_hi = random_id();
+    trace->trace_id_lo = random_id();
+
+    TraceSpan root;
+    root.name = req.method + " " + req.path;
+    root.span_id = random_id();
+    root.start_unix_ns = wall_ns(timing.start);
+    root.end_unix_ns = wall_ns(end);
+    root.error = status >= 500;
+    root.attributes = {
+            {"http.request.method", req.method},
+            {"http.route", req.path},
+            {"http.response.status_code", std::to_string(status)},
+            {"luma.sampling", timing.sampled ? "head" : "tail"}
+    };
+
+    const Span* db_span = nullptr;
+    uint64_t db_span_id = 0;
+    for (int i = 0; i < timing.count; i++) {
+        if (timing.spans[i].phase == Phase::Db) {
+            db_span = &timing.spans[i];
+            db_span_id = random_id();
+            break;
+        }
+    }
+
+    trace->spans.push_back(std::move(root));
+    for (int i = 0; i < timing.count; i++) {
+        const Span& span = timing.spans[i];
+        TraceSpan out;
+        out.name = PHASE_NAMES[static_cast<int>(span.phase)];
+        out.span_id = &span == db_span ? db_span_id : random_id();
+        out.parent_id = trace->spans[0].span_id;
+        if (db_span && (span.phase == Phase::Lock || span.phase == Phase::Statement) &&
+            span.begin >= db_span->begin && span.end <= db_span->end) {
+            out.parent_id = db_span_id;
+        }
+        out.start_unix_ns = wall_ns(span.begin);
+        out.end_unix_ns = wall_ns(span.end);
+        if (!span.detail.empty()) out.attributes.emplace_back("db.statement", span.detail);
+        trace->spans.push_back(std::move(out));
+    }
+    tracer->submit(std::move(trace));
+}
+
+// What a decoded request's std::string_view members point into besides
+// req.body (which outlives the handler, lane work included)
+struct BodyBuffers {
+    std::string repaired;   // the body with its invalid UTF-8 replaced
+    std::string unescaped;  // strings that had JSON escapes
+};
+
+template <typename T>
+static bool decode_text(std::string_view text, T& out, CodecError& err, BodyBuffers& buffers) {
+    if constexpr (json_codec::has_views<T>::value) return decode(text, out, err, buffers.unescaped);
+    else return decode(text, out, err);
+}
+
+// Decode the request body with its schema codec (api_codecs.h), timed as the
+// "parse" phase. On failure answers 400: `missing` when a required field is
+// absent, otherwise "invalid json", "invalid utf-8" or "invalid request" with
+// the detail. With `repair_utf8` (chat text, see UTF8_INVALID_ENV) a body
+// that is not valid UTF-8 is decoded again with the bad sequences replaced.
+// Requests with string views (the hot write paths) pass the buffers that
+// back them; nothing is copied out of a body that is valid and unescaped.
+template <typename T>
+static bool decode_body(const Request& req, Response& res, T& out, BodyBuffers& buffers, const char* missing,
+                        bool repair_utf8 = false) {
+    CodecError err;
+    {
+        ScopedSpan span(Phase::Parse);
+        MemoryScope mem(MemTag::Json);
+        if (decode_text(req.body, out, err, buffers)) return true;
+        if (err.kind == CodecError::Encoding && repair_utf8) {
+            buffers.repaired = req.body;
+            size_t replaced = utf8_replace_invalid(buffers.repaired);
+            out = T();
+            if (decode_text(buffers.repaired, out, err, buffers)) {
+                metrics.utf8_repaired++;
+                metrics.utf8_replacements += replaced;
+                LOG_WARN_LIMITED("utf8_repaired").str("path", req.path).num("replaced", replaced);
+                return true;
+            }
+        }
+    }
+    if (err.kind == CodecError::Encoding) metrics.utf8_rejected++;
+    res.status = 400;
+    if (err.kind == CodecError::Missing) {
+        res.set_content(json{{"error", missing}}.dump(), "application/json");
+        return false;
+    }
+    const char* error = err.kind == CodecError::Syntax ? "invalid json"
+                        : err.kind == CodecError::Encoding ? "invalid utf-8" : "invalid request";
+    json body = {{"error", error},
+                 {"detail", err.message()}};
+    res.set_content(body.dump(), "application/json");
+    return false;
+}
+
+// Requests that own their strings
+template <typename T>
+static bool decode_body(const Request& req, Response& res, T& out, const char* missing, bool repair_utf8 = false) {
+    static_assert(!json_codec::has_views<T>::value, "pass BodyBuffers for requests with string views");
+    BodyBuffers buffers;
+    return decode_body(req, res, out, buffers, missing, repair_utf8);
+}
+
+// Serialize `body` into the response, timed as the "serialize" phase
+void send_json(Response& res, const json& body, int indent = -1) {
+    ScopedSpan span(Phase::Serialize);
+    MemoryScope mem(MemTag::Json);
+    res.set_content(body.dump(indent), "application/json");
+}
+
+// Encode a response struct with its schema codec, timed as the "serialize"
+// phase; 500 if it holds invalid UTF-8 (which dump() would have thrown on)
+template <typename T>
+static void send_encoded(Response& res, const T& body, int indent = -1) {
+    ScopedSpan span(Phase::Serialize);
+    MemoryScope mem(MemTag::Json);
+    std::string out;
+    CodecError err;
+    if (!encode(body, out, err, indent)) {
+        LOG_ERROR_LIMITED("encode_failed").str("detail", err.message());
+        res.status = 500;
+        res.set_content(R"({"error":"response encoding failed"})", "application/json");
+        return;
+    }
+    res.set_content(std::move(out), "application/json");
+}
+
+// Aggregate a finished request's spans into the per-phase histograms and, if
+// the client asked, describe them in a Server-Timing header.
+static void finish_timing(const Request& req, Response& res, const RequestTiming& timing, uint64_t seq) {
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration per_phase[PHASE_COUNT] = {};
+    bool seen[PHASE_COUNT] = {};
+    for (int i = 0; i < timing.count; i++) {
+        int p = static_cast<int>(timing.spans[i].phase);
+        per_phase[p] += timing.spans[i].end - timing.spans[i].begin;
+        seen[p] = true;
+    }
+    metrics.requests_timed++;
+    metrics.request_total.record(end - timing.start);
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        if (seen[p]) metrics.phases[p].record(per_phase[p]);
+    }
+
+    if (tracer) {
+        auto total_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(end - timing.start).count());
+        bool failed = res.status >= 500;
+        if (seq % TRACE_SAMPLE_EVERY == 0 || failed || trace_is_slow(seq, total_us)) {
+            export_trace(req, res, timing, end);
+        }
+    }
+
+    if (!timing.requested) return;
+    std::ostringstream header;
+    header.setf(std::ios::fixed);
+    header.precision(3);
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        header << PHASE_NAMES[p] << ";dur="
+               << std::chrono::duration<double, std::milli>(per_phase[p]).count() << ", ";
+    }
+    header << "total;dur=" << std::chrono::duration<double, std::milli>(end - timing.start).count();
+    res.set_header("Server-Timing", header.str());
+}
+
+// Wrap a route handler with a time budget. Cancelled requests are counted and
+// answered with 503 (deadline) or 499 (client closed the connection).
+Server::Handler with_deadline(std::chrono::milliseconds budget, Server::Handler handler) {
+    return [budget, handler](const Request& req, Response& res) {
+        RequestContext ctx;
+        ctx.req = &req;
+        ctx.deadline = std::chrono::steady_clock::now() + budget;
+        ctx.next_probe = std::chrono::steady_clock::now() + DISCONNECT_PROBE_INTERVAL;
+        uint64_t seq = ++metrics.requests_total;
+        ctx.timing.requested = req.has_header(TIMING_REQUEST_HEADER);
+        ctx.timing.sampled = seq % TIMING_SAMPLE_EVERY == 0;
+        ctx.timing.enabled = ctx.timing.requested || ctx.timing.sampled || tracer;
+        if (ctx.timing.enabled) {
+            // the request started with the auth check in the pre-routing handler
+            auto now = std::chrono::steady_clock::now();
+            bool authed = auth_end > auth_begin && auth_end <= now;
+            ctx.timing.start = authed ? auth_begin : now;
+            ctx.timing.wall_start = std::chrono::system_clock::now() - (now - ctx.timing.start);
+            if (authed) ctx.timing.add(Phase::Auth, auth_begin, auth_end);
+        }
+
+        struct Scope {
+            explicit Scope(RequestContext* c) { current_request = c; }
+            ~Scope() { current_request = nullptr; }
+        } scope(&ctx);
+
+        handler(req, res);
+
+        switch (ctx.reason.load()) {
+        case CancelReason::DeadlineExceeded:
+            metrics.requests_timed_out++;
+            res.status = 503;
+            res.set_content(R"({"error":"deadline exceeded"})", "application/json");
+            break;
+        case CancelReason::ClientGone:
+            metrics.requests_cancelled++;
+            res.status = 499;
+            res.body.clear();
+            break;
+        case CancelReason::None:
+            break;
+        }
+        if (ctx.timing.enabled) finish_timing(req, res, ctx.timing, seq);
+    };
+}
+
 // --- Server and routes --- //
 int main() {
-    init_db();
+    // SIGINT/SIGTERM stop the server cleanly (see the end of main). They are
+    // blocked here, before any thread starts, and taken by sigwait() instead.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+
+    if (const char* log_file = std::getenv(LOG_FILE_ENV)) {
+        if (!Logger::instance().open(log_file)) {
+            LOG_ERROR("log_file_open_failed").str("path", log_file);
+        }
+    }
+    if (const char* level = std::getenv(LOG_LEVEL_ENV)) {
+        std::string l = level;
+        Logger::instance().set_level(l == "debug" ? LogLevel::Debug : l == "warn" ? LogLevel::Warn
+                                     : l == "error" ? LogLevel::Error : LogLevel::Info);
+    }
+    Logger::instance().start();
+
+    auto slow_threshold = std::chrono::duration_cast<std::chrono::microseconds>(SLOW_QUERY_THRESHOLD);
+    if (const char* ms = std::getenv(SLOW_QUERY_ENV)) slow_threshold = std::chrono::milliseconds(std::atol(ms));
+    slow_queries.reset(new SlowQueryLog(DB_FILE, slow_threshold, SLOW_QUERY_RECENT));
+
+    if (const char* policy = std::getenv(UTF8_INVALID_ENV)) utf8_repair_chat = std::string(policy) != "reject";
+    if (const char* slots = std::getenv(SETTINGS_CACHE_ENV)) settings_cache_slots = static_cast<size_t>(std::max(0L, std::atol(slots)));
+
+    if (!open_store()) return 1;
+    if (const char* trace_file = std::getenv(TRACE_FILE_ENV)) {
+        tracer.reset(new TraceExporter(trace_file, "luma-settings", TRACE_RING_SIZE, TRACE_MAX_FILE_BYTES, TRACE_KEEP_FILES));
+        if (!tracer->start()) {
+            LOG_ERROR("trace_file_open_failed").str("path", trace_file);
+            tracer.reset();
+        }
+    }
+    if (const char* capture_file = std::getenv(CAPTURE_FILE_ENV)) {
+        capture.reset(new CaptureWriter(capture_file, CAPTURE_RING_SIZE));
+        if (!capture->start()) {
+            LOG_ERROR("capture_file_open_failed").str("path", capture_file);
+            capture.reset();
+        }
+    }
+    interactive_lane.start();
+    bulk_lane.start();
+    activity.start();
+    cache_hits.start();
+
     Server svr;
+    svr.new_task_queue = [] { return new ThreadPool(HTTP_THREADS); };
 
     // Middleware: basic auth
     svr.set_pre_routing_handler([](const Request &req, Response &res) {
+        request_begin = std::chrono::steady_clock::now();
+        CpuProfiler::instance().register_thread("http");
+        MemoryProfiler::set_thread_tag(MemTag::Http);
         // allow health & import if needed without key? require key globally
-        if (req.path == "/health") return true;
+        if (req.path == "/health") return Server::HandlerResponse::Unhandled;
+        auth_begin = std::chrono::steady_clock::now();
         auto it = req.headers.find(API_KEY_HEADER);
-        if (it == req.headers.end() || it->second != VALID_API_KEY) {
+        bool ok = it != req.headers.end() && it->second == VALID_API_KEY;
+        auth_end = std::chrono::steady_clock::now();
+        if (!ok) {
             res.status = 401;
             res.set_content(R"({"error":"unauthorized"})", "application/json");
-            return false;
+            return Server::HandlerResponse::Handled;
         }
-        return true;
+        return Server::HandlerResponse::Unhandled;
+    });
+
+    // Access log: one line per request, after the response is written
+    svr.set_logger([](const Request& req, const Response& res) {
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - request_begin);
+        if (capture) capture_request(req, res, request_begin, latency);
+        LOG_INFO("access")
+                .str("method", req.method)
+                .str("path", req.path)
+                .num("status", res.status)
+                .num("latency_us", latency.count())
+                .num("bytes_in", req.body.size())
+                .num("bytes_out", res.body.size())
+                .str("remote", req.remote_addr);
     });
 
     // Health
-    svr.Get("/health", [](const Request& req, Response& res) {
+    svr.Get("/health", [](const Request&, Response& res) {
         json out = {
                 {"status", "ok"},
                 {"time", iso_now()}
@@ -463,169 +1561,289 @@ int main() {
         res.set_content(out.dump(), "application/json");
     });
 
+    // Metrics
+    svr.Get("/metrics", [](const Request&, Response& res) {
+        json phases;
+        for (int p = 0; p < PHASE_COUNT; p++) phases[PHASE_NAMES[p]] = metrics.phases[p].to_json();
+        SettingsCacheStats cache = store->settings_cache_stats();
+        json out = {
+                {"requests_total", metrics.requests_total.load()},
+                {"requests_cancelled", metrics.requests_cancelled.load()},
+                {"requests_timed_out", metrics.requests_timed_out.load()},
+                {"utf8", {
+                        {"implementation", utf8_implementation()},
+                        {"rejected", metrics.utf8_rejected.load()},
+                        {"repaired", metrics.utf8_repaired.load()},
+                        {"replacements", metrics.utf8_replacements.load()}
+                }},
+                {"settings_cache", {
+                        {"capacity", cache.capacity},
+                        {"hits", metrics.settings_cache_hits.load()},
+                        {"hits_counted_inline", metrics.settings_cache_hits_inline.load()},
+                        {"misses", cache.misses},
+                        {"fills", cache.fills},
+                        {"publishes", cache.publishes},
+                        {"epoch", cache.epoch},
+                        {"retired", cache.retired},
+                        {"reclaimed", cache.reclaimed}
+                }},
+                {"timing", {
+                        {"sampled_requests", metrics.requests_timed.load()},
+                        {"total", metrics.request_total.to_json()},
+                        {"phases", phases}
+                }},
+                {"tracing", {
+                        {"enabled", tracer != nullptr},
+                        {"exported", tracer ? tracer->exported() : 0},
+                        {"dropped", tracer ? tracer->dropped() : 0},
+                        {"slow_threshold_us", metrics.trace_slow_threshold_us.load()}
+                }},
+                {"lanes", {
+                        {"interactive", interactive_lane.stats()},
+                        {"bulk", bulk_lane.stats()}
+                }},
+                {"logging", {
+                        {"logged", Logger::instance().logged()},
+                        {"dropped", Logger::instance().dropped()}
+                }},
+                {"capture", {
+                        {"enabled", capture != nullptr},
+                        {"written", capture ? capture->written() : 0},
+                        {"dropped", capture ? capture->dropped() : 0}
+                }}
+        };
+        res.set_content(out.dump(), "application/json");
+    });
+
+    // Slow statement report (top offenders by total time, with query plans)
+    svr.Get("/admin/slow-queries", [](const Request& req, Response& res) {
+        size_t limit = 20;
+        auto q = req.get_param_value("limit");
+        if (!q.empty()) limit = static_cast<size_t>(std::max(1L, std::atol(q.c_str())));
+        res.set_content(slow_queries->report(limit).dump(2), "application/json");
+    });
+
+    // Active users/devices per hour or day, merged across the requested windows
+    svr.Get("/admin/active-users", with_deadline(DEFAULT_DEADLINE, [](const Request& req, Response& res) {
+        Granularity g = req.get_param_value("granularity") == "hour" ? Granularity::Hour : Granularity::Day;
+        int64_t windows = g == Granularity::Hour ? 24 : 7;
+        auto w = req.get_param_value("windows");
+        if (!w.empty()) windows = std::max(1L, std::min(std::atol(w.c_str()), g == Granularity::Hour ? 24L * ACTIVITY_HOURLY_RETENTION_DAYS : 400L));
+        std::string dimension = req.has_param("dimension") ? req.get_param_value("dimension") : "all";
+        std::string metric = req.get_param_value("metric") == "devices" ? "devices" : "users";
+        json out;
+        if (!bulk_lane.run(res, "", [&](StoreSession& db) {
+            out = activity.report(db.handle(), g, windows, dimension, metric);  // flushes on its own session
+            return true;
+        })) return;
+        send_json(res, out, 2);
+    }));
+
+    // Lock contention report: per mutex and call site wait/hold stats
+    svr.Get("/debug/locks", [](const Request&, Response& res) {
+        res.set_content(LockRegistry::instance().report(10).dump(2), "application/json");
+    });
+
+    // CPU profile (folded stacks, feed to flamegraph.pl or speedscope)
+    svr.Get("/debug/pprof/profile", [](const Request& req, Response& res) {
+        long seconds = req.has_param("seconds") ? std::atol(req.get_param_value("seconds").c_str()) : PROFILE_DEFAULT_SECONDS;
+        long hz = req.has_param("hz") ? std::atol(req.get_param_value("hz").c_str()) : PROFILE_DEFAULT_HZ;
+        seconds = std::max(1L, std::min(seconds, PROFILE_MAX_SECONDS));
+        hz = std::max(1L, std::min(hz, PROFILE_MAX_HZ));
+
+        MemoryScope mem(MemTag::Diagnostics);
+        std::string folded;
+        size_t samples = 0;
+        if (!CpuProfiler::instance().profile(std::chrono::seconds(seconds), static_cast<int>(hz), folded, samples)) {
+            res.status = 409;
+            res.set_content(R"({"error":"a profile is already running"})", "application/json");
+            return;
+        }
+        res.set_header("X-Profile-Samples", std::to_string(samples));
+        res.set_content(folded, "text/plain");
+    });
+
+    // Memory accounting: tagged heap, SQLite's allocator and page caches, process RSS
+    svr.Get("/debug/memory", [](const Request&, Response& res) {
+        json out = MemoryProfiler::instance().report(MEMORY_TOP_SITES);
+        sqlite3_int64 used = 0, used_peak = 0, overflow = 0, overflow_peak = 0;
+        sqlite3_status64(SQLITE_STATUS_MEMORY_USED, &used, &used_peak, 0);
+        sqlite3_status64(SQLITE_STATUS_PAGECACHE_OVERFLOW, &overflow, &overflow_peak, 0);
+        out["sqlite"] = {
+                {"memory_used_bytes", used},
+                {"memory_used_peak_bytes", used_peak},
+                {"pagecache_overflow_bytes", overflow},
+                {"lanes", {
+                        {"interactive", interactive_lane.memory()},
+                        {"bulk", bulk_lane.memory()}
+                }}
+        };
+        res.set_content(out.dump(2), "application/json");
+    });
+
+    // Sampled live heap (folded stacks weighted by bytes, for flamegraph.pl --countname=bytes)
+    svr.Get("/debug/memory/heap", [](const Request&, Response& res) {
+        res.set_content(MemoryProfiler::instance().folded(), "text/plain");
+    });
+
+    // Heavy hitters over the last window
+    svr.Get("/debug/hotkeys", [](const Request&, Response& res) {
+        json out = {
+                {"users", hot_users.report()},
+                {"routes", hot_routes.report()},
+                {"bytes_written", hot_writers.report()}
+        };
+        res.set_content(out.dump(2), "application/json");
+    });
+
     // GET settings
-    svr.Get("/settings", [](const Request& req, Response& res) {
+    svr.Get("/settings", with_deadline(DEFAULT_DEADLINE, [](const Request& req, Response& res) {
         auto user_it = req.get_param_value("user_id");
         if (user_it.empty()) {
             res.status = 400;
             res.set_content(R"({"error":"user_id required"})", "application/json");
             return;
         }
-        json s = get_user_settings(user_it);
-        res.set_content(s.dump(), "application/json");
-    });
-
-    // POST settings (partial allowed)
-    svr.Post("/settings", [](const Request& req, Response& res) {
-        try {
-            json j = json::parse(req.body);
-            if (!j.contains("user_id")) {
-                res.status = 400;
-                res.set_content(R"({"error":"user_id required"})", "application/json");
-                return;
+        // encoded straight from the cached entry; counted like lane work by the hit ledger
+        if (store->read_cached_settings(user_it, [&](const UserSettings& s) { send_encoded(res, s); })) {
+            metrics.settings_cache_hits++;
+            if (!cache_hits.append(user_it, req)) {
+                metrics.settings_cache_hits_inline++;
+                track_user(user_it);
+                record_activity("interactive", user_it);
             }
-            std::string user_id = j["user_id"];
-            json payload = j.value("settings", j); // allow passing settings directly or inside "settings"
-            // remove user_id if present in payload
-            payload.erase("user_id");
-            upsert_settings(user_id, payload);
-            res.set_content(R"({"ok":true})", "application/json");
-        } catch (const std::exception& e) {
-            res.status = 400;
-            json err = {{"error","invalid json"}, {"detail", e.what()}};
-            res.set_content(err.dump(), "application/json");
+            return;
         }
-    });
+        UserSettings s;
+        if (!interactive_lane.run(res, user_it, [&](StoreSession& db) { return db.get_settings(user_it, s); })) return;
+        send_encoded(res, s);
+    }));
+
+    // POST settings (partial allowed)
+    svr.Post("/settings", with_deadline(DEFAULT_DEADLINE, [](const Request& req, Response& res) {
+        SettingsRequest body;
+        BodyBuffers buffers;
+        if (!decode_body(req, res, body, buffers, "user_id required")) return;
+        const SettingsUpdateView& update = body.update(); // settings directly or inside "settings"
+        std::string user_id(body.user_id);                // lane key
+        if (!interactive_lane.run(res, user_id, [&](StoreSession& db) { return db.update_settings(body.user_id, update); })) return;
+        res.set_content(R"({"ok":true})", "application/json");
+    }));
 
     // POST profile update
-    svr.Post("/profile", [](const Request& req, Response& res) {
-        try {
-            json j = json::parse(req.body);
-            if (!j.contains("user_id")) {
-                res.status = 400;
-                res.set_content(R"({"error":"user_id required"})", "application/json");
-                return;
-            }
-            std::string user_id = j["user_id"];
-            json payload;
-            if (j.contains("name")) payload["name"] = j["name"];
-            if (j.contains("email")) payload["email"] = j["email"];
-            if (j.contains("avatar_url")) payload["avatar_url"] = j["avatar_url"];
-            upsert_settings(user_id, payload);
-            res.set_content(R"({"ok":true})", "application/json");
-        } catch (...) {
-            res.status = 400;
-            res.set_content(R"({"error":"invalid request"})", "application/json");
-        }
-    });
+    svr.Post("/profile", with_deadline(DEFAULT_DEADLINE, [](const Request& req, Response& res) {
+        ProfileRequest body;
+        BodyBuffers buffers;
+        if (!decode_body(req, res, body, buffers, "user_id required")) return;
+        std::string user_id(body.user_id); // lane key
+        if (!interactive_lane.run(res, user_id, [&](StoreSession& db) { return db.update_settings(body.user_id, body.update()); })) return;
+        res.set_content(R"({"ok":true})", "application/json");
+    }));
 
     // POST notifications (granular)
-    svr.Post("/notifications", [](const Request& req, Response& res) {
-        try {
-            json j = json::parse(req.body);
-            if (!j.contains("user_id")) { res.status = 400; res.set_content(R"({"error":"user_id required"})", "application/json"); return; }
-            std::string user_id = j["user_id"];
-            json payload;
-            if (j.contains("notifications_enabled")) payload["notifications_enabled"] = j["notifications_enabled"];
-            if (j.contains("chat_notifications")) payload["chat_notifications"] = j["chat_notifications"];
-            if (j.contains("update_notifications")) payload["update_notifications"] = j["update_notifications"];
-            if (j.contains("reminder_notifications")) payload["reminder_notifications"] = j["reminder_notifications"];
-            upsert_settings(user_id, payload);
-            res.set_content(R"({"ok":true})", "application/json");
-        } catch (...) { res.status = 400; res.set_content(R"({"error":"invalid request"})", "application/json"); }
-    });
+    svr.Post("/notifications", with_deadline(DEFAULT_DEADLINE, [](const Request& req, Response& res) {
+        NotificationsRequest body;
+        BodyBuffers buffers;
+        if (!decode_body(req, res, body, buffers, "user_id required")) return;
+        std::string user_id(body.user_id); // lane key
+        if (!interactive_lane.run(res, user_id, [&](StoreSession& db) { return db.update_settings(body.user_id, body.update()); })) return;
+        res.set_content(R"({"ok":true})", "application/json");
+    }));
 
     // POST theme
-    svr.Post("/theme", [](const Request& req, Response& res) {
-        try {
-            json j = json::parse(req.body);
-            if (!j.contains("user_id") || !j.contains("theme_mode")) { res.status = 400; res.set_content(R"({"error":"user_id and theme_mode required"})", "application/json"); return; }
-            std::string user_id = j["user_id"];
-            std::string mode = j["theme_mode"];
-            json payload;
-            payload["theme_mode"] = mode;
-            payload["dark_mode"] = (mode == "Dark");
-            upsert_settings(user_id, payload);
-            res.set_content(R"({"ok":true})", "application/json");
-        } catch (...) { res.status = 400; res.set_content(R"({"error":"invalid request"})", "application/json"); }
-    });
+    svr.Post("/theme", with_deadline(DEFAULT_DEADLINE, [](const Request& req, Response& res) {
+        ThemeRequest body;
+        BodyBuffers buffers;
+        if (!decode_body(req, res, body, buffers, "user_id and theme_mode required")) return;
+        body.dark_mode = (*body.theme_mode == "Dark");
+        std::string user_id(body.user_id); // lane key
+        if (!interactive_lane.run(res, user_id, [&](StoreSession& db) { return db.update_settings(body.user_id, body.update()); })) return;
+        res.set_content(R"({"ok":true})", "application/json");
+    }));
 
     // POST security biometric lock
-    svr.Post("/security/biometric", [](const Request& req, Response& res) {
-        try {
-            json j = json::parse(req.body);
-            if (!j.contains("user_id") || !j.contains("enabled")) { res.status = 400; res.set_content(R"({"error":"user_id and enabled required"})", "application/json"); return; }
-            std::string user_id = j["user_id"];
-            bool enabled = j["enabled"];
-            json payload;
-            payload["biometric_lock"] = enabled;
-            upsert_settings(user_id, payload);
-            res.set_content(R"({"ok":true})", "application/json");
-        } catch (...) { res.status = 400; res.set_content(R"({"error":"invalid request"})", "application/json"); }
-    });
+    svr.Post("/security/biometric", with_deadline(DEFAULT_DEADLINE, [](const Request& req, Response& res) {
+        BiometricRequest body;
+        BodyBuffers buffers;
+        if (!decode_body(req, res, body, buffers, "user_id and enabled required")) return;
+        std::string user_id(body.user_id); // lane key
+        if (!interactive_lane.run(res, user_id, [&](StoreSession& db) { return db.update_settings(body.user_id, body.update()); })) return;
+        res.set_content(R"({"ok":true})", "application/json");
+    }));
 
     // POST append chat message
-    svr.Post("/history", [](const Request& req, Response& res) {
-        try {
-            json j = json::parse(req.body);
-            if (!j.contains("user_id") || !j.contains("role") || !j.contains("message")) {
-                res.status = 400;
-                res.set_content(R"({"error":"user_id, role, message required"})", "application/json");
-                return;
-            }
-            append_chat_message(j["user_id"], j["role"], j["message"]);
-            res.set_content(R"({"ok":true})", "application/json");
-        } catch (...) { res.status = 400; res.set_content(R"({"error":"invalid request"})", "application/json"); }
-    });
+    svr.Post("/history", with_deadline(DEFAULT_DEADLINE, [](const Request& req, Response& res) {
+        AppendMessageRequest body;
+        BodyBuffers buffers;
+        if (!decode_body(req, res, body, buffers, "user_id, role, message required", utf8_repair_chat)) return;
+        std::string user_id(body.user_id); // lane key
+        if (!interactive_lane.run(res, user_id, [&](StoreSession& db) { return db.append_message(body.user_id, body.role, body.message); })) return;
+        res.set_content(R"({"ok":true})", "application/json");
+    }));
 
     // POST clear history
-    svr.Post("/history/clear", [](const Request& req, Response& res) {
-        try {
-            json j = json::parse(req.body);
-            if (!j.contains("user_id")) { res.status = 400; res.set_content(R"({"error":"user_id required"})", "application/json"); return; }
-            clear_chat_history(j["user_id"]);
-            res.set_content(R"({"ok":true})", "application/json");
-        } catch (...) { res.status = 400; res.set_content(R"({"error":"invalid request"})", "application/json"); }
-    });
+    svr.Post("/history/clear", with_deadline(DEFAULT_DEADLINE, [](const Request& req, Response& res) {
+        UserRequest body;
+        if (!decode_body(req, res, body, "user_id required")) return;
+        if (!bulk_lane.run(res, body.user_id, [&](StoreSession& db) { return db.clear_history(body.user_id); })) return;
+        res.set_content(R"({"ok":true})", "application/json");
+    }));
 
     // GET export
-    svr.Get("/history/export", [](const Request& req, Response& res) {
+    svr.Get("/history/export", with_deadline(EXPORT_DEADLINE, [](const Request& req, Response& res) {
         auto user_id = req.get_param_value("user_id");
         if (user_id.empty()) { res.status = 400; res.set_content(R"({"error":"user_id required"})", "application/json"); return; }
-        json out = export_user_data(user_id);
-        res.set_content(out.dump(2), "application/json");
-    });
+        UserExport data;
+        if (!bulk_lane.run(res, user_id, [&](StoreSession& db) { return db.export_user(user_id, data); })) return;
+        send_encoded(res, data, 2);
+    }));
 
     // POST import (replace param optional: ?replace=true)
-    svr.Post("/history/import", [](const Request& req, Response& res) {
-        try {
-            bool replace = false;
-            auto q = req.get_param_value("replace");
-            if (!q.empty() && (q == "1" || q == "true")) replace = true;
-            json j = json::parse(req.body);
-            if (!j.contains("user_id")) { res.status = 400; res.set_content(R"({"error":"user_id required"})", "application/json"); return; }
-            std::string user_id = j["user_id"];
-            import_user_data(user_id, j, replace);
-            res.set_content(R"({"ok":true})", "application/json");
-        } catch (const std::exception& e) {
-            res.status = 400;
-            json err = {{"error","invalid request"}, {"detail", e.what()}};
-            res.set_content(err.dump(), "application/json");
-        }
-    });
+    svr.Post("/history/import", with_deadline(IMPORT_DEADLINE, [](const Request& req, Response& res) {
+        bool replace = false;
+        auto q = req.get_param_value("replace");
+        if (!q.empty() && (q == "1" || q == "true")) replace = true;
+        ImportRequest body;
+        if (!decode_body(req, res, body, "user_id required", utf8_repair_chat)) return;
+        UserImport data = body.take_import();
+        if (!bulk_lane.run(res, body.user_id, [&](StoreSession& db) { return db.import_user(body.user_id, data, replace); })) return;
+        res.set_content(R"({"ok":true})", "application/json");
+    }));
 
     // GET history (simple list)
-    svr.Get("/history", [](const Request& req, Response& res) {
+    svr.Get("/history", with_deadline(HISTORY_DEADLINE, [](const Request& req, Response& res) {
         auto user_id = req.get_param_value("user_id");
         if (user_id.empty()) { res.status = 400; res.set_content(R"({"error":"user_id required"})", "application/json"); return; }
-        // reuse export_user_data but return only chat_history
-        json data = export_user_data(user_id);
-        res.set_content(data["chat_history"].dump(2), "application/json");
-    });
+        std::vector<ChatMessage> messages;
+        if (!bulk_lane.run(res, user_id, [&](StoreSession& db) { return db.history_page(user_id, 0, 0, messages); })) return;
+        send_encoded(res, messages, 2);
+    }));
 
     // Start server
-    std::cout << "Starting settings server on http://0.0.0.0:8080\n";
-    svr.listen("0.0.0.0", 8080);
+    std::thread signal_waiter([&svr, &stop_signals] {
+        int sig = 0;
+        sigwait(&stop_signals, &sig);
+        LOG_INFO("shutdown_requested").num("signal", sig);
+        svr.stop();
+    });
+    LOG_INFO("server_started").str("address", "0.0.0.0").num("port", 8080);
+    bool listened = svr.listen("0.0.0.0", 8080);
+    if (listened) {
+        signal_waiter.join();
+    } else {
+        LOG_ERROR("listen_failed").str("address", "0.0.0.0").num("port", 8080);
+        signal_waiter.detach();
+    }
 
-    return 0;
+    // Clean shutdown: finish queued work, persist the activity sketches and
+    // flush exporters, so exit handlers (e.g. PGO profile dumps) run normally
+    interactive_lane.stop();
+    bulk_lane.stop();
+    cache_hits.stop();
+    activity.stop();
+    if (capture) capture->stop();
+    if (tracer) tracer->stop();
+    LOG_INFO("server_stopped");
+    Logger::instance().stop();
+    return listened ? 0 : 1;
 }
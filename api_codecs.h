@@ -0,0 +1,231 @@
+// api_codecs.h
+//
+// Schemas of the settings server's request and response bodies (json_codec.h)
+// - one struct per POST body with its required and optional fields; a body
+//   is decoded straight into it and the handler moves the fields on into
+//   luma_store.h types
+// - the settings routes decode into a SettingsUpdateView (the delta the
+//   store applies) and POST /history into AppendMessageRequest, both with
+//   std::string_view members over the request body, so their text is never
+//   copied between the socket buffer and SQLite (see decode_body() in the
+//   server for the buffers involved)
+// - response schemas for UserSettings, ChatMessage and UserExport list their
+//   fields in sorted key order, so encode() writes the same bytes as the
+//   nlohmann::json documents of luma_store_json.h did
+
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "json_codec.h"
+#include "luma_store.h"
+
+// --- Requests --- //
+
+// POST /settings: the fields inside "settings", or at the top level if absent
+struct SettingsRequest {
+    std::string_view user_id;
+    std::optional<SettingsUpdateView> settings;
+    SettingsUpdateView flat;
+
+    const SettingsUpdateView& update() const { return settings ? *settings : flat; }
+};
+
+// POST /profile, /notifications, /theme and /security/biometric decode
+// straight into the delta they apply; each route's schema names the fields
+// of it that the route accepts, and update() hands it to the store as is
+struct SettingsDeltaRequest : SettingsUpdateView {
+    std::string_view user_id;
+
+    const SettingsUpdateView& update() const { return *this; }
+};
+
+struct ProfileRequest : SettingsDeltaRequest {};
+
+struct NotificationsRequest : SettingsDeltaRequest {};
+
+// theme_mode is required; the handler derives dark_mode from it
+struct ThemeRequest : SettingsDeltaRequest {};
+
+// "enabled" is biometric_lock
+struct BiometricRequest : SettingsDeltaRequest {};
+
+struct AppendMessageRequest {
+    std::string_view user_id;
+    std::string_view role;
+    std::string_view message;
+};
+
+// POST /history/clear
+struct UserRequest {
+    std::string user_id;
+};
+
+// A chat_history entry of an import; no role means a "user" message, no
+// created_at stamps it at import time
+struct ImportMessage {
+    std::string role = "user";
+    std::string message;
+    std::string created_at;
+};
+
+// POST /history/import: an export document or any subset of it
+struct ImportRequest {
+    std::string user_id;
+    std::optional<SettingsUpdate> settings;
+    std::optional<std::vector<ImportMessage>> chat_history;
+
+    UserImport take_import() {
+        UserImport in;
+        in.settings = std::move(settings);
+        if (chat_history) {
+            in.chat_history.emplace();
+            in.chat_history->reserve(chat_history->size());
+            for (auto& m : *chat_history) {
+                ChatMessage msg;
+                msg.role = std::move(m.role);
+                msg.message = std::move(m.message);
+                msg.created_at = std::move(m.created_at);
+                in.chat_history->push_back(std::move(msg));
+            }
+        }
+        return in;
+    }
+};
+
+// The settings fields, for SettingsUpdate (owned text) and SettingsUpdateView
+template <typename U>
+struct SettingsFieldsSchema {
+    static constexpr auto fields = std::make_tuple(
+            optional_field("name", &U::name),
+            optional_field("email", &U::email),
+            optional_field("avatar_url", &U::avatar_url),
+            optional_field("theme_mode", &U::theme_mode),
+            optional_field("dark_mode", &U::dark_mode),
+            optional_field("notifications_enabled", &U::notifications_enabled),
+            optional_field("chat_notifications", &U::chat_notifications),
+            optional_field("update_notifications", &U::update_notifications),
+            optional_field("reminder_notifications", &U::reminder_notifications),
+            optional_field("language", &U::language),
+            optional_field("biometric_lock", &U::biometric_lock),
+            optional_field("app_version", &U::app_version));
+};
+
+template <>
+struct JsonSchema<SettingsUpdate> : SettingsFieldsSchema<SettingsUpdate> {};
+
+template <>
+struct JsonSchema<SettingsUpdateView> : SettingsFieldsSchema<SettingsUpdateView> {};
+
+template <>
+struct JsonSchema<SettingsRequest> {
+    static constexpr auto fields = std::make_tuple(
+            required_field("user_id", &SettingsRequest::user_id),
+            optional_field("settings", &SettingsRequest::settings),
+            flatten_fields(&SettingsRequest::flat));
+};
+
+template <>
+struct JsonSchema<ProfileRequest> {
+    static constexpr auto fields = std::make_tuple(
+            required_field("user_id", &ProfileRequest::user_id),
+            optional_field("name", &ProfileRequest::name),
+            optional_field("email", &ProfileRequest::email),
+            optional_field("avatar_url", &ProfileRequest::avatar_url));
+};
+
+template <>
+struct JsonSchema<NotificationsRequest> {
+    static constexpr auto fields = std::make_tuple(
+            required_field("user_id", &NotificationsRequest::user_id),
+            optional_field("notifications_enabled", &NotificationsRequest::notifications_enabled),
+            optional_field("chat_notifications", &NotificationsRequest::chat_notifications),
+            optional_field("update_notifications", &NotificationsRequest::update_notifications),
+            optional_field("reminder_notifications", &NotificationsRequest::reminder_notifications));
+};
+
+template <>
+struct JsonSchema<ThemeRequest> {
+    static constexpr auto fields = std::make_tuple(
+            required_field("user_id", &ThemeRequest::user_id),
+            required_field("theme_mode", &ThemeRequest::theme_mode));
+};
+
+template <>
+struct JsonSchema<BiometricRequest> {
+    static constexpr auto fields = std::make_tuple(
+            required_field("user_id", &BiometricRequest::user_id),
+            required_field("enabled", &BiometricRequest::biometric_lock));
+};
+
+template <>
+struct JsonSchema<AppendMessageRequest> {
+    static constexpr auto fields = std::make_tuple(
+            required_field("user_id", &AppendMessageRequest::user_id),
+            required_field("role", &AppendMessageRequest::role),
+            required_field("message", &AppendMessageRequest::message));
+};
+
+template <>
+struct JsonSchema<UserRequest> {
+    static constexpr auto fields = std::make_tuple(
+            required_field("user_id", &UserRequest::user_id));
+};
+
+template <>
+struct JsonSchema<ImportMessage> {
+    static constexpr auto fields = std::make_tuple(
+            optional_field("role", &ImportMessage::role),
+            optional_field("message", &ImportMessage::message),
+            optional_field("created_at", &ImportMessage::created_at));
+};
+
+template <>
+struct JsonSchema<ImportRequest> {
+    static constexpr auto fields = std::make_tuple(
+            required_field("user_id", &ImportRequest::user_id),
+            optional_field("settings", &ImportRequest::settings),
+            optional_field("chat_history", &ImportRequest::chat_history));
+};
+
+// --- Responses (fields in sorted key order) --- //
+
+template <>
+struct JsonSchema<UserSettings> {
+    static constexpr auto fields = std::make_tuple(
+            required_field("app_version", &UserSettings::app_version),
+            required_field("avatar_url", &UserSettings::avatar_url),
+            required_field("biometric_lock", &UserSettings::biometric_lock),
+            required_field("chat_notifications", &UserSettings::chat_notifications),
+            required_field("dark_mode", &UserSettings::dark_mode),
+            required_field("email", &UserSettings::email),
+            required_field("language", &UserSettings::language),
+            required_field("name", &UserSettings::name),
+            required_field("notifications_enabled", &UserSettings::notifications_enabled),
+            required_field("reminder_notifications", &UserSettings::reminder_notifications),
+            required_field("theme_mode", &UserSettings::theme_mode),
+            required_field("update_notifications", &UserSettings::update_notifications),
+            required_field("updated_at", &UserSettings::updated_at),
+            required_field("user_id", &UserSettings::user_id));
+};
+
+// GET /history entries (the row id is not part of the API)
+template <>
+struct JsonSchema<ChatMessage> {
+    static constexpr auto fields = std::make_tuple(
+            required_field("created_at", &ChatMessage::created_at),
+            required_field("message", &ChatMessage::message),
+            required_field("role", &ChatMessage::role));
+};
+
+template <>
+struct JsonSchema<UserExport> {
+    static constexpr auto fields = std::make_tuple(
+            required_field("chat_history", &UserExport::chat_history),
+            required_field("exported_at", &UserExport::exported_at),
+            required_field("settings", &UserExport::settings));
+};
@@ -0,0 +1,339 @@
+// async_bench.cpp
+//
+// Coroutine store calls (luma_store_async.h) vs blocking threads
+// - every mode sends the same requests through one StoreExecutor with
+//   --db-workers DB threads; a request is the store call plus the handler
+//   work around it (parsing the JSON body, serializing the JSON response)
+// - modes:
+//     blocking    --front-threads threads each block on their request, like
+//                 HTTP workers waiting on a lane: at most that many in flight
+//     threads     one blocking thread per client (--clients threads)
+//     coroutines  --clients coroutines on --front-threads threads; a
+//                 suspended request holds no thread
+// - closed loop: each client sends its next request when the last finished
+// - reports throughput, latency from issue to completion, the peak number
+//   of requests in flight and how many threads it took
+// - with --json FILE, writes per-mode summaries and HDR buckets for
+//   bench_compare
+//
+// Usage:
+//   async_bench [--db luma_settings.db] [--db-workers 4] [--front-threads 8]
+//               [--clients 1000] [--seconds 5] [--users 1000]
+//               [--op get|set|append|mix] [--modes blocking,threads,coroutines]
+//               [--json FILE]
+//
+// Build (example):
+// g++ async_bench.cpp luma_store.cpp -std=c++20 -O2 -lsqlite3 -pthread -o async_bench
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+
+#include "json.hpp"      // nlohmann::json (single header)
+#include "hdr_histogram.h"
+#include "luma_store_async.h"
+#include "luma_store_json.h"
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string db = "luma_settings.db";
+    int db_workers = 4;
+    int front_threads = 8;
+    int clients = 1000;
+    double seconds = 5;
+    int users = 1000;
+    std::string op = "get";
+    std::vector<std::string> modes = {"blocking", "threads", "coroutines"};
+    std::string json_out;
+};
+
+static Options parse_args(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string k = argv[i];
+        const char* v = argv[i + 1];
+        if (k == "--db") o.db = v;
+        else if (k == "--db-workers") o.db_workers = std::max(1, std::atoi(v));
+        else if (k == "--front-threads") o.front_threads = std::max(1, std::atoi(v));
+        else if (k == "--clients") o.clients = std::max(1, std::atoi(v));
+        else if (k == "--seconds") o.seconds = std::atof(v);
+        else if (k == "--users") o.users = std::max(1, std::atoi(v));
+        else if (k == "--op") o.op = v;
+        else if (k == "--json") o.json_out = v;
+        else if (k == "--modes") {
+            o.modes.clear();
+            std::string s = v;
+            size_t start = 0;
+            while (start < s.size()) {
+                size_t end = s.find(',', start);
+                if (end == std::string::npos) end = s.size();
+                o.modes.push_back(s.substr(start, end - start));
+                start = end + 1;
+            }
+        } else std::cerr << "unknown option " << k << "\n";
+    }
+    return o;
+}
+
+// Shared by the clients of one run. Latencies go to striped histograms so
+// any thread (including the front pool resuming coroutines) can record.
+struct RunState {
+    static const int STRIPES = 64;
+    struct Stripe {
+        std::mutex mutex;
+        HdrHistogram latency;
+        uint64_t errors = 0;
+    };
+    Stripe stripes[STRIPES];
+    std::atomic<bool> running{true};
+    std::atomic<int64_t> in_flight{0};
+    std::atomic<int64_t> peak_in_flight{0};
+    std::atomic<int> finished{0};
+
+    void begin() {
+        int64_t now = ++in_flight;
+        int64_t peak = peak_in_flight.load(std::memory_order_relaxed);
+        while (now > peak && !peak_in_flight.compare_exchange_weak(peak, now)) {}
+    }
+    void end(Clock::time_point started, bool ok) {
+        in_flight--;
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started).count();
+        Stripe& s = stripes[std::hash<std::thread::id>()(std::this_thread::get_id()) % STRIPES];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.latency.record(static_cast<uint64_t>(std::max<int64_t>(1, us)));
+        if (!ok) s.errors++;
+    }
+};
+
+// Runs coroutine continuations handed over by the store (the "HTTP" threads)
+class ResumePool {
+public:
+    explicit ResumePool(int threads) {
+        for (int i = 0; i < threads; i++) threads_.emplace_back([this] { loop(); });
+    }
+    ~ResumePool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : threads_) t.join();
+    }
+    void post(std::coroutine_handle<> h) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(h);
+        }
+        cv_.notify_one();
+    }
+
+private:
+    void loop() {
+        for (;;) {
+            std::coroutine_handle<> h;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+                if (queue_.empty()) return;
+                h = queue_.front();
+                queue_.pop_front();
+            }
+            h.resume();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::coroutine_handle<>> queue_;
+    std::vector<std::thread> threads_;
+    bool stopping_ = false;
+};
+
+enum class Op { Get, Set, Append };
+
+static Op pick_op(const std::string& mix, uint64_t i) {
+    if (mix == "set") return Op::Set;
+    if (mix == "append") return Op::Append;
+    if (mix == "mix") return i % 10 < 6 ? Op::Get : i % 10 < 8 ? Op::Set : Op::Append;
+    return Op::Get;
+}
+
+static std::string user_of(int client, uint64_t i, int users) {
+    return "bench-user-" + std::to_string((static_cast<uint64_t>(client) * 7919 + i) % static_cast<uint64_t>(users));
+}
+
+// Request bodies as a client would send them; parsed by the "handler"
+static std::string request_body(Op op, const std::string& user, uint64_t i) {
+    if (op == Op::Set) return json{{"user_id", user}, {"settings", {{"dark_mode", (i & 1) != 0}}}}.dump();
+    if (op == Op::Append) return json{{"user_id", user}, {"role", "user"}, {"message", "async_bench " + std::to_string(i)}}.dump();
+    return "";
+}
+
+// --- Blocking handlers: the calling thread waits for the DB thread --- //
+
+template <typename F>
+static bool call_blocking(StoreExecutor& executor, F fn) {
+    std::promise<bool> done;
+    std::future<bool> result = done.get_future();
+    executor.post([&](StoreSession* s) { done.set_value(s && fn(*s)); });
+    return result.get();
+}
+
+static bool handle_blocking(StoreExecutor& executor, Op op, const std::string& user, uint64_t i) {
+    if (op == Op::Get) {
+        UserSettings s;
+        if (!call_blocking(executor, [&](StoreSession& db) { return db.get_settings(user, s); })) return false;
+        return !settings_to_json(s).dump().empty();
+    }
+    json j = json::parse(request_body(op, user, i));
+    if (op == Op::Set) {
+        SettingsUpdate u = settings_update_from_json(j["settings"]);
+        return call_blocking(executor, [&](StoreSession& db) { return db.update_settings(user, u); });
+    }
+    std::string role = j["role"], message = j["message"];
+    return call_blocking(executor, [&](StoreSession& db) { return db.append_message(user, role, message); });
+}
+
+// --- Coroutine handlers: suspended while the DB thread works --- //
+
+static Task<bool> handle_async(AsyncStore& store, Op op, std::string user, uint64_t i) {
+    if (op == Op::Get) {
+        StoreResult<UserSettings> r = co_await store.get_settings(user);
+        co_return r.ok && !settings_to_json(r.value).dump().empty();
+    }
+    json j = json::parse(request_body(op, user, i));
+    if (op == Op::Set) {
+        StoreResult<void> r = co_await store.update_settings(user, settings_update_from_json(j["settings"]));
+        co_return r.ok;
+    }
+    StoreResult<void> r = co_await store.append_message(user, j["role"].get<std::string>(),
+                                                       j["message"].get<std::string>());
+    co_return r.ok;
+}
+
+static Task<void> async_client(AsyncStore& store, RunState& state, const Options& o, int client) {
+    for (uint64_t i = 0; state.running.load(std::memory_order_relaxed); i++) {
+        auto started = Clock::now();
+        state.begin();
+        bool ok = co_await handle_async(store, pick_op(o.op, i), user_of(client, i, o.users), i);
+        state.end(started, ok);
+    }
+    state.finished++;
+}
+
+struct Result {
+    std::string mode;
+    int threads = 0;
+    double seconds = 0;
+    int64_t peak_in_flight = 0;
+    uint64_t errors = 0;
+    HdrHistogram latency;
+
+    double throughput() const { return seconds > 0 ? static_cast<double>(latency.count()) / seconds : 0; }
+};
+
+static Result run_mode(const Options& o, StoreExecutor& executor, const std::string& mode) {
+    RunState state;
+    Result r;
+    r.mode = mode;
+    auto start = Clock::now();
+    if (mode == "coroutines") {
+        r.threads = o.front_threads;
+        ResumePool front(o.front_threads);
+        AsyncStore store(executor, [&front](std::coroutine_handle<> h) { front.post(h); });
+        // each client runs here until its first store call, then on the pool
+        for (int c = 0; c < o.clients; c++) spawn(async_client(store, state, o, c));
+        std::this_thread::sleep_for(std::chrono::duration<double>(o.seconds));
+        state.running = false;
+        while (state.finished.load() < o.clients) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    } else {
+        int threads = mode == "threads" ? o.clients : o.front_threads;
+        r.threads = threads;
+        std::vector<std::thread> clients;
+        for (int c = 0; c < threads; c++) {
+            clients.emplace_back([&, c] {
+                for (uint64_t i = 0; state.running.load(std::memory_order_relaxed); i++) {
+                    auto started = Clock::now();
+                    state.begin();
+                    bool ok = handle_blocking(executor, pick_op(o.op, i), user_of(c, i, o.users), i);
+                    state.end(started, ok);
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(o.seconds));
+        state.running = false;
+        for (auto& t : clients) t.join();
+    }
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    r.peak_in_flight = state.peak_in_flight.load();
+    for (auto& s : state.stripes) {
+        r.latency.merge(s.latency);
+        r.errors += s.errors;
+    }
+    return r;
+}
+
+int main(int argc, char** argv) {
+    Options o = parse_args(argc, argv);
+    for (const auto& m : o.modes) {
+        if (m != "blocking" && m != "threads" && m != "coroutines") {
+            std::cerr << "unknown mode " << m << " (blocking, threads, coroutines)\n";
+            return 2;
+        }
+    }
+    LumaStore store(o.db);
+    std::string error;
+    if (!store.init(&error)) {
+        std::cerr << "cannot open " << o.db << ": " << error << "\n";
+        return 2;
+    }
+    StoreExecutor executor(store, static_cast<size_t>(o.db_workers));
+
+    std::vector<Result> results;
+    for (const auto& m : o.modes) results.push_back(run_mode(o, executor, m));
+
+    std::printf("op %s, %d clients, %d DB threads, %.1fs per mode, db %s\n\n", o.op.c_str(), o.clients,
+                o.db_workers, o.seconds, o.db.c_str());
+    std::printf("%-11s %8s %10s %10s %9s %9s %9s %8s\n", "mode", "threads", "req/s", "in flight", "p50 us", "p99 us",
+                "max us", "errors");
+    uint64_t errors = 0;
+    for (const auto& r : results) {
+        std::printf("%-11s %8d %10.0f %10lld %9llu %9llu %9llu %8llu\n", r.mode.c_str(), r.threads, r.throughput(),
+                    static_cast<long long>(r.peak_in_flight),
+                    static_cast<unsigned long long>(r.latency.percentile(50)),
+                    static_cast<unsigned long long>(r.latency.percentile(99)),
+                    static_cast<unsigned long long>(r.latency.max()),
+                    static_cast<unsigned long long>(r.errors));
+        errors += r.errors;
+    }
+    std::printf("(threads: request threads besides the %d DB threads)\n", o.db_workers);
+
+    if (!o.json_out.empty()) {
+        json out = {{"tool", "async_bench"}, {"op", o.op}, {"clients", o.clients}, {"db_workers", o.db_workers}};
+        for (const auto& r : results) {
+            out["modes"][r.mode] = {
+                    {"threads", r.threads},
+                    {"throughput", r.throughput()},
+                    {"peak_in_flight", r.peak_in_flight},
+                    {"errors", r.errors},
+                    {"summary", r.latency.summary()},
+                    {"buckets", r.latency.buckets()}
+            };
+        }
+        std::ofstream f(o.json_out);
+        f << out.dump(2) << "\n";
+    }
+    return errors ? 1 : 0;
+}
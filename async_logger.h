@@ -0,0 +1,337 @@
+// async_logger.h
+//
+// Asynchronous structured logger (JSON lines)
+// - a log call formats one JSON object into a per-thread scratch string and
+//   copies it into that thread's single-producer/single-consumer byte ring;
+//   no locks, no syscalls, and no allocation once the scratch string is warm
+// - a background flusher drains every thread's ring to the output fd with
+//   large write()s; a full ring drops the line (counted) instead of blocking
+// - LOG_ERROR_LIMITED / LOG_WARN_LIMITED allow a burst per call site, then a
+//   fixed rate; the next line that gets through carries "suppressed": N
+//
+// Usage:
+//   LOG_INFO("access").str("path", req.path).num("status", 200);
+// The line is committed when the temporary record goes out of scope.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lock_profiler.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+enum class LogLevel { Debug, Info, Warn, Error };
+
+class Logger {
+public:
+    static const size_t RING_BYTES = 64 * 1024;   // per thread, power of two
+    static const size_t MAX_LINE = 16 * 1024;     // longer lines are dropped
+
+    static Logger& instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    // Log to `path` (appending) instead of stderr; false if it can't be opened
+    bool open(const char* path) {
+        int fd = ::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) return false;
+        int old = fd_.exchange(fd);
+        if (old > 2) ::close(old);
+        return true;
+    }
+
+    void set_level(LogLevel level) { level_ = level; }
+    bool enabled(LogLevel level) const { return level >= level_; }
+
+    void start() {
+        if (running_.exchange(true)) return;
+        flusher_ = std::thread([this] { run(); });
+    }
+
+    // Drain everything and stop the flusher (lines logged afterwards stay buffered)
+    void stop() {
+        if (!running_.exchange(false)) return;
+        flusher_.join();
+        drain();
+    }
+
+    // Lines accepted into the rings so far
+    uint64_t logged() {
+        ProfiledLock lock(rings_mutex_, "Logger::logged");
+        uint64_t lines = 0;
+        for (auto& r : rings_) lines += r->lines.load(std::memory_order_relaxed);
+        return lines;
+    }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    // Copy one complete line into the calling thread's ring
+    void push(const char* data, size_t len) {
+        Ring* ring = thread_ring();
+        size_t tail = ring->tail.load(std::memory_order_relaxed);
+        size_t head = ring->head.load(std::memory_order_acquire);
+        if (len > MAX_LINE || RING_BYTES - (tail - head) < len) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        size_t at = tail & (RING_BYTES - 1);
+        size_t first = std::min(len, RING_BYTES - at);
+        std::memcpy(ring->data + at, data, first);
+        std::memcpy(ring->data, data + first, len - first);
+        ring->tail.store(tail + len, std::memory_order_release);
+        ring->lines.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static const char* level_name(LogLevel level) {
+        static const char* names[] = {"debug", "info", "warn", "error"};
+        return names[static_cast<int>(level)];
+    }
+
+private:
+    struct Ring {
+        std::atomic<size_t> tail{0};  // written by the owning thread
+        alignas(64) std::atomic<size_t> head{0};  // written by the flusher
+        std::atomic<uint64_t> lines{0};
+        char data[RING_BYTES];
+    };
+
+    Logger() = default;
+    ~Logger() { stop(); }
+
+    Ring* thread_ring() {
+        thread_local Ring* ring = nullptr;
+        if (!ring) {
+            auto owned = std::make_unique<Ring>();
+            ring = owned.get();
+            ProfiledLock lock(rings_mutex_, "Logger::thread_ring");
+            rings_.push_back(std::move(owned));  // kept after the thread exits; pools reuse threads
+        }
+        return ring;
+    }
+
+    void run() {
+        while (running_.load(std::memory_order_relaxed)) {
+            if (drain() == 0) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    // Write out every ring; returns the number of bytes written
+    size_t drain() {
+        std::vector<Ring*> rings;
+        {
+            ProfiledLock lock(rings_mutex_, "Logger::drain");
+            for (auto& r : rings_) rings.push_back(r.get());
+        }
+        size_t total = 0;
+        int fd = fd_.load();
+        for (Ring* ring : rings) {
+            size_t head = ring->head.load(std::memory_order_relaxed);
+            size_t tail = ring->tail.load(std::memory_order_acquire);
+            if (head == tail) continue;
+            size_t at = head & (RING_BYTES - 1);
+            size_t len = tail - head;
+            size_t first = std::min(len, RING_BYTES - at);
+            write_all(fd, ring->data + at, first);
+            write_all(fd, ring->data, len - first);
+            ring->head.store(tail, std::memory_order_release);
+            total += len;
+        }
+        return total;
+    }
+
+    static void write_all(int fd, const char* p, size_t n) {
+        while (n > 0) {
+            ssize_t w = ::write(fd, p, n);
+            if (w <= 0) return;  // nowhere to report it; drop the rest
+            p += w;
+            n -= static_cast<size_t>(w);
+        }
+    }
+
+    std::atomic<int> fd_{2};
+    LogLevel level_ = LogLevel::Info;
+    ProfiledMutex rings_mutex_{"logger_rings"};
+    std::vector<std::unique_ptr<Ring>> rings_;
+    std::thread flusher_;
+    std::atomic<bool> running_{false};
+    std::atomic<uint64_t> dropped_{0};
+};
+
+// One log line under construction; committed by the destructor
+class LogRecord {
+public:
+    LogRecord(LogLevel level, const char* event, uint64_t suppressed = 0) {
+        Scratch& s = scratch();
+        if (s.in_use) {
+            owned_.reset(new Scratch);  // logging while building another line
+            line_ = owned_.get();
+        } else {
+            line_ = &s;
+        }
+        line_->in_use = true;
+        line_->text.clear();
+        line_->text += "{\"ts\":\"";
+        append_timestamp();
+        line_->text += "\",\"level\":\"";
+        line_->text += Logger::level_name(level);
+        line_->text += "\",\"event\":";
+        append_string(event);
+        if (suppressed) num("suppressed", suppressed);
+    }
+
+    ~LogRecord() {
+        line_->text += "}\n";
+        Logger::instance().push(line_->text.data(), line_->text.size());
+        line_->in_use = false;
+    }
+
+    LogRecord(const LogRecord&) = delete;
+    LogRecord& operator=(const LogRecord&) = delete;
+
+    LogRecord& str(const char* key, const char* value) {
+        append_key(key);
+        append_string(value ? value : "");
+        return *this;
+    }
+    LogRecord& str(const char* key, const std::string& value) {
+        append_key(key);
+        append_string(value.data(), value.size());
+        return *this;
+    }
+    template <typename T>
+    LogRecord& num(const char* key, T value) {
+        append_key(key);
+        line_->text += std::to_string(value);
+        return *this;
+    }
+    LogRecord& flag(const char* key, bool value) {
+        append_key(key);
+        line_->text += value ? "true" : "false";
+        return *this;
+    }
+
+private:
+    struct Scratch {
+        std::string text;
+        bool in_use = false;
+    };
+
+    static Scratch& scratch() {
+        thread_local Scratch s;
+        return s;
+    }
+
+    void append_key(const char* key) {
+        line_->text += ',';
+        append_string(key);
+        line_->text += ':';
+    }
+
+    void append_string(const char* s) { append_string(s, std::strlen(s)); }
+
+    void append_string(const char* s, size_t n) {
+        static const char hex[] = "0123456789abcdef";
+        std::string& out = line_->text;
+        out += '"';
+        for (size_t i = 0; i < n; i++) {
+            unsigned char c = static_cast<unsigned char>(s[i]);
+            switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    out += "\\u00";
+                    out += hex[c >> 4];
+                    out += hex[c & 0xf];
+                } else {
+                    out += static_cast<char>(c);
+                }
+            }
+        }
+        out += '"';
+    }
+
+    // UTC with milliseconds; the date/time part is reformatted once per second per thread
+    void append_timestamp() {
+        thread_local std::time_t cached_second = 0;
+        thread_local char cached[24];
+        auto now = std::chrono::system_clock::now();
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+        std::time_t sec = static_cast<std::time_t>(ms / 1000);
+        if (sec != cached_second) {
+            std::tm tm{};
+            gmtime_r(&sec, &tm);
+            std::strftime(cached, sizeof(cached), "%Y-%m-%dT%H:%M:%S", &tm);
+            cached_second = sec;
+        }
+        char frac[8];
+        std::snprintf(frac, sizeof(frac), ".%03dZ", static_cast<int>(ms % 1000));
+        line_->text += cached;
+        line_->text += frac;
+    }
+
+    Scratch* line_ = nullptr;
+    std::unique_ptr<Scratch> owned_;
+};
+
+// Token bucket for one call site: `burst` lines, then `per_second`
+class LogRateLimiter {
+public:
+    LogRateLimiter(double burst, double per_second) : burst_(burst), rate_(per_second), tokens_(burst) {}
+
+    // True if a line may be logged now; `suppressed` gets the lines dropped since the last one
+    bool allow(uint64_t& suppressed) {
+        ProfiledLock lock(mutex_, "LogRateLimiter::allow");
+        auto now = std::chrono::steady_clock::now();
+        if (last_ != std::chrono::steady_clock::time_point()) {
+            tokens_ = std::min(burst_, tokens_ + rate_ * std::chrono::duration<double>(now - last_).count());
+        }
+        last_ = now;
+        if (tokens_ < 1) {
+            suppressed_++;
+            return false;
+        }
+        tokens_ -= 1;
+        suppressed = suppressed_;
+        suppressed_ = 0;
+        return true;
+    }
+
+private:
+    ProfiledMutex mutex_{"log_rate_limiter"};
+    double burst_;
+    double rate_;
+    double tokens_;
+    uint64_t suppressed_ = 0;
+    std::chrono::steady_clock::time_point last_;
+};
+
+#define LOG_AT(level, event) \
+    if (!Logger::instance().enabled(level)) {} else LogRecord(level, event)
+#define LOG_DEBUG(event) LOG_AT(LogLevel::Debug, event)
+#define LOG_INFO(event) LOG_AT(LogLevel::Info, event)
+#define LOG_WARN(event) LOG_AT(LogLevel::Warn, event)
+#define LOG_ERROR(event) LOG_AT(LogLevel::Error, event)
+
+// Rate-limited per call site: 10 lines, then one per second
+#define LOG_LIMITED(level, event)                                                         \
+    if (static LogRateLimiter log_limiter_(10, 1); uint64_t log_suppressed_ = 0) {} else  \
+    if (!Logger::instance().enabled(level) || !log_limiter_.allow(log_suppressed_)) {} else \
+    LogRecord(level, event, log_suppressed_)
+#define LOG_WARN_LIMITED(event) LOG_LIMITED(LogLevel::Warn, event)
+#define LOG_ERROR_LIMITED(event) LOG_LIMITED(LogLevel::Error, event)
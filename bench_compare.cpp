@@ -0,0 +1,280 @@
+// bench_compare.cpp
+//
+// Compares two builds' benchmark results with bootstrap confidence intervals
+// - reads the --json output of loadgen, stress and fleet_sim; every latency
+//   distribution in a file (any object with HDR "buckets") becomes a series
+//   named by where it sits, e.g. "rate=400 GET /settings",
+//   "threads=16 POST /history" or "settings server"
+// - several files per side (comma separated, e.g. repeated runs) are merged
+//   series by series
+// - for each series present in both builds, resamples both distributions
+//   --iterations times (a multinomial draw over the histogram buckets, which
+//   is the same as resampling every recorded value but costs one binomial
+//   draw per bucket) and takes the 2.5th/97.5th percentiles of the B/A
+//   ratio of the median and of the p99.
+//   A change is significant when the whole interval lies beyond
+//   --threshold (default 5%) in one direction
+// - prints a table sorted by p99 change and exits with status 1 if any
+//   series regressed significantly (status 2 on bad input)
+//
+// Usage:
+//   bench_compare --a BASE.json[,BASE2.json...] --b NEW.json[,NEW2.json...]
+//                 [--threshold 0.05] [--iterations 1000] [--min-count 50]
+//                 [--filter SUBSTRING] [--seed S]
+//
+// Build (example):
+// g++ bench_compare.cpp -std=c++17 -O2 -o bench_compare
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+
+#include "json.hpp"      // nlohmann::json (single header)
+#include "hdr_histogram.h"
+
+using json = nlohmann::json;
+
+struct Options {
+    std::string a;
+    std::string b;
+    double threshold = 0.05;
+    int iterations = 1000;
+    uint64_t min_count = 50;
+    std::string filter;
+    uint64_t seed = 1;
+};
+
+// A distribution as (value, count) buckets, resampled as a whole
+struct Series {
+    std::vector<uint64_t> values;
+    std::vector<uint64_t> counts;
+    uint64_t count = 0;
+
+    explicit Series(const HdrHistogram& h) {
+        for (const auto& b : h.buckets()) {
+            values.push_back(b.at(0).get<uint64_t>());
+            counts.push_back(b.at(1).get<uint64_t>());
+            count += counts.back();
+        }
+    }
+
+    // One bootstrap replicate: `count` values drawn with replacement, as
+    // bucket counts (multinomial via successive conditional binomials)
+    void resample(std::mt19937_64& rng, std::vector<uint64_t>& out) const {
+        out.assign(counts.size(), 0);
+        uint64_t left = count;
+        uint64_t mass = count;
+        for (size_t i = 0; i < counts.size() && left > 0; i++) {
+            if (i + 1 == counts.size() || counts[i] >= mass) {
+                out[i] = left;
+                break;
+            }
+            double p = static_cast<double>(counts[i]) / static_cast<double>(mass);
+            out[i] = std::binomial_distribution<uint64_t>(left, p)(rng);
+            left -= out[i];
+            mass -= counts[i];
+        }
+    }
+
+    // Quantile q of a replicate produced by resample()
+    uint64_t quantile(const std::vector<uint64_t>& replicate, double q) const {
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * static_cast<double>(count) + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < replicate.size(); i++) {
+            seen += replicate[i];
+            if (seen >= rank) return values[i];
+        }
+        return values.empty() ? 0 : values.back();
+    }
+};
+
+struct Interval {
+    double point = 0;  // ratio of the observed statistics
+    double low = 0;
+    double high = 0;
+};
+
+struct Comparison {
+    std::string name;
+    uint64_t count_a = 0, count_b = 0;
+    uint64_t p50_a = 0, p50_b = 0, p99_a = 0, p99_b = 0;
+    Interval p50, p99;
+    int verdict = 0;  // -1 faster, 0 no significant change, 1 slower
+};
+
+static Options parse_args(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string k = argv[i];
+        const char* v = argv[i + 1];
+        if (k == "--a") o.a = v;
+        else if (k == "--b") o.b = v;
+        else if (k == "--threshold") o.threshold = std::atof(v);
+        else if (k == "--iterations") o.iterations = std::max(100, std::atoi(v));
+        else if (k == "--min-count") o.min_count = std::strtoull(v, nullptr, 10);
+        else if (k == "--filter") o.filter = v;
+        else if (k == "--seed") o.seed = std::strtoull(v, nullptr, 10);
+        else std::cerr << "unknown option " << k << "\n";
+    }
+    return o;
+}
+
+// Label for an element of an array of runs: its load parameter if it has one
+static std::string element_label(const json& j, size_t index) {
+    for (const char* key : {"threads", "rate", "devices"}) {
+        if (j.is_object() && j.contains(key) && j[key].is_number()) {
+            double v = j[key].get<double>();
+            char buf[64];
+            std::snprintf(buf, sizeof(buf), "%s=%g", key, v);
+            return buf;
+        }
+    }
+    return "#" + std::to_string(index);
+}
+
+// Collects every object with "buckets" under a name built from the path to it
+static void collect(const json& j, const std::string& name, std::map<std::string, HdrHistogram>& out) {
+    if (j.is_object()) {
+        if (j.contains("buckets") && j["buckets"].is_array()) {
+            out[name.empty() ? "all" : name].merge(HdrHistogram::from_buckets(j["buckets"]));
+            return;
+        }
+        for (auto it = j.begin(); it != j.end(); ++it) {
+            // Container keys ("routes", "stages", ...) don't help tell series apart
+            bool container = it.key() == "routes" || it.key() == "stages" || it.key() == "runs";
+            std::string child = container ? name : (name.empty() ? it.key() : name + " " + it.key());
+            collect(it.value(), child, out);
+        }
+    } else if (j.is_array()) {
+        for (size_t i = 0; i < j.size(); i++) {
+            std::string label = element_label(j[i], i);
+            collect(j[i], name.empty() ? label : name + " " + label, out);
+        }
+    }
+}
+
+static bool load(const std::string& files, std::map<std::string, HdrHistogram>& out) {
+    size_t start = 0;
+    while (start < files.size()) {
+        size_t end = files.find(',', start);
+        if (end == std::string::npos) end = files.size();
+        std::string path = files.substr(start, end - start);
+        start = end + 1;
+        std::ifstream f(path);
+        json j = json::parse(f, nullptr, false);
+        if (!f || j.is_discarded()) {
+            std::cerr << "cannot parse " << path << "\n";
+            return false;
+        }
+        collect(j, "", out);
+    }
+    return !out.empty();
+}
+
+static double ratio(uint64_t b, uint64_t a) {
+    return static_cast<double>(std::max<uint64_t>(b, 1)) / static_cast<double>(std::max<uint64_t>(a, 1));
+}
+
+static Comparison compare(const Options& o, const std::string& name, const HdrHistogram& ha,
+                          const HdrHistogram& hb, std::mt19937_64& rng) {
+    Comparison c;
+    c.name = name;
+    c.count_a = ha.count();
+    c.count_b = hb.count();
+    c.p50_a = ha.percentile(50);
+    c.p50_b = hb.percentile(50);
+    c.p99_a = ha.percentile(99);
+    c.p99_b = hb.percentile(99);
+    c.p50.point = ratio(c.p50_b, c.p50_a);
+    c.p99.point = ratio(c.p99_b, c.p99_a);
+
+    Series sa(ha), sb(hb);
+    std::vector<uint64_t> xa, xb;
+    std::vector<double> r50, r99;
+    for (int it = 0; it < o.iterations; it++) {
+        sa.resample(rng, xa);
+        sb.resample(rng, xb);
+        r50.push_back(ratio(sb.quantile(xb, 0.50), sa.quantile(xa, 0.50)));
+        r99.push_back(ratio(sb.quantile(xb, 0.99), sa.quantile(xa, 0.99)));
+    }
+    auto interval = [](std::vector<double>& r, Interval& out) {
+        std::sort(r.begin(), r.end());
+        out.low = r[static_cast<size_t>(0.025 * static_cast<double>(r.size() - 1))];
+        out.high = r[static_cast<size_t>(0.975 * static_cast<double>(r.size() - 1))];
+    };
+    interval(r50, c.p50);
+    interval(r99, c.p99);
+
+    bool slower = c.p50.low > 1 + o.threshold || c.p99.low > 1 + o.threshold;
+    bool faster = c.p50.high < 1 - o.threshold || c.p99.high < 1 - o.threshold;
+    c.verdict = slower ? 1 : faster ? -1 : 0;
+    return c;
+}
+
+static std::string pct(double ratio) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%+.1f%%", (ratio - 1) * 100);
+    return buf;
+}
+
+int main(int argc, char** argv) {
+    Options o = parse_args(argc, argv);
+    if (o.a.empty() || o.b.empty()) {
+        std::cerr << "usage: bench_compare --a BASE.json[,...] --b NEW.json[,...] [--threshold 0.05]\n";
+        return 2;
+    }
+    std::map<std::string, HdrHistogram> a, b;
+    if (!load(o.a, a) || !load(o.b, b)) {
+        std::cerr << "no latency distributions found\n";
+        return 2;
+    }
+
+    std::mt19937_64 rng(o.seed);
+    std::vector<Comparison> results;
+    std::vector<std::string> skipped;
+    for (const auto& kv : a) {
+        if (!o.filter.empty() && kv.first.find(o.filter) == std::string::npos) continue;
+        auto other = b.find(kv.first);
+        if (other == b.end()) {
+            skipped.push_back(kv.first + " (only in A)");
+            continue;
+        }
+        if (kv.second.count() < o.min_count || other->second.count() < o.min_count) {
+            skipped.push_back(kv.first + " (fewer than " + std::to_string(o.min_count) + " samples)");
+            continue;
+        }
+        results.push_back(compare(o, kv.first, kv.second, other->second, rng));
+    }
+    for (const auto& kv : b) {
+        if (a.count(kv.first) == 0 && (o.filter.empty() || kv.first.find(o.filter) != std::string::npos)) {
+            skipped.push_back(kv.first + " (only in B)");
+        }
+    }
+    std::sort(results.begin(), results.end(), [](const Comparison& x, const Comparison& y) { return x.p99.point > y.p99.point; });
+
+    std::printf("A = %s\nB = %s\n95%% bootstrap intervals of B/A, %d iterations, significant beyond %.1f%%\n\n",
+                o.a.c_str(), o.b.c_str(), o.iterations, o.threshold * 100);
+    std::printf("%-44s %8s %8s  %-30s %-30s %s\n", "series", "n A", "n B", "median A->B us [95% CI]", "p99 A->B us [95% CI]", "verdict");
+    int regressions = 0, improvements = 0;
+    for (const auto& c : results) {
+        char median[64], p99[64];
+        std::snprintf(median, sizeof(median), "%llu->%llu %s [%s,%s]", static_cast<unsigned long long>(c.p50_a),
+                      static_cast<unsigned long long>(c.p50_b), pct(c.p50.point).c_str(), pct(c.p50.low).c_str(), pct(c.p50.high).c_str());
+        std::snprintf(p99, sizeof(p99), "%llu->%llu %s [%s,%s]", static_cast<unsigned long long>(c.p99_a),
+                      static_cast<unsigned long long>(c.p99_b), pct(c.p99.point).c_str(), pct(c.p99.low).c_str(), pct(c.p99.high).c_str());
+        const char* verdict = c.verdict > 0 ? "SLOWER" : c.verdict < 0 ? "faster" : "-";
+        std::printf("%-44s %8llu %8llu  %-30s %-30s %s\n", c.name.c_str(), static_cast<unsigned long long>(c.count_a),
+                    static_cast<unsigned long long>(c.count_b), median, p99, verdict);
+        if (c.verdict > 0) regressions++;
+        if (c.verdict < 0) improvements++;
+    }
+    for (const auto& s : skipped) std::printf("skipped: %s\n", s.c_str());
+    std::printf("\n%zu series compared: %d significantly slower, %d significantly faster\n", results.size(), regressions, improvements);
+    return regressions ? 1 : 0;
+}
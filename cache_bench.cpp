@@ -0,0 +1,332 @@
+// cache_bench.cpp
+//
+// Read scalability of settings lookups (GET /settings) from 1 to 64 threads
+// - epoch      LumaStore's settings cache: lock-free lookups pinned with
+//              epoch.h, writers publish immutable entries (the server now)
+// - mutex      the usual alternative: a std::mutex around an unordered_map
+//              of shared_ptr<const UserSettings>
+// - shared     the same map behind a std::shared_mutex (readers share it,
+//              but still write its reader count)
+// - sqlite     no cache: a point SELECT per lookup on the thread's own
+//              connection
+// - readers pick users uniformly from --users; a writer thread updates
+//   --writes users per second through the store (and, for the maps, puts
+//   the row it reads back), so entries keep being replaced and reclaimed
+// - afterwards every cached entry is compared with the database; any
+//   difference fails the run
+//
+// Usage:
+//   cache_bench [--db cache_bench.db] [--users N] [--threads 1,2,4,...] [--millis M] [--writes N] [--json FILE]
+// The database is created if needed, with users cache-bench-0..N-1.
+//
+// Build (example):
+// g++ cache_bench.cpp luma_store.cpp -std=c++17 -O2 -lsqlite3 -pthread -o cache_bench
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include "json.hpp"      // nlohmann::json (single header)
+#include "luma_store.h"
+
+using json = nlohmann::json;
+
+struct Options {
+    std::string db = "cache_bench.db";
+    size_t users = 10000;
+    std::vector<int> threads = {1, 2, 4, 8, 16, 32, 64};
+    double millis = 300;
+    int writes = 500;
+    std::string json_out;
+};
+
+static Options parse_args(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string k = argv[i];
+        const char* v = argv[i + 1];
+        if (k == "--db") o.db = v;
+        else if (k == "--users") o.users = static_cast<size_t>(std::max(1, std::atoi(v)));
+        else if (k == "--threads") {
+            o.threads.clear();
+            for (const char* p = v; *p; p++) {
+                int n = std::atoi(p);
+                if (n > 0) o.threads.push_back(n);
+                while (p[1] && *p != ',') p++;
+            }
+            if (o.threads.empty()) o.threads.push_back(1);
+        }
+        else if (k == "--millis") o.millis = std::max(1.0, std::atof(v));
+        else if (k == "--writes") o.writes = std::max(0, std::atoi(v));
+        else if (k == "--json") o.json_out = v;
+        else std::cerr << "unknown option " << k << "\n";
+    }
+    return o;
+}
+
+// --- Caches under test --- //
+
+// A lookup: true if `user_id` was served (from a cache or the database)
+using Lookup = std::function<bool(const std::string& user_id, StoreSession& session, uint64_t& sink)>;
+
+static void consume(const UserSettings& s, uint64_t& sink) {
+    sink += s.dark_mode + s.language.size() + s.updated_at.size();
+}
+
+// The lock-based caches the epoch cache replaces, filled and updated the same way
+template <typename Mutex, typename ReadLock>
+class MapCache {
+public:
+    bool read(const std::string& user_id, uint64_t& sink) {
+        std::shared_ptr<const UserSettings> entry;
+        {
+            ReadLock lock(mutex_);
+            auto it = map_.find(user_id);
+            if (it == map_.end()) return false;
+            entry = it->second;
+        }
+        consume(*entry, sink);
+        return true;
+    }
+
+    void put(const UserSettings& s) {
+        auto entry = std::make_shared<const UserSettings>(s);
+        std::lock_guard<Mutex> lock(mutex_);
+        map_[s.user_id] = std::move(entry);
+    }
+
+private:
+    Mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const UserSettings>> map_;
+};
+
+using MutexCache = MapCache<std::mutex, std::lock_guard<std::mutex>>;
+using SharedCache = MapCache<std::shared_mutex, std::shared_lock<std::shared_mutex>>;
+
+// --- Runs --- //
+
+struct Result {
+    std::string mode;
+    int threads = 0;
+    uint64_t lookups = 0;
+    uint64_t misses = 0;  // cache misses served from the database
+    uint64_t writes = 0;
+    double seconds = 0;
+
+    double mops() const { return static_cast<double>(lookups) / seconds / 1e6; }
+};
+
+static uint64_t next_random(uint64_t& x) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x;
+}
+
+// `threads` readers calling `lookup` for --millis while `write` runs --writes
+// times a second on its own thread
+static Result run(const Options& o, LumaStore& store, const std::vector<std::string>& users, const std::string& mode,
+                  int threads, const Lookup& lookup, const std::function<bool(StoreSession&, const std::string&)>& write) {
+    Result r;
+    r.mode = mode;
+    r.threads = threads;
+    std::vector<std::unique_ptr<StoreSession>> sessions;
+    for (int t = 0; t <= threads; t++) {
+        std::string error;
+        sessions.push_back(store.open_session(&error));
+        if (!sessions.back()) {
+            std::cerr << "cannot open " << o.db << ": " << error << "\n";
+            std::exit(2);
+        }
+    }
+
+    std::atomic<bool> go{false}, stop{false};
+    std::atomic<uint64_t> lookups{0}, misses{0}, writes{0};
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++) {
+        pool.emplace_back([&, t] {
+            uint64_t x = 0x9E3779B97F4A7C15ull * static_cast<uint64_t>(t + 1), sink = 0, n = 0, missed = 0;
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (int i = 0; i < 64; i++) {
+                    if (!lookup(users[next_random(x) % users.size()], *sessions[t], sink)) missed++;
+                }
+                n += 64;
+            }
+            lookups += n;
+            misses += missed;
+            if (sink == 1) std::printf(" ");  // keep the reads
+        });
+    }
+    if (o.writes > 0) {
+        pool.emplace_back([&] {
+            uint64_t x = 0xD1B54A32D192ED03ull;
+            auto interval = std::chrono::duration<double>(1.0 / o.writes);
+            auto next = std::chrono::steady_clock::now();
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (write(*sessions[threads], users[next_random(x) % users.size()])) writes++;
+                next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval);
+                std::this_thread::sleep_until(next);
+            }
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(o.millis));
+    stop = true;
+    for (auto& t : pool) t.join();
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    r.lookups = lookups;
+    r.misses = misses;
+    r.writes = writes;
+    return r;
+}
+
+static bool same(const UserSettings& a, const UserSettings& b) {
+    return a.user_id == b.user_id && a.name == b.name && a.email == b.email && a.avatar_url == b.avatar_url &&
+           a.theme_mode == b.theme_mode && a.dark_mode == b.dark_mode &&
+           a.notifications_enabled == b.notifications_enabled && a.chat_notifications == b.chat_notifications &&
+           a.update_notifications == b.update_notifications && a.reminder_notifications == b.reminder_notifications &&
+           a.language == b.language && a.biometric_lock == b.biometric_lock && a.app_version == b.app_version &&
+           a.updated_at == b.updated_at;
+}
+
+int main(int argc, char** argv) {
+    Options o = parse_args(argc, argv);
+
+    StoreOptions cached_options;
+    cached_options.settings_cache_slots = o.users * 2;
+    LumaStore cached(o.db, cached_options);
+    LumaStore plain(o.db);
+    std::string error;
+    std::unique_ptr<StoreSession> setup;
+    if (cached.init(&error)) setup = cached.open_session(&error);
+    if (!setup) {
+        std::cerr << "cannot open " << o.db << ": " << error << "\n";
+        return 2;
+    }
+
+    // Create the users if needed and warm the caches
+    std::vector<std::string> users;
+    MutexCache mutex_cache;
+    SharedCache shared_cache;
+    for (size_t i = 0; i < o.users; i++) {
+        users.push_back("cache-bench-" + std::to_string(i));
+        UserSettings s;
+        if (!setup->get_settings(users.back(), s)) {
+            std::cerr << "get_settings: " << setup->error() << "\n";
+            return 2;
+        }
+        mutex_cache.put(s);
+        shared_cache.put(s);
+    }
+
+    // The store update GET /settings readers race with: flip dark_mode
+    auto update = [](StoreSession& session, const std::string& user_id, UserSettings* readback) {
+        UserSettings s;
+        if (!session.get_settings(user_id, s)) return false;
+        SettingsUpdate u;
+        u.dark_mode = !s.dark_mode;
+        return session.update_settings(user_id, u) && (!readback || session.get_settings(user_id, *readback));
+    };
+    auto epoch_write = [&](StoreSession& session, const std::string& user_id) {
+        return update(session, user_id, nullptr);
+    };
+    auto epoch_lookup = [&](const std::string& user_id, StoreSession& session, uint64_t& sink) {
+        if (cached.read_cached_settings(user_id, [&](const UserSettings& s) { consume(s, sink); })) return true;
+        UserSettings s;
+        session.get_settings(user_id, s);
+        consume(s, sink);
+        return false;
+    };
+    auto map_write = [&](auto& cache) {
+        return [c = &cache, &update](StoreSession& session, const std::string& user_id) {
+            UserSettings s;
+            if (!update(session, user_id, &s)) return false;
+            c->put(s);
+            return true;
+        };
+    };
+    auto map_lookup = [](auto& cache) {
+        return [c = &cache](const std::string& user_id, StoreSession&, uint64_t& sink) {
+            return c->read(user_id, sink);
+        };
+    };
+    auto sqlite_lookup = [](const std::string& user_id, StoreSession& session, uint64_t& sink) {
+        UserSettings s;
+        bool ok = session.get_settings(user_id, s);
+        consume(s, sink);
+        return ok;
+    };
+
+    std::printf("%zu users, %d writes/s, %.0f ms per run, %u hardware threads\n\n", o.users, o.writes, o.millis,
+                std::thread::hardware_concurrency());
+    std::printf("%-8s %8s %12s %14s %10s %10s %8s\n", "mode", "threads", "Mlookups/s", "per thread", "scaling",
+                "misses", "writes");
+
+    std::vector<Result> results;
+    size_t cached_entries = 0, stale = 0;
+    for (const char* mode : {"epoch", "mutex", "shared", "sqlite"}) {
+        std::string m = mode;
+        double base = 0;
+        for (int threads : o.threads) {
+            Result r;
+            if (m == "epoch") r = run(o, cached, users, m, threads, epoch_lookup, epoch_write);
+            else if (m == "mutex") r = run(o, plain, users, m, threads, map_lookup(mutex_cache), map_write(mutex_cache));
+            else if (m == "shared") r = run(o, plain, users, m, threads, map_lookup(shared_cache), map_write(shared_cache));
+            else r = run(o, plain, users, m, threads, sqlite_lookup, epoch_write);
+            if (base == 0) base = r.mops() / threads;
+            std::printf("%-8s %8d %12.2f %14.3f %9.2fx %10llu %8llu\n", r.mode.c_str(), r.threads, r.mops(),
+                        r.mops() / threads, r.mops() / base, static_cast<unsigned long long>(r.misses),
+                        static_cast<unsigned long long>(r.writes));
+            results.push_back(r);
+        }
+        if (m != "epoch") continue;
+
+        // Every cached entry must match its row (checked before the other
+        // modes write through `plain`, which bypasses the cache)
+        std::unique_ptr<StoreSession> check = plain.open_session(&error);
+        for (const auto& user_id : users) {
+            UserSettings from_cache, from_db;
+            if (!cached.read_cached_settings(user_id, [&](const UserSettings& s) { from_cache = s; })) continue;
+            cached_entries++;
+            if (!check || !check->get_settings(user_id, from_db) || !same(from_cache, from_db)) stale++;
+        }
+    }
+
+    SettingsCacheStats stats = cached.settings_cache_stats();
+    std::printf("\nepoch cache: %zu/%zu users cached, %zu stale; %llu publishes, %llu fills, epoch %llu, "
+                "%llu of %llu retired objects reclaimed\n",
+                cached_entries, users.size(), stale, static_cast<unsigned long long>(stats.publishes),
+                static_cast<unsigned long long>(stats.fills), static_cast<unsigned long long>(stats.epoch),
+                static_cast<unsigned long long>(stats.reclaimed), static_cast<unsigned long long>(stats.retired));
+    std::printf("(scaling: throughput over the per-thread rate of the first run; ideal is the thread count)\n");
+
+    if (!o.json_out.empty()) {
+        json out = {{"tool", "cache_bench"}, {"users", o.users}, {"writes_per_second", o.writes},
+                    {"cached_entries", cached_entries}, {"stale", stale}};
+        for (const auto& r : results) {
+            out["modes"][r.mode][std::to_string(r.threads)] = {
+                    {"mlookups_per_second", r.mops()},
+                    {"misses", r.misses},
+                    {"writes", r.writes}
+            };
+        }
+        std::ofstream f(o.json_out);
+        f << out.dump(2) << "\n";
+    }
+    return stale ? 1 : 0;
+}
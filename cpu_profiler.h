@@ -0,0 +1,234 @@
+// cpu_profiler.h
+//
+// In-process sampling CPU profiler (Linux)
+// - threads that should be profiled call CpuProfiler::register_thread() once
+// - profile() arms a per-thread CPU-time timer (timer_create on the thread's
+//   CPU clock, delivered as SIGPROF to that thread only), so every registered
+//   thread is sampled in proportion to the CPU it burns
+// - the SIGPROF handler only captures a backtrace into a preallocated slot;
+//   symbolization and folding happen after the timers are disarmed and every
+//   handler still running has left (counted in in_flight_)
+// - the handler stays installed once set: a SIGPROF already queued when the
+//   timers are deleted is ignored instead of taking the default action, which
+//   terminates the process
+// - output is "folded stacks" (thread;root;...;leaf count per line), the input
+//   format of flamegraph.pl / speedscope / inferno
+//
+// Link with -rdynamic so dladdr() can name functions in the main binary.
+// backtrace() is primed once before any signal so that the handler never
+// triggers libgcc's lazy loading.
+
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "lock_profiler.h"
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+class CpuProfiler {
+public:
+    static const int MAX_FRAMES = 48;
+    static constexpr size_t MAX_SAMPLES = 20000;
+
+    static CpuProfiler& instance() {
+        static CpuProfiler profiler;
+        return profiler;
+    }
+
+    // Make the calling thread profilable. `name` must outlive the process
+    // (a string literal); it becomes the root frame of the thread's stacks.
+    void register_thread(const char* name) {
+        if (thread_index() >= 0) return;
+        ThreadInfo info;
+        info.name = name;
+        info.tid = static_cast<pid_t>(syscall(SYS_gettid));
+        if (pthread_getcpuclockid(pthread_self(), &info.clock) != 0) return;
+        ProfiledLock lock(threads_mutex_, "CpuProfiler::register_thread");
+        thread_index() = static_cast<int>(threads_.size());
+        threads_.push_back(info);
+    }
+
+    bool busy() const { return running_.load(); }
+
+    // Sample all registered threads for `duration` at `hz` samples per second
+    // of thread CPU time and return folded stacks. Returns false if another
+    // profile is already running.
+    bool profile(std::chrono::seconds duration, int hz, std::string& folded, size_t& samples_taken) {
+        bool expected = false;
+        if (!running_.compare_exchange_strong(expected, true)) return false;
+
+        std::vector<ThreadInfo> threads;
+        {
+            ProfiledLock lock(threads_mutex_, "CpuProfiler::profile");
+            threads = threads_;
+        }
+
+        samples_.assign(MAX_SAMPLES, Sample{});
+        next_sample_.store(0);
+        active_.store(this);
+
+        if (!handler_installed_) {
+            struct sigaction action {};
+            action.sa_sigaction = &CpuProfiler::on_sigprof;
+            action.sa_flags = SA_SIGINFO | SA_RESTART;
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGPROF, &action, nullptr);
+            handler_installed_ = true;
+        }
+
+        long interval_ns = 1000000000L / (hz > 0 ? hz : 1);
+        std::vector<timer_t> timers;
+        for (const auto& t : threads) {
+            sigevent sev{};
+            sev.sigev_notify = SIGEV_THREAD_ID;
+            sev.sigev_signo = SIGPROF;
+            sev.sigev_notify_thread_id = t.tid;
+            timer_t timer;
+            if (timer_create(t.clock, &sev, &timer) != 0) continue;  // thread gone
+            itimerspec spec{};
+            spec.it_interval.tv_nsec = interval_ns % 1000000000L;
+            spec.it_interval.tv_sec = interval_ns / 1000000000L;
+            spec.it_value = spec.it_interval;
+            timer_settime(timer, 0, &spec, nullptr);
+            timers.push_back(timer);
+        }
+
+        std::this_thread::sleep_for(duration);
+
+        for (auto timer : timers) timer_delete(timer);
+        // Handlers that start from here on see nullptr; wait out the ones
+        // that may already have loaded `this` before touching samples_
+        active_.store(nullptr);
+        while (in_flight_.load() != 0) std::this_thread::yield();
+
+        samples_taken = std::min(next_sample_.load(), MAX_SAMPLES);
+        folded = fold(threads, samples_taken);
+        samples_.clear();
+        samples_.shrink_to_fit();
+        running_.store(false);
+        return true;
+    }
+
+    // Function name (demangled) or module+offset for a code address
+    static std::string symbolize(void* addr) {
+        Dl_info info{};
+        if (!dladdr(addr, &info)) info = Dl_info{};
+        if (info.dli_sname) {
+            int status = 0;
+            char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            std::string name = status == 0 && demangled ? demangled : info.dli_sname;
+            std::free(demangled);
+            return name;
+        }
+        if (info.dli_fname) {
+            const char* base = std::strrchr(info.dli_fname, '/');
+            char offset[32];
+            std::snprintf(offset, sizeof(offset), "+0x%lx",
+                          static_cast<unsigned long>(static_cast<char*>(addr) - static_cast<char*>(info.dli_fbase)));
+            return std::string(base ? base + 1 : info.dli_fname) + offset;
+        }
+        char raw[32];
+        std::snprintf(raw, sizeof(raw), "%p", addr);
+        return raw;
+    }
+
+private:
+    struct ThreadInfo {
+        const char* name = nullptr;
+        pid_t tid = 0;
+        clockid_t clock{};
+    };
+
+    struct Sample {
+        int thread = -1;
+        int depth = 0;
+        void* frames[MAX_FRAMES];
+    };
+
+    CpuProfiler() {
+        void* warmup[4];
+        backtrace(warmup, 4);
+    }
+
+    static int& thread_index() {
+        thread_local int index = -1;
+        return index;
+    }
+
+    // in_flight_ is raised before active_ is read (both seq_cst), so once
+    // profile() has cleared active_ and seen in_flight_ at 0, no handler can
+    // still reach samples_
+    static void on_sigprof(int, siginfo_t*, void*) {
+        int saved_errno = errno;
+        in_flight_.fetch_add(1);
+        CpuProfiler* self = active_.load();
+        if (self) {
+            size_t slot = self->next_sample_.fetch_add(1, std::memory_order_relaxed);
+            if (slot < self->samples_.size()) {
+                Sample& s = self->samples_[slot];
+                s.depth = backtrace(s.frames, MAX_FRAMES);
+                s.thread = thread_index();
+            }
+        }
+        in_flight_.fetch_sub(1, std::memory_order_release);
+        errno = saved_errno;
+    }
+
+    std::string fold(const std::vector<ThreadInfo>& threads, size_t count) {
+        std::unordered_map<void*, std::string> names;
+        std::map<std::string, size_t> stacks;
+        for (size_t i = 0; i < count; i++) {
+            const Sample& s = samples_[i];
+            std::string stack = s.thread >= 0 && s.thread < static_cast<int>(threads.size())
+                                        ? threads[s.thread].name : "unknown";
+            // frames[0] is the handler, frames[1] the signal trampoline
+            for (int f = s.depth - 1; f >= 2; f--) {
+                void* pc = s.frames[f];
+                auto it = names.find(pc);
+                if (it == names.end()) {
+                    // return addresses point after the call; look up the call itself
+                    std::string name = symbolize(static_cast<char*>(pc) - 1);
+                    for (auto& c : name) if (c == ';' || c == ' ') c = '_';
+                    it = names.emplace(pc, name).first;
+                }
+                stack += ';';
+                stack += it->second;
+            }
+            stacks[stack]++;
+        }
+        std::string out;
+        for (const auto& kv : stacks) out += kv.first + " " + std::to_string(kv.second) + "\n";
+        return out;
+    }
+
+    ProfiledMutex threads_mutex_{"cpu_profiler_threads"};
+    std::vector<ThreadInfo> threads_;
+    std::vector<Sample> samples_;
+    std::atomic<size_t> next_sample_{0};
+    std::atomic<bool> running_{false};
+    bool handler_installed_ = false;  // only touched by the running profile()
+    static inline std::atomic<CpuProfiler*> active_{nullptr};  // set while timers are armed
+    static inline std::atomic<int> in_flight_{0};  // SIGPROF handlers currently running
+};
@@ -0,0 +1,342 @@
+// datagen.cpp
+//
+// Synthetic luma_settings.db generator for benchmarks
+// - same schema as the server (schema.h)
+// - users get profiles and settings drawn from fixed distributions (theme,
+//   language, notification toggles, app version, ...)
+// - messages per user follow a Zipf law over a random popularity rank: a few
+//   users have --max-messages, most have few or none
+// - message lengths are log-normal, bot replies longer than user messages
+// - every user's data comes from an RNG seeded by (--seed, user index), and
+//   shards are merged in user order, so the output depends only on the
+//   options, not on --threads (with the same standard library)
+//
+// Each thread fills a shard database for a contiguous range of users with
+// journaling off and large transactions; the shards are then attached and
+// copied into the target in order.
+//
+// Usage:
+//   datagen [--db PATH] [--users N] [--max-messages N] [--zipf S]
+//           [--seed N] [--threads N] [--batch N] [--epoch UNIX_SECS] [--overwrite]
+// Timestamps fall in the two years before --epoch (default 2025-01-01).
+//
+// Build (example):
+// g++ datagen.cpp -std=c++17 -O2 -lsqlite3 -pthread -o datagen
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+
+#include <sqlite3.h>
+
+#include "schema.h"
+
+struct Options {
+    std::string db = "luma_settings.db";
+    int64_t users = 1000000;
+    int64_t max_messages = 5000;  // messages of the most active user
+    double zipf = 1.1;            // exponent of messages-per-user
+    uint64_t seed = 42;
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int64_t batch = 20000;        // rows per transaction in the shards
+    bool overwrite = false;
+    std::time_t epoch = 1735689600;  // "now" for generated timestamps (2025-01-01)
+};
+
+static Options parse_args(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i < argc; i++) {
+        std::string k = argv[i];
+        if (k == "--overwrite") { o.overwrite = true; continue; }
+        if (i + 1 >= argc) { std::cerr << "missing value for " << k << "\n"; std::exit(2); }
+        const char* v = argv[++i];
+        if (k == "--db") o.db = v;
+        else if (k == "--users") o.users = std::atoll(v);
+        else if (k == "--max-messages") o.max_messages = std::atoll(v);
+        else if (k == "--zipf") o.zipf = std::atof(v);
+        else if (k == "--seed") o.seed = std::strtoull(v, nullptr, 10);
+        else if (k == "--threads") o.threads = std::max(1, std::atoi(v));
+        else if (k == "--batch") o.batch = std::max<int64_t>(1, std::atoll(v));
+        else if (k == "--epoch") o.epoch = static_cast<std::time_t>(std::atoll(v));
+        else { std::cerr << "unknown option " << k << "\n"; std::exit(2); }
+    }
+    return o;
+}
+
+static uint64_t splitmix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+static bool exec(sqlite3* db, const char* sql) {
+    char* err = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &err) == SQLITE_OK) return true;
+    std::cerr << "sqlite: " << (err ? err : "?") << " in: " << sql << "\n";
+    sqlite3_free(err);
+    return false;
+}
+
+template <typename T>
+static const T& pick(std::mt19937_64& rng, const std::vector<std::pair<T, double>>& weighted) {
+    double total = 0;
+    for (const auto& w : weighted) total += w.second;
+    double x = std::uniform_real_distribution<double>(0, total)(rng);
+    for (const auto& w : weighted) {
+        if ((x -= w.second) < 0) return w.first;
+    }
+    return weighted.back().first;
+}
+
+static std::string iso(std::time_t t) {
+    std::tm tm{};
+    gmtime_r(&t, &tm);
+    char buf[32];
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    return buf;
+}
+
+static const std::vector<std::string> FIRST = {"Ada", "Ben", "Chen", "Dana", "Eli", "Fatima", "Gus", "Hana", "Ivan",
+                                               "Jia", "Kofi", "Lena", "Mo", "Nia", "Omar", "Priya", "Quinn", "Rosa",
+                                               "Sam", "Tara", "Uma", "Vik", "Wen", "Yusuf", "Zoe"};
+static const std::vector<std::string> LAST = {"Kim", "Patel", "Garcia", "Nguyen", "Smith", "Okafor", "Rossi",
+                                              "Muller", "Sato", "Silva", "Cohen", "Novak", "Haddad", "Larsen"};
+static const std::vector<std::string> WORDS = {
+        "the", "a", "to", "and", "you", "I", "is", "it", "what", "can", "set", "timer", "for", "minutes", "light",
+        "turn", "on", "off", "weather", "today", "tomorrow", "play", "music", "remind", "me", "call", "time", "is",
+        "please", "thanks", "kitchen", "bedroom", "volume", "up", "down", "news", "how", "are", "doing", "sure",
+        "okay", "done", "here", "your", "alarm", "at", "seven", "morning", "evening", "temperature", "degrees"};
+
+// Space-separated words until about `length` characters
+static std::string sentence(std::mt19937_64& rng, size_t length) {
+    std::uniform_int_distribution<size_t> word(0, WORDS.size() - 1);
+    std::string out;
+    out.reserve(length + 16);
+    while (out.size() < length) {
+        if (!out.empty()) out += ' ';
+        out += WORDS[word(rng)];
+    }
+    return out;
+}
+
+// Number of messages of the user with popularity rank `rank` (1 = most active)
+static int64_t messages_for_rank(const Options& o, int64_t rank) {
+    return static_cast<int64_t>(std::floor(static_cast<double>(o.max_messages) / std::pow(static_cast<double>(rank), o.zipf)));
+}
+
+struct ShardStats {
+    int64_t users = 0;
+    int64_t messages = 0;
+};
+
+// Fill one shard with users [from, to)
+static bool fill_shard(const Options& o, const std::string& path, int64_t from, int64_t to,
+                       const std::vector<int64_t>& rank, ShardStats& stats, std::atomic<int64_t>& progress) {
+    std::remove(path.c_str());
+    sqlite3* db = nullptr;
+    if (sqlite3_open(path.c_str(), &db) != SQLITE_OK) return false;
+    exec(db, "PRAGMA journal_mode=OFF;");
+    exec(db, "PRAGMA synchronous=OFF;");
+    for (const char* sql : SCHEMA_STATEMENTS) exec(db, sql);
+
+    sqlite3_stmt* user_stmt = nullptr;
+    sqlite3_stmt* settings_stmt = nullptr;
+    sqlite3_stmt* message_stmt = nullptr;
+    sqlite3_prepare_v2(db, "INSERT INTO users(user_id, name, email, avatar_url, created_at) VALUES(?, ?, ?, ?, ?);",
+                       -1, &user_stmt, 0);
+    sqlite3_prepare_v2(db, "INSERT INTO settings(user_id, theme_mode, dark_mode, notifications_enabled, "
+                           "chat_notifications, update_notifications, reminder_notifications, language, "
+                           "biometric_lock, app_version, updated_at) VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
+                       -1, &settings_stmt, 0);
+    sqlite3_prepare_v2(db, "INSERT INTO chat_history(user_id, role, message, created_at) VALUES(?, ?, ?, ?);",
+                       -1, &message_stmt, 0);
+
+    static const std::vector<std::pair<std::string, double>> themes = {{"System", 60}, {"Light", 15}, {"Dark", 25}};
+    static const std::vector<std::pair<std::string, double>> languages = {
+            {"English", 55}, {"Spanish", 10}, {"Hindi", 8}, {"German", 8}, {"French", 7}, {"Portuguese", 5},
+            {"Japanese", 4}, {"Arabic", 3}};
+    static const std::vector<std::pair<std::string, double>> versions = {
+            {"1.0.0", 5}, {"1.1.0", 10}, {"1.2.0", 20}, {"1.2.1", 45}, {"1.3.0-beta", 20}};
+    const std::time_t now = o.epoch;
+    const std::time_t two_years = 2 * 365 * 86400;
+
+    int64_t in_txn = 0;
+    exec(db, "BEGIN;");
+    auto row_done = [&]() {
+        if (++in_txn < o.batch) return;
+        exec(db, "COMMIT;");
+        exec(db, "BEGIN;");
+        in_txn = 0;
+    };
+
+    for (int64_t i = from; i < to; i++) {
+        std::mt19937_64 rng(splitmix(o.seed ^ splitmix(static_cast<uint64_t>(i))));
+        std::uniform_real_distribution<double> coin(0, 1);
+        std::string user_id = "user-" + std::to_string(i);
+        const std::string& first = FIRST[rng() % FIRST.size()];
+        const std::string& last = LAST[rng() % LAST.size()];
+        std::string email = first + "." + last + std::to_string(i) + "@example.com";
+        std::transform(email.begin(), email.end(), email.begin(), [](unsigned char c) { return std::tolower(c); });
+        std::time_t created = now - static_cast<std::time_t>(rng() % two_years);
+
+        sqlite3_bind_text(user_stmt, 1, user_id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(user_stmt, 2, (first + " " + last).c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(user_stmt, 3, email.c_str(), -1, SQLITE_TRANSIENT);
+        if (coin(rng) < 0.4) {
+            std::string avatar = "https://cdn.example.com/avatars/" + std::to_string(i) + ".png";
+            sqlite3_bind_text(user_stmt, 4, avatar.c_str(), -1, SQLITE_TRANSIENT);
+        } else {
+            sqlite3_bind_null(user_stmt, 4);
+        }
+        sqlite3_bind_text(user_stmt, 5, iso(created).c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_step(user_stmt);
+        sqlite3_reset(user_stmt);
+        row_done();
+
+        const std::string& theme = pick(rng, themes);
+        bool notifications = coin(rng) < 0.85;
+        sqlite3_bind_text(settings_stmt, 1, user_id.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(settings_stmt, 2, theme.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(settings_stmt, 3, theme == "Dark" ? 1 : 0);
+        sqlite3_bind_int(settings_stmt, 4, notifications ? 1 : 0);
+        sqlite3_bind_int(settings_stmt, 5, notifications && coin(rng) < 0.8 ? 1 : 0);
+        sqlite3_bind_int(settings_stmt, 6, notifications && coin(rng) < 0.6 ? 1 : 0);
+        sqlite3_bind_int(settings_stmt, 7, notifications && coin(rng) < 0.2 ? 1 : 0);
+        sqlite3_bind_text(settings_stmt, 8, pick(rng, languages).c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(settings_stmt, 9, coin(rng) < 0.3 ? 1 : 0);
+        sqlite3_bind_text(settings_stmt, 10, pick(rng, versions).c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(settings_stmt, 11, iso(created + static_cast<std::time_t>(rng() % (now - created + 1))).c_str(),
+                          -1, SQLITE_TRANSIENT);
+        sqlite3_step(settings_stmt);
+        sqlite3_reset(settings_stmt);
+        row_done();
+
+        // conversation: alternating user/bot turns, minutes apart, after sign-up
+        int64_t count = messages_for_rank(o, rank[i]);
+        std::lognormal_distribution<double> user_len(std::log(40.0), 0.8);
+        std::lognormal_distribution<double> bot_len(std::log(90.0), 0.9);
+        std::exponential_distribution<double> gap(1.0 / 600.0);  // mean 10 minutes
+        std::time_t at = created;
+        for (int64_t m = 0; m < count; m++) {
+            bool bot = m % 2 == 1;
+            size_t len = static_cast<size_t>(std::min(4000.0, std::max(2.0, bot ? bot_len(rng) : user_len(rng))));
+            at += static_cast<std::time_t>(gap(rng));
+            std::string text = sentence(rng, len);
+            sqlite3_bind_text(message_stmt, 1, user_id.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(message_stmt, 2, bot ? "bot" : "user", -1, SQLITE_STATIC);
+            sqlite3_bind_text(message_stmt, 3, text.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(message_stmt, 4, iso(std::min(at, now)).c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_step(message_stmt);
+            sqlite3_reset(message_stmt);
+            row_done();
+        }
+        stats.users++;
+        stats.messages += count;
+        progress++;
+    }
+    exec(db, "COMMIT;");
+    sqlite3_finalize(user_stmt);
+    sqlite3_finalize(settings_stmt);
+    sqlite3_finalize(message_stmt);
+    return sqlite3_close(db) == SQLITE_OK;
+}
+
+int main(int argc, char** argv) {
+    Options o = parse_args(argc, argv);
+    auto t0 = std::chrono::steady_clock::now();
+
+    sqlite3* db = nullptr;
+    if (o.overwrite) {
+        for (const char* suffix : {"", "-wal", "-shm"}) std::remove((o.db + suffix).c_str());
+    }
+    if (sqlite3_open(o.db.c_str(), &db) != SQLITE_OK) {
+        std::cerr << "cannot open " << o.db << "\n";
+        return 1;
+    }
+    for (const char* sql : SCHEMA_STATEMENTS) exec(db, sql);
+    sqlite3_stmt* check = nullptr;
+    bool empty = true;
+    if (sqlite3_prepare_v2(db, "SELECT 1 FROM users LIMIT 1;", -1, &check, 0) == SQLITE_OK) {
+        empty = sqlite3_step(check) != SQLITE_ROW;
+    }
+    sqlite3_finalize(check);
+    if (!empty) {
+        std::cerr << o.db << " already has users; use --overwrite to start from scratch\n";
+        sqlite3_close(db);
+        return 1;
+    }
+
+    // popularity rank of every user: a seeded permutation of 1..N
+    std::vector<int64_t> rank(static_cast<size_t>(o.users));
+    std::iota(rank.begin(), rank.end(), 1);
+    std::shuffle(rank.begin(), rank.end(), std::mt19937_64(splitmix(o.seed)));
+
+    int threads = static_cast<int>(std::min<int64_t>(o.threads, std::max<int64_t>(1, o.users)));
+    std::vector<std::string> shards;
+    std::vector<ShardStats> stats(threads);
+    std::vector<std::thread> workers;
+    std::atomic<int64_t> progress{0};
+    std::atomic<bool> failed{false};
+    for (int t = 0; t < threads; t++) {
+        int64_t from = o.users * t / threads;
+        int64_t to = o.users * (t + 1) / threads;
+        shards.push_back(o.db + ".shard" + std::to_string(t));
+        workers.emplace_back([&, t, from, to] {
+            if (!fill_shard(o, shards[t], from, to, rank, stats[t], progress)) failed = true;
+        });
+    }
+    while (progress < o.users && !failed) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        std::printf("\rgenerating: %lld / %lld users", static_cast<long long>(progress.load()),
+                    static_cast<long long>(o.users));
+        std::fflush(stdout);
+    }
+    for (auto& w : workers) w.join();
+    std::printf("\n");
+    if (failed) {
+        std::cerr << "shard generation failed\n";
+        return 1;
+    }
+
+    // merge shards in user order (chat_history ids follow)
+    exec(db, "PRAGMA journal_mode=WAL;");
+    for (int t = 0; t < threads; t++) {
+        std::string attach = "ATTACH DATABASE '" + shards[t] + "' AS shard;";
+        if (!exec(db, attach.c_str())) return 1;
+        exec(db, "BEGIN;");
+        exec(db, "INSERT INTO users SELECT * FROM shard.users;");
+        exec(db, "INSERT INTO settings SELECT * FROM shard.settings;");
+        exec(db, "INSERT INTO chat_history(user_id, role, message, created_at) "
+                 "SELECT user_id, role, message, created_at FROM shard.chat_history ORDER BY id;");
+        exec(db, "COMMIT;");
+        exec(db, "DETACH DATABASE shard;");
+        std::remove(shards[t].c_str());
+        std::printf("\rmerging: %d / %d shards", t + 1, threads);
+        std::fflush(stdout);
+    }
+    exec(db, "PRAGMA wal_checkpoint(TRUNCATE);");
+    sqlite3_close(db);
+
+    int64_t users = 0, messages = 0;
+    for (const auto& s : stats) {
+        users += s.users;
+        messages += s.messages;
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::printf("\n%s: %lld users, %lld messages (seed %llu, zipf %.2f, max %lld/user) in %.1f s\n", o.db.c_str(),
+                static_cast<long long>(users), static_cast<long long>(messages),
+                static_cast<unsigned long long>(o.seed), o.zipf, static_cast<long long>(o.max_messages), secs);
+    return 0;
+}
@@ -0,0 +1,142 @@
+// epoch.h
+//
+// Epoch-based memory reclamation for lock-free readers
+// - a reader pin()s the current epoch for the duration of a lookup: one
+//   compare-and-swap on a reader slot of its own cache line, no lock and no
+//   write to memory other readers touch
+// - a writer unlinks an object (e.g. swaps a new immutable version into an
+//   atomic pointer) and retire()s the old one; it is deleted once every
+//   reader pinned at that time has left, i.e. two epoch advances later
+// - the epoch advances when every pinned reader has seen the current one,
+//   tried on each retire(); a long pin delays reclamation but never blocks
+//   a reader or a writer
+// - pointers a pin protects must be published and loaded seq_cst (a plain
+//   load on x86), so a retire() that follows an unlink sees every reader
+//   that could still hold the old pointer
+//
+//   EpochDomain epochs;
+//   std::atomic<const Node*> head;
+//   {
+//       auto pin = epochs.pin();
+//       if (const Node* n = head.load()) use(*n);
+//   }
+//   epochs.retire(head.exchange(new Node(...)));  // writer
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "lock_profiler.h"
+
+class EpochDomain {
+public:
+    // Readers pinned at once; more wait for a slot to come free
+    static const size_t READER_SLOTS = 256;
+
+    EpochDomain() : retire_mutex_("epoch_retire") {}
+    ~EpochDomain() {
+        for (auto& r : retired_) r.deleter(r.object);
+    }
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    // Keeps the epoch pinned; objects retired meanwhile stay alive until it
+    // is destroyed
+    class Guard {
+    public:
+        Guard(Guard&& o) noexcept : slot_(o.slot_) { o.slot_ = nullptr; }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        ~Guard() {
+            if (slot_) slot_->store(IDLE, std::memory_order_release);
+        }
+
+    private:
+        friend class EpochDomain;
+        explicit Guard(std::atomic<uint64_t>* slot) : slot_(slot) {}
+        std::atomic<uint64_t>* slot_;
+    };
+
+    Guard pin() {
+        thread_local size_t hint = std::hash<std::thread::id>()(std::this_thread::get_id());
+        for (size_t tries = 0;; tries++) {
+            ReaderSlot& slot = readers_[hint % READER_SLOTS];
+            uint64_t idle = IDLE;
+            if (slot.epoch.load(std::memory_order_relaxed) == IDLE &&
+                slot.epoch.compare_exchange_strong(idle, epoch_.load())) {
+                return Guard(&slot.epoch);
+            }
+            hint++;
+            if (tries % READER_SLOTS == READER_SLOTS - 1) std::this_thread::yield();
+        }
+    }
+
+    // Deletes `object` once no reader can still see it. Call after unlinking it.
+    template <typename T>
+    void retire(const T* object) {
+        if (!object) return;
+        retire(const_cast<T*>(object), [](void* p) { delete static_cast<T*>(p); });
+    }
+
+    void retire(void* object, void (*deleter)(void*)) {
+        std::vector<Retired> ready;
+        {
+            ProfiledLock lock(retire_mutex_, "EpochDomain::retire");
+            retired_.push_back({epoch_.load(), object, deleter});
+            retired_total_++;
+            uint64_t epoch = try_advance();
+            auto keep = retired_.begin();
+            for (auto it = retired_.begin(); it != retired_.end(); ++it) {
+                if (it->epoch + 2 <= epoch) ready.push_back(*it);
+                else *keep++ = *it;
+            }
+            retired_.erase(keep, retired_.end());
+            reclaimed_total_ += ready.size();
+        }
+        for (auto& r : ready) r.deleter(r.object);
+    }
+
+    uint64_t epoch() const { return epoch_.load(std::memory_order_relaxed); }
+
+    // Objects retired and not yet deleted, and totals since start
+    size_t pending() {
+        ProfiledLock lock(retire_mutex_, "EpochDomain::pending");
+        return retired_.size();
+    }
+    uint64_t retired_total() const { return retired_total_.load(std::memory_order_relaxed); }
+    uint64_t reclaimed_total() const { return reclaimed_total_.load(std::memory_order_relaxed); }
+
+private:
+    static const uint64_t IDLE = 0;  // epochs start at 1
+
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch{IDLE};
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        void* object;
+        void (*deleter)(void*);
+    };
+
+    // The epoch after advancing it, if every pinned reader is in the current one
+    uint64_t try_advance() {
+        uint64_t epoch = epoch_.load();
+        for (const auto& slot : readers_) {
+            uint64_t pinned = slot.epoch.load();
+            if (pinned != IDLE && pinned != epoch) return epoch;
+        }
+        return epoch_.compare_exchange_strong(epoch, epoch + 1) ? epoch + 1 : epoch;
+    }
+
+    alignas(64) std::atomic<uint64_t> epoch_{1};
+    ReaderSlot readers_[READER_SLOTS];
+    ProfiledMutex retire_mutex_;
+    std::vector<Retired> retired_;
+    std::atomic<uint64_t> retired_total_{0};
+    std::atomic<uint64_t> reclaimed_total_{0};
+};
@@ -0,0 +1,671 @@
+// fleet_sim.cpp
+//
+// ESP32 fleet simulator
+// - every simulated device runs the firmware's cycle: wake, post the user's
+//   utterance (POST /history), post the bot reply (POST /history), check for
+//   settings changes (GET /settings), then sleep for an exponentially
+//   distributed think time
+// - devices are state machines multiplexed over one epoll loop with
+//   hand-written non-blocking HTTP/1.1, so one process holds thousands of
+//   connections; a device keeps its connection alive between cycles and
+//   reconnects (without counting a retry) if the server closed it meanwhile
+// - failed requests (connect errors, resets, timeouts, 429/5xx) are retried
+//   with exponential backoff and full jitter, up to --retries times
+// - Wi-Fi drops: each cycle a device may drop with --drop-prob; every
+//   --storm-every seconds a --storm-fraction of the fleet drops at once.
+//   Dropped devices come back after --outage-ms plus up to
+//   --reconnect-jitter-ms (0 = all at the same instant) and resync with
+//   GET /settings, which is what produces reconnect storms
+// - reports client-side latency per request attempt, end-to-end latency per
+//   operation (including connects, retries and backoff), and server-side
+//   latency from the Server-Timing header (see settings_server.cpp)
+//
+// Usage:
+//   fleet_sim [--host H] [--port P] [--devices N] [--duration S] [--think-ms MS]
+//             [--retries N] [--timeout-ms MS] [--drop-prob P] [--storm-every S]
+//             [--storm-fraction F] [--outage-ms MS] [--reconnect-jitter-ms MS]
+//             [--cold-start] [--seed S] [--report-sec S] [--json FILE]
+// The API key is read from LUMA_API_KEY (default: the server's dev key).
+// Raise the open file limit (ulimit -n) above --devices.
+//
+// Build (example):
+// g++ fleet_sim.cpp -std=c++17 -O2 -o fleet_sim
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include "json.hpp"      // nlohmann::json (single header)
+#include "hdr_histogram.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int devices = 1000;
+    double duration = 60;
+    double think_ms = 5000;
+    int retries = 3;
+    double timeout_ms = 5000;
+    double backoff_ms = 200;       // first retry waits up to this, doubling per attempt
+    double drop_prob = 0.01;
+    double storm_every = 0;        // seconds; 0 = no storms
+    double storm_fraction = 0.5;
+    double outage_ms = 3000;
+    double reconnect_jitter_ms = 2000;
+    bool cold_start = false;
+    uint64_t seed = 1;
+    double report_sec = 5;
+    std::string json_out;
+};
+
+enum class Step { Utterance, Reply, Settings };
+enum class State { Idle, Connecting, Sending, Receiving, Backoff, Offline };
+
+struct Device {
+    int fd = -1;
+    State state = State::Idle;
+    bool reused = false;           // the connection has already carried a response
+    bool resync = false;           // current cycle is the post-reconnect settings check
+    size_t step = 0;
+    int attempt = 0;
+    Clock::time_point op_start;
+    Clock::time_point attempt_start;
+    Clock::time_point connect_start;
+    std::string out;
+    size_t out_off = 0;
+    std::string in;
+    uint64_t timer_gen = 0;
+    std::string user;
+    std::string device_id;
+};
+
+struct RouteStats {
+    HdrHistogram client;   // one attempt: first byte sent to last byte received
+    HdrHistogram e2e;      // one operation: including connect, retries and backoff
+    HdrHistogram server;   // Server-Timing total
+    uint64_t ok = 0;
+    uint64_t failed = 0;   // gave up after all retries
+};
+
+struct Counters {
+    uint64_t connects = 0;
+    uint64_t connect_errors = 0;
+    uint64_t stale_reconnects = 0;   // keep-alive connection found closed on reuse
+    uint64_t idle_closed = 0;        // server closed an idle keep-alive connection
+    uint64_t timeouts = 0;
+    uint64_t resets = 0;
+    uint64_t bad_status = 0;
+    uint64_t retries = 0;
+    uint64_t gave_up = 0;
+    uint64_t drops = 0;              // devices taken offline (random drops + storms)
+    uint64_t interrupted = 0;        // requests in flight when the device dropped
+    uint64_t storms = 0;
+    uint64_t cycles = 0;
+    std::map<int, uint64_t> statuses;
+};
+
+static Options parse_args(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i < argc; i++) {
+        std::string k = argv[i];
+        if (k == "--cold-start") { o.cold_start = true; continue; }
+        if (i + 1 >= argc) { std::cerr << "missing value for " << k << "\n"; std::exit(2); }
+        const char* v = argv[++i];
+        if (k == "--host") o.host = v;
+        else if (k == "--port") o.port = std::atoi(v);
+        else if (k == "--devices") o.devices = std::max(1, std::atoi(v));
+        else if (k == "--duration") o.duration = std::atof(v);
+        else if (k == "--think-ms") o.think_ms = std::atof(v);
+        else if (k == "--retries") o.retries = std::atoi(v);
+        else if (k == "--timeout-ms") o.timeout_ms = std::atof(v);
+        else if (k == "--backoff-ms") o.backoff_ms = std::atof(v);
+        else if (k == "--drop-prob") o.drop_prob = std::atof(v);
+        else if (k == "--storm-every") o.storm_every = std::atof(v);
+        else if (k == "--storm-fraction") o.storm_fraction = std::atof(v);
+        else if (k == "--outage-ms") o.outage_ms = std::atof(v);
+        else if (k == "--reconnect-jitter-ms") o.reconnect_jitter_ms = std::atof(v);
+        else if (k == "--seed") o.seed = std::strtoull(v, nullptr, 10);
+        else if (k == "--report-sec") o.report_sec = std::atof(v);
+        else if (k == "--json") o.json_out = v;
+        else { std::cerr << "unknown option " << k << "\n"; std::exit(2); }
+    }
+    return o;
+}
+
+static const Step CYCLE[] = {Step::Utterance, Step::Reply, Step::Settings};
+static const Step RESYNC[] = {Step::Settings};
+
+static const char* UTTERANCES[] = {
+        "what's the weather like today", "set a timer for ten minutes", "tell me a joke",
+        "turn off the living room lights", "what time is it in Tokyo", "play some jazz",
+};
+
+class Fleet {
+public:
+    explicit Fleet(const Options& o) : o_(o), rng_(o.seed), devices_(static_cast<size_t>(o.devices)) {
+        const char* k = std::getenv("LUMA_API_KEY");
+        api_key_ = k ? k : "secret-api-key";
+        for (size_t i = 0; i < devices_.size(); i++) {
+            devices_[i].user = "esp32-user-" + std::to_string(i);
+            devices_[i].device_id = "esp32-" + std::to_string(i);
+        }
+    }
+
+    bool resolve() {
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* res = nullptr;
+        if (getaddrinfo(o_.host.c_str(), std::to_string(o_.port).c_str(), &hints, &res) != 0 || !res) return false;
+        std::memcpy(&addr_, res->ai_addr, sizeof(addr_));
+        freeaddrinfo(res);
+        return true;
+    }
+
+    int run() {
+        ep_ = epoll_create1(EPOLL_CLOEXEC);
+        if (ep_ < 0) {
+            std::perror("epoll_create1");
+            return 1;
+        }
+        auto start = Clock::now();
+        auto end = start + ms(o_.duration * 1000);
+        for (size_t i = 0; i < devices_.size(); i++) {
+            double delay = o_.cold_start ? 0 : uniform() * o_.think_ms;
+            arm(i, start + ms(delay));
+        }
+        auto next_storm = o_.storm_every > 0 ? start + ms(o_.storm_every * 1000) : Clock::time_point::max();
+        auto next_report = start + ms(o_.report_sec * 1000);
+
+        std::vector<epoll_event> events(1024);
+        while (Clock::now() < end) {
+            auto now = Clock::now();
+            auto wake = std::min({end, next_storm, next_report, timers_.empty() ? end : timers_.top().when});
+            int wait_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count());
+            int n = epoll_wait(ep_, events.data(), static_cast<int>(events.size()), std::max(0, wait_ms));
+            for (int e = 0; e < n; e++) on_event(events[static_cast<size_t>(e)].data.u32, events[static_cast<size_t>(e)].events);
+
+            now = Clock::now();
+            while (!timers_.empty() && timers_.top().when <= now) {
+                Timer t = timers_.top();
+                timers_.pop();
+                if (t.gen == devices_[t.device].timer_gen) on_timer(t.device);
+            }
+            if (now >= next_storm) {
+                storm();
+                next_storm += ms(o_.storm_every * 1000);
+            }
+            if (now >= next_report) {
+                report_progress(std::chrono::duration<double>(now - start).count());
+                next_report += ms(o_.report_sec * 1000);
+            }
+        }
+        for (auto& d : devices_) close_fd(d);
+        ::close(ep_);
+        return 0;
+    }
+
+    void print_summary() const {
+        std::printf("\n%-16s %9s %7s | client p50/p99 us   | e2e p50/p99 us       | server p50/p99 us\n", "route", "ok", "failed");
+        for (const auto& kv : routes_) {
+            const RouteStats& s = kv.second;
+            std::printf("%-16s %9llu %7llu | %8llu / %-8llu | %8llu / %-9llu | %7llu / %llu\n", kv.first.c_str(),
+                        u(s.ok), u(s.failed), u(s.client.percentile(50)), u(s.client.percentile(99)),
+                        u(s.e2e.percentile(50)), u(s.e2e.percentile(99)),
+                        u(s.server.percentile(50)), u(s.server.percentile(99)));
+        }
+        std::printf("connect p50/p99 us: %llu / %llu\n", u(connect_.percentile(50)), u(connect_.percentile(99)));
+        std::printf("%s\n", counters_json().dump().c_str());
+    }
+
+    json to_json() const {
+        json routes = json::object();
+        for (const auto& kv : routes_) {
+            json client = kv.second.client.summary();
+            client["buckets"] = kv.second.client.buckets();
+            json e2e = kv.second.e2e.summary();
+            e2e["buckets"] = kv.second.e2e.buckets();
+            json server = kv.second.server.summary();
+            server["buckets"] = kv.second.server.buckets();
+            routes[kv.first] = {{"ok", kv.second.ok}, {"failed", kv.second.failed},
+                                {"client", client}, {"e2e", e2e}, {"server", server}};
+        }
+        json connect = connect_.summary();
+        connect["buckets"] = connect_.buckets();
+        return {
+                {"tool", "fleet_sim"},
+                {"target", o_.host + ":" + std::to_string(o_.port)},
+                {"devices", o_.devices},
+                {"duration_sec", o_.duration},
+                {"routes", routes},
+                {"connect", connect},
+                {"counters", counters_json()}
+        };
+    }
+
+private:
+    struct Timer {
+        Clock::time_point when;
+        uint32_t device;
+        uint64_t gen;
+        bool operator>(const Timer& other) const { return when > other.when; }
+    };
+
+    static Clock::duration ms(double v) {
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(v));
+    }
+    static unsigned long long u(uint64_t v) { return static_cast<unsigned long long>(v); }
+    static uint64_t us_since(Clock::time_point t) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t).count());
+    }
+
+    double uniform() { return std::uniform_real_distribution<double>(0, 1)(rng_); }
+
+    // Replaces any pending timer of the device
+    void arm(size_t i, Clock::time_point when) {
+        Device& d = devices_[i];
+        d.timer_gen++;
+        timers_.push({when, static_cast<uint32_t>(i), d.timer_gen});
+    }
+
+    const Step* plan(const Device& d, size_t& len) const {
+        len = d.resync ? 1 : 3;
+        return d.resync ? RESYNC : CYCLE;
+    }
+
+    static const char* route_name(Step s) {
+        switch (s) {
+        case Step::Utterance: return "utterance";
+        case Step::Reply: return "reply";
+        default: return "settings";
+        }
+    }
+
+    Step current_step(const Device& d) const {
+        size_t len;
+        return plan(d, len)[d.step];
+    }
+
+    void set_events(Device& d, uint32_t events, size_t i) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.u32 = static_cast<uint32_t>(i);
+        epoll_ctl(ep_, EPOLL_CTL_MOD, d.fd, &ev);
+    }
+
+    void close_fd(Device& d) {
+        if (d.fd < 0) return;
+        ::close(d.fd);  // also removes it from the epoll set
+        d.fd = -1;
+        d.reused = false;
+        d.in.clear();
+    }
+
+    void begin_cycle(size_t i, bool resync) {
+        Device& d = devices_[i];
+        d.resync = resync;
+        d.step = 0;
+        d.attempt = 0;
+        d.op_start = Clock::now();
+        counters_.cycles++;
+        if (!resync && uniform() < o_.drop_prob) {
+            drop(i);
+            return;
+        }
+        start_attempt(i);
+    }
+
+    void start_attempt(size_t i) {
+        Device& d = devices_[i];
+        arm(i, Clock::now() + ms(o_.timeout_ms));
+        if (d.fd >= 0) send_request(i);
+        else connect_device(i);
+    }
+
+    void connect_device(size_t i) {
+        Device& d = devices_[i];
+        d.fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (d.fd < 0) {
+            counters_.connect_errors++;
+            fail(i);
+            return;
+        }
+        int one = 1;
+        setsockopt(d.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        epoll_event ev{};
+        ev.events = EPOLLOUT;
+        ev.data.u32 = static_cast<uint32_t>(i);
+        epoll_ctl(ep_, EPOLL_CTL_ADD, d.fd, &ev);
+        counters_.connects++;
+        d.connect_start = Clock::now();
+        d.state = State::Connecting;
+        int rc = ::connect(d.fd, reinterpret_cast<const sockaddr*>(&addr_), sizeof(addr_));
+        if (rc != 0 && errno != EINPROGRESS) {
+            counters_.connect_errors++;
+            fail(i);
+        }
+    }
+
+    void send_request(size_t i) {
+        Device& d = devices_[i];
+        Step step = current_step(d);
+        std::string body;
+        std::string target;
+        if (step == Step::Settings) {
+            target = "/settings?user_id=" + d.user;
+        } else {
+            target = "/history";
+            json j = {{"user_id", d.user}};
+            if (step == Step::Utterance) {
+                j["role"] = "user";
+                j["message"] = UTTERANCES[rng_() % (sizeof(UTTERANCES) / sizeof(UTTERANCES[0]))];
+            } else {
+                j["role"] = "bot";
+                j["message"] = std::string(40 + rng_() % 400, 'r');
+            }
+            body = j.dump();
+        }
+        d.out = (step == Step::Settings ? "GET " : "POST ") + target + " HTTP/1.1\r\n"
+                "Host: " + o_.host + "\r\n"
+                "X-API-KEY: " + api_key_ + "\r\n"
+                "X-Device-Id: " + d.device_id + "\r\n"
+                "X-App-Version: esp32-fw-2.1.0\r\n"
+                "X-Server-Timing: 1\r\n"
+                "Connection: keep-alive\r\n";
+        if (!body.empty()) d.out += "Content-Type: application/json\r\n";
+        d.out += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+        d.out_off = 0;
+        d.in.clear();
+        d.attempt_start = Clock::now();
+        d.state = State::Sending;
+        flush(i);
+    }
+
+    void flush(size_t i) {
+        Device& d = devices_[i];
+        while (d.out_off < d.out.size()) {
+            ssize_t w = ::send(d.fd, d.out.data() + d.out_off, d.out.size() - d.out_off, MSG_NOSIGNAL);
+            if (w > 0) {
+                d.out_off += static_cast<size_t>(w);
+            } else if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                set_events(d, EPOLLOUT, i);
+                return;
+            } else {
+                broken(i);
+                return;
+            }
+        }
+        d.state = State::Receiving;
+        set_events(d, EPOLLIN, i);
+    }
+
+    // The connection died before a response arrived
+    void broken(size_t i) {
+        Device& d = devices_[i];
+        if (d.reused && d.in.empty()) {
+            // Stale keep-alive connection: reconnect and resend, not a failure
+            counters_.stale_reconnects++;
+            close_fd(d);
+            connect_device(i);
+            return;
+        }
+        counters_.resets++;
+        fail(i);
+    }
+
+    void on_event(uint32_t i, uint32_t events) {
+        if (i >= devices_.size()) return;
+        Device& d = devices_[i];
+        if (d.fd < 0) return;
+        switch (d.state) {
+        case State::Connecting: {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(d.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err != 0) {
+                counters_.connect_errors++;
+                fail(i);
+                return;
+            }
+            connect_.record(us_since(d.connect_start));
+            send_request(i);
+            return;
+        }
+        case State::Sending:
+            flush(i);
+            return;
+        case State::Receiving:
+            receive(i);
+            return;
+        default: {
+            // Idle with an open connection: the server closing it is all we expect
+            char buf[512];
+            ssize_t r = ::recv(d.fd, buf, sizeof(buf), 0);
+            if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK) || (events & (EPOLLHUP | EPOLLERR))) {
+                counters_.idle_closed++;
+                close_fd(d);
+            }
+            return;
+        }
+        }
+    }
+
+    void receive(size_t i) {
+        Device& d = devices_[i];
+        char buf[16384];
+        for (;;) {
+            ssize_t r = ::recv(d.fd, buf, sizeof(buf), 0);
+            if (r > 0) {
+                d.in.append(buf, static_cast<size_t>(r));
+                continue;
+            }
+            if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            broken(i);
+            return;
+        }
+        size_t header_end = d.in.find("\r\n\r\n");
+        if (header_end == std::string::npos) return;
+        std::string head = d.in.substr(0, header_end);
+        std::transform(head.begin(), head.end(), head.begin(), [](unsigned char c) { return std::tolower(c); });
+        size_t body_len = 0;
+        size_t cl = head.find("\r\ncontent-length:");
+        if (cl != std::string::npos) body_len = std::strtoul(head.c_str() + cl + 17, nullptr, 10);
+        if (d.in.size() < header_end + 4 + body_len) return;
+
+        int status = d.in.size() > 12 ? std::atoi(d.in.c_str() + 9) : 0;
+        bool close_after = head.find("\r\nconnection: close") != std::string::npos;
+        uint64_t server_us = 0;
+        size_t st = head.find("total;dur=");
+        if (st != std::string::npos) server_us = static_cast<uint64_t>(std::atof(head.c_str() + st + 10) * 1000);
+        complete(i, status, server_us, close_after);
+    }
+
+    void complete(size_t i, int status, uint64_t server_us, bool close_after) {
+        Device& d = devices_[i];
+        counters_.statuses[status]++;
+        RouteStats& s = routes_[route_name(current_step(d))];
+        s.client.record(us_since(d.attempt_start));
+        if (server_us) s.server.record(server_us);
+        d.in.clear();
+        d.reused = true;
+        if (close_after) close_fd(d);
+        if (status == 429 || status >= 500) {
+            counters_.bad_status++;
+            fail(i);
+            return;
+        }
+        s.ok++;
+        s.e2e.record(us_since(d.op_start));
+
+        size_t len;
+        plan(d, len);
+        d.attempt = 0;
+        if (++d.step < len) {
+            d.op_start = Clock::now();
+            start_attempt(i);
+            return;
+        }
+        go_idle(i);
+    }
+
+    void go_idle(size_t i) {
+        Device& d = devices_[i];
+        d.state = State::Idle;
+        if (d.fd >= 0) set_events(d, EPOLLIN, i);
+        double think = std::exponential_distribution<double>(1.0 / std::max(1.0, o_.think_ms))(rng_);
+        arm(i, Clock::now() + ms(think));
+    }
+
+    void fail(size_t i) {
+        Device& d = devices_[i];
+        close_fd(d);
+        if (d.attempt++ >= o_.retries) {
+            counters_.gave_up++;
+            routes_[route_name(current_step(d))].failed++;
+            go_idle(i);
+            return;
+        }
+        counters_.retries++;
+        d.state = State::Backoff;
+        double cap = o_.backoff_ms * static_cast<double>(1u << std::min(d.attempt - 1, 10));
+        arm(i, Clock::now() + ms(uniform() * cap));
+    }
+
+    void on_timer(size_t i) {
+        Device& d = devices_[i];
+        switch (d.state) {
+        case State::Idle:
+            begin_cycle(i, false);
+            return;
+        case State::Offline:
+            d.state = State::Idle;
+            begin_cycle(i, true);
+            return;
+        case State::Backoff:
+            start_attempt(i);
+            return;
+        default:
+            counters_.timeouts++;
+            fail(i);
+            return;
+        }
+    }
+
+    // Wi-Fi loss: the connection vanishes, the device is unreachable for a while
+    void drop(size_t i) {
+        Device& d = devices_[i];
+        if (d.state == State::Offline) return;
+        if (d.state == State::Connecting || d.state == State::Sending || d.state == State::Receiving) {
+            counters_.interrupted++;
+        }
+        close_fd(d);
+        counters_.drops++;
+        d.state = State::Offline;
+        arm(i, Clock::now() + ms(o_.outage_ms + uniform() * o_.reconnect_jitter_ms));
+    }
+
+    void storm() {
+        counters_.storms++;
+        for (size_t i = 0; i < devices_.size(); i++) {
+            if (uniform() < o_.storm_fraction) drop(i);
+        }
+    }
+
+    void report_progress(double t) {
+        size_t open = 0, offline = 0;
+        for (const auto& d : devices_) {
+            if (d.fd >= 0) open++;
+            if (d.state == State::Offline) offline++;
+        }
+        uint64_t ok = 0;
+        for (const auto& kv : routes_) ok += kv.second.ok;
+        std::printf("t=%6.1fs open=%zu offline=%zu ok=%llu retries=%llu gave_up=%llu timeouts=%llu\n", t, open, offline,
+                    u(ok), u(counters_.retries), u(counters_.gave_up), u(counters_.timeouts));
+        std::fflush(stdout);
+    }
+
+    json counters_json() const {
+        json statuses = json::object();
+        for (const auto& kv : counters_.statuses) statuses[std::to_string(kv.first)] = kv.second;
+        return {
+                {"cycles", counters_.cycles},
+                {"connects", counters_.connects},
+                {"connect_errors", counters_.connect_errors},
+                {"stale_reconnects", counters_.stale_reconnects},
+                {"idle_closed", counters_.idle_closed},
+                {"timeouts", counters_.timeouts},
+                {"resets", counters_.resets},
+                {"bad_status", counters_.bad_status},
+                {"retries", counters_.retries},
+                {"gave_up", counters_.gave_up},
+                {"drops", counters_.drops},
+                {"interrupted", counters_.interrupted},
+                {"storms", counters_.storms},
+                {"statuses", statuses}
+        };
+    }
+
+    const Options& o_;
+    std::mt19937_64 rng_;
+    std::vector<Device> devices_;
+    std::string api_key_;
+    sockaddr_in addr_{};
+    int ep_ = -1;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+    std::map<std::string, RouteStats> routes_;
+    HdrHistogram connect_;
+    Counters counters_;
+};
+
+int main(int argc, char** argv) {
+    Options o = parse_args(argc, argv);
+
+    rlimit lim{};
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < static_cast<rlim_t>(o.devices) + 16) {
+        std::cerr << "warning: open file limit " << lim.rlim_cur << " is below --devices " << o.devices << "\n";
+    }
+
+    Fleet fleet(o);
+    if (!fleet.resolve()) {
+        std::cerr << "cannot resolve " << o.host << "\n";
+        return 1;
+    }
+    std::printf("%d devices for %.0fs against %s:%d\n", o.devices, o.duration, o.host.c_str(), o.port);
+    int rc = fleet.run();
+    fleet.print_summary();
+
+    if (!o.json_out.empty()) {
+        std::ofstream f(o.json_out);
+        f << fleet.to_json().dump(2) << "\n";
+        if (!f) {
+            std::cerr << "cannot write " << o.json_out << "\n";
+            return 1;
+        }
+    }
+    return rc;
+}
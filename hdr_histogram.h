@@ -0,0 +1,111 @@
+// hdr_histogram.h
+//
+// High-dynamic-range histogram of integer values (microseconds in the load tools)
+// - log-linear buckets: exact below 128, then 64 sub-buckets per power of
+//   two, so every recorded value is within 1/64 (~1.6%) of the reported one
+//   over the whole range (below 2^41)
+// - not thread safe: give each thread its own and merge() them afterwards
+// - buckets() / from_buckets() carry the non-empty buckets so a run's full
+//   distribution can be stored and compared later (bench_compare.cpp)
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "json.hpp"
+
+class HdrHistogram {
+public:
+    static const int SUB_BITS = 7;
+    static const uint64_t SUB = uint64_t(1) << SUB_BITS;  // exact range
+    static const uint64_t HALF = SUB / 2;                 // sub-buckets per power of two
+    static const int MAX_SHIFT = 34;                      // values below 2^41
+    static const size_t BUCKETS = SUB + MAX_SHIFT * HALF;
+
+    HdrHistogram() : counts_(BUCKETS, 0) {}
+
+    void record(uint64_t value, uint64_t count = 1) {
+        counts_[index(value)] += count;
+        total_ += count;
+        sum_ += static_cast<double>(value) * static_cast<double>(count);
+        max_ = std::max(max_, value);
+        min_ = std::min(min_, value);
+    }
+
+    void merge(const HdrHistogram& other) {
+        for (size_t i = 0; i < BUCKETS; i++) counts_[i] += other.counts_[i];
+        total_ += other.total_;
+        sum_ += other.sum_;
+        max_ = std::max(max_, other.max_);
+        min_ = std::min(min_, other.min_);
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t max() const { return total_ ? max_ : 0; }
+    uint64_t min() const { return total_ ? min_ : 0; }
+    double mean() const { return total_ ? sum_ / static_cast<double>(total_) : 0; }
+
+    // Smallest bucket value with at least p% of the values at or below it
+    uint64_t percentile(double p) const {
+        if (total_ == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(total_) + 0.5);
+        rank = std::max<uint64_t>(1, std::min(rank, total_));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            seen += counts_[i];
+            if (seen >= rank) return std::min(highest_equivalent(i), max_);
+        }
+        return max_;
+    }
+
+    // Every non-empty bucket as [highest equivalent value, count]
+    nlohmann::json buckets() const {
+        nlohmann::json out = nlohmann::json::array();
+        for (size_t i = 0; i < BUCKETS; i++) {
+            if (counts_[i]) out.push_back({std::min(highest_equivalent(i), max_), counts_[i]});
+        }
+        return out;
+    }
+
+    static HdrHistogram from_buckets(const nlohmann::json& buckets) {
+        HdrHistogram h;
+        for (const auto& b : buckets) h.record(b.at(0).get<uint64_t>(), b.at(1).get<uint64_t>());
+        return h;
+    }
+
+    nlohmann::json summary() const {
+        return {
+                {"count", total_},
+                {"min_us", min()},
+                {"mean_us", static_cast<uint64_t>(mean())},
+                {"p50_us", percentile(50)},
+                {"p90_us", percentile(90)},
+                {"p99_us", percentile(99)},
+                {"p999_us", percentile(99.9)},
+                {"max_us", max()}
+        };
+    }
+
+private:
+    static size_t index(uint64_t v) {
+        if (v < SUB) return static_cast<size_t>(v);
+        int shift = 63 - __builtin_clzll(v) - (SUB_BITS - 1);  // v >> shift lands in [HALF, SUB)
+        if (shift > MAX_SHIFT) return BUCKETS - 1;
+        return static_cast<size_t>(SUB + static_cast<uint64_t>(shift - 1) * HALF + ((v >> shift) - HALF));
+    }
+
+    static uint64_t highest_equivalent(size_t i) {
+        if (i < SUB) return i;
+        uint64_t shift = (i - SUB) / HALF + 1;
+        uint64_t sub = (i - SUB) % HALF + HALF;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    double sum_ = 0;
+    uint64_t max_ = 0;
+    uint64_t min_ = UINT64_MAX;
+};
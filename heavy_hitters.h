@@ -0,0 +1,204 @@
+// heavy_hitters.h
+//
+// Streaming heavy-hitter detection over string keys
+// - a count-min sketch (DEPTH rows of WIDTH atomic counters) estimates each
+//   key's weight; it never underestimates, and overestimates by at most
+//   ~e/WIDTH of the total with high probability
+// - counts are over a sliding window built from two sketches: the current
+//   window plus the previous one scaled by how much of it still overlaps
+// - a small top-k list (min-heap by estimate) keeps the keys themselves;
+//   add() only takes its lock when a key's estimate beats the current
+//   minimum, so the common case is DEPTH relaxed atomic adds
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+#include "lock_profiler.h"
+
+class HotKeyTracker {
+public:
+    static const int DEPTH = 4;
+    static const size_t WIDTH = 2048;
+
+    HotKeyTracker(const char* name, size_t k, std::chrono::seconds window)
+        : k_(k), window_ns_(std::chrono::duration_cast<std::chrono::nanoseconds>(window).count()),
+          mutex_name_(std::string(name) + "_topk"), mutex_(mutex_name_.c_str()) {
+        window_end_ns_ = now_ns() + window_ns_;
+    }
+
+    void add(const std::string& key, uint64_t weight = 1) {
+        if (weight == 0) return;
+        int64_t now = now_ns();
+        rotate_if_due(now);
+        int cur = current_.load(std::memory_order_acquire);
+        size_t h = std::hash<std::string>()(key);
+        for (int r = 0; r < DEPTH; r++) {
+            windows_[cur].cells[r][index(h, r)].fetch_add(weight, std::memory_order_relaxed);
+        }
+        windows_[cur].total.fetch_add(weight, std::memory_order_relaxed);
+
+        uint64_t est = estimate(h, now);
+        if (est < topk_min_.load(std::memory_order_relaxed)) return;
+        ProfiledLock lock(mutex_, "HotKeyTracker::add");
+        offer(key, est);
+    }
+
+    // Estimated weight of `key` over the last window
+    uint64_t estimate(const std::string& key) const {
+        return estimate(std::hash<std::string>()(key), now_ns());
+    }
+
+    // Total weight over the last window
+    uint64_t total() const {
+        double overlap = previous_overlap(now_ns());
+        int cur = current_.load(std::memory_order_acquire);
+        return windows_[cur].total.load(std::memory_order_relaxed) +
+               static_cast<uint64_t>(windows_[1 - cur].total.load(std::memory_order_relaxed) * overlap);
+    }
+
+    // True if `key` carries at least `share` of the window's weight and at least `min_weight`
+    bool is_hot(const std::string& key, double share, uint64_t min_weight) const {
+        uint64_t est = estimate(key);
+        return est >= min_weight && static_cast<double>(est) >= share * static_cast<double>(total());
+    }
+
+    nlohmann::json report() const {
+        using nlohmann::json;
+        std::vector<std::string> keys;
+        {
+            ProfiledLock lock(mutex_, "HotKeyTracker::report");
+            for (const auto& e : heap_) keys.push_back(e.key);
+        }
+        uint64_t sum = total();
+        std::vector<std::pair<uint64_t, std::string>> ranked;
+        for (auto& key : keys) ranked.emplace_back(estimate(key), std::move(key));
+        std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+        json top = json::array();
+        for (const auto& r : ranked) {
+            if (r.first == 0) continue;
+            top.push_back({
+                    {"key", r.second},
+                    {"estimate", r.first},
+                    {"share", sum ? static_cast<double>(r.first) / static_cast<double>(sum) : 0.0}
+            });
+        }
+        return {
+                {"window_sec", window_ns_ / 1000000000},
+                {"total", sum},
+                {"max_error", sum * 3 / WIDTH},  // ~e/WIDTH of the total
+                {"top", top}
+        };
+    }
+
+private:
+    struct Window {
+        std::atomic<uint64_t> cells[DEPTH][WIDTH] = {};
+        std::atomic<uint64_t> total{0};
+
+        void clear() {
+            for (auto& row : cells)
+                for (auto& c : row) c.store(0, std::memory_order_relaxed);
+            total.store(0, std::memory_order_relaxed);
+        }
+    };
+
+    struct Entry {
+        std::string key;
+        uint64_t estimate;
+    };
+
+    static int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static size_t index(size_t h, int row) {
+        uint64_t x = static_cast<uint64_t>(h) + 0x9E3779B97F4A7C15ull * static_cast<uint64_t>(row + 1);
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return static_cast<size_t>((x ^ (x >> 31)) % WIDTH);
+    }
+
+    // Fraction of the previous window still inside the sliding window
+    double previous_overlap(int64_t now) const {
+        int64_t left = window_end_ns_.load(std::memory_order_relaxed) - now;
+        return std::min(1.0, std::max(0.0, static_cast<double>(left) / static_cast<double>(window_ns_)));
+    }
+
+    uint64_t estimate(size_t h, int64_t now) const {
+        double overlap = previous_overlap(now);
+        int cur = current_.load(std::memory_order_acquire);
+        uint64_t best = UINT64_MAX;
+        for (int r = 0; r < DEPTH; r++) {
+            size_t i = index(h, r);
+            uint64_t v = windows_[cur].cells[r][i].load(std::memory_order_relaxed) +
+                         static_cast<uint64_t>(windows_[1 - cur].cells[r][i].load(std::memory_order_relaxed) * overlap);
+            best = std::min(best, v);
+        }
+        return best;
+    }
+
+    // One thread per window boundary clears the older sketch and makes it current
+    void rotate_if_due(int64_t now) {
+        int64_t end = window_end_ns_.load(std::memory_order_relaxed);
+        if (now < end) return;
+        if (!window_end_ns_.compare_exchange_strong(end, now + window_ns_)) return;
+        int cur = current_.load(std::memory_order_relaxed);
+        windows_[1 - cur].clear();
+        if (now >= end + window_ns_) windows_[cur].clear();  // idle for a whole window: nothing overlaps
+        current_.store(1 - cur, std::memory_order_release);
+
+        ProfiledLock lock(mutex_, "HotKeyTracker::rotate");
+        for (auto& e : heap_) e.estimate = estimate(std::hash<std::string>()(e.key), now);
+        heap_.erase(std::remove_if(heap_.begin(), heap_.end(), [](const Entry& e) { return e.estimate == 0; }), heap_.end());
+        std::make_heap(heap_.begin(), heap_.end(), by_estimate);
+        refresh_min();
+    }
+
+    static bool by_estimate(const Entry& a, const Entry& b) { return a.estimate > b.estimate; }  // min-heap
+
+    // Caller holds mutex_
+    void offer(const std::string& key, uint64_t est) {
+        for (auto& e : heap_) {
+            if (e.key == key) {
+                e.estimate = est;
+                std::make_heap(heap_.begin(), heap_.end(), by_estimate);
+                refresh_min();
+                return;
+            }
+        }
+        if (heap_.size() < k_) {
+            heap_.push_back({key, est});
+            std::push_heap(heap_.begin(), heap_.end(), by_estimate);
+        } else if (est > heap_.front().estimate) {
+            std::pop_heap(heap_.begin(), heap_.end(), by_estimate);
+            heap_.back() = {key, est};
+            std::push_heap(heap_.begin(), heap_.end(), by_estimate);
+        }
+        refresh_min();
+    }
+
+    // Until the list is full any key may enter
+    void refresh_min() {
+        topk_min_.store(heap_.size() < k_ ? 0 : heap_.front().estimate, std::memory_order_relaxed);
+    }
+
+    size_t k_;
+    int64_t window_ns_;
+    Window windows_[2];
+    std::atomic<int> current_{0};
+    std::atomic<int64_t> window_end_ns_{0};
+    std::string mutex_name_;
+    mutable ProfiledMutex mutex_;
+    std::vector<Entry> heap_;
+    std::atomic<uint64_t> topk_min_{0};
+};
@@ -0,0 +1,107 @@
+// hyperloglog.h
+//
+// HyperLogLog distinct counter
+// - 2^P one-byte registers (4 KiB at P=12, ~1.6% standard error)
+// - add() is lock-free (atomic max per register), so one sketch can be fed
+//   from any number of threads
+// - sketches merge by taking the register-wise max, which makes merging
+//   idempotent: a window's sketch can be merged into its persisted copy
+//   repeatedly without double counting
+// - bytes() / merge_bytes() give the raw register array for storage
+// - values are hashed with MurmurHash64A under a fixed seed, read
+//   byte-by-byte, so a stored sketch means the same on every build and
+//   platform; HASH_ID names the hash and belongs next to stored registers
+
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+class HyperLogLog {
+public:
+    static const int P = 12;
+    static const size_t M = size_t(1) << P;
+
+    static const uint64_t HASH_SEED = 0x4C756D6F48504C4Cull;  // "LumoHPLL"
+    static constexpr const char* HASH_ID = "murmur64a:4c756d6f48504c4c";
+
+    // MurmurHash64A of `value` under HASH_SEED; little-endian loads regardless of the host
+    static uint64_t hash(std::string_view value) {
+        const uint64_t m = 0xC6A4A7935BD1E995ull;
+        const int r = 47;
+        const auto* p = reinterpret_cast<const unsigned char*>(value.data());
+        size_t len = value.size();
+        uint64_t h = HASH_SEED ^ (static_cast<uint64_t>(len) * m);
+        for (; len >= 8; p += 8, len -= 8) {
+            uint64_t k = 0;
+            for (int i = 7; i >= 0; i--) k = (k << 8) | p[i];
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+            h ^= k;
+            h *= m;
+        }
+        if (len > 0) {
+            for (size_t i = len; i-- > 0;) h ^= static_cast<uint64_t>(p[i]) << (8 * i);
+            h *= m;
+        }
+        h ^= h >> r;
+        h *= m;
+        return h ^ (h >> r);
+    }
+
+    void add(uint64_t h) {
+        size_t idx = static_cast<size_t>(h >> (64 - P));
+        uint64_t rest = (h << P) | (uint64_t(1) << (P - 1));  // sentinel bit bounds the rank
+        uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+        uint8_t prev = registers_[idx].load(std::memory_order_relaxed);
+        while (rank > prev && !registers_[idx].compare_exchange_weak(prev, rank, std::memory_order_relaxed)) {}
+    }
+
+    void add(std::string_view value) { add(hash(value)); }
+
+    void merge(const HyperLogLog& other) {
+        for (size_t i = 0; i < M; i++) raise(i, other.registers_[i].load(std::memory_order_relaxed));
+    }
+
+    // Merge a register array produced by bytes(); false if the size doesn't match
+    bool merge_bytes(const void* data, size_t size) {
+        if (size != M) return false;
+        const auto* r = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < M; i++) raise(i, r[i]);
+        return true;
+    }
+
+    std::string bytes() const {
+        std::string out(M, '\0');
+        for (size_t i = 0; i < M; i++) out[i] = static_cast<char>(registers_[i].load(std::memory_order_relaxed));
+        return out;
+    }
+
+    // Estimated number of distinct values; linear counting while sparse
+    double estimate() const {
+        double sum = 0;
+        size_t zeros = 0;
+        for (const auto& reg : registers_) {
+            uint8_t r = reg.load(std::memory_order_relaxed);
+            sum += std::ldexp(1.0, -r);
+            if (r == 0) zeros++;
+        }
+        double m = static_cast<double>(M);
+        double alpha = 0.7213 / (1.0 + 1.079 / m);
+        double e = alpha * m * m / sum;
+        if (e <= 2.5 * m && zeros > 0) e = m * std::log(m / static_cast<double>(zeros));
+        return e;
+    }
+
+private:
+    void raise(size_t i, uint8_t v) {
+        uint8_t prev = registers_[i].load(std::memory_order_relaxed);
+        while (v > prev && !registers_[i].compare_exchange_weak(prev, v, std::memory_order_relaxed)) {}
+    }
+
+    std::atomic<uint8_t> registers_[M] = {};
+};
@@ -0,0 +1,721 @@
+// json_codec.h
+//
+// Compile-time JSON codecs generated from declarative struct schemas
+// - a JsonSchema<T> specialization lists T's fields: JSON name, member
+//   pointer, required or optional. Member types: std::string,
+//   std::string_view (below), bool, int64_t, structs with their own schema,
+//   and std::optional / std::vector of those
+// - decode() parses, validates and fills a T in a single pass over the text,
+//   without building a DOM: each key dispatches straight to its member
+//   (the dispatch is unrolled over the schema at compile time), each value
+//   is type-checked as it is read, unknown keys are skipped (they must still
+//   be well-formed JSON) and required fields are checked when the object
+//   closes. Nothing throws: a failure is a CodecError saying what was wrong
+//   (syntax, wrong type, missing field) and where
+// - the input must be valid UTF-8 (as nlohmann::json's parser requires):
+//   it is checked once up front with utf8_valid() (SIMD, utf8.h), so the
+//   string scanner copies non-ASCII bytes without looking at them.
+//   \u escapes, including surrogate pairs, are decoded
+// - encode() writes a T in schema order, compact or indented exactly like
+//   nlohmann::json::dump(indent), so a schema listing fields in sorted
+//   order produces byte-identical output
+// - std::string_view members decode without a copy: they point into the
+//   input, or into a caller-owned buffer for strings with escapes
+// - flatten_fields() folds a member struct's fields into the enclosing
+//   object (its fields are all treated as optional)
+//
+//   struct ThemeRequest { std::string user_id; std::string theme_mode; };
+//   template <> struct JsonSchema<ThemeRequest> {
+//       static constexpr auto fields = std::make_tuple(
+//               required_field("user_id", &ThemeRequest::user_id),
+//               required_field("theme_mode", &ThemeRequest::theme_mode));
+//   };
+//
+//   ThemeRequest r;
+//   CodecError err;
+//   if (!decode(body, r, err)) reply_400(err.message());
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "utf8.h"
+
+// Specialize with `static constexpr auto fields = std::make_tuple(...)`
+template <typename T>
+struct JsonSchema;
+
+template <typename C, typename M>
+struct JsonField {
+    const char* name;
+    M C::*member;
+    bool required;
+};
+
+template <typename C, typename M>
+struct JsonFlatten {
+    M C::*member;
+};
+
+template <typename C, typename M>
+constexpr JsonField<C, M> required_field(const char* name, M C::*member) { return {name, member, true}; }
+
+template <typename C, typename M>
+constexpr JsonField<C, M> optional_field(const char* name, M C::*member) { return {name, member, false}; }
+
+template <typename C, typename M>
+constexpr JsonFlatten<C, M> flatten_fields(M C::*member) { return {member}; }
+
+struct CodecError {
+    enum Kind { None, Syntax, Type, Missing, Encoding };
+    Kind kind = None;
+    const char* field = "";  // schema field name for Type and Missing
+    size_t offset = 0;       // byte offset into the input
+
+    std::string message() const {
+        char buf[160];
+        switch (kind) {
+        case Syntax: std::snprintf(buf, sizeof(buf), "syntax error at byte %zu", offset); break;
+        case Type:
+            if (*field) std::snprintf(buf, sizeof(buf), "wrong type for \"%s\" at byte %zu", field, offset);
+            else std::snprintf(buf, sizeof(buf), "expected an object at byte %zu", offset);
+            break;
+        case Missing: std::snprintf(buf, sizeof(buf), "\"%s\" required", field); break;
+        case Encoding:
+            if (*field) std::snprintf(buf, sizeof(buf), "invalid UTF-8 in \"%s\"", field);
+            else std::snprintf(buf, sizeof(buf), "invalid UTF-8 at byte %zu", offset);
+            break;
+        default: return "ok";
+        }
+        return buf;
+    }
+};
+
+namespace json_codec {
+
+template <typename T, typename = void>
+struct has_schema : std::false_type {};
+template <typename T>
+struct has_schema<T, std::void_t<decltype(JsonSchema<T>::fields)>> : std::true_type {};
+
+template <typename F>
+struct member_of;
+template <typename C, typename M>
+struct member_of<JsonField<C, M>> { using type = M; };
+template <typename C, typename M>
+struct member_of<JsonFlatten<C, M>> { using type = M; };
+
+// Whether decoding a T produces std::string_view members (needs a buffer)
+template <typename T, typename = void>
+struct has_views : std::is_same<T, std::string_view> {};
+template <typename T>
+struct has_views<std::optional<T>> : has_views<T> {};
+template <typename T>
+struct has_views<std::vector<T>> : has_views<T> {};
+template <typename Tuple>
+struct any_views;
+template <typename... F>
+struct any_views<std::tuple<F...>> : std::disjunction<has_views<typename member_of<F>::type>...> {};
+template <typename T>
+struct has_views<T, std::enable_if_t<has_schema<T>::value>>
+    : any_views<std::decay_t<decltype(JsonSchema<T>::fields)>> {};
+
+static const int MAX_DEPTH = 64;  // nesting limit for skipped values
+
+inline void append_utf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+class Reader {
+public:
+    Reader(std::string_view text, CodecError& err, std::string* unescaped = nullptr)
+        : begin_(text.data()), p_(text.data()), end_(text.data() + text.size()), err_(err), unescaped_(unescaped) {}
+
+    void skip_to(size_t offset) { p_ = begin_ + offset; }
+
+    bool fail(CodecError::Kind kind, const char* field = "") {
+        if (err_.kind == CodecError::None) {
+            err_.kind = kind;
+            err_.field = field;
+            err_.offset = static_cast<size_t>(p_ - begin_);
+        }
+        return false;
+    }
+
+    void ws() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) p_++;
+    }
+    char peek() const { return p_ < end_ ? *p_ : '\0'; }
+    bool consume(char c) {
+        if (p_ < end_ && *p_ == c) {
+            p_++;
+            return true;
+        }
+        return false;
+    }
+    bool literal(const char* word) {
+        size_t n = std::strlen(word);
+        if (static_cast<size_t>(end_ - p_) < n || std::memcmp(p_, word, n) != 0) return fail(CodecError::Syntax);
+        p_ += n;
+        return true;
+    }
+    bool at_end() {
+        ws();
+        return p_ == end_;
+    }
+
+    // A string value; appends the decoded text to *out unless out is null.
+    // Plain runs are copied in bulk, escapes decoded one by one.
+    bool string(std::string* out) {
+        if (!consume('"')) return fail(CodecError::Syntax);
+        for (;;) {
+            const char* run = p_;
+            while (p_ < end_ && *p_ != '"' && *p_ != '\\' && static_cast<unsigned char>(*p_) >= 0x20) p_++;
+            if (out) out->append(run, static_cast<size_t>(p_ - run));
+            if (p_ == end_) return fail(CodecError::Syntax);
+            auto c = static_cast<unsigned char>(*p_);
+            if (c == '"') {
+                p_++;
+                return true;
+            }
+            if (c < 0x20) return fail(CodecError::Syntax);
+            if (!escape(out)) return false;
+        }
+    }
+
+    // A string value as a view: into the input when it has no escapes, else
+    // decoded into the unescaped buffer. That buffer is reserved to the
+    // input's size on first use; decoded text is never longer than its JSON,
+    // so it never reallocates and earlier views into it stay valid.
+    bool string_view(std::string_view& out) {
+        const char* start = p_ + 1;
+        const char* q = start;
+        while (q < end_ && *q != '"' && *q != '\\' && static_cast<unsigned char>(*q) >= 0x20) q++;
+        if (q < end_ && *q == '"') {
+            out = std::string_view(start, static_cast<size_t>(q - start));
+            p_ = q + 1;
+            return true;
+        }
+        size_t size = static_cast<size_t>(end_ - begin_);
+        if (unescaped_->capacity() < size) unescaped_->reserve(size);
+        size_t at = unescaped_->size();
+        if (!string(unescaped_)) return false;
+        out = std::string_view(unescaped_->data() + at, unescaped_->size() - at);
+        return true;
+    }
+
+    // Object key without escapes as a view into the input; keys with
+    // escapes are decoded into `scratch`
+    bool key(std::string_view& out, std::string& scratch) {
+        if (peek() != '"') return fail(CodecError::Syntax);
+        const char* start = p_ + 1;
+        const char* q = start;
+        while (q < end_ && *q != '"' && *q != '\\' && static_cast<unsigned char>(*q) >= 0x20) q++;
+        if (q < end_ && *q == '"') {
+            out = std::string_view(start, static_cast<size_t>(q - start));
+            p_ = q + 1;
+            return true;
+        }
+        scratch.clear();
+        if (!string(&scratch)) return false;
+        out = scratch;
+        return true;
+    }
+
+    bool number(int64_t* out) {
+        const char* start = p_;
+        bool negative = consume('-');
+        if (p_ == end_ || *p_ < '0' || *p_ > '9') return fail(CodecError::Syntax);
+        uint64_t v = 0;
+        bool integral = true, overflow = false;
+        if (*p_ == '0') {
+            p_++;
+        } else {
+            while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+                if (v > (UINT64_MAX - 9) / 10) overflow = true;
+                v = v * 10 + static_cast<uint64_t>(*p_++ - '0');
+            }
+        }
+        if (consume('.')) {
+            integral = false;
+            if (p_ == end_ || *p_ < '0' || *p_ > '9') return fail(CodecError::Syntax);
+            while (p_ < end_ && *p_ >= '0' && *p_ <= '9') p_++;
+        }
+        if (p_ < end_ && (*p_ == 'e' || *p_ == 'E')) {
+            integral = false;
+            p_++;
+            if (!consume('+')) consume('-');
+            if (p_ == end_ || *p_ < '0' || *p_ > '9') return fail(CodecError::Syntax);
+            while (p_ < end_ && *p_ >= '0' && *p_ <= '9') p_++;
+        }
+        if (!out) return true;
+        uint64_t limit = negative ? static_cast<uint64_t>(INT64_MAX) + 1 : static_cast<uint64_t>(INT64_MAX);
+        if (!integral || overflow || v > limit) {
+            p_ = start;
+            return false;  // caller reports a type error
+        }
+        *out = negative ? static_cast<int64_t>(0 - v) : static_cast<int64_t>(v);
+        return true;
+    }
+
+    // Any well-formed value, discarded
+    bool skip(int depth = 0) {
+        if (depth > MAX_DEPTH) return fail(CodecError::Syntax);
+        ws();
+        switch (peek()) {
+        case '"': return string(nullptr);
+        case 't': return literal("true");
+        case 'f': return literal("false");
+        case 'n': return literal("null");
+        case '{': {
+            p_++;
+            ws();
+            if (consume('}')) return true;
+            for (;;) {
+                ws();
+                if (!string(nullptr)) return false;
+                ws();
+                if (!consume(':')) return fail(CodecError::Syntax);
+                if (!skip(depth + 1)) return false;
+                ws();
+                if (consume(',')) continue;
+                if (consume('}')) return true;
+                return fail(CodecError::Syntax);
+            }
+        }
+        case '[': {
+            p_++;
+            ws();
+            if (consume(']')) return true;
+            for (;;) {
+                if (!skip(depth + 1)) return false;
+                ws();
+                if (consume(',')) continue;
+                if (consume(']')) return true;
+                return fail(CodecError::Syntax);
+            }
+        }
+        default: return number(nullptr);
+        }
+    }
+
+private:
+    static int hex(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    bool hex4(uint32_t& out) {
+        if (end_ - p_ < 4) return fail(CodecError::Syntax);
+        out = 0;
+        for (int i = 0; i < 4; i++) {
+            int h = hex(p_[i]);
+            if (h < 0) return fail(CodecError::Syntax);
+            out = out << 4 | static_cast<uint32_t>(h);
+        }
+        p_ += 4;
+        return true;
+    }
+
+    bool escape(std::string* out) {
+        p_++;  // backslash
+        if (p_ == end_) return fail(CodecError::Syntax);
+        char c = *p_++;
+        char plain = 0;
+        switch (c) {
+        case '"': plain = '"'; break;
+        case '\\': plain = '\\'; break;
+        case '/': plain = '/'; break;
+        case 'b': plain = '\b'; break;
+        case 'f': plain = '\f'; break;
+        case 'n': plain = '\n'; break;
+        case 'r': plain = '\r'; break;
+        case 't': plain = '\t'; break;
+        case 'u': {
+            uint32_t cp = 0;
+            if (!hex4(cp)) return false;
+            if (cp >= 0xDC00 && cp <= 0xDFFF) return fail(CodecError::Syntax);  // lone low surrogate
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                uint32_t low = 0;
+                if (!consume('\\') || !consume('u') || !hex4(low) || low < 0xDC00 || low > 0xDFFF) {
+                    return fail(CodecError::Syntax);
+                }
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            }
+            if (out) append_utf8(*out, cp);
+            return true;
+        }
+        default: return fail(CodecError::Syntax);
+        }
+        if (out) *out += plain;
+        return true;
+    }
+
+    const char* begin_;
+    const char* p_;
+    const char* end_;
+    CodecError& err_;
+    std::string* unescaped_;
+};
+
+// --- Decoding --- //
+
+template <typename T>
+bool read(Reader& r, T& out, const char* field);
+
+inline bool read(Reader& r, std::string& out, const char* field) {
+    if (r.peek() != '"') return r.fail(CodecError::Type, field);
+    out.clear();
+    return r.string(&out);
+}
+
+inline bool read(Reader& r, std::string_view& out, const char* field) {
+    if (r.peek() != '"') return r.fail(CodecError::Type, field);
+    return r.string_view(out);
+}
+
+inline bool read(Reader& r, bool& out, const char* field) {
+    char c = r.peek();
+    if (c == 't' && r.literal("true")) {
+        out = true;
+        return true;
+    }
+    if (c == 'f' && r.literal("false")) {
+        out = false;
+        return true;
+    }
+    return r.fail(c == 't' || c == 'f' ? CodecError::Syntax : CodecError::Type, field);
+}
+
+inline bool read(Reader& r, int64_t& out, const char* field) {
+    char c = r.peek();
+    if (c != '-' && (c < '0' || c > '9')) return r.fail(CodecError::Type, field);
+    return r.number(&out) || r.fail(CodecError::Type, field);
+}
+
+template <typename T>
+bool read(Reader& r, std::optional<T>& out, const char* field) {
+    // null is a wrong type, not "absent" (as with nlohmann's get<T>)
+    out.emplace();
+    return read(r, *out, field);
+}
+
+template <typename T>
+bool read(Reader& r, std::vector<T>& out, const char* field) {
+    if (!r.consume('[')) return r.fail(CodecError::Type, field);
+    out.clear();
+    r.ws();
+    if (r.consume(']')) return true;
+    for (;;) {
+        r.ws();
+        out.emplace_back();
+        if (!read(r, out.back(), field)) return false;
+        r.ws();
+        if (r.consume(',')) continue;
+        if (r.consume(']')) return true;
+        return r.fail(CodecError::Syntax);
+    }
+}
+
+// Offer `key` to each field of T's schema in turn; sets `matched`
+template <typename T>
+bool dispatch(Reader& r, T& out, std::string_view key, uint64_t& seen, bool& matched);
+
+template <typename T, typename C, typename M>
+bool dispatch_one(Reader& r, T& out, std::string_view key, uint64_t& seen, bool& matched, size_t index,
+                  const JsonField<C, M>& f) {
+    if (matched || key != f.name) return true;
+    matched = true;
+    if (index < 64) seen |= uint64_t(1) << index;
+    return read(r, out.*(f.member), f.name);
+}
+
+template <typename T, typename C, typename M>
+bool dispatch_one(Reader& r, T& out, std::string_view key, uint64_t&, bool& matched, size_t,
+                  const JsonFlatten<C, M>& f) {
+    if (matched) return true;
+    uint64_t inner_seen = 0;
+    return dispatch(r, out.*(f.member), key, inner_seen, matched);
+}
+
+template <typename T, size_t... I>
+bool dispatch_fields(Reader& r, T& out, std::string_view key, uint64_t& seen, bool& matched, std::index_sequence<I...>) {
+    constexpr auto& fields = JsonSchema<T>::fields;
+    return (dispatch_one(r, out, key, seen, matched, I, std::get<I>(fields)) && ...);
+}
+
+template <typename T>
+bool dispatch(Reader& r, T& out, std::string_view key, uint64_t& seen, bool& matched) {
+    constexpr size_t n = std::tuple_size<std::decay_t<decltype(JsonSchema<T>::fields)>>::value;
+    return dispatch_fields(r, out, key, seen, matched, std::make_index_sequence<n>());
+}
+
+template <typename C, typename M>
+const char* missing_one(uint64_t seen, size_t index, const JsonField<C, M>& f) {
+    return f.required && index < 64 && !(seen & (uint64_t(1) << index)) ? f.name : nullptr;
+}
+
+template <typename C, typename M>
+const char* missing_one(uint64_t, size_t, const JsonFlatten<C, M>&) { return nullptr; }
+
+// First required field of T not seen, or null
+template <typename T, size_t... I>
+const char* first_missing(uint64_t seen, std::index_sequence<I...>) {
+    constexpr auto& fields = JsonSchema<T>::fields;
+    const char* missing = nullptr;
+    ((missing = missing ? missing : missing_one(seen, I, std::get<I>(fields))), ...);
+    return missing;
+}
+
+template <typename T>
+bool read_object(Reader& r, T& out, const char* field) {
+    if (!r.consume('{')) return r.fail(CodecError::Type, field);
+    uint64_t seen = 0;
+    std::string scratch;
+    r.ws();
+    if (!r.consume('}')) {
+        for (;;) {
+            r.ws();
+            std::string_view key;
+            if (!r.key(key, scratch)) return false;
+            r.ws();
+            if (!r.consume(':')) return r.fail(CodecError::Syntax);
+            r.ws();
+            bool matched = false;
+            if (!dispatch(r, out, key, seen, matched)) return false;
+            if (!matched && !r.skip()) return false;
+            r.ws();
+            if (r.consume(',')) continue;
+            if (r.consume('}')) break;
+            return r.fail(CodecError::Syntax);
+        }
+    }
+    constexpr size_t n = std::tuple_size<std::decay_t<decltype(JsonSchema<T>::fields)>>::value;
+    if (const char* missing = first_missing<T>(seen, std::make_index_sequence<n>())) {
+        return r.fail(CodecError::Missing, missing);
+    }
+    return true;
+}
+
+template <typename T>
+bool read(Reader& r, T& out, const char* field) {
+    static_assert(has_schema<T>::value, "json_codec: member type needs a JsonSchema");
+    return read_object(r, out, field);
+}
+
+// --- Encoding --- //
+
+class Writer {
+public:
+    Writer(std::string& out, int indent) : out_(out), indent_(indent) {}
+
+    bool ok() const { return bad_field_ == nullptr; }
+    const char* bad_field() const { return bad_field_; }
+
+    void open(char c) {
+        out_ += c;
+        depth_++;
+        first_ = true;
+    }
+    void close(char c) {
+        depth_--;
+        if (!first_) newline();
+        out_ += c;
+        first_ = false;
+    }
+    // Separator and indentation before an array element or object member
+    void item() {
+        if (!first_) out_ += ',';
+        first_ = false;
+        newline();
+    }
+    void key(const char* name) {
+        item();
+        out_ += '"';
+        out_ += name;
+        out_ += indent_ >= 0 ? "\": " : "\":";
+    }
+    void raw(const char* s) { out_ += s; }
+
+    // Escaped like nlohmann::json::dump; invalid UTF-8 fails the encode
+    void string(std::string_view s, const char* field) {
+        static const char* const HEX = "0123456789abcdef";
+        out_ += '"';
+        const auto* p = reinterpret_cast<const unsigned char*>(s.data());
+        const auto* end = p + s.size();
+        while (p < end) {
+            const unsigned char* run = p;
+            while (p < end && *p >= 0x20 && *p < 0x80 && *p != '"' && *p != '\\') p++;
+            out_.append(reinterpret_cast<const char*>(run), static_cast<size_t>(p - run));
+            if (p == end) break;
+            unsigned char c = *p;
+            if (c >= 0x80) {
+                size_t n = utf8_detail::sequence(p, end);
+                if (n == 0) {
+                    if (!bad_field_) bad_field_ = field;
+                    return;
+                }
+                out_.append(reinterpret_cast<const char*>(p), n);
+                p += n;
+                continue;
+            }
+            p++;
+            switch (c) {
+            case '"': out_ += "\\\""; break;
+            case '\\': out_ += "\\\\"; break;
+            case '\b': out_ += "\\b"; break;
+            case '\f': out_ += "\\f"; break;
+            case '\n': out_ += "\\n"; break;
+            case '\r': out_ += "\\r"; break;
+            case '\t': out_ += "\\t"; break;
+            default:
+                out_ += "\\u00";
+                out_ += HEX[c >> 4];
+                out_ += HEX[c & 0xF];
+            }
+        }
+        out_ += '"';
+    }
+
+private:
+    void newline() {
+        if (indent_ < 0) return;
+        out_ += '\n';
+        out_.append(static_cast<size_t>(depth_ * indent_), ' ');
+    }
+
+    std::string& out_;
+    int indent_;
+    int depth_ = 0;
+    bool first_ = true;
+    const char* bad_field_ = nullptr;
+};
+
+template <typename T>
+void write(Writer& w, const T& v, const char* field);
+
+inline void write(Writer& w, const std::string& v, const char* field) { w.string(v, field); }
+inline void write(Writer& w, std::string_view v, const char* field) { w.string(v, field); }
+inline void write(Writer& w, bool v, const char*) { w.raw(v ? "true" : "false"); }
+inline void write(Writer& w, int64_t v, const char*) { w.raw(std::to_string(v).c_str()); }
+
+template <typename T>
+void write(Writer& w, const std::optional<T>& v, const char* field) {
+    if (v) write(w, *v, field);
+    else w.raw("null");
+}
+
+template <typename T>
+void write(Writer& w, const std::vector<T>& v, const char* field) {
+    if (v.empty()) {
+        w.raw("[]");
+        return;
+    }
+    w.open('[');
+    for (const auto& e : v) {
+        w.item();
+        write(w, e, field);
+    }
+    w.close(']');
+}
+
+template <typename T>
+void write_members(Writer& w, const T& v);
+
+template <typename T, typename C, typename M>
+void write_one(Writer& w, const T& v, const JsonField<C, M>& f) {
+    w.key(f.name);
+    write(w, v.*(f.member), f.name);
+}
+
+template <typename T, typename C, typename M>
+void write_one(Writer& w, const T& v, const JsonFlatten<C, M>& f) {
+    write_members(w, v.*(f.member));
+}
+
+template <typename T>
+void write_members(Writer& w, const T& v) {
+    std::apply([&](const auto&... f) { (write_one(w, v, f), ...); }, JsonSchema<T>::fields);
+}
+
+template <typename T>
+void write(Writer& w, const T& v, const char*) {
+    static_assert(has_schema<T>::value, "json_codec: member type needs a JsonSchema");
+    w.open('{');
+    write_members(w, v);
+    w.close('}');
+}
+
+}  // namespace json_codec
+
+namespace json_codec {
+
+template <typename T>
+bool decode_text(std::string_view text, T& out, CodecError& err, std::string* unescaped) {
+    err = CodecError();
+    Reader r(text, err, unescaped);
+    if (!utf8_valid(text.data(), text.size())) {
+        r.skip_to(utf8_invalid_offset(text.data(), text.size()));
+        return r.fail(CodecError::Encoding);
+    }
+    if (r.at_end()) return r.fail(CodecError::Syntax);
+    if (!read(r, out, "")) return false;
+    return r.at_end() || r.fail(CodecError::Syntax);
+}
+
+}  // namespace json_codec
+
+// Parse `text` into `out` (see the top of this file). On failure `out` may
+// be partly filled and `err` says why.
+template <typename T>
+bool decode(std::string_view text, T& out, CodecError& err) {
+    static_assert(!json_codec::has_views<T>::value, "std::string_view members: decode with an unescaped buffer");
+    return json_codec::decode_text(text, out, err, nullptr);
+}
+
+// For T with std::string_view members: they point into `text` (no copy) or,
+// for strings with escapes, into `unescaped` (cleared first). Both must
+// outlive the views.
+template <typename T>
+bool decode(std::string_view text, T& out, CodecError& err, std::string& unescaped) {
+    unescaped.clear();
+    return json_codec::decode_text(text, out, err, &unescaped);
+}
+
+// Append `v` as JSON to `out`; indent < 0 is compact. Fails (with the field
+// in err) only on strings that are not valid UTF-8.
+template <typename T>
+bool encode(const T& v, std::string& out, CodecError& err, int indent = -1) {
+    err = CodecError();
+    json_codec::Writer w(out, indent);
+    json_codec::write(w, v, "");
+    if (w.ok()) return true;
+    err.kind = CodecError::Encoding;
+    err.field = w.bad_field();
+    return false;
+}
@@ -0,0 +1,399 @@
+// loadgen.cpp
+//
+// Open-loop load generator for the settings server
+// - requests are scheduled at a fixed arrival rate, independent of how fast
+//   the server answers; each connection owns every Nth slot of the schedule
+// - latency is measured from a request's scheduled send time, not from when
+//   it was actually sent, which corrects for coordinated omission: when the
+//   server stalls (e.g. on db_mutex) the requests that should have been sent
+//   during the stall are charged for it instead of silently not existing
+// - latencies go into HDR histograms (see hdr_histogram.h), per route and overall
+// - the route mix is weighted (--mix) and users are picked at random from
+//   --users synthetic users
+// - profiles: one constant rate (--rate/--duration), explicit steps
+//   (--steps "100:10,200:10" = rate:seconds, ...), a linear ramp
+//   (--ramp FROM:TO:SECONDS, run as 10 equal steps), or --find-max, which
+//   raises the rate until a stage misses the p99 target (or errors more than
+//   1%, or falls 5% short of the offered rate) and then bisects to the
+//   highest rate that still meets it
+// - with --json FILE, writes every stage's per-route summaries and HDR
+//   buckets for bench_compare
+//
+// Usage:
+//   loadgen [--host H] [--port P] [--connections N] [--users N] [--seed S]
+//           [--rate R --duration S | --steps R:S,... | --ramp FROM:TO:S | --find-max]
+//           [--p99-ms MS] [--start-rate R] [--max-rate R] [--stage-sec S]
+//           [--mix "GET /settings=50,POST /history=25,..."] [--json FILE]
+// The API key is read from LUMA_API_KEY (default: the server's dev key).
+//
+// Build (example):
+// g++ loadgen.cpp -std=c++17 -O2 -pthread -o loadgen
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+
+#include "httplib.h"     // https://github.com/yhirose/cpp-httplib (single header)
+#include "json.hpp"      // nlohmann::json (single header)
+#include "hdr_histogram.h"
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int connections = 64;
+    int users = 1000;
+    uint64_t seed = 1;
+    double rate = 100;
+    double duration = 30;
+    std::string steps;
+    std::string ramp;
+    bool find_max = false;
+    double p99_ms = 50;
+    double start_rate = 50;
+    double max_rate = 20000;
+    double stage_sec = 10;
+    int refine = 3;           // bisection rounds after the first failing rate
+    double grace_sec = 5;     // after a stage, how long stragglers may still be sent
+    std::string mix = "GET /settings=45,POST /settings=10,POST /history=25,GET /history=12,"
+                      "POST /theme=5,GET /history/export=3";
+    std::string json_out;
+};
+
+struct Route {
+    std::string name;  // "METHOD /path"
+    std::string method;
+    std::string path;
+    double weight;
+};
+
+struct Stage {
+    double rate;
+    double seconds;
+};
+
+struct StageResult {
+    Stage stage;
+    double achieved_rate = 0;  // completed per second of stage time
+    uint64_t errors = 0;
+    uint64_t missed = 0;       // never sent: the stage ended with them still queued
+    HdrHistogram overall;
+    std::map<std::string, HdrHistogram> routes;
+    std::map<std::string, uint64_t> route_errors;
+};
+
+static Options parse_args(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i < argc; i++) {
+        std::string k = argv[i];
+        if (k == "--find-max") { o.find_max = true; continue; }
+        if (i + 1 >= argc) { std::cerr << "missing value for " << k << "\n"; std::exit(2); }
+        const char* v = argv[++i];
+        if (k == "--host") o.host = v;
+        else if (k == "--port") o.port = std::atoi(v);
+        else if (k == "--connections") o.connections = std::max(1, std::atoi(v));
+        else if (k == "--users") o.users = std::max(1, std::atoi(v));
+        else if (k == "--seed") o.seed = std::strtoull(v, nullptr, 10);
+        else if (k == "--rate") o.rate = std::atof(v);
+        else if (k == "--duration") o.duration = std::atof(v);
+        else if (k == "--steps") o.steps = v;
+        else if (k == "--ramp") o.ramp = v;
+        else if (k == "--p99-ms") o.p99_ms = std::atof(v);
+        else if (k == "--start-rate") o.start_rate = std::atof(v);
+        else if (k == "--max-rate") o.max_rate = std::atof(v);
+        else if (k == "--stage-sec") o.stage_sec = std::atof(v);
+        else if (k == "--refine") o.refine = std::atoi(v);
+        else if (k == "--mix") o.mix = v;
+        else if (k == "--json") o.json_out = v;
+        else { std::cerr << "unknown option " << k << "\n"; std::exit(2); }
+    }
+    return o;
+}
+
+static std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> out;
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t end = s.find(sep, start);
+        if (end == std::string::npos) end = s.size();
+        if (end > start) out.push_back(s.substr(start, end - start));
+        start = end + 1;
+    }
+    return out;
+}
+
+static std::vector<Route> parse_mix(const std::string& mix) {
+    std::vector<Route> routes;
+    for (const auto& item : split(mix, ',')) {
+        size_t eq = item.rfind('=');
+        size_t sp = item.find(' ');
+        if (eq == std::string::npos || sp == std::string::npos || sp > eq) {
+            std::cerr << "bad mix entry '" << item << "' (want 'METHOD /path=weight')\n";
+            std::exit(2);
+        }
+        Route r;
+        r.method = item.substr(0, sp);
+        r.path = item.substr(sp + 1, eq - sp - 1);
+        r.name = r.method + " " + r.path;
+        r.weight = std::atof(item.c_str() + eq + 1);
+        if (r.weight > 0) routes.push_back(r);
+    }
+    if (routes.empty()) {
+        std::cerr << "empty route mix\n";
+        std::exit(2);
+    }
+    return routes;
+}
+
+static std::vector<Stage> parse_stages(const Options& o) {
+    std::vector<Stage> stages;
+    if (!o.steps.empty()) {
+        for (const auto& s : split(o.steps, ',')) {
+            auto parts = split(s, ':');
+            if (parts.size() != 2) { std::cerr << "bad step '" << s << "' (want RATE:SECONDS)\n"; std::exit(2); }
+            stages.push_back({std::atof(parts[0].c_str()), std::atof(parts[1].c_str())});
+        }
+    } else if (!o.ramp.empty()) {
+        auto parts = split(o.ramp, ':');
+        if (parts.size() != 3) { std::cerr << "bad ramp (want FROM:TO:SECONDS)\n"; std::exit(2); }
+        double from = std::atof(parts[0].c_str()), to = std::atof(parts[1].c_str()), secs = std::atof(parts[2].c_str());
+        const int n = 10;
+        for (int i = 0; i < n; i++) stages.push_back({from + (to - from) * (i + 0.5) / n, secs / n});
+    } else {
+        stages.push_back({o.rate, o.duration});
+    }
+    return stages;
+}
+
+static std::string api_key() {
+    const char* k = std::getenv("LUMA_API_KEY");
+    return k ? k : "secret-api-key";
+}
+
+// Path and body for one request of `route` on behalf of `user`
+static void build_request(const Route& route, const std::string& user, std::mt19937_64& rng,
+                          std::string& path, std::string& body) {
+    path = route.path;
+    body.clear();
+    if (route.method == "GET") {
+        path += "?user_id=" + user;
+        return;
+    }
+    json j = {{"user_id", user}};
+    if (route.path == "/settings") {
+        j["settings"] = {{"dark_mode", rng() % 2 == 0}, {"language", rng() % 2 ? "English" : "German"}};
+    } else if (route.path == "/history") {
+        j["role"] = rng() % 2 ? "user" : "bot";
+        j["message"] = std::string(20 + rng() % 200, 'm');
+    } else if (route.path == "/theme") {
+        static const char* modes[] = {"System", "Light", "Dark"};
+        j["theme_mode"] = modes[rng() % 3];
+    } else if (route.path == "/profile") {
+        j["name"] = "Load User";
+    } else if (route.path == "/notifications") {
+        j["chat_notifications"] = rng() % 2 == 0;
+    } else if (route.path == "/security/biometric") {
+        j["enabled"] = rng() % 2 == 0;
+    }
+    body = j.dump();
+}
+
+static StageResult run_stage(const Options& o, const std::vector<Route>& routes, const Stage& stage, uint64_t stage_seed) {
+    StageResult result;
+    result.stage = stage;
+    if (stage.rate <= 0 || stage.seconds <= 0) return result;
+
+    double total_weight = 0;
+    for (const auto& r : routes) total_weight += r.weight;
+    uint64_t slots = static_cast<uint64_t>(stage.rate * stage.seconds);
+    auto interval = std::chrono::duration<double>(1.0 / stage.rate);
+    auto start = Clock::now() + std::chrono::milliseconds(50);
+    auto give_up = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(stage.seconds + o.grace_sec));
+    size_t workers_n = static_cast<size_t>(o.connections);
+
+    struct WorkerResult {
+        HdrHistogram overall;
+        std::map<std::string, HdrHistogram> routes;
+        std::map<std::string, uint64_t> route_errors;
+        uint64_t errors = 0;
+        uint64_t missed = 0;
+        uint64_t completed = 0;
+    };
+    std::vector<WorkerResult> per_worker(workers_n);
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < workers_n; w++) {
+        workers.emplace_back([&, w] {
+            WorkerResult& out = per_worker[w];
+            std::mt19937_64 rng(stage_seed * 1000003 + w);
+            std::uniform_real_distribution<double> pick(0, total_weight);
+            httplib::Client cli(o.host, o.port);
+            cli.set_keep_alive(true);
+            cli.set_read_timeout(30, 0);
+            httplib::Headers headers = {{"X-API-KEY", api_key()}};
+            std::string path, body;
+            for (uint64_t slot = w; slot < slots; slot += workers_n) {
+                auto intended = start + std::chrono::duration_cast<Clock::duration>(interval * static_cast<double>(slot));
+                double x = pick(rng);
+                const Route* route = &routes.back();
+                for (const auto& r : routes) {
+                    if (x < r.weight) { route = &r; break; }
+                    x -= r.weight;
+                }
+                std::string user = "load-user-" + std::to_string(rng() % static_cast<uint64_t>(o.users));
+
+                if (Clock::now() > give_up) {
+                    // Still owed but never sent: charge the lag so far, like a timeout
+                    uint64_t lag = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - intended).count());
+                    out.overall.record(lag);
+                    out.routes[route->name].record(lag);
+                    out.missed++;
+                    continue;
+                }
+                std::this_thread::sleep_until(intended);
+                build_request(*route, user, rng, path, body);
+                httplib::Result res = route->method == "GET"
+                        ? cli.Get(path.c_str(), headers)
+                        : cli.Post(path.c_str(), headers, body, "application/json");
+                auto done = Clock::now();
+                uint64_t us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(done - intended).count());
+                out.overall.record(us);
+                out.routes[route->name].record(us);
+                out.completed++;
+                if (!res || res->status >= 500 || res->status == 429) {
+                    out.errors++;
+                    out.route_errors[route->name]++;
+                }
+            }
+        });
+    }
+    for (auto& t : workers) t.join();
+
+    uint64_t completed = 0;
+    for (auto& w : per_worker) {
+        result.overall.merge(w.overall);
+        for (auto& kv : w.routes) result.routes[kv.first].merge(kv.second);
+        for (auto& kv : w.route_errors) result.route_errors[kv.first] += kv.second;
+        result.errors += w.errors;
+        result.missed += w.missed;
+        completed += w.completed;
+    }
+    result.achieved_rate = static_cast<double>(completed) / stage.seconds;
+    return result;
+}
+
+static bool meets_target(const Options& o, const StageResult& r) {
+    double n = static_cast<double>(r.overall.count());
+    return r.missed == 0 &&
+           static_cast<double>(r.overall.percentile(99)) <= o.p99_ms * 1000 &&
+           static_cast<double>(r.errors) <= 0.01 * n &&
+           r.achieved_rate >= 0.95 * r.stage.rate;
+}
+
+static void print_stage(const StageResult& r) {
+    std::printf("rate %8.1f/s for %5.1fs: achieved %8.1f/s  p50 %7llu  p90 %7llu  p99 %8llu  p99.9 %8llu  max %8llu us"
+                "  errors %llu  missed %llu\n",
+                r.stage.rate, r.stage.seconds, r.achieved_rate,
+                static_cast<unsigned long long>(r.overall.percentile(50)),
+                static_cast<unsigned long long>(r.overall.percentile(90)),
+                static_cast<unsigned long long>(r.overall.percentile(99)),
+                static_cast<unsigned long long>(r.overall.percentile(99.9)),
+                static_cast<unsigned long long>(r.overall.max()),
+                static_cast<unsigned long long>(r.errors), static_cast<unsigned long long>(r.missed));
+    for (const auto& kv : r.routes) {
+        auto err = r.route_errors.find(kv.first);
+        std::printf("    %-24s n=%-8llu p50 %7llu  p99 %8llu us  errors %llu\n", kv.first.c_str(),
+                    static_cast<unsigned long long>(kv.second.count()),
+                    static_cast<unsigned long long>(kv.second.percentile(50)),
+                    static_cast<unsigned long long>(kv.second.percentile(99)),
+                    static_cast<unsigned long long>(err == r.route_errors.end() ? 0 : err->second));
+    }
+    std::fflush(stdout);
+}
+
+static json stage_json(const StageResult& r) {
+    json routes = json::object();
+    for (const auto& kv : r.routes) {
+        json s = kv.second.summary();
+        auto err = r.route_errors.find(kv.first);
+        s["errors"] = err == r.route_errors.end() ? 0 : err->second;
+        s["buckets"] = kv.second.buckets();
+        routes[kv.first] = s;
+    }
+    json overall = r.overall.summary();
+    overall["buckets"] = r.overall.buckets();
+    return {
+            {"rate", r.stage.rate},
+            {"seconds", r.stage.seconds},
+            {"achieved_rate", r.achieved_rate},
+            {"errors", r.errors},
+            {"missed", r.missed},
+            {"overall", overall},
+            {"routes", routes}
+    };
+}
+
+int main(int argc, char** argv) {
+    Options o = parse_args(argc, argv);
+    auto routes = parse_mix(o.mix);
+    json out = {
+            {"tool", "loadgen"},
+            {"target", o.host + ":" + std::to_string(o.port)},
+            {"connections", o.connections},
+            {"mix", o.mix},
+            {"stages", json::array()}
+    };
+    uint64_t stage_seed = o.seed;
+
+    if (!o.find_max) {
+        for (const auto& stage : parse_stages(o)) {
+            StageResult r = run_stage(o, routes, stage, stage_seed++);
+            print_stage(r);
+            out["stages"].push_back(stage_json(r));
+        }
+    } else {
+        std::printf("searching for the highest rate with p99 <= %.1f ms\n", o.p99_ms);
+        double good = 0, bad = 0;
+        auto attempt = [&](double rate) {
+            StageResult r = run_stage(o, routes, {rate, o.stage_sec}, stage_seed++);
+            print_stage(r);
+            json s = stage_json(r);
+            bool ok = meets_target(o, r);
+            s["meets_target"] = ok;
+            out["stages"].push_back(s);
+            return ok;
+        };
+        for (double rate = o.start_rate; rate <= o.max_rate; rate *= 1.5) {
+            if (!attempt(rate)) { bad = rate; break; }
+            good = rate;
+        }
+        for (int i = 0; bad > 0 && i < o.refine; i++) {
+            double mid = (good + bad) / 2;
+            if (attempt(mid)) good = mid;
+            else bad = mid;
+        }
+        out["p99_target_ms"] = o.p99_ms;
+        out["max_sustainable_rate"] = good;
+        if (bad == 0) std::printf("target still met at --max-rate %.1f/s\n", good);
+        else std::printf("max sustainable rate: %.1f/s (p99 <= %.1f ms)\n", good, o.p99_ms);
+    }
+
+    if (!o.json_out.empty()) {
+        std::ofstream f(o.json_out);
+        f << out.dump(2) << "\n";
+        if (!f) {
+            std::cerr << "cannot write " << o.json_out << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,231 @@
+// lock_profiler.h
+//
+// Contention profiling for mutexes
+// - ProfiledMutex wraps std::mutex; every acquisition names its call site
+//   (usually __func__) through ProfiledLock, the RAII guard used instead of
+//   std::lock_guard / std::unique_lock
+// - per (mutex, site) it records wait time, hold time and how much waiting
+//   the site caused others while it held the lock ("blocked others")
+// - stats live in a fixed lock-free table of atomics; an uncontended
+//   acquire/release costs two steady_clock reads and a few relaxed adds
+//
+// ProfiledLock is Lockable (lock/unlock), so it works with
+// std::condition_variable_any.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "json.hpp"
+
+// log2-bucketed nanosecond histogram
+struct LockHistogram {
+    static const int BUCKETS = 48;
+    std::atomic<uint64_t> counts[BUCKETS] = {};
+
+    void record(uint64_t ns) {
+        int b = ns == 0 ? 0 : std::min(BUCKETS - 1, 64 - __builtin_clzll(ns));
+        counts[b].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Upper bound (ns) of the bucket holding the p-th percentile
+    uint64_t percentile(double p) const {
+        uint64_t n = 0;
+        for (const auto& c : counts) n += c.load(std::memory_order_relaxed);
+        if (n == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(n - 1)) + 1;
+        uint64_t seen = 0;
+        for (int b = 0; b < BUCKETS; b++) {
+            seen += counts[b].load(std::memory_order_relaxed);
+            if (seen >= rank) return b == 0 ? 0 : (uint64_t(1) << b);
+        }
+        return uint64_t(1) << (BUCKETS - 1);
+    }
+};
+
+struct LockSiteStats {
+    std::atomic<uint64_t> key{0};
+    std::atomic<const char*> mutex{nullptr};
+    std::atomic<const char*> site{nullptr};
+    std::atomic<uint64_t> acquisitions{0};
+    std::atomic<uint64_t> contended{0};
+    std::atomic<uint64_t> wait_ns{0};
+    std::atomic<uint64_t> hold_ns{0};
+    std::atomic<uint64_t> max_wait_ns{0};
+    std::atomic<uint64_t> max_hold_ns{0};
+    std::atomic<uint64_t> blocked_others_ns{0};  // waits that started while this site held the lock
+    LockHistogram wait_hist;
+    LockHistogram hold_hist;
+
+    static void raise(std::atomic<uint64_t>& max, uint64_t v) {
+        uint64_t prev = max.load(std::memory_order_relaxed);
+        while (v > prev && !max.compare_exchange_weak(prev, v, std::memory_order_relaxed)) {}
+    }
+};
+
+// Process-wide table of (mutex, site) stats. Open addressing over a fixed
+// array; slots are claimed with a CAS and never freed.
+class LockRegistry {
+public:
+    static const size_t SLOTS = 256;
+
+    static LockRegistry& instance() {
+        static LockRegistry registry;
+        return registry;
+    }
+
+    LockSiteStats* lookup(const char* mutex, const char* site) {
+        uint64_t key = (reinterpret_cast<uintptr_t>(mutex) * 0x9E3779B97F4A7C15ull) ^ reinterpret_cast<uintptr_t>(site);
+        if (key == 0) key = 1;
+        for (size_t i = 0; i < SLOTS; i++) {
+            LockSiteStats& slot = slots_[(key + i) % SLOTS];
+            uint64_t current = slot.key.load(std::memory_order_acquire);
+            if (current == key) return &slot;
+            if (current == 0) {
+                uint64_t expected = 0;
+                if (slot.key.compare_exchange_strong(expected, key, std::memory_order_acq_rel)) {
+                    slot.mutex.store(mutex, std::memory_order_release);
+                    slot.site.store(site, std::memory_order_release);
+                    return &slot;
+                }
+                if (expected == key) return &slot;
+            }
+        }
+        return &overflow_;  // table full: lump the rest together
+    }
+
+    nlohmann::json report(size_t top) const {
+        using nlohmann::json;
+        std::vector<const LockSiteStats*> used;
+        for (const auto& slot : slots_) {
+            if (slot.site.load(std::memory_order_acquire)) used.push_back(&slot);
+        }
+        if (overflow_.acquisitions.load()) used.push_back(&overflow_);
+
+        auto to_json = [](const LockSiteStats* s) {
+            uint64_t n = s->acquisitions.load(std::memory_order_relaxed);
+            const char* mutex = s->mutex.load();
+            const char* site = s->site.load();
+            return json{
+                    {"mutex", mutex ? mutex : "(overflow)"},
+                    {"site", site ? site : "(overflow)"},
+                    {"acquisitions", n},
+                    {"contended", s->contended.load(std::memory_order_relaxed)},
+                    {"wait", {
+                            {"total_us", s->wait_ns.load(std::memory_order_relaxed) / 1000},
+                            {"p50_ns", s->wait_hist.percentile(50)},
+                            {"p99_ns", s->wait_hist.percentile(99)},
+                            {"max_ns", s->max_wait_ns.load(std::memory_order_relaxed)}
+                    }},
+                    {"hold", {
+                            {"total_us", s->hold_ns.load(std::memory_order_relaxed) / 1000},
+                            {"mean_ns", n ? s->hold_ns.load(std::memory_order_relaxed) / n : 0},
+                            {"p50_ns", s->hold_hist.percentile(50)},
+                            {"p99_ns", s->hold_hist.percentile(99)},
+                            {"max_ns", s->max_hold_ns.load(std::memory_order_relaxed)}
+                    }},
+                    {"blocked_others_us", s->blocked_others_ns.load(std::memory_order_relaxed) / 1000}
+            };
+        };
+
+        json sites = json::array();
+        for (const auto* s : used) sites.push_back(to_json(s));
+
+        // Top contenders: holders that made others wait the longest
+        std::vector<const LockSiteStats*> ranked = used;
+        std::sort(ranked.begin(), ranked.end(), [](const LockSiteStats* a, const LockSiteStats* b) {
+            return a->blocked_others_ns.load() > b->blocked_others_ns.load();
+        });
+        json contenders = json::array();
+        for (size_t i = 0; i < ranked.size() && i < top; i++) {
+            if (ranked[i]->blocked_others_ns.load() == 0) break;
+            contenders.push_back(to_json(ranked[i]));
+        }
+        return {{"top_contenders", contenders}, {"sites", sites}};
+    }
+
+private:
+    LockSiteStats slots_[SLOTS];
+    LockSiteStats overflow_;
+};
+
+class ProfiledMutex {
+public:
+    explicit ProfiledMutex(const char* name) : name_(name) {}
+    ProfiledMutex(const ProfiledMutex&) = delete;
+    ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+    const char* name() const { return name_; }
+
+    void lock(const char* site) {
+        LockSiteStats* stats = LockRegistry::instance().lookup(name_, site);
+        uint64_t waited = 0;
+        if (!m_.try_lock()) {
+            auto t0 = std::chrono::steady_clock::now();
+            LockSiteStats* blocker = holder_.load(std::memory_order_relaxed);
+            m_.lock();
+            waited = elapsed_ns(t0, std::chrono::steady_clock::now());
+            stats->contended.fetch_add(1, std::memory_order_relaxed);
+            stats->wait_ns.fetch_add(waited, std::memory_order_relaxed);
+            LockSiteStats::raise(stats->max_wait_ns, waited);
+            if (blocker) blocker->blocked_others_ns.fetch_add(waited, std::memory_order_relaxed);
+        }
+        stats->acquisitions.fetch_add(1, std::memory_order_relaxed);
+        stats->wait_hist.record(waited);
+        holder_.store(stats, std::memory_order_relaxed);
+        acquired_ = std::chrono::steady_clock::now();
+    }
+
+    void unlock() {
+        LockSiteStats* stats = holder_.load(std::memory_order_relaxed);
+        uint64_t held = elapsed_ns(acquired_, std::chrono::steady_clock::now());
+        holder_.store(nullptr, std::memory_order_relaxed);
+        m_.unlock();
+        stats->hold_ns.fetch_add(held, std::memory_order_relaxed);
+        stats->hold_hist.record(held);
+        LockSiteStats::raise(stats->max_hold_ns, held);
+    }
+
+private:
+    static uint64_t elapsed_ns(std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(b - a).count());
+    }
+
+    std::mutex m_;
+    const char* name_;
+    std::atomic<LockSiteStats*> holder_{nullptr};  // read racily by waiters for attribution
+    std::chrono::steady_clock::time_point acquired_;  // only touched by the holder
+};
+
+// RAII guard naming the call site of the acquisition
+class ProfiledLock {
+public:
+    ProfiledLock(ProfiledMutex& m, const char* site) : m_(&m), site_(site) { lock(); }
+    ~ProfiledLock() {
+        if (owned_) m_->unlock();
+    }
+    ProfiledLock(ProfiledLock&& other) noexcept : m_(other.m_), site_(other.site_), owned_(other.owned_) {
+        other.owned_ = false;
+    }
+    ProfiledLock(const ProfiledLock&) = delete;
+    ProfiledLock& operator=(const ProfiledLock&) = delete;
+
+    void lock() {
+        m_->lock(site_);
+        owned_ = true;
+    }
+    void unlock() {
+        owned_ = false;
+        m_->unlock();
+    }
+
+private:
+    ProfiledMutex* m_;
+    const char* site_;
+    bool owned_ = false;
+};
@@ -0,0 +1,113 @@
+// logger_bench.cpp
+//
+// Latency cost of the async logger at peak request rates
+// - N threads each emit an access-log line (same fields as the server's)
+//   per simulated request, paced to a target aggregate QPS
+// - measures the time spent inside the log call alone and reports
+//   p50/p99/p99.9/max, next to the cost of an empty timed section
+// - lines go to /dev/null by default so the disk is not what is measured
+//
+// Usage:
+//   logger_bench [--threads N] [--qps Q] [--seconds S] [--out PATH]
+//
+// Build (example):
+// g++ logger_bench.cpp -std=c++17 -O2 -pthread -o logger_bench
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include "async_logger.h"
+
+struct Options {
+    int threads = 8;
+    double qps = 50000;  // aggregate target
+    double seconds = 5;
+    std::string out = "/dev/null";
+};
+
+static Options parse_args(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string k = argv[i];
+        const char* v = argv[i + 1];
+        if (k == "--threads") o.threads = std::atoi(v);
+        else if (k == "--qps") o.qps = std::atof(v);
+        else if (k == "--seconds") o.seconds = std::atof(v);
+        else if (k == "--out") o.out = v;
+        else std::cerr << "unknown option " << k << "\n";
+    }
+    return o;
+}
+
+// Per-call latencies in ns, one vector per thread
+static std::vector<uint64_t> run(const Options& o, bool log, int id) {
+    using clock = std::chrono::steady_clock;
+    std::vector<uint64_t> ns;
+    auto interval = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(o.threads / o.qps));
+    auto start = clock::now();
+    auto end = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(o.seconds));
+    std::string path = "/history/export";
+    std::string remote = "10.0.0." + std::to_string(id);
+    auto next = start;
+    for (uint64_t n = 0; next < end; n++, next += interval) {
+        std::this_thread::sleep_until(next);
+        auto t0 = clock::now();
+        if (log) {
+            LOG_INFO("access")
+                    .str("method", "GET")
+                    .str("path", path)
+                    .num("status", 200)
+                    .num("latency_us", 1234 + n % 100)
+                    .num("bytes_in", 0)
+                    .num("bytes_out", 48213)
+                    .str("remote", remote);
+        }
+        ns.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count()));
+    }
+    return ns;
+}
+
+static void report(const char* name, std::vector<uint64_t> all, double seconds) {
+    std::sort(all.begin(), all.end());
+    auto pct = [&all](double p) { return all.empty() ? 0 : all[static_cast<size_t>(p / 100.0 * (all.size() - 1))]; };
+    std::printf("%-10s calls %9zu (%8.0f/s)  p50 %6llu ns  p99 %6llu ns  p99.9 %7llu ns  max %8llu ns\n", name,
+                all.size(), all.size() / seconds, static_cast<unsigned long long>(pct(50)),
+                static_cast<unsigned long long>(pct(99)), static_cast<unsigned long long>(pct(99.9)),
+                static_cast<unsigned long long>(all.empty() ? 0 : all.back()));
+}
+
+static std::vector<uint64_t> run_all(const Options& o, bool log) {
+    std::vector<std::vector<uint64_t>> per_thread(o.threads);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < o.threads; i++) {
+        threads.emplace_back([&, i] { per_thread[i] = run(o, log, i); });
+    }
+    for (auto& t : threads) t.join();
+    std::vector<uint64_t> all;
+    for (auto& v : per_thread) all.insert(all.end(), v.begin(), v.end());
+    return all;
+}
+
+int main(int argc, char** argv) {
+    Options o = parse_args(argc, argv);
+    if (!Logger::instance().open(o.out.c_str())) {
+        std::cerr << "cannot open " << o.out << "\n";
+        return 1;
+    }
+    Logger::instance().start();
+
+    std::printf("%d threads, target %.0f req/s, %.1f s each\n", o.threads, o.qps, o.seconds);
+    report("baseline", run_all(o, false), o.seconds);
+    report("logging", run_all(o, true), o.seconds);
+    Logger::instance().stop();
+    std::printf("logged %llu lines, dropped %llu\n", static_cast<unsigned long long>(Logger::instance().logged()),
+                static_cast<unsigned long long>(Logger::instance().dropped()));
+    return 0;
+}
@@ -0,0 +1,709 @@
+// luma_store.cpp
+//
+// Implementation of luma_store.h and its C API (luma_store_c.h)
+
+#include "luma_store.h"
+#include "luma_store_c.h"
+#include "luma_store_json.h"
+#include "epoch.h"
+#include "schema.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+static const char* const SQL_INSERT_USER =
+        "INSERT OR IGNORE INTO users(user_id, name, email, avatar_url, created_at) "
+        "VALUES(?, 'User Name', 'user@example.com', '', ?);";
+
+static const char* const SQL_INSERT_DEFAULT_SETTINGS = R"sql(
+    INSERT OR IGNORE INTO settings(
+      user_id, theme_mode, dark_mode, notifications_enabled,
+      chat_notifications, update_notifications, reminder_notifications,
+      language, biometric_lock, app_version, updated_at
+    ) VALUES(?, 'System', 0, 1, 1, 1, 0, 'English', 0, '1.0.0', ?);
+    )sql";
+
+static const char* const SQL_SELECT_SETTINGS = R"sql(
+    SELECT u.user_id, u.name, u.email, u.avatar_url,
+           s.theme_mode, s.dark_mode, s.notifications_enabled,
+           s.chat_notifications, s.update_notifications, s.reminder_notifications,
+           s.language, s.biometric_lock, s.app_version, s.updated_at
+    FROM users u
+    JOIN settings s ON u.user_id = s.user_id
+    WHERE u.user_id = ?;
+    )sql";
+
+static const char* const SQL_UPDATE_PROFILE =
+        "UPDATE users SET name = COALESCE(?, name), email = COALESCE(?, email), "
+        "avatar_url = COALESCE(?, avatar_url) WHERE user_id = ?;";
+
+// NULL binds keep the stored value
+static const char* const SQL_UPSERT_SETTINGS = R"sql(
+    INSERT INTO settings(user_id, theme_mode, dark_mode, notifications_enabled,
+      chat_notifications, update_notifications, reminder_notifications,
+      language, biometric_lock, app_version, updated_at)
+    VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+    ON CONFLICT(user_id) DO UPDATE SET
+      theme_mode = COALESCE(excluded.theme_mode, settings.theme_mode),
+      dark_mode = COALESCE(excluded.dark_mode, settings.dark_mode),
+      notifications_enabled = COALESCE(excluded.notifications_enabled, settings.notifications_enabled),
+      chat_notifications = COALESCE(excluded.chat_notifications, settings.chat_notifications),
+      update_notifications = COALESCE(excluded.update_notifications, settings.update_notifications),
+      reminder_notifications = COALESCE(excluded.reminder_notifications, settings.reminder_notifications),
+      language = COALESCE(excluded.language, settings.language),
+      biometric_lock = COALESCE(excluded.biometric_lock, settings.biometric_lock),
+      app_version = COALESCE(excluded.app_version, settings.app_version),
+      updated_at = COALESCE(excluded.updated_at, settings.updated_at);
+    )sql";
+
+static const char* const SQL_INSERT_MESSAGE =
+        "INSERT INTO chat_history(user_id, role, message, created_at) VALUES(?, ?, ?, ?);";
+
+static const char* const SQL_SELECT_HISTORY =
+        "SELECT id, role, message, created_at FROM chat_history WHERE user_id = ? AND id > ? ORDER BY id ASC LIMIT ?;";
+
+static const char* const SQL_DELETE_HISTORY = "DELETE FROM chat_history WHERE user_id = ?;";
+
+static std::string now_iso() {
+    std::time_t t = std::time(nullptr);
+    std::tm tm{};
+    gmtime_r(&t, &tm);
+    char buf[32];
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    return buf;
+}
+
+static const char* column_text(sqlite3_stmt* stmt, int col) {
+    const unsigned char* text = sqlite3_column_text(stmt, col);
+    return text ? reinterpret_cast<const char*>(text) : "";
+}
+
+// Binds without copying (SQLITE_STATIC): `value` must stay alive until the
+// statement is reset and unbound, which StatementUse does before every call
+// returns. An empty view with no data still binds '' (a null pointer would
+// bind NULL).
+static void bind_text(sqlite3_stmt* stmt, int index, std::string_view value) {
+    sqlite3_bind_text(stmt, index, value.data() ? value.data() : "", static_cast<int>(value.size()), SQLITE_STATIC);
+}
+
+// Unset (or, if `empty_is_null`, empty) binds NULL
+static void bind_text(sqlite3_stmt* stmt, int index, const std::optional<std::string_view>& value, bool empty_is_null) {
+    if (value && !(empty_is_null && value->empty())) bind_text(stmt, index, *value);
+    else sqlite3_bind_null(stmt, index);
+}
+
+static void bind_flag(sqlite3_stmt* stmt, int index, const std::optional<bool>& value) {
+    if (value) sqlite3_bind_int(stmt, index, *value ? 1 : 0);
+    else sqlite3_bind_null(stmt, index);
+}
+
+// A cached statement for one use: reset and unbound when it goes out of scope
+class StatementUse {
+public:
+    explicit StatementUse(sqlite3_stmt* stmt) : stmt_(stmt) {}
+    ~StatementUse() {
+        if (!stmt_) return;
+        sqlite3_reset(stmt_);
+        sqlite3_clear_bindings(stmt_);
+    }
+    StatementUse(const StatementUse&) = delete;
+    StatementUse& operator=(const StatementUse&) = delete;
+    operator sqlite3_stmt*() const { return stmt_; }
+
+private:
+    sqlite3_stmt* stmt_;
+};
+
+// A write transaction under the store's writer lock. BEGIN IMMEDIATE takes
+// SQLite's write lock up front, so a writer in another process makes this
+// one wait (busy timeout) instead of failing when it upgrades. Rolled back
+// unless committed.
+class WriteTransaction {
+public:
+    WriteTransaction(StoreSession& session, const char* site)
+        : session_(session), lock_(session.store_.write_lock(site)) {
+        begun_ = session_.exec("BEGIN IMMEDIATE;");
+    }
+    ~WriteTransaction() {
+        if (begun_ && !committed_) sqlite3_exec(session_.db_, "ROLLBACK;", nullptr, nullptr, nullptr);
+    }
+    WriteTransaction(const WriteTransaction&) = delete;
+    WriteTransaction& operator=(const WriteTransaction&) = delete;
+
+    bool begun() const { return begun_; }
+    bool commit() {
+        committed_ = session_.exec("COMMIT;");
+        return committed_;
+    }
+
+private:
+    StoreSession& session_;
+    ProfiledLock lock_;
+    bool begun_ = false;
+    bool committed_ = false;
+};
+
+// --- Settings cache --- //
+//
+// A hash table of buckets of up to WAYS entries. A bucket and its entries are
+// immutable: a change builds a new bucket and swaps it into the slot with a
+// compare-and-swap, so a slot only ever changes to a newly allocated bucket
+// (never back to null), and pinned readers keep the old one from being freed
+// and its address reused. A miss remembers the bucket it searched before
+// reading the database and stores its row only if the slot still holds that
+// bucket; if a writer published meanwhile, the writer's entry is at least as
+// new. Entries dropped from a bucket (replaced, evicted or invalidated) are
+// retired with it.
+
+class SettingsCache {
+public:
+    static const size_t WAYS = 8;
+
+    struct Entry {
+        UserSettings settings;
+    };
+
+    // Most recently stored first; hashes inline so a lookup touches one entry
+    struct Bucket {
+        size_t count = 0;
+        size_t hashes[WAYS] = {};
+        const Entry* entries[WAYS] = {};
+    };
+
+    // A miss in progress: its slot and the bucket it searched
+    struct Miss {
+        EpochDomain::Guard pin;
+        std::atomic<const Bucket*>* slot;
+        const Bucket* seen;
+    };
+
+    explicit SettingsCache(size_t slots) {
+        size_t n = 1;
+        while (n * WAYS < slots) n <<= 1;
+        slots_.reset(new std::atomic<const Bucket*>[n]());
+        mask_ = n - 1;
+    }
+    ~SettingsCache() {
+        for (size_t i = 0; i <= mask_; i++) {
+            const Bucket* bucket = slots_[i].load();
+            if (!bucket) continue;
+            for (size_t e = 0; e < bucket->count; e++) delete bucket->entries[e];
+            delete bucket;
+        }
+    }
+
+    bool read(std::string_view user_id, const std::function<void(const UserSettings&)>& fn) const {
+        size_t hash = std::hash<std::string_view>()(user_id);
+        EpochDomain::Guard pin = epochs_.pin();
+        const Entry* entry = find(slot(hash).load(), hash, user_id);
+        if (!entry) return false;
+        fn(entry->settings);
+        return true;
+    }
+
+    Miss miss(std::string_view user_id) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        EpochDomain::Guard pin = epochs_.pin();
+        std::atomic<const Bucket*>& s = slot(std::hash<std::string_view>()(user_id));
+        return Miss{std::move(pin), &s, s.load()};
+    }
+
+    void fill(Miss& miss, const UserSettings& settings) {
+        if (store(*miss.slot, miss.seen, settings.user_id, &settings)) fills_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Writers only, under the writer lock after committing, so entries land
+    // in commit order. Null `settings` drops the user's entry.
+    void publish(std::string_view user_id, const UserSettings* settings) {
+        std::atomic<const Bucket*>& s = slot(std::hash<std::string_view>()(user_id));
+        EpochDomain::Guard pin = epochs_.pin();
+        while (!store(s, s.load(), user_id, settings)) {}
+        publishes_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    SettingsCacheStats stats() const {
+        SettingsCacheStats s;
+        s.capacity = (mask_ + 1) * WAYS;
+        s.misses = misses_.load(std::memory_order_relaxed);
+        s.fills = fills_.load(std::memory_order_relaxed);
+        s.publishes = publishes_.load(std::memory_order_relaxed);
+        s.epoch = epochs_.epoch();
+        s.retired = epochs_.retired_total();
+        s.reclaimed = epochs_.reclaimed_total();
+        return s;
+    }
+
+private:
+    std::atomic<const Bucket*>& slot(size_t hash) const { return slots_[hash & mask_]; }
+
+    static const Entry* find(const Bucket* bucket, size_t hash, std::string_view user_id) {
+        if (!bucket) return nullptr;
+        for (size_t i = 0; i < bucket->count; i++) {
+            if (bucket->hashes[i] == hash && bucket->entries[i]->settings.user_id == user_id) return bucket->entries[i];
+        }
+        return nullptr;
+    }
+
+    // Replaces `seen` in `s` with a copy holding `settings` (or without the
+    // user's entry if null); false if `s` no longer holds `seen`. The caller
+    // is pinned, so `seen` is still alive.
+    bool store(std::atomic<const Bucket*>& s, const Bucket* seen, std::string_view user_id,
+               const UserSettings* settings) {
+        size_t hash = std::hash<std::string_view>()(user_id);
+        const Entry* added = settings ? new Entry{*settings} : nullptr;
+        auto* bucket = new Bucket;
+        if (added) {
+            bucket->hashes[0] = hash;
+            bucket->entries[bucket->count++] = added;
+        }
+        const Entry* dropped[WAYS];
+        size_t dropped_count = 0;
+        for (size_t i = 0; seen && i < seen->count; i++) {
+            const Entry* e = seen->entries[i];
+            bool same_user = seen->hashes[i] == hash && e->settings.user_id == user_id;
+            if (same_user || bucket->count == WAYS) {
+                dropped[dropped_count++] = e;
+                continue;
+            }
+            bucket->hashes[bucket->count] = seen->hashes[i];
+            bucket->entries[bucket->count++] = e;
+        }
+        const Bucket* expected = seen;
+        if (!s.compare_exchange_strong(expected, bucket)) {
+            delete added;
+            delete bucket;
+            return false;
+        }
+        epochs_.retire(seen);
+        for (size_t i = 0; i < dropped_count; i++) epochs_.retire(dropped[i]);
+        return true;
+    }
+
+    std::unique_ptr<std::atomic<const Bucket*>[]> slots_;
+    size_t mask_ = 0;
+    mutable EpochDomain epochs_;
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> fills_{0};
+    std::atomic<uint64_t> publishes_{0};
+};
+
+// --- StoreSession --- //
+
+StoreSession::~StoreSession() {
+    for (auto& kv : statements_) sqlite3_finalize(kv.second);
+    sqlite3_close(db_);
+}
+
+// Prepared once per connection and kept; callers wrap it in StatementUse
+sqlite3_stmt* StoreSession::statement(const char* sql) {
+    auto it = statements_.find(sql);
+    if (it != statements_.end()) return it->second;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v3(db_, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr) != SQLITE_OK) {
+        fail("prepare");
+        return nullptr;
+    }
+    statements_.emplace(sql, stmt);
+    return stmt;
+}
+
+bool StoreSession::exec(const char* sql) {
+    if (sqlite3_exec(db_, sql, nullptr, nullptr, nullptr) != SQLITE_OK) return fail(sql);
+    return true;
+}
+
+// Always false. An interrupted statement (progress handler) isn't reported
+// through on_error: the caller cancelled it.
+bool StoreSession::fail(const char* op) {
+    error_ = std::string(op) + ": " + sqlite3_errmsg(db_);
+    const StoreOptions& options = store_.options();
+    if (options.on_error && sqlite3_errcode(db_) != SQLITE_INTERRUPT) options.on_error(op, error_);
+    return false;
+}
+
+bool StoreSession::cancelled(const char* op) {
+    const StoreOptions& options = store_.options();
+    if (!options.cancelled || !options.cancelled()) return false;
+    error_ = std::string(op) + ": cancelled";
+    return true;
+}
+
+bool StoreSession::read_settings(std::string_view user_id, UserSettings& out, bool& found) {
+    StatementUse stmt(statement(SQL_SELECT_SETTINGS));
+    if (!stmt) return false;
+    bind_text(stmt, 1, user_id);
+    int rc = sqlite3_step(stmt);
+    found = rc == SQLITE_ROW;
+    if (!found) return rc == SQLITE_DONE || fail("get_settings");
+    out.user_id = column_text(stmt, 0);
+    out.name = column_text(stmt, 1);
+    out.email = column_text(stmt, 2);
+    out.avatar_url = column_text(stmt, 3);
+    out.theme_mode = column_text(stmt, 4);
+    out.dark_mode = sqlite3_column_int(stmt, 5) != 0;
+    out.notifications_enabled = sqlite3_column_int(stmt, 6) != 0;
+    out.chat_notifications = sqlite3_column_int(stmt, 7) != 0;
+    out.update_notifications = sqlite3_column_int(stmt, 8) != 0;
+    out.reminder_notifications = sqlite3_column_int(stmt, 9) != 0;
+    out.language = column_text(stmt, 10);
+    out.biometric_lock = sqlite3_column_int(stmt, 11) != 0;
+    out.app_version = column_text(stmt, 12);
+    out.updated_at = column_text(stmt, 13);
+    return true;
+}
+
+// Default users/settings rows. Caller holds a WriteTransaction.
+bool StoreSession::ensure_user(std::string_view user_id) {
+    std::string now = now_iso();
+    for (const char* sql : {SQL_INSERT_USER, SQL_INSERT_DEFAULT_SETTINGS}) {
+        StatementUse stmt(statement(sql));
+        if (!stmt) return false;
+        bind_text(stmt, 1, user_id);
+        bind_text(stmt, 2, now);
+        if (sqlite3_step(stmt) != SQLITE_DONE) return fail("ensure_user");
+    }
+    return true;
+}
+
+// Caller holds a WriteTransaction
+bool StoreSession::apply(std::string_view user_id, const SettingsUpdateView& u) {
+    if (u.has_profile()) {
+        StatementUse stmt(statement(SQL_UPDATE_PROFILE));
+        if (!stmt) return false;
+        bind_text(stmt, 1, u.name, false);
+        bind_text(stmt, 2, u.email, false);
+        bind_text(stmt, 3, u.avatar_url, false);
+        bind_text(stmt, 4, user_id);
+        if (sqlite3_step(stmt) != SQLITE_DONE) return fail("update_profile");
+    }
+
+    StatementUse stmt(statement(SQL_UPSERT_SETTINGS));
+    if (!stmt) return false;
+    bind_text(stmt, 1, user_id);
+    bind_text(stmt, 2, u.theme_mode, true);
+    bind_flag(stmt, 3, u.dark_mode);
+    bind_flag(stmt, 4, u.notifications_enabled);
+    bind_flag(stmt, 5, u.chat_notifications);
+    bind_flag(stmt, 6, u.update_notifications);
+    bind_flag(stmt, 7, u.reminder_notifications);
+    bind_text(stmt, 8, u.language, true);
+    bind_flag(stmt, 9, u.biometric_lock);
+    bind_text(stmt, 10, u.app_version, true);
+    std::string now = now_iso();
+    bind_text(stmt, 11, now);
+    if (sqlite3_step(stmt) != SQLITE_DONE) return fail("update_settings");
+    return true;
+}
+
+bool StoreSession::insert_message(std::string_view user_id, std::string_view role, std::string_view message,
+                                  std::string_view created_at) {
+    StatementUse stmt(statement(SQL_INSERT_MESSAGE));
+    if (!stmt) return false;
+    std::string now = created_at.empty() ? now_iso() : std::string();
+    bind_text(stmt, 1, user_id);
+    bind_text(stmt, 2, role);
+    bind_text(stmt, 3, message);
+    bind_text(stmt, 4, created_at.empty() ? std::string_view(now) : created_at);
+    if (sqlite3_step(stmt) != SQLITE_DONE) return fail("append_message");
+    return true;
+}
+
+bool StoreSession::delete_history(std::string_view user_id) {
+    StatementUse stmt(statement(SQL_DELETE_HISTORY));
+    if (!stmt) return false;
+    bind_text(stmt, 1, user_id);
+    if (sqlite3_step(stmt) != SQLITE_DONE) return fail("clear_history");
+    return true;
+}
+
+// Caller holds the writer lock and has committed: entries land in commit order
+void StoreSession::publish_settings(std::string_view user_id) {
+    SettingsCache* cache = store_.settings_cache_.get();
+    if (!cache) return;
+    UserSettings settings;
+    bool found = false;
+    bool ok = read_settings(user_id, settings, found) && found;
+    cache->publish(user_id, ok ? &settings : nullptr);
+}
+
+bool StoreSession::get_settings(std::string_view user_id, UserSettings& out) {
+    SettingsCache* cache = store_.settings_cache_.get();
+    if (cache && cache->read(user_id, [&](const UserSettings& s) { out = s; })) return true;
+    std::optional<SettingsCache::Miss> miss;
+    if (cache) miss.emplace(cache->miss(user_id));
+
+    // Readers don't take the writer lock (WAL); only a first-time user needs the write path
+    bool found = false;
+    if (!read_settings(user_id, out, found)) return false;
+    if (!found) {
+        {
+            WriteTransaction tx(*this, "StoreSession::get_settings");
+            if (!tx.begun() || !ensure_user(user_id) || !tx.commit()) return false;
+        }
+        if (!read_settings(user_id, out, found)) return false;
+    }
+    if (miss && found) cache->fill(*miss, out);
+    return true;
+}
+
+bool StoreSession::update_settings(std::string_view user_id, const SettingsUpdateView& update) {
+    WriteTransaction tx(*this, "StoreSession::update_settings");
+    if (!tx.begun() || !ensure_user(user_id) || !apply(user_id, update) || !tx.commit()) return false;
+    publish_settings(user_id);
+    return true;
+}
+
+bool StoreSession::append_message(std::string_view user_id, std::string_view role, std::string_view message) {
+    WriteTransaction tx(*this, "StoreSession::append_message");
+    return tx.begun() && ensure_user(user_id) && insert_message(user_id, role, message, "") && tx.commit();
+}
+
+bool StoreSession::history_page(std::string_view user_id, int64_t after_id, size_t limit,
+                                std::vector<ChatMessage>& out) {
+    out.clear();
+    StatementUse stmt(statement(SQL_SELECT_HISTORY));
+    if (!stmt) return false;
+    bind_text(stmt, 1, user_id);
+    sqlite3_bind_int64(stmt, 2, after_id);
+    sqlite3_bind_int64(stmt, 3, limit ? static_cast<sqlite3_int64>(limit) : -1);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        ChatMessage m;
+        m.id = sqlite3_column_int64(stmt, 0);
+        m.role = column_text(stmt, 1);
+        m.message = column_text(stmt, 2);
+        m.created_at = column_text(stmt, 3);
+        out.push_back(std::move(m));
+    }
+    // cancelled mid-scan: drop the partial result right away
+    if (rc != SQLITE_DONE || cancelled("history_page")) {
+        out.clear();
+        out.shrink_to_fit();
+        return rc == SQLITE_DONE ? false : fail("history_page");
+    }
+    return true;
+}
+
+bool StoreSession::clear_history(std::string_view user_id) {
+    auto lock = store_.write_lock("StoreSession::clear_history");
+    return delete_history(user_id);
+}
+
+bool StoreSession::export_user(std::string_view user_id, UserExport& out) {
+    out.exported_at = now_iso();
+    return get_settings(user_id, out.settings) && history_page(user_id, 0, 0, out.chat_history);
+}
+
+bool StoreSession::import_user(std::string_view user_id, const UserImport& data, bool replace) {
+    WriteTransaction tx(*this, "StoreSession::import_user");
+    if (!tx.begun() || !ensure_user(user_id)) return false;
+    if (data.settings && !apply(user_id, data.settings->view())) return false;
+    if (data.chat_history) {
+        if (replace && !delete_history(user_id)) return false;
+        for (const auto& m : *data.chat_history) {
+            if (cancelled("import_user")) return false;
+            if (!insert_message(user_id, m.role, m.message, m.created_at)) return false;
+        }
+    }
+    if (!tx.commit()) return false;
+    if (data.settings) publish_settings(user_id);
+    return true;
+}
+
+// --- LumaStore --- //
+
+LumaStore::LumaStore(std::string path, StoreOptions options)
+    : path_(std::move(path)), options_(std::move(options)) {
+    if (options_.settings_cache_slots) settings_cache_.reset(new SettingsCache(options_.settings_cache_slots));
+}
+
+LumaStore::~LumaStore() = default;
+
+bool LumaStore::init(std::string* error) {
+    std::unique_ptr<StoreSession> session = open_session(error);
+    if (!session) return false;
+    auto lock = write_lock("LumaStore::init");
+    for (const char* sql : SCHEMA_STATEMENTS) {
+        if (!session->exec(sql)) {
+            if (error) *error = session->error();
+            return false;
+        }
+    }
+    return true;
+}
+
+// WAL lets readers run alongside a writer; the busy timeout covers SQLite's
+// own file lock held briefly by another connection or process
+std::unique_ptr<StoreSession> LumaStore::open_session(std::string* error) {
+    sqlite3* db = nullptr;
+    if (sqlite3_open(path_.c_str(), &db) != SQLITE_OK) {
+        if (error) *error = std::string("open ") + path_ + ": " + (db ? sqlite3_errmsg(db) : "out of memory");
+        sqlite3_close(db);
+        return nullptr;
+    }
+    std::unique_ptr<StoreSession> session(new StoreSession(*this, db));
+    sqlite3_busy_timeout(db, options_.busy_timeout_ms);
+    if (!session->exec("PRAGMA journal_mode=WAL;") || !session->exec("PRAGMA synchronous=NORMAL;")) {
+        if (error) *error = session->error();
+        return nullptr;
+    }
+    if (options_.on_open) options_.on_open(db);
+    return session;
+}
+
+bool LumaStore::read_cached_settings(std::string_view user_id,
+                                     const std::function<void(const UserSettings&)>& fn) const {
+    return settings_cache_ && settings_cache_->read(user_id, fn);
+}
+
+SettingsCacheStats LumaStore::settings_cache_stats() const {
+    return settings_cache_ ? settings_cache_->stats() : SettingsCacheStats();
+}
+
+ProfiledLock LumaStore::write_lock(const char* site) {
+    auto begin = std::chrono::steady_clock::now();
+    ProfiledLock lock(write_mutex_, site);
+    if (options_.on_lock_wait) options_.on_lock_wait(begin, std::chrono::steady_clock::now());
+    return lock;
+}
+
+// --- C API --- //
+
+struct luma_store {
+    std::unique_ptr<LumaStore> store;
+    std::unique_ptr<StoreSession> session;
+    std::string error;
+    UserSettings settings;                // backs the strings of the last luma_settings
+    std::vector<ChatMessage> page;        // and of the last history page
+    std::vector<luma_message> page_view;
+
+    int check(bool ok) {
+        if (ok) return LUMA_OK;
+        error = session->error();
+        return LUMA_ERROR;
+    }
+};
+
+extern "C" {
+
+int luma_store_open(const char* path, luma_store** out) {
+    auto* handle = new luma_store;
+    *out = handle;
+    handle->store.reset(new LumaStore(path ? path : ""));
+    if (!handle->store->init(&handle->error)) return LUMA_ERROR;
+    handle->session = handle->store->open_session(&handle->error);
+    return handle->session ? LUMA_OK : LUMA_ERROR;
+}
+
+void luma_store_close(luma_store* store) {
+    if (!store) return;
+    store->session.reset();
+    delete store;
+}
+
+const char* luma_store_errmsg(const luma_store* store) {
+    return store ? store->error.c_str() : "out of memory";
+}
+
+void luma_settings_update_init(luma_settings_update* update) {
+    std::memset(update, 0, sizeof(*update));
+    update->dark_mode = update->notifications_enabled = update->chat_notifications = -1;
+    update->update_notifications = update->reminder_notifications = update->biometric_lock = -1;
+}
+
+int luma_get_settings(luma_store* store, const char* user_id, luma_settings* out) {
+    if (!store->session) return LUMA_ERROR;
+    if (store->check(store->session->get_settings(user_id, store->settings)) != LUMA_OK) return LUMA_ERROR;
+    const UserSettings& s = store->settings;
+    out->user_id = s.user_id.c_str();
+    out->name = s.name.c_str();
+    out->email = s.email.c_str();
+    out->avatar_url = s.avatar_url.c_str();
+    out->theme_mode = s.theme_mode.c_str();
+    out->dark_mode = s.dark_mode;
+    out->notifications_enabled = s.notifications_enabled;
+    out->chat_notifications = s.chat_notifications;
+    out->update_notifications = s.update_notifications;
+    out->reminder_notifications = s.reminder_notifications;
+    out->language = s.language.c_str();
+    out->biometric_lock = s.biometric_lock;
+    out->app_version = s.app_version.c_str();
+    out->updated_at = s.updated_at.c_str();
+    return LUMA_OK;
+}
+
+int luma_update_settings(luma_store* store, const char* user_id, const luma_settings_update* update) {
+    if (!store->session) return LUMA_ERROR;
+    auto text = [](const char* v) { return v ? std::optional<std::string_view>(v) : std::nullopt; };
+    auto flag = [](int v) { return v >= 0 ? std::optional<bool>(v != 0) : std::nullopt; };
+    SettingsUpdateView u;
+    u.name = text(update->name);
+    u.email = text(update->email);
+    u.avatar_url = text(update->avatar_url);
+    u.theme_mode = text(update->theme_mode);
+    u.dark_mode = flag(update->dark_mode);
+    u.notifications_enabled = flag(update->notifications_enabled);
+    u.chat_notifications = flag(update->chat_notifications);
+    u.update_notifications = flag(update->update_notifications);
+    u.reminder_notifications = flag(update->reminder_notifications);
+    u.language = text(update->language);
+    u.biometric_lock = flag(update->biometric_lock);
+    u.app_version = text(update->app_version);
+    return store->check(store->session->update_settings(user_id, u));
+}
+
+int luma_append_message(luma_store* store, const char* user_id, const char* role, const char* message) {
+    if (!store->session) return LUMA_ERROR;
+    return store->check(store->session->append_message(user_id, role, message));
+}
+
+int luma_history_page(luma_store* store, const char* user_id, int64_t after_id, size_t limit,
+                      const luma_message** out, size_t* count) {
+    if (!store->session) return LUMA_ERROR;
+    if (store->check(store->session->history_page(user_id, after_id, limit, store->page)) != LUMA_OK) return LUMA_ERROR;
+    store->page_view.clear();
+    for (const auto& m : store->page) {
+        store->page_view.push_back({m.id, m.role.c_str(), m.message.c_str(), m.created_at.c_str()});
+    }
+    *out = store->page_view.data();
+    *count = store->page_view.size();
+    return LUMA_OK;
+}
+
+int luma_clear_history(luma_store* store, const char* user_id) {
+    if (!store->session) return LUMA_ERROR;
+    return store->check(store->session->clear_history(user_id));
+}
+
+int luma_export_json(luma_store* store, const char* user_id, char** out) {
+    if (!store->session) return LUMA_ERROR;
+    UserExport e;
+    if (store->check(store->session->export_user(user_id, e)) != LUMA_OK) return LUMA_ERROR;
+    std::string doc = export_to_json(e).dump(2, ' ', false, nlohmann::json::error_handler_t::replace);
+    *out = static_cast<char*>(std::malloc(doc.size() + 1));
+    if (!*out) {
+        store->error = "out of memory";
+        return LUMA_ERROR;
+    }
+    std::memcpy(*out, doc.c_str(), doc.size() + 1);
+    return LUMA_OK;
+}
+
+int luma_import_json(luma_store* store, const char* user_id, const char* json, int replace) {
+    if (!store->session) return LUMA_ERROR;
+    UserImport in;
+    try {
+        in = import_from_json(nlohmann::json::parse(json ? json : ""));
+    } catch (const std::exception& e) {
+        store->error = std::string("invalid import document: ") + e.what();
+        return LUMA_ERROR;
+    }
+    return store->check(store->session->import_user(user_id, in, replace != 0));
+}
+
+void luma_free(void* p) {
+    std::free(p);
+}
+
+}  // extern "C"
@@ -0,0 +1,262 @@
+// luma_store.h
+//
+// Embeddable storage for user settings and chat history (luma_settings.db)
+// - the settings server stores everything through this library; services on
+//   the same host can link it (CMake target luma_store) and read or write the
+//   same database in-process, without HTTP or JSON
+// - LumaStore is shared by all threads: it holds the path, the options and
+//   the writer lock. Each thread opens its own StoreSession, one SQLite
+//   connection with its prepared statements, used by one thread at a time
+// - readers never take the writer lock (WAL mode); writers in one process are
+//   serialized by it, writers in different processes by SQLite's file lock
+//   and the busy timeout
+// - calls return false on failure with the reason in StoreSession::error();
+//   nothing throws
+// - text arguments are borrowed (std::string_view) and bound to SQLite
+//   without copying (SQLITE_STATIC): they only need to outlive the call
+// - with StoreOptions::settings_cache_slots, settings reads are served from
+//   an in-memory cache that readers search without locks (epoch.h); writers
+//   publish the committed row in commit order under the writer lock
+// - luma_store_c.h is the C API over the same calls, luma_store_json.h
+//   converts to and from the server's JSON shapes
+//
+//   LumaStore store("luma_settings.db");
+//   store.init();
+//   auto session = store.open_session();
+//   UserSettings s;
+//   if (session && session->get_settings("u1", s) && s.dark_mode) ...
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "lock_profiler.h"
+
+// A user's profile and settings row
+struct UserSettings {
+    std::string user_id;
+    std::string name;
+    std::string email;
+    std::string avatar_url;
+    std::string theme_mode;  // System | Light | Dark
+    bool dark_mode = false;
+    bool notifications_enabled = true;
+    bool chat_notifications = true;
+    bool update_notifications = true;
+    bool reminder_notifications = false;
+    std::string language;
+    bool biometric_lock = false;
+    std::string app_version;
+    std::string updated_at;
+};
+
+struct SettingsUpdateView;
+
+// A partial update; unset fields keep their stored value. Like the HTTP API,
+// an empty theme_mode, language or app_version also leaves the value alone,
+// while profile fields (name, email, avatar_url) may be set to "".
+struct SettingsUpdate {
+    std::optional<std::string> name;
+    std::optional<std::string> email;
+    std::optional<std::string> avatar_url;
+    std::optional<std::string> theme_mode;
+    std::optional<bool> dark_mode;
+    std::optional<bool> notifications_enabled;
+    std::optional<bool> chat_notifications;
+    std::optional<bool> update_notifications;
+    std::optional<bool> reminder_notifications;
+    std::optional<std::string> language;
+    std::optional<bool> biometric_lock;
+    std::optional<std::string> app_version;
+
+    bool has_profile() const { return name || email || avatar_url; }
+
+    SettingsUpdateView view() const;
+};
+
+// A SettingsUpdate over text owned by the caller (e.g. views into a request
+// body), so an update reaches SQLite without a copy. Same rules as above.
+struct SettingsUpdateView {
+    std::optional<std::string_view> name;
+    std::optional<std::string_view> email;
+    std::optional<std::string_view> avatar_url;
+    std::optional<std::string_view> theme_mode;
+    std::optional<bool> dark_mode;
+    std::optional<bool> notifications_enabled;
+    std::optional<bool> chat_notifications;
+    std::optional<bool> update_notifications;
+    std::optional<bool> reminder_notifications;
+    std::optional<std::string_view> language;
+    std::optional<bool> biometric_lock;
+    std::optional<std::string_view> app_version;
+
+    bool has_profile() const { return name || email || avatar_url; }
+};
+
+inline SettingsUpdateView SettingsUpdate::view() const {
+    auto text = [](const std::optional<std::string>& v) {
+        return v ? std::optional<std::string_view>(*v) : std::nullopt;
+    };
+    SettingsUpdateView v;
+    v.name = text(name);
+    v.email = text(email);
+    v.avatar_url = text(avatar_url);
+    v.theme_mode = text(theme_mode);
+    v.dark_mode = dark_mode;
+    v.notifications_enabled = notifications_enabled;
+    v.chat_notifications = chat_notifications;
+    v.update_notifications = update_notifications;
+    v.reminder_notifications = reminder_notifications;
+    v.language = text(language);
+    v.biometric_lock = biometric_lock;
+    v.app_version = text(app_version);
+    return v;
+}
+
+struct ChatMessage {
+    int64_t id = 0;          // assigned on insert; ignored by import
+    std::string role;        // user | bot
+    std::string message;
+    std::string created_at;  // empty on append/import: now
+};
+
+// Everything stored for one user
+struct UserExport {
+    std::string exported_at;
+    UserSettings settings;
+    std::vector<ChatMessage> chat_history;
+};
+
+// What an import applies: the settings fields given and, if present, the
+// messages (history is left alone without them, even when replacing)
+struct UserImport {
+    std::optional<SettingsUpdate> settings;
+    std::optional<std::vector<ChatMessage>> chat_history;
+};
+
+struct StoreOptions {
+    // How long a connection waits on SQLite's file lock before SQLITE_BUSY
+    int busy_timeout_ms = 5000;
+    // Called for each new connection after the store has configured it
+    // (e.g. to install trace or progress callbacks)
+    std::function<void(sqlite3*)> on_open;
+    // Called after every wait for the writer lock, with its begin and end
+    std::function<void(std::chrono::steady_clock::time_point, std::chrono::steady_clock::time_point)> on_lock_wait;
+    // Polled between rows of long scans and imports; true abandons the call
+    std::function<bool()> cancelled;
+    // Called for every failed call, with the operation and SQLite's message
+    std::function<void(const char* op, const std::string& error)> on_error;
+    // Users the settings cache holds (rounded up to a power of two; 0: no cache).
+    // Only for a store that makes every settings write to the database: other
+    // processes, and SQL run through handle(), bypass the cache.
+    size_t settings_cache_slots = 0;
+};
+
+// Settings cache counters (lookups are not counted: they write nothing shared)
+struct SettingsCacheStats {
+    size_t capacity = 0;      // users it can hold
+    uint64_t misses = 0;      // get_settings calls that went to the database
+    uint64_t fills = 0;       // misses that stored the row they read
+    uint64_t publishes = 0;   // entries stored by writers
+    uint64_t epoch = 0;
+    uint64_t retired = 0;     // replaced buckets and entries, deleted once no reader can hold them
+    uint64_t reclaimed = 0;
+};
+
+class SettingsCache;
+
+class LumaStore;
+
+// One connection. Not thread-safe: use from one thread at a time.
+class StoreSession {
+public:
+    ~StoreSession();
+    StoreSession(const StoreSession&) = delete;
+    StoreSession& operator=(const StoreSession&) = delete;
+
+    // Settings of `user_id`, created with defaults on first access
+    bool get_settings(std::string_view user_id, UserSettings& out);
+    bool update_settings(std::string_view user_id, const SettingsUpdate& update) {
+        return update_settings(user_id, update.view());
+    }
+    bool update_settings(std::string_view user_id, const SettingsUpdateView& update);
+
+    bool append_message(std::string_view user_id, std::string_view role, std::string_view message);
+    // Up to `limit` messages (0: all) with id > after_id, oldest first; page on
+    // by passing the last id seen
+    bool history_page(std::string_view user_id, int64_t after_id, size_t limit, std::vector<ChatMessage>& out);
+    bool clear_history(std::string_view user_id);
+
+    bool export_user(std::string_view user_id, UserExport& out);
+    // Applies data.settings and appends data.chat_history (after deleting the
+    // existing history if `replace`), all in one transaction
+    bool import_user(std::string_view user_id, const UserImport& data, bool replace);
+
+    const std::string& error() const { return error_; }
+    sqlite3* handle() const { return db_; }
+
+private:
+    friend class LumaStore;
+    friend class WriteTransaction;
+    StoreSession(LumaStore& store, sqlite3* db) : store_(store), db_(db) {}
+
+    sqlite3_stmt* statement(const char* sql);
+    bool exec(const char* sql);
+    bool fail(const char* op);
+    bool cancelled(const char* op);
+    bool read_settings(std::string_view user_id, UserSettings& out, bool& found);
+    bool ensure_user(std::string_view user_id);
+    bool apply(std::string_view user_id, const SettingsUpdateView& update);
+    bool insert_message(std::string_view user_id, std::string_view role, std::string_view message,
+                        std::string_view created_at);
+    bool delete_history(std::string_view user_id);
+    void publish_settings(std::string_view user_id);
+
+    LumaStore& store_;
+    sqlite3* db_;
+    std::map<const char*, sqlite3_stmt*> statements_;  // keyed by the SQL literal
+    std::string error_;
+};
+
+class LumaStore {
+public:
+    explicit LumaStore(std::string path, StoreOptions options = {});
+    ~LumaStore();
+
+    // Create the tables if needed
+    bool init(std::string* error = nullptr);
+
+    // A new connection, or null (with the reason in *error)
+    std::unique_ptr<StoreSession> open_session(std::string* error = nullptr);
+
+    // The writer lock, for callers writing other tables of the same database
+    ProfiledLock write_lock(const char* site);
+
+    // Calls `fn` with the cached settings of `user_id` and returns true, or
+    // returns false (no cache, or not cached) without touching the database.
+    // Lock-free; `fn` runs while the entry is pinned and must not keep
+    // references to it.
+    bool read_cached_settings(std::string_view user_id, const std::function<void(const UserSettings&)>& fn) const;
+    SettingsCacheStats settings_cache_stats() const;
+
+    const std::string& path() const { return path_; }
+    const StoreOptions& options() const { return options_; }
+
+private:
+    friend class StoreSession;
+
+    std::string path_;
+    StoreOptions options_;
+    ProfiledMutex write_mutex_{"db_mutex"};
+    std::unique_ptr<SettingsCache> settings_cache_;  // null without settings_cache_slots
+};
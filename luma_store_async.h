@@ -0,0 +1,351 @@
+// luma_store_async.h
+//
+// Awaitable (C++20 coroutine) API over luma_store.h
+// - StoreExecutor runs store calls on a few DB threads, each with its own
+//   StoreSession, in FIFO order
+// - AsyncStore has the StoreSession calls as awaitables:
+//     StoreResult<UserSettings> r = co_await store.get_settings(user_id);
+//   The coroutine is suspended (holding no thread) until a DB thread has run
+//   the call, then resumed through the AsyncStore's resumer: inline on the DB
+//   thread by default, or handed to another pool so request work (parsing,
+//   serializing) never runs on the few DB threads
+// - Task<T> is a lazily started coroutine that can co_await and be
+//   co_awaited; spawn() starts a Task<void> detached, sync_wait() blocks the
+//   calling thread until a Task finishes
+// - arguments are copied into the call, so temporaries are safe to pass
+//
+// Needs -std=c++20. async_bench.cpp compares it with blocking threads.
+
+#pragma once
+
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "luma_store.h"
+#include "lock_profiler.h"
+
+// Outcome of an awaited store call: `value` is only meaningful if ok
+template <typename T = void>
+struct StoreResult {
+    bool ok = false;
+    std::string error;
+    T value{};
+
+    explicit operator bool() const { return ok; }
+};
+
+template <>
+struct StoreResult<void> {
+    bool ok = false;
+    std::string error;
+
+    explicit operator bool() const { return ok; }
+};
+
+// --- Task --- //
+
+template <typename T>
+class Task;
+
+namespace task_detail {
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // Hand control straight to whoever awaited the task (symmetric transfer)
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            std::coroutine_handle<> next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+    std::optional<T> value;
+    Task<T> get_return_object();
+    void return_value(T v) { value = std::move(v); }
+    T result() {
+        if (error) std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+    void result() {
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+}  // namespace task_detail
+
+template <typename T = void>
+class Task {
+public:
+    using promise_type = task_detail::Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Task(Handle h) : h_(h) {}
+    Task(Task&& other) noexcept : h_(std::exchange(other.h_, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (h_) h_.destroy();
+            h_ = std::exchange(other.h_, {});
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (h_) h_.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        h_.promise().continuation = awaiting;
+        return h_;
+    }
+    T await_resume() { return h_.promise().result(); }
+
+private:
+    Handle h_;
+};
+
+namespace task_detail {
+
+template <typename T>
+Task<T> Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// Coroutine that starts right away and frees itself when done
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+inline Detached run_detached(Task<void> task) {
+    co_await std::move(task);
+}
+
+}  // namespace task_detail
+
+// Start `task` without waiting for it; it must not throw
+inline void spawn(Task<void> task) {
+    task_detail::run_detached(std::move(task));
+}
+
+// Run `task` and block until it finishes (its result or exception)
+template <typename T>
+T sync_wait(Task<T> task) {
+    std::promise<T> done;
+    std::future<T> result = done.get_future();
+    spawn([](Task<T> t, std::promise<T>& p) -> Task<void> {
+        try {
+            if constexpr (std::is_void_v<T>) {
+                co_await std::move(t);
+                p.set_value();
+            } else {
+                p.set_value(co_await std::move(t));
+            }
+        } catch (...) {
+            p.set_exception(std::current_exception());
+        }
+    }(std::move(task), done));
+    return result.get();
+}
+
+// --- Executor --- //
+
+// DB threads with one session each. Jobs get a null session if the
+// thread's connection could not be opened.
+class StoreExecutor {
+public:
+    using Job = std::function<void(StoreSession*)>;
+
+    StoreExecutor(LumaStore& store, size_t workers) : store_(store) {
+        for (size_t i = 0; i < workers; i++) threads_.emplace_back([this] { worker_loop(); });
+    }
+    ~StoreExecutor() { stop(); }
+    StoreExecutor(const StoreExecutor&) = delete;
+    StoreExecutor& operator=(const StoreExecutor&) = delete;
+
+    void post(Job job) {
+        {
+            ProfiledLock lock(mutex_, "StoreExecutor::post");
+            queue_.push_back(std::move(job));
+        }
+        cv_.notify_one();
+    }
+
+    // Run the queued jobs, then stop the threads
+    void stop() {
+        {
+            ProfiledLock lock(mutex_, "StoreExecutor::stop");
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : threads_) t.join();
+        threads_.clear();
+    }
+
+    size_t workers() const { return threads_.size(); }
+
+private:
+    void worker_loop() {
+        std::unique_ptr<StoreSession> session = store_.open_session();
+        for (;;) {
+            Job job;
+            {
+                ProfiledLock lock(mutex_, "StoreExecutor::worker_loop");
+                cv_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+                if (queue_.empty()) return;
+                job = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            job(session.get());
+        }
+    }
+
+    LumaStore& store_;
+    ProfiledMutex mutex_{"store_executor"};
+    std::condition_variable_any cv_;
+    std::deque<Job> queue_;
+    std::vector<std::thread> threads_;
+    bool stopping_ = false;
+};
+
+// --- AsyncStore --- //
+
+// Where a coroutine continues after its store call; empty: on the DB thread
+using Resumer = std::function<void(std::coroutine_handle<>)>;
+
+// Awaitable for one store call, created by AsyncStore
+template <typename T>
+class StoreCall {
+public:
+    using Fn = std::function<StoreResult<T>(StoreSession&)>;
+
+    StoreCall(StoreExecutor& executor, const Resumer& resumer, Fn fn)
+        : executor_(executor), resumer_(resumer), fn_(std::move(fn)) {}
+
+    bool await_ready() const noexcept { return false; }
+    // The coroutine may be resumed (on another thread) before this returns,
+    // so nothing here touches the awaitable after post()
+    void await_suspend(std::coroutine_handle<> h) {
+        executor_.post([this, h](StoreSession* session) {
+            if (session) {
+                result_ = fn_(*session);
+            } else {
+                result_.error = "no database connection";
+            }
+            if (resumer_) resumer_(h);
+            else h.resume();
+        });
+    }
+    StoreResult<T> await_resume() { return std::move(result_); }
+
+private:
+    StoreExecutor& executor_;
+    const Resumer& resumer_;
+    Fn fn_;
+    StoreResult<T> result_;
+};
+
+class AsyncStore {
+public:
+    explicit AsyncStore(StoreExecutor& executor, Resumer resumer = {})
+        : executor_(executor), resumer_(std::move(resumer)) {}
+
+    StoreCall<UserSettings> get_settings(std::string user_id) {
+        return fetch<UserSettings>([user_id = std::move(user_id)](StoreSession& s, UserSettings& out) {
+            return s.get_settings(user_id, out);
+        });
+    }
+    StoreCall<void> update_settings(std::string user_id, SettingsUpdate update) {
+        return call([user_id = std::move(user_id), update = std::move(update)](StoreSession& s) {
+            return s.update_settings(user_id, update);
+        });
+    }
+    StoreCall<void> append_message(std::string user_id, std::string role, std::string message) {
+        return call([user_id = std::move(user_id), role = std::move(role), message = std::move(message)](StoreSession& s) {
+            return s.append_message(user_id, role, message);
+        });
+    }
+    StoreCall<std::vector<ChatMessage>> history_page(std::string user_id, int64_t after_id, size_t limit) {
+        return fetch<std::vector<ChatMessage>>([user_id = std::move(user_id), after_id, limit](
+                StoreSession& s, std::vector<ChatMessage>& out) {
+            return s.history_page(user_id, after_id, limit, out);
+        });
+    }
+    StoreCall<void> clear_history(std::string user_id) {
+        return call([user_id = std::move(user_id)](StoreSession& s) { return s.clear_history(user_id); });
+    }
+    StoreCall<UserExport> export_user(std::string user_id) {
+        return fetch<UserExport>([user_id = std::move(user_id)](StoreSession& s, UserExport& out) {
+            return s.export_user(user_id, out);
+        });
+    }
+    StoreCall<void> import_user(std::string user_id, UserImport data, bool replace) {
+        return call([user_id = std::move(user_id), data = std::move(data), replace](StoreSession& s) {
+            return s.import_user(user_id, data, replace);
+        });
+    }
+
+private:
+    // fn(session, out) -> bool
+    template <typename T, typename F>
+    StoreCall<T> fetch(F fn) {
+        return StoreCall<T>(executor_, resumer_, [fn = std::move(fn)](StoreSession& s) {
+            StoreResult<T> r;
+            r.ok = fn(s, r.value);
+            if (!r.ok) r.error = s.error();
+            return r;
+        });
+    }
+
+    // fn(session) -> bool
+    template <typename F>
+    StoreCall<void> call(F fn) {
+        return StoreCall<void>(executor_, resumer_, [fn = std::move(fn)](StoreSession& s) {
+            StoreResult<void> r;
+            r.ok = fn(s);
+            if (!r.ok) r.error = s.error();
+            return r;
+        });
+    }
+
+    StoreExecutor& executor_;
+    Resumer resumer_;
+};
@@ -0,0 +1,100 @@
+/* luma_store_c.h
+ *
+ * C API of the embeddable settings store (see luma_store.h)
+ * - a luma_store handle is one connection to the database; use it from one
+ *   thread at a time and open one handle per thread
+ * - every call returns LUMA_OK or LUMA_ERROR; luma_store_errmsg() says why
+ * - strings in results are owned by the handle and stay valid until the
+ *   next call on it; luma_export_json() results are freed with luma_free()
+ *
+ *   luma_store* db = NULL;
+ *   luma_settings s;
+ *   if (luma_store_open("luma_settings.db", &db) == LUMA_OK &&
+ *       luma_get_settings(db, "u1", &s) == LUMA_OK && s.dark_mode) ...
+ *   luma_store_close(db);
+ */
+
+#ifndef LUMA_STORE_C_H
+#define LUMA_STORE_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LUMA_OK 0
+#define LUMA_ERROR 1
+
+typedef struct luma_store luma_store;
+
+typedef struct luma_settings {
+    const char* user_id;
+    const char* name;
+    const char* email;
+    const char* avatar_url;
+    const char* theme_mode;
+    int dark_mode;
+    int notifications_enabled;
+    int chat_notifications;
+    int update_notifications;
+    int reminder_notifications;
+    const char* language;
+    int biometric_lock;
+    const char* app_version;
+    const char* updated_at;
+} luma_settings;
+
+/* Partial update: NULL strings and negative flags keep the stored value.
+ * luma_settings_update_init() sets every field that way. */
+typedef struct luma_settings_update {
+    const char* name;
+    const char* email;
+    const char* avatar_url;
+    const char* theme_mode;
+    int dark_mode;
+    int notifications_enabled;
+    int chat_notifications;
+    int update_notifications;
+    int reminder_notifications;
+    const char* language;
+    int biometric_lock;
+    const char* app_version;
+} luma_settings_update;
+
+typedef struct luma_message {
+    int64_t id;
+    const char* role;
+    const char* message;
+    const char* created_at;
+} luma_message;
+
+/* Opens (and creates the tables of) the database at `path`. *out is set even
+ * on failure so luma_store_errmsg() can be read; close it either way. */
+int luma_store_open(const char* path, luma_store** out);
+void luma_store_close(luma_store* store);
+const char* luma_store_errmsg(const luma_store* store);
+
+void luma_settings_update_init(luma_settings_update* update);
+int luma_get_settings(luma_store* store, const char* user_id, luma_settings* out);
+int luma_update_settings(luma_store* store, const char* user_id, const luma_settings_update* update);
+
+int luma_append_message(luma_store* store, const char* user_id, const char* role, const char* message);
+/* Up to `limit` messages (0: all) with id > after_id, oldest first */
+int luma_history_page(luma_store* store, const char* user_id, int64_t after_id, size_t limit,
+                      const luma_message** out, size_t* count);
+int luma_clear_history(luma_store* store, const char* user_id);
+
+/* Export document as the server's GET /history/export returns it */
+int luma_export_json(luma_store* store, const char* user_id, char** out);
+/* Import document as POST /history/import takes it; replace != 0 deletes
+ * the existing history first */
+int luma_import_json(luma_store* store, const char* user_id, const char* json, int replace);
+void luma_free(void* p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LUMA_STORE_C_H */
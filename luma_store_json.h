@@ -0,0 +1,94 @@
+// luma_store_json.h
+//
+// JSON shapes of the settings server for luma_store.h types
+// - settings_to_json / export_to_json / history_to_json: response bodies of
+//   GET /settings, GET /history/export and GET /history
+// - settings_update_from_json / import_from_json: request bodies of the
+//   settings routes and POST /history/import. Only keys present are taken;
+//   a value of the wrong type throws nlohmann::json::type_error, as reading
+//   the DOM directly did before
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "json.hpp"      // nlohmann::json (single header)
+#include "luma_store.h"
+
+inline nlohmann::json settings_to_json(const UserSettings& s) {
+    nlohmann::json out;
+    out["user_id"] = s.user_id;
+    out["name"] = s.name;
+    out["email"] = s.email;
+    out["avatar_url"] = s.avatar_url;
+    out["theme_mode"] = s.theme_mode;
+    out["dark_mode"] = s.dark_mode;
+    out["notifications_enabled"] = s.notifications_enabled;
+    out["chat_notifications"] = s.chat_notifications;
+    out["update_notifications"] = s.update_notifications;
+    out["reminder_notifications"] = s.reminder_notifications;
+    out["language"] = s.language;
+    out["biometric_lock"] = s.biometric_lock;
+    out["app_version"] = s.app_version;
+    out["updated_at"] = s.updated_at;
+    return out;
+}
+
+inline nlohmann::json history_to_json(const std::vector<ChatMessage>& messages) {
+    nlohmann::json arr = nlohmann::json::array();
+    for (const auto& m : messages) {
+        arr.push_back({{"role", m.role}, {"message", m.message}, {"created_at", m.created_at}});
+    }
+    return arr;
+}
+
+inline nlohmann::json export_to_json(const UserExport& e) {
+    nlohmann::json out;
+    out["exported_at"] = e.exported_at;
+    out["settings"] = settings_to_json(e.settings);
+    out["chat_history"] = history_to_json(e.chat_history);
+    return out;
+}
+
+template <typename T>
+inline void take_field(const nlohmann::json& j, const char* key, std::optional<T>& field) {
+    auto it = j.find(key);
+    if (it != j.end()) field = it->template get<T>();
+}
+
+inline SettingsUpdate settings_update_from_json(const nlohmann::json& j) {
+    SettingsUpdate u;
+    if (!j.is_object()) return u;
+    take_field(j, "name", u.name);
+    take_field(j, "email", u.email);
+    take_field(j, "avatar_url", u.avatar_url);
+    take_field(j, "theme_mode", u.theme_mode);
+    take_field(j, "dark_mode", u.dark_mode);
+    take_field(j, "notifications_enabled", u.notifications_enabled);
+    take_field(j, "chat_notifications", u.chat_notifications);
+    take_field(j, "update_notifications", u.update_notifications);
+    take_field(j, "reminder_notifications", u.reminder_notifications);
+    take_field(j, "language", u.language);
+    take_field(j, "biometric_lock", u.biometric_lock);
+    take_field(j, "app_version", u.app_version);
+    return u;
+}
+
+// An export document (or any subset of it); messages without a role are
+// "user" messages, without created_at they are stamped at import time
+inline UserImport import_from_json(const nlohmann::json& payload) {
+    UserImport in;
+    if (payload.contains("settings")) in.settings = settings_update_from_json(payload["settings"]);
+    if (payload.contains("chat_history")) {
+        in.chat_history.emplace();
+        for (const auto& m : payload["chat_history"]) {
+            ChatMessage msg;
+            msg.role = m.value("role", "user");
+            msg.message = m.value("message", "");
+            msg.created_at = m.value("created_at", "");
+            in.chat_history->push_back(std::move(msg));
+        }
+    }
+    return in;
+}
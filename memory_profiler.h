@@ -0,0 +1,311 @@
+// memory_profiler.h
+//
+// Heap accounting by subsystem plus a sampling heap profiler
+// - every operator new/delete goes through MemoryProfiler, which keeps live
+//   bytes per tag (http, json, trace, ...). The tag is a per-thread setting:
+//   MemoryScope switches it for a block, set_thread_tag() sets a thread's
+//   default. Bytes are credited back to the tag that allocated them, whatever
+//   thread frees them (the tag sits in a 16-byte header before each block).
+// - about one allocation per SAMPLE_RATE bytes is sampled: its backtrace goes
+//   into a fixed table until the block is freed, so the table is a profile of
+//   the live heap. Sizes are scaled up by the inverse sampling probability.
+// - memory that does not come from operator new (SQLite, malloc in libc) is
+//   not tagged; the caller reports it from its own statistics.
+//
+// The replacement operators are only compiled where MEMORY_PROFILER_HOOK_NEW
+// is defined before including this header; do that in exactly one
+// translation unit. The replacement is global all the same: once linked, every
+// operator new/delete in the program goes through it, including the ones in
+// luma_store, httplib and the standard library.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+#include "cpu_profiler.h"
+
+#include <execinfo.h>
+#include <malloc.h>
+#include <unistd.h>
+
+enum class MemTag : uint8_t { Other, Http, Json, Trace, Diagnostics, Count };
+static const char* const MEM_TAG_NAMES[] = {"other", "http", "json", "trace", "diagnostics"};
+static const int MEM_TAG_COUNT = static_cast<int>(MemTag::Count);
+
+class MemoryProfiler {
+public:
+    static const size_t SAMPLE_RATE = 512 * 1024;  // mean bytes between samples
+    static const size_t SLOTS = 4096;              // live sampled blocks kept
+    static const int MAX_FRAMES = 24;
+    static const size_t HEADER = 16;               // keeps the default new alignment
+
+    static MemoryProfiler& instance() {
+        static MemoryProfiler profiler;
+        return profiler;
+    }
+
+    static MemTag& current_tag() {
+        thread_local MemTag tag = MemTag::Other;
+        return tag;
+    }
+
+    // Default tag of the calling thread (outside any MemoryScope)
+    static void set_thread_tag(MemTag tag) { current_tag() = tag; }
+
+    // allocate() hands out the bytes after the header of a malloc() block and
+    // release() steps back to that block and free()s it, so the replacement
+    // new and delete below always pair malloc() with free() on the same
+    // pointer. Both stay out of line: inlined into a delete expression, GCC
+    // reads the step back as indexing before the deleted object
+    // (-Warray-bounds) and the free() as freeing new'd memory
+    // (-Wmismatched-new-delete).
+    __attribute__((noinline)) void* allocate(size_t size) {
+        char* block = static_cast<char*>(std::malloc(size + HEADER));
+        if (!block) return nullptr;
+        auto* h = reinterpret_cast<Header*>(block);
+        h->size = size;
+        h->tag = current_tag();
+        h->slot = -1;
+        Counters& c = tags_[static_cast<int>(h->tag)];
+        c.live.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+        c.allocated.fetch_add(size, std::memory_order_relaxed);
+        c.allocations.fetch_add(1, std::memory_order_relaxed);
+
+        Thread& t = thread_state();
+        t.until_sample -= static_cast<int64_t>(size);
+        if (t.rng == 0) t.until_sample = next_interval(t);  // first allocation on this thread
+        if (t.until_sample <= 0 && !t.in_hook) {
+            t.in_hook = true;
+            t.until_sample = next_interval(t);
+            h->slot = sample(h);
+            t.in_hook = false;
+        }
+        return block + HEADER;
+    }
+
+    __attribute__((noinline)) void release(void* p) {
+        if (!p) return;
+        char* block = static_cast<char*>(p) - HEADER;
+        auto* h = reinterpret_cast<Header*>(block);
+        Counters& c = tags_[static_cast<int>(h->tag)];
+        c.live.fetch_sub(static_cast<int64_t>(h->size), std::memory_order_relaxed);
+        c.frees.fetch_add(1, std::memory_order_relaxed);
+        if (h->slot >= 0) slots_[h->slot].state.store(0, std::memory_order_release);
+        std::free(block);
+    }
+
+    // Live and cumulative bytes per tag, process-level numbers from the kernel
+    // and glibc, and the `top` live allocation sites by estimated bytes
+    nlohmann::json report(size_t top) const {
+        using nlohmann::json;
+        json tags;
+        int64_t tracked = 0;
+        for (int i = 0; i < MEM_TAG_COUNT; i++) {
+            const Counters& c = tags_[i];
+            int64_t live = c.live.load(std::memory_order_relaxed);
+            tracked += live;
+            tags[MEM_TAG_NAMES[i]] = {
+                    {"live_bytes", live},
+                    {"allocated_bytes", c.allocated.load(std::memory_order_relaxed)},
+                    {"allocations", c.allocations.load(std::memory_order_relaxed)},
+                    {"frees", c.frees.load(std::memory_order_relaxed)}
+            };
+        }
+
+        std::vector<Site> sites = live_sites();
+        std::sort(sites.begin(), sites.end(), [](const Site& a, const Site& b) { return a.bytes > b.bytes; });
+        double sampled_total = 0;
+        for (const auto& s : sites) sampled_total += s.bytes;
+        json top_sites = json::array();
+        for (size_t i = 0; i < sites.size() && i < top; i++) {
+            top_sites.push_back({
+                    {"tag", MEM_TAG_NAMES[static_cast<int>(sites[i].tag)]},
+                    {"estimated_bytes", static_cast<uint64_t>(sites[i].bytes)},
+                    {"samples", sites[i].samples},
+                    {"stack", sites[i].frames}
+            });
+        }
+
+        json process = {{"rss_bytes", rss_bytes()}};
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+        struct mallinfo2 mi = mallinfo2();
+        process["malloc_in_use_bytes"] = mi.uordblks + mi.hblkhd;
+        process["malloc_free_bytes"] = mi.fordblks;
+        process["malloc_arena_bytes"] = mi.arena + mi.hblkhd;
+#endif
+        return {
+                {"tracked_live_bytes", tracked},
+                {"tags", tags},
+                {"process", process},
+                {"heap_profile", {
+                        {"sample_rate_bytes", SAMPLE_RATE},
+                        {"estimated_live_bytes", static_cast<uint64_t>(sampled_total)},
+                        {"dropped_samples", dropped_.load(std::memory_order_relaxed)},
+                        {"top_sites", top_sites}
+                }}
+        };
+    }
+
+    // Live heap as folded stacks weighted by estimated bytes (tag as the root)
+    std::string folded() const {
+        std::map<std::string, double> stacks;
+        for (const auto& s : live_sites()) {
+            std::string stack = MEM_TAG_NAMES[static_cast<int>(s.tag)];
+            for (auto it = s.frames.rbegin(); it != s.frames.rend(); ++it) stack += ";" + *it;
+            stacks[stack] += s.bytes;
+        }
+        std::string out;
+        for (const auto& kv : stacks) out += kv.first + " " + std::to_string(static_cast<uint64_t>(kv.second)) + "\n";
+        return out;
+    }
+
+    static uint64_t rss_bytes() {
+        long pages = 0, resident = 0;
+        std::FILE* f = std::fopen("/proc/self/statm", "r");
+        if (!f) return 0;
+        if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        std::fclose(f);
+        return static_cast<uint64_t>(resident) * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    }
+
+private:
+    struct Header {
+        size_t size;
+        MemTag tag;
+        int32_t slot;  // sample table index, -1 if not sampled
+    };
+    static_assert(sizeof(Header) <= HEADER, "header must fit in the alignment padding");
+
+    struct Counters {
+        std::atomic<int64_t> live{0};
+        std::atomic<uint64_t> allocated{0};
+        std::atomic<uint64_t> allocations{0};
+        std::atomic<uint64_t> frees{0};
+    };
+
+    // state: 0 free, 1 being written, otherwise the sampled block's address
+    struct Slot {
+        std::atomic<uintptr_t> state{0};
+        size_t size = 0;
+        MemTag tag = MemTag::Other;
+        int depth = 0;
+        void* frames[MAX_FRAMES];
+    };
+
+    struct Thread {
+        int64_t until_sample = 0;
+        uint64_t rng = 0;
+        bool in_hook = false;
+    };
+
+    struct Site {
+        MemTag tag;
+        std::vector<std::string> frames;  // leaf first
+        double bytes = 0;
+        uint64_t samples = 0;
+    };
+
+    MemoryProfiler() = default;
+
+    static Thread& thread_state() {
+        thread_local Thread t;
+        return t;
+    }
+
+    // Exponentially distributed gap, so every byte is equally likely to be sampled
+    static int64_t next_interval(Thread& t) {
+        if (t.rng == 0) t.rng = reinterpret_cast<uintptr_t>(&t) | 1;
+        t.rng ^= t.rng << 13;
+        t.rng ^= t.rng >> 7;
+        t.rng ^= t.rng << 17;
+        double u = (static_cast<double>(t.rng >> 11) + 1.0) / 9007199254740993.0;
+        return static_cast<int64_t>(-std::log(u) * SAMPLE_RATE) + 1;
+    }
+
+    int32_t sample(const Header* h) {
+        size_t start = (reinterpret_cast<uintptr_t>(h) >> 4) % SLOTS;
+        for (size_t i = 0; i < 64; i++) {
+            size_t idx = (start + i) % SLOTS;
+            Slot& s = slots_[idx];
+            uintptr_t expected = 0;
+            if (!s.state.compare_exchange_strong(expected, 1, std::memory_order_acquire)) continue;
+            s.size = h->size;
+            s.tag = h->tag;
+            s.depth = backtrace(s.frames, MAX_FRAMES);
+            s.state.store(reinterpret_cast<uintptr_t>(h), std::memory_order_release);
+            return static_cast<int32_t>(idx);
+        }
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return -1;
+    }
+
+    // Sampled live blocks grouped by stack; skips allocate() and operator new
+    std::vector<Site> live_sites() const {
+        std::map<std::vector<void*>, Site> by_stack;
+        for (const Slot& s : slots_) {
+            uintptr_t state = s.state.load(std::memory_order_acquire);
+            if (state <= 1) continue;
+            std::vector<void*> frames(s.frames + std::min(2, s.depth), s.frames + s.depth);
+            size_t size = s.size;
+            MemTag tag = s.tag;
+            if (s.state.load(std::memory_order_acquire) != state) continue;  // freed meanwhile
+
+            Site& site = by_stack[frames];
+            site.tag = tag;
+            double p = 1.0 - std::exp(-static_cast<double>(size) / SAMPLE_RATE);
+            site.bytes += p > 0 ? size / p : 0;
+            site.samples++;
+        }
+        std::vector<Site> out;
+        for (auto& kv : by_stack) {
+            for (void* pc : kv.first) kv.second.frames.push_back(CpuProfiler::symbolize(static_cast<char*>(pc) - 1));
+            out.push_back(std::move(kv.second));
+        }
+        return out;
+    }
+
+    Counters tags_[MEM_TAG_COUNT];
+    Slot slots_[SLOTS];
+    std::atomic<uint64_t> dropped_{0};
+};
+
+// Attribute the calling thread's allocations to `tag` for this scope
+class MemoryScope {
+public:
+    explicit MemoryScope(MemTag tag) : previous_(MemoryProfiler::current_tag()) {
+        MemoryProfiler::current_tag() = tag;
+    }
+    ~MemoryScope() { MemoryProfiler::current_tag() = previous_; }
+    MemoryScope(const MemoryScope&) = delete;
+    MemoryScope& operator=(const MemoryScope&) = delete;
+
+private:
+    MemTag previous_;
+};
+
+#ifdef MEMORY_PROFILER_HOOK_NEW
+// Over-aligned new/delete keep the library versions; they never reach these.
+void* operator new(size_t size) {
+    if (void* p = MemoryProfiler::instance().allocate(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return MemoryProfiler::instance().allocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return MemoryProfiler::instance().allocate(size); }
+void operator delete(void* p) noexcept { MemoryProfiler::instance().release(p); }
+void operator delete[](void* p) noexcept { MemoryProfiler::instance().release(p); }
+void operator delete(void* p, size_t) noexcept { MemoryProfiler::instance().release(p); }
+void operator delete[](void* p, size_t) noexcept { MemoryProfiler::instance().release(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { MemoryProfiler::instance().release(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { MemoryProfiler::instance().release(p); }
+#endif
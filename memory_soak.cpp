@@ -0,0 +1,175 @@
+// memory_soak.cpp
+//
+// Soak test for the settings server's memory use
+// - drives a steady import/export/history/settings workload against a
+//   running server for a fixed time
+// - polls GET /debug/memory and records RSS, SQLite memory and the live
+//   bytes of every tag
+// - after a warm-up, fits a line through each series; a series whose fitted
+//   growth over the measured window exceeds the limit is reported as
+//   unbounded and the program exits with status 1
+//
+// Usage:
+//   memory_soak [--host H] [--port P] [--minutes M] [--clients N]
+//               [--users N] [--messages N] [--interval-sec S] [--max-growth-mb MB]
+// The API key is read from LUMA_API_KEY (default: the server's dev key).
+//
+// Build (example):
+// g++ memory_soak.cpp -std=c++17 -O2 -pthread -o memory_soak
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <cstdio>
+
+#include "httplib.h"     // https://github.com/yhirose/cpp-httplib (single header)
+#include "json.hpp"      // nlohmann::json (single header)
+
+using json = nlohmann::json;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    double minutes = 10;
+    int clients = 4;
+    int users = 8;
+    int messages = 2000;
+    int interval_sec = 5;
+    double max_growth_mb = 8;
+    double warmup_fraction = 0.25;  // samples ignored at the start
+};
+
+struct Series {
+    std::vector<double> t_min;
+    std::vector<double> bytes;
+};
+
+static std::atomic<bool> running{true};
+static std::atomic<uint64_t> requests{0};
+static std::atomic<uint64_t> failures{0};
+
+static Options parse_args(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string k = argv[i];
+        const char* v = argv[i + 1];
+        if (k == "--host") o.host = v;
+        else if (k == "--port") o.port = std::atoi(v);
+        else if (k == "--minutes") o.minutes = std::atof(v);
+        else if (k == "--clients") o.clients = std::atoi(v);
+        else if (k == "--users") o.users = std::atoi(v);
+        else if (k == "--messages") o.messages = std::atoi(v);
+        else if (k == "--interval-sec") o.interval_sec = std::atoi(v);
+        else if (k == "--max-growth-mb") o.max_growth_mb = std::atof(v);
+        else std::cerr << "unknown option " << k << "\n";
+    }
+    return o;
+}
+
+static void count(const httplib::Result& r) {
+    requests++;
+    if (!r || r->status >= 400) failures++;
+}
+
+// One client: cycles through its users doing a full replace-import, an
+// export, a history listing and a settings write. Every cycle leaves the DB
+// the same size, so memory should level off.
+static void client_loop(const Options& o, int id, const httplib::Headers& headers) {
+    httplib::Client cli(o.host, o.port);
+    cli.set_read_timeout(std::chrono::seconds(60));
+
+    json history = json::array();
+    for (int i = 0; i < o.messages; i++) {
+        history.push_back({{"role", i % 2 ? "bot" : "user"},
+                           {"message", "soak message " + std::to_string(i) + std::string(120, 'x')}});
+    }
+
+    for (uint64_t n = 0; running; n++) {
+        std::string user = "soak-" + std::to_string((id + n * o.clients) % o.users);
+        json payload = {{"user_id", user}, {"settings", {{"language", "English"}}}, {"chat_history", history}};
+        count(cli.Post("/history/import?replace=true", headers, payload.dump(), "application/json"));
+        count(cli.Get("/history/export?user_id=" + user, headers));
+        count(cli.Get("/history?user_id=" + user, headers));
+        json settings = {{"user_id", user}, {"settings", {{"dark_mode", n % 2 == 0}}}};
+        count(cli.Post("/settings", headers, settings.dump(), "application/json"));
+    }
+}
+
+// Least-squares slope in bytes per minute
+static double slope(const Series& s, size_t from) {
+    double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (size_t i = from; i < s.t_min.size(); i++) {
+        n++;
+        sx += s.t_min[i];
+        sy += s.bytes[i];
+        sxx += s.t_min[i] * s.t_min[i];
+        sxy += s.t_min[i] * s.bytes[i];
+    }
+    double d = n * sxx - sx * sx;
+    return n < 2 || d == 0 ? 0 : (n * sxy - sx * sy) / d;
+}
+
+int main(int argc, char** argv) {
+    Options o = parse_args(argc, argv);
+    const char* key = std::getenv("LUMA_API_KEY");
+    httplib::Headers headers = {{"X-API-KEY", key ? key : "secret-api-key"}};
+
+    std::vector<std::thread> clients;
+    for (int i = 0; i < o.clients; i++) clients.emplace_back(client_loop, std::cref(o), i, std::cref(headers));
+
+    httplib::Client probe(o.host, o.port);
+    std::map<std::string, Series> series;
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::ratio<60>>(o.minutes));
+    while (std::chrono::steady_clock::now() < end) {
+        std::this_thread::sleep_for(std::chrono::seconds(o.interval_sec));
+        auto r = probe.Get("/debug/memory", headers);
+        if (!r || r->status != 200) {
+            std::cerr << "GET /debug/memory failed\n";
+            continue;
+        }
+        json m = json::parse(r->body, nullptr, false);
+        if (m.is_discarded()) continue;
+        double t = std::chrono::duration<double, std::ratio<60>>(std::chrono::steady_clock::now() - start).count();
+        auto add = [&](const std::string& name, double bytes) {
+            series[name].t_min.push_back(t);
+            series[name].bytes.push_back(bytes);
+        };
+        add("rss", m["process"].value("rss_bytes", 0.0));
+        add("sqlite", m["sqlite"].value("memory_used_bytes", 0.0));
+        add("heap.tracked", m.value("tracked_live_bytes", 0.0));
+        for (auto& kv : m["tags"].items()) add("heap." + kv.key(), kv.value().value("live_bytes", 0.0));
+        std::printf("%7.2f min  rss %8.1f MiB  sqlite %7.1f MiB  heap %7.1f MiB  requests %llu\n", t,
+                    series["rss"].bytes.back() / 1048576, series["sqlite"].bytes.back() / 1048576,
+                    series["heap.tracked"].bytes.back() / 1048576, static_cast<unsigned long long>(requests.load()));
+        std::fflush(stdout);
+    }
+    running = false;
+    for (auto& c : clients) c.join();
+
+    bool leak = false;
+    std::printf("\n%-18s %14s %14s %16s\n", "series", "first MiB", "last MiB", "growth MiB/min");
+    for (const auto& kv : series) {
+        const Series& s = kv.second;
+        if (s.bytes.size() < 4) continue;
+        size_t from = static_cast<size_t>(s.bytes.size() * o.warmup_fraction);
+        double per_min = slope(s, from);
+        double window = s.t_min.back() - s.t_min[from];
+        bool growing = per_min * window > o.max_growth_mb * 1048576;
+        leak = leak || growing;
+        std::printf("%-18s %14.2f %14.2f %16.3f%s\n", kv.first.c_str(), s.bytes[from] / 1048576,
+                    s.bytes.back() / 1048576, per_min / 1048576, growing ? "  <- UNBOUNDED GROWTH" : "");
+    }
+    std::printf("\nrequests %llu, failures %llu\n", static_cast<unsigned long long>(requests.load()),
+                static_cast<unsigned long long>(failures.load()));
+    if (series.empty()) {
+        std::cerr << "no samples collected\n";
+        return 2;
+    }
+    return leak ? 1 : 0;
+}
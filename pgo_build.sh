@@ -0,0 +1,114 @@
+#!/usr/bin/env bash
+# pgo_build.sh
+#
+# Builds an LTO+PGO settings_server trained on the load generator's endpoint
+# mix, and benchmarks it against a plain Release build
+# 1. _build/base: Release build of the server and tools (the baseline)
+# 2. _build/pgo:  instrumented server (LUMA_PGO=GENERATE)
+# 3. training: the instrumented server runs on a datagen database under a
+#    loadgen ramp with the default route mix, then gets SIGTERM so it exits
+#    cleanly and writes its profile
+# 4. _build/pgo:  rebuilt in place with LUMA_PGO=USE and LUMA_LTO=ON
+# 5. benchmark: baseline and optimized servers alternate (ROUNDS times) on
+#    identical copies of the database under the same constant-rate loadgen
+#    run; bench_compare reports the per-route change with confidence intervals
+#
+# The server always listens on :8080, so nothing else may be using it.
+# Environment overrides: TRAIN_SECONDS (60) TRAIN_RATE (2000) BENCH_RATE (500)
+# BENCH_SECONDS (20) ROUNDS (2) USERS (20000) CMAKE_ARGS (extra configure
+# arguments, e.g. -DHTTPLIB_INCLUDE_DIR=...)
+#
+# Usage: ./pgo_build.sh   (results in _build/pgo-results)
+
+set -euo pipefail
+
+ROOT="$(cd "$(dirname "$0")" && pwd)"
+OUT="$ROOT/_build"
+BASE="$OUT/base"
+PGO="$OUT/pgo"
+PROFILES="$PGO/pgo-profiles"
+RESULTS="$OUT/pgo-results"
+TRAIN_SECONDS="${TRAIN_SECONDS:-60}"
+TRAIN_RATE="${TRAIN_RATE:-2000}"
+BENCH_RATE="${BENCH_RATE:-500}"
+BENCH_SECONDS="${BENCH_SECONDS:-20}"
+ROUNDS="${ROUNDS:-2}"
+USERS="${USERS:-20000}"
+CONNECTIONS=24  # below the server's HTTP thread count, so keep-alive connections never queue for a thread
+JOBS="$(nproc 2>/dev/null || echo 4)"
+read -r -a EXTRA <<< "${CMAKE_ARGS:-}"
+
+configure_and_build() {  # dir, target, cmake args...
+    local dir="$1" target="$2"
+    shift 2
+    cmake -S "$ROOT" -B "$dir" -DCMAKE_BUILD_TYPE=Release "${EXTRA[@]}" "$@" > /dev/null
+    cmake --build "$dir" -j"$JOBS" --target "$target"
+}
+
+# Runs server binary $1 in directory $2 until the command after them finishes
+with_server() {
+    local bin="$1" dir="$2"
+    shift 2
+    (cd "$dir" && exec "$bin" > server.log 2>&1) &
+    local pid=$!
+    local up=0
+    for _ in $(seq 100); do
+        if curl -sf -o /dev/null "http://127.0.0.1:8080/health"; then up=1; break; fi
+        sleep 0.1
+    done
+    if [ "$up" = 0 ]; then
+        echo "server did not start, see $dir/server.log" >&2
+        kill "$pid" 2>/dev/null || true
+        exit 1
+    fi
+    "$@"
+    kill -TERM "$pid"
+    wait "$pid"
+}
+
+echo "== baseline build"
+configure_and_build "$BASE" all -DLUMA_PGO=OFF -DLUMA_LTO=OFF
+
+echo "== instrumented build"
+rm -rf "$PROFILES"
+configure_and_build "$PGO" settings_server -DLUMA_PGO=GENERATE -DLUMA_LTO=OFF -DLUMA_PGO_DIR="$PROFILES"
+
+echo "== seed database ($USERS users)"
+rm -rf "$RESULTS"
+mkdir -p "$RESULTS/seed" "$RESULTS/train"
+"$BASE/datagen" --db "$RESULTS/seed/luma_settings.db" --users "$USERS" --overwrite
+cp "$RESULTS/seed/luma_settings.db" "$RESULTS/train/"
+
+echo "== training for ${TRAIN_SECONDS}s"
+with_server "$PGO/settings_server" "$RESULTS/train" \
+    "$BASE/loadgen" --ramp "50:$TRAIN_RATE:$TRAIN_SECONDS" --users "$USERS" \
+                        --connections "$CONNECTIONS" > "$RESULTS/train/loadgen.txt"
+if compgen -G "$PROFILES/*.profraw" > /dev/null; then
+    llvm-profdata merge -o "$PROFILES/settings_server.profdata" "$PROFILES"/*.profraw
+fi
+
+echo "== optimized build (PGO + LTO)"
+configure_and_build "$PGO" settings_server -DLUMA_PGO=USE -DLUMA_LTO=ON -DLUMA_PGO_DIR="$PROFILES"
+
+echo "== benchmark: $ROUNDS rounds of ${BENCH_SECONDS}s at ${BENCH_RATE}/s"
+base_runs=()
+pgo_runs=()
+for round in $(seq "$ROUNDS"); do
+    for variant in base pgo; do
+        dir="$RESULTS/bench-$variant-$round"
+        mkdir -p "$dir"
+        cp "$RESULTS/seed/luma_settings.db" "$dir/"
+        if [ "$variant" = base ]; then bin="$BASE/settings_server"; else bin="$PGO/settings_server"; fi
+        with_server "$bin" "$dir" \
+            "$BASE/loadgen" --rate "$BENCH_RATE" --duration "$BENCH_SECONDS" --users "$USERS" \
+                            --connections "$CONNECTIONS" --seed "$round" --json "$dir/loadgen.json" > "$dir/loadgen.txt"
+        if [ "$variant" = base ]; then base_runs+=("$dir/loadgen.json"); else pgo_runs+=("$dir/loadgen.json"); fi
+    done
+done
+
+echo "== baseline (A) vs PGO+LTO (B)"
+status=0
+"$BASE/bench_compare" --a "$(IFS=,; echo "${base_runs[*]}")" --b "$(IFS=,; echo "${pgo_runs[*]}")" \
+    | tee "$RESULTS/compare.txt" || status=$?
+echo "optimized binary: $PGO/settings_server"
+exit "$status"
@@ -0,0 +1,294 @@
+// replay.cpp
+//
+// Replays a traffic capture (LUMA_CAPTURE_FILE, see traffic_capture.h)
+// against a running settings server
+// - re-issues every recorded request at its original offset, divided by
+//   --speed (2 = twice as fast; 0 = back to back, as fast as possible)
+// - requests for the same (pseudonymized) user go through the same
+//   connection in capture order, so each user's writes and reads keep their
+//   order; different users run concurrently on --connections connections
+// - latency is measured from the scheduled send time, so a server that falls
+//   behind is charged for the queueing it causes, not just for service time
+// - prints per-route latency percentiles next to the latencies seen when the
+//   traffic was captured
+// - with --compare, replays the same capture against a second server (e.g. a
+//   new build) afterwards and reports per-route latency deltas and every
+//   request whose status or response body differs; timestamps are ignored
+//   when comparing bodies. Start both servers from copies of the same DB.
+//
+// Usage:
+//   replay --capture FILE [--target HOST:PORT] [--compare HOST:PORT]
+//          [--speed X] [--connections N] [--limit N] [--examples N]
+// The API key is read from LUMA_API_KEY (default: the server's dev key).
+// Exits with status 1 if --compare found differences.
+//
+// Build (example):
+// g++ replay.cpp -std=c++17 -O2 -pthread -o replay
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+
+#include "httplib.h"     // https://github.com/yhirose/cpp-httplib (single header)
+#include "json.hpp"      // nlohmann::json (single header)
+#include "traffic_capture.h"
+
+using json = nlohmann::json;
+
+struct Options {
+    std::string capture;
+    std::string target = "127.0.0.1:8080";
+    std::string compare;
+    double speed = 1;
+    int connections = 8;
+    size_t limit = 0;     // 0 = all records
+    size_t examples = 10; // differences printed in full
+};
+
+struct Outcome {
+    int status = 0;              // 0 = transport error
+    uint64_t latency_us = 0;     // from the scheduled send time
+    uint64_t service_us = 0;     // from the actual send time
+    uint64_t body_hash = 0;
+    std::string body;            // kept only for --compare examples
+};
+
+static Options parse_args(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string k = argv[i];
+        const char* v = argv[i + 1];
+        if (k == "--capture") o.capture = v;
+        else if (k == "--target") o.target = v;
+        else if (k == "--compare") o.compare = v;
+        else if (k == "--speed") o.speed = std::atof(v);
+        else if (k == "--connections") o.connections = std::max(1, std::atoi(v));
+        else if (k == "--limit") o.limit = std::strtoull(v, nullptr, 10);
+        else if (k == "--examples") o.examples = std::strtoull(v, nullptr, 10);
+        else std::cerr << "unknown option " << k << "\n";
+    }
+    return o;
+}
+
+static std::string api_key() {
+    const char* k = std::getenv("LUMA_API_KEY");
+    return k ? k : "secret-api-key";
+}
+
+// Key that pins a request to a connection: the user it acts on, else the device
+static std::string user_key(const CaptureRecord& r) {
+    size_t at = r.query.find("user_id=");
+    if (at != std::string::npos && (at == 0 || r.query[at - 1] == '&')) {
+        size_t end = r.query.find('&', at);
+        return r.query.substr(at + 8, end == std::string::npos ? std::string::npos : end - at - 8);
+    }
+    json body = json::parse(r.body, nullptr, false);
+    if (body.is_object() && body.contains("user_id") && body["user_id"].is_string()) {
+        return body["user_id"].get<std::string>();
+    }
+    return r.device_id;
+}
+
+// Drops fields that legitimately differ between runs, then hashes
+static void strip_volatile(json& j) {
+    static const char* keys[] = {"updated_at", "created_at", "exported_at", "time", "timestamp"};
+    if (j.is_object()) {
+        for (const char* k : keys) j.erase(k);
+        for (auto& v : j) strip_volatile(v);
+    } else if (j.is_array()) {
+        for (auto& v : j) strip_volatile(v);
+    }
+}
+
+static uint64_t body_hash(const std::string& body, std::string& normalized) {
+    json j = json::parse(body, nullptr, false);
+    if (j.is_discarded()) {
+        normalized = body;
+    } else {
+        strip_volatile(j);
+        normalized = j.dump();
+    }
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (unsigned char c : normalized) h = (h ^ c) * 0x100000001b3ull;
+    return h;
+}
+
+static bool split_host(const std::string& target, std::string& host, int& port) {
+    size_t colon = target.rfind(':');
+    if (colon == std::string::npos) return false;
+    host = target.substr(0, colon);
+    port = std::atoi(target.c_str() + colon + 1);
+    return port > 0;
+}
+
+// Replays `records` against one server; outcomes are indexed like records
+static std::vector<Outcome> replay(const Options& o, const std::string& target,
+                                   const std::vector<CaptureRecord>& records, bool keep_bodies) {
+    std::string host;
+    int port = 0;
+    if (!split_host(target, host, port)) {
+        std::cerr << "bad target " << target << " (want HOST:PORT)\n";
+        std::exit(2);
+    }
+
+    std::vector<std::vector<size_t>> queues(static_cast<size_t>(o.connections));
+    for (size_t i = 0; i < records.size(); i++) {
+        queues[std::hash<std::string>()(user_key(records[i])) % queues.size()].push_back(i);
+    }
+
+    std::vector<Outcome> outcomes(records.size());
+    uint64_t first_offset = records.empty() ? 0 : records.front().offset_ns;
+    auto start = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+
+    std::vector<std::thread> workers;
+    for (const auto& queue : queues) {
+        workers.emplace_back([&, queue] {
+            httplib::Client cli(host, port);
+            cli.set_keep_alive(true);
+            cli.set_read_timeout(60, 0);
+            for (size_t i : queue) {
+                const CaptureRecord& r = records[i];
+                auto scheduled = start;
+                if (o.speed > 0) {
+                    scheduled += std::chrono::nanoseconds(static_cast<int64_t>((r.offset_ns - first_offset) / o.speed));
+                    std::this_thread::sleep_until(scheduled);
+                }
+                httplib::Headers headers = {{"X-API-KEY", api_key()}};
+                if (!r.app_version.empty()) headers.emplace("X-App-Version", r.app_version);
+                if (!r.device_id.empty()) headers.emplace("X-Device-Id", r.device_id);
+                std::string path = r.query.empty() ? r.path : r.path + "?" + r.query;
+
+                auto sent = std::chrono::steady_clock::now();
+                if (o.speed <= 0) scheduled = sent;
+                httplib::Result res;
+                if (r.method == "GET") res = cli.Get(path.c_str(), headers);
+                else if (r.method == "POST") res = cli.Post(path.c_str(), headers, r.body, "application/json");
+                auto done = std::chrono::steady_clock::now();
+
+                Outcome& out = outcomes[i];
+                out.latency_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(done - scheduled).count());
+                out.service_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(done - sent).count());
+                if (res) {
+                    out.status = res->status;
+                    std::string normalized;
+                    out.body_hash = body_hash(res->body, normalized);
+                    if (keep_bodies) out.body = std::move(normalized);
+                }
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+    return outcomes;
+}
+
+static uint64_t percentile(std::vector<uint64_t>& v, double p) {
+    if (v.empty()) return 0;
+    size_t idx = static_cast<size_t>(p / 100.0 * static_cast<double>(v.size() - 1) + 0.5);
+    std::nth_element(v.begin(), v.begin() + static_cast<long>(idx), v.end());
+    return v[idx];
+}
+
+struct RouteStats {
+    std::vector<uint64_t> captured;
+    std::vector<uint64_t> latency;
+    std::vector<uint64_t> service;
+    uint64_t errors = 0;  // transport errors and 5xx
+};
+
+static std::string route(const CaptureRecord& r) { return r.method + " " + r.path; }
+
+static std::map<std::string, RouteStats> route_stats(const std::vector<CaptureRecord>& records,
+                                                     const std::vector<Outcome>& outcomes) {
+    std::map<std::string, RouteStats> stats;
+    for (size_t i = 0; i < records.size(); i++) {
+        RouteStats& s = stats[route(records[i])];
+        s.captured.push_back(records[i].latency_us);
+        s.latency.push_back(outcomes[i].latency_us);
+        s.service.push_back(outcomes[i].service_us);
+        if (outcomes[i].status == 0 || outcomes[i].status >= 500) s.errors++;
+    }
+    return stats;
+}
+
+static void print_latencies(const std::string& target, std::map<std::string, RouteStats>& stats) {
+    std::printf("\n%s (latency in us: captured p50/p99 | replayed p50/p90/p99/max | service p99)\n", target.c_str());
+    for (auto& kv : stats) {
+        RouteStats& s = kv.second;
+        std::printf("  %-28s n=%-7zu err=%-5llu %7llu/%-7llu | %7llu/%7llu/%7llu/%-8llu | %llu\n",
+                    kv.first.c_str(), s.latency.size(), static_cast<unsigned long long>(s.errors),
+                    static_cast<unsigned long long>(percentile(s.captured, 50)),
+                    static_cast<unsigned long long>(percentile(s.captured, 99)),
+                    static_cast<unsigned long long>(percentile(s.latency, 50)),
+                    static_cast<unsigned long long>(percentile(s.latency, 90)),
+                    static_cast<unsigned long long>(percentile(s.latency, 99)),
+                    static_cast<unsigned long long>(percentile(s.latency, 100)),
+                    static_cast<unsigned long long>(percentile(s.service, 99)));
+    }
+}
+
+int main(int argc, char** argv) {
+    Options o = parse_args(argc, argv);
+    if (o.capture.empty()) {
+        std::cerr << "usage: replay --capture FILE [--target HOST:PORT] [--compare HOST:PORT] [--speed X]\n";
+        return 2;
+    }
+
+    CaptureReader reader;
+    if (!reader.open(o.capture)) {
+        std::cerr << "cannot read capture " << o.capture << "\n";
+        return 1;
+    }
+    std::vector<CaptureRecord> records;
+    CaptureRecord r;
+    while ((o.limit == 0 || records.size() < o.limit) && reader.next(r)) records.push_back(r);
+    // Writers flush in ring order, which is close to but not exactly arrival order
+    std::stable_sort(records.begin(), records.end(),
+                     [](const CaptureRecord& a, const CaptureRecord& b) { return a.offset_ns < b.offset_ns; });
+    if (records.empty()) {
+        std::cerr << "capture is empty\n";
+        return 1;
+    }
+    double span_s = static_cast<double>(records.back().offset_ns - records.front().offset_ns) / 1e9;
+    std::printf("%zu requests spanning %.1fs, speed %s\n", records.size(), span_s,
+                o.speed > 0 ? std::to_string(o.speed).c_str() : "max");
+
+    bool comparing = !o.compare.empty();
+    auto a = replay(o, o.target, records, comparing);
+    auto stats_a = route_stats(records, a);
+    print_latencies(o.target, stats_a);
+    if (!comparing) return 0;
+
+    auto b = replay(o, o.compare, records, true);
+    auto stats_b = route_stats(records, b);
+    print_latencies(o.compare, stats_b);
+
+    std::printf("\np99 change %s -> %s\n", o.target.c_str(), o.compare.c_str());
+    for (auto& kv : stats_a) {
+        double pa = static_cast<double>(percentile(kv.second.latency, 99));
+        double pb = static_cast<double>(percentile(stats_b[kv.first].latency, 99));
+        std::printf("  %-28s %+.1f%%\n", kv.first.c_str(), pa > 0 ? (pb - pa) / pa * 100.0 : 0.0);
+    }
+
+    std::map<std::string, uint64_t> diffs;
+    size_t total = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        if (a[i].status == b[i].status && a[i].body_hash == b[i].body_hash) continue;
+        diffs[route(records[i])]++;
+        if (total++ < o.examples) {
+            std::printf("\n  diff #%zu %s?%s\n    %s: %d %.200s\n    %s: %d %.200s\n", i, records[i].path.c_str(),
+                        records[i].query.c_str(), o.target.c_str(), a[i].status, a[i].body.c_str(),
+                        o.compare.c_str(), b[i].status, b[i].body.c_str());
+        }
+    }
+    std::printf("\n%zu of %zu responses differ\n", total, records.size());
+    for (const auto& kv : diffs) {
+        std::printf("  %-28s %llu\n", kv.first.c_str(), static_cast<unsigned long long>(kv.second));
+    }
+    return total ? 1 : 0;
+}
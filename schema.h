@@ -0,0 +1,68 @@
+// schema.h
+//
+// SQLite schema of luma_settings.db, shared by the store's LumaStore::init()
+// (luma_store.cpp) and the tools that create or fill databases (datagen).
+
+#pragma once
+
+// Users table (basic profile)
+static const char* const SCHEMA_USERS = R"sql(
+    CREATE TABLE IF NOT EXISTS users (
+      user_id TEXT PRIMARY KEY,
+      name TEXT,
+      email TEXT,
+      avatar_url TEXT,
+      created_at TEXT
+    );
+    )sql";
+
+// Settings table (one row per user)
+static const char* const SCHEMA_SETTINGS = R"sql(
+    CREATE TABLE IF NOT EXISTS settings (
+      user_id TEXT PRIMARY KEY,
+      theme_mode TEXT DEFAULT 'System', -- System|Light|Dark
+      dark_mode INTEGER DEFAULT 0,
+      notifications_enabled INTEGER DEFAULT 1,
+      chat_notifications INTEGER DEFAULT 1,
+      update_notifications INTEGER DEFAULT 1,
+      reminder_notifications INTEGER DEFAULT 0,
+      language TEXT DEFAULT 'English',
+      biometric_lock INTEGER DEFAULT 0,
+      app_version TEXT DEFAULT '1.0.0',
+      updated_at TEXT,
+      FOREIGN KEY(user_id) REFERENCES users(user_id)
+    );
+    )sql";
+
+// Chat history
+static const char* const SCHEMA_CHAT_HISTORY = R"sql(
+    CREATE TABLE IF NOT EXISTS chat_history (
+      id INTEGER PRIMARY KEY AUTOINCREMENT,
+      user_id TEXT,
+      role TEXT, -- user | bot
+      message TEXT,
+      created_at TEXT,
+      FOREIGN KEY(user_id) REFERENCES users(user_id)
+    );
+    )sql";
+
+// Active-user sketches (HyperLogLog registers per window/dimension/metric)
+static const char* const SCHEMA_ACTIVITY_SKETCHES = R"sql(
+    CREATE TABLE IF NOT EXISTS activity_sketches (
+      granularity TEXT,  -- hour | day
+      window_start TEXT, -- 2024-05-01T13:00Z | 2024-05-01
+      dimension TEXT,    -- all | class:<lane> | app:<version>
+      metric TEXT,       -- users | devices
+      registers BLOB,
+      hash_id TEXT,      -- HyperLogLog::HASH_ID the registers were built with
+      PRIMARY KEY(granularity, window_start, dimension, metric)
+    );
+    )sql";
+
+// All tables, in creation order
+static const char* const SCHEMA_STATEMENTS[] = {
+        SCHEMA_USERS,
+        SCHEMA_SETTINGS,
+        SCHEMA_CHAT_HISTORY,
+        SCHEMA_ACTIVITY_SKETCHES
+};
@@ -0,0 +1,249 @@
+// slow_query_log.h
+//
+// Slow SQLite statement log
+// - record() is called from a connection's trace callback when a statement
+//   finishes above the threshold; it keeps per-statement aggregates keyed by
+//   the parameterized SQL text plus a ring of the most recent slow runs
+// - bound parameters are reported by shape only (text(12), int, null, ...),
+//   never by value
+// - the EXPLAIN QUERY PLAN of each distinct statement is captured once, on a
+//   separate read-only connection so the caller's connection and transaction
+//   are untouched
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "json.hpp"
+#include "lock_profiler.h"
+#include <sqlite3.h>
+
+// Per-run work counters of a statement, taken (and reset) when it finishes
+struct StatementCounters {
+    int rows_scanned = 0;   // rows visited by full table scans
+    int vm_steps = 0;
+    int sorts = 0;
+    int autoindexes = 0;    // transient indexes SQLite had to build
+    int rows_changed = -1;  // -1 for read-only statements
+
+    static StatementCounters take(sqlite3_stmt* stmt) {
+        StatementCounters c;
+        c.rows_scanned = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+        c.vm_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+        c.sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+        c.autoindexes = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+        if (!sqlite3_stmt_readonly(stmt)) c.rows_changed = sqlite3_changes(sqlite3_db_handle(stmt));
+        return c;
+    }
+};
+
+class SlowQueryLog {
+public:
+    SlowQueryLog(std::string db_file, std::chrono::microseconds threshold, size_t recent_capacity)
+        : db_file_(std::move(db_file)), threshold_(threshold), recent_capacity_(recent_capacity) {}
+
+    std::chrono::microseconds threshold() const { return threshold_; }
+
+    // Record one slow run (shapes from param_shapes()). Returns true the first
+    // time this statement is seen.
+    bool record(sqlite3_stmt* stmt, std::chrono::nanoseconds elapsed, const StatementCounters& counters,
+                const std::string& shapes) {
+        const char* sql_text = sqlite3_sql(stmt);
+        std::string sql = sql_text ? sql_text : "";
+        auto elapsed_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+
+        bool first = false;
+        {
+            ProfiledLock lock(mutex_, "SlowQueryLog::record");
+            auto it = statements_.find(sql);
+            if (it == statements_.end()) {
+                it = statements_.emplace(sql, Aggregate{}).first;
+                first = true;
+            }
+            Aggregate& agg = it->second;
+            agg.count++;
+            agg.total_us += elapsed_us;
+            agg.max_us = std::max(agg.max_us, elapsed_us);
+            agg.max_rows_scanned = std::max(agg.max_rows_scanned, counters.rows_scanned);
+            agg.last_shapes = shapes;
+
+            recent_.push_back(Event{sql, shapes, elapsed_us, counters, std::chrono::system_clock::now()});
+            if (recent_.size() > recent_capacity_) recent_.pop_front();
+        }
+
+        if (first) {
+            std::string plan = explain(sql);
+            ProfiledLock lock(mutex_, "SlowQueryLog::record");
+            statements_[sql].plan = plan;
+        }
+        return first;
+    }
+
+    // Top statements by total time spent above the threshold, plus recent runs
+    nlohmann::json report(size_t limit) const {
+        using nlohmann::json;
+        ProfiledLock lock(mutex_, "SlowQueryLog::report");
+        std::vector<std::pair<const std::string*, const Aggregate*>> rows;
+        for (const auto& kv : statements_) rows.emplace_back(&kv.first, &kv.second);
+        std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+            return a.second->total_us > b.second->total_us;
+        });
+        if (rows.size() > limit) rows.resize(limit);
+
+        json top = json::array();
+        for (const auto& row : rows) {
+            const Aggregate& a = *row.second;
+            top.push_back({
+                    {"sql", *row.first},
+                    {"count", a.count},
+                    {"total_us", a.total_us},
+                    {"mean_us", a.count ? a.total_us / a.count : 0},
+                    {"max_us", a.max_us},
+                    {"max_rows_scanned", a.max_rows_scanned},
+                    {"params", a.last_shapes},
+                    {"plan", a.plan}
+            });
+        }
+
+        json recent = json::array();
+        for (auto it = recent_.rbegin(); it != recent_.rend(); ++it) {
+            recent.push_back({
+                    {"at", std::chrono::duration_cast<std::chrono::milliseconds>(it->at.time_since_epoch()).count()},
+                    {"sql", it->sql},
+                    {"params", it->shapes},
+                    {"duration_us", it->elapsed_us},
+                    {"rows_scanned", it->counters.rows_scanned},
+                    {"rows_changed", it->counters.rows_changed},
+                    {"vm_steps", it->counters.vm_steps},
+                    {"sorts", it->counters.sorts},
+                    {"autoindexes", it->counters.autoindexes}
+            });
+        }
+        return {
+                {"threshold_us", threshold_.count()},
+                {"distinct_statements", statements_.size()},
+                {"top", top},
+                {"recent", recent}
+        };
+    }
+
+    // Shapes of the bound parameters, e.g. "text(8), int, null". Walks the
+    // statement's SQL template alongside its expanded form and classifies the
+    // literal that replaced each '?'.
+    static std::string param_shapes(sqlite3_stmt* stmt) {
+        const char* tmpl = sqlite3_sql(stmt);
+        char* expanded = sqlite3_expanded_sql(stmt);
+        if (!tmpl || !expanded) {
+            sqlite3_free(expanded);
+            return "";
+        }
+        std::string out;
+        const char* t = tmpl;
+        const char* e = expanded;
+        while (*t && *e) {
+            if (*t == '\'') {
+                // copy a literal from the template verbatim (same text in both)
+                size_t len = quoted_length(t);
+                t += len;
+                e += len;
+            } else if (*t == '?') {
+                while (*t == '?' || (*t >= '0' && *t <= '9')) t++;  // ?NNN
+                if (!out.empty()) out += ", ";
+                if (*e == '\'') {
+                    size_t len = quoted_length(e);
+                    out += "text(" + std::to_string(len - 2) + ")";
+                    e += len;
+                } else if ((*e == 'x' || *e == 'X') && e[1] == '\'') {
+                    size_t len = quoted_length(e + 1);
+                    out += "blob(" + std::to_string((len - 2) / 2) + ")";
+                    e += len + 1;
+                } else if (std::strncmp(e, "NULL", 4) == 0) {
+                    out += "null";
+                    e += 4;
+                } else {
+                    bool real = false;
+                    while (*e == '-' || *e == '+' || *e == '.' || *e == 'e' || *e == 'E' || (*e >= '0' && *e <= '9')) {
+                        if (*e == '.' || *e == 'e' || *e == 'E') real = true;
+                        e++;
+                    }
+                    out += real ? "real" : "int";
+                }
+            } else {
+                t++;
+                e++;
+            }
+        }
+        sqlite3_free(expanded);
+        return out;
+    }
+
+private:
+    struct Aggregate {
+        uint64_t count = 0;
+        uint64_t total_us = 0;
+        uint64_t max_us = 0;
+        int max_rows_scanned = 0;
+        std::string last_shapes;
+        std::string plan;
+    };
+
+    struct Event {
+        std::string sql;
+        std::string shapes;
+        uint64_t elapsed_us;
+        StatementCounters counters;
+        std::chrono::system_clock::time_point at;
+    };
+
+    // Length of a '...' literal starting at s (with '' escapes), quotes included
+    static size_t quoted_length(const char* s) {
+        size_t i = 1;
+        while (s[i]) {
+            if (s[i] == '\'') {
+                if (s[i + 1] == '\'') { i += 2; continue; }
+                return i + 1;
+            }
+            i++;
+        }
+        return i;
+    }
+
+    // EXPLAIN QUERY PLAN on a private read-only connection, one line per plan
+    // node indented under its parent
+    std::string explain(const std::string& sql) const {
+        sqlite3* db = nullptr;
+        std::string plan;
+        if (sqlite3_open_v2(db_file_.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK) {
+            sqlite3_stmt* stmt = nullptr;
+            std::string eqp = "EXPLAIN QUERY PLAN " + sql;
+            if (sqlite3_prepare_v2(db, eqp.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+                std::unordered_map<int, int> depth;
+                while (sqlite3_step(stmt) == SQLITE_ROW) {
+                    int id = sqlite3_column_int(stmt, 0);
+                    int parent = sqlite3_column_int(stmt, 1);
+                    int d = depth.count(parent) ? depth[parent] + 1 : 0;
+                    depth[id] = d;
+                    const unsigned char* detail = sqlite3_column_text(stmt, 3);
+                    plan += std::string(2 * d, ' ') + (detail ? reinterpret_cast<const char*>(detail) : "") + "\n";
+                }
+            }
+            sqlite3_finalize(stmt);
+        }
+        sqlite3_close(db);
+        return plan;
+    }
+
+    std::string db_file_;
+    std::chrono::microseconds threshold_;
+    size_t recent_capacity_;
+    mutable ProfiledMutex mutex_{"slow_query_log"};
+    std::unordered_map<std::string, Aggregate> statements_;
+    std::deque<Event> recent_;
+};
@@ -0,0 +1,275 @@
+// store_bench.cpp
+//
+// In-process store calls vs the same operations over HTTP
+// - runs --threads closed-loop clients for --seconds per operation and path:
+//   "in_process" calls luma_store.h directly (one StoreSession per thread,
+//   no HTTP, no JSON), "http" sends the equivalent request to a settings
+//   server running on the same database
+//     get     StoreSession::get_settings   GET /settings
+//     set     update_settings (dark_mode)  POST /settings
+//     append  append_message               POST /history
+// - reports throughput and latency per operation and path, and the
+//   in-process speedup
+// - --path inproc|http runs only one side (e.g. with no server running);
+//   the server must be started in the directory holding --db for the two
+//   paths to touch the same rows
+// - with --json FILE, writes summaries and HDR buckets per path and
+//   operation for bench_compare
+//
+// Usage:
+//   store_bench [--db luma_settings.db] [--host H] [--port P] [--threads N]
+//               [--seconds S] [--users N] [--ops get,set,append]
+//               [--path both|inproc|http] [--json FILE]
+// The API key is read from LUMA_API_KEY (default: the server's dev key).
+//
+// Build (example):
+// g++ store_bench.cpp luma_store.cpp -std=c++17 -O2 -lsqlite3 -pthread -o store_bench
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+
+#include "httplib.h"     // https://github.com/yhirose/cpp-httplib (single header)
+#include "json.hpp"      // nlohmann::json (single header)
+#include "hdr_histogram.h"
+#include "luma_store.h"
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string db = "luma_settings.db";
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int threads = 4;
+    double seconds = 5;
+    int users = 1000;
+    std::vector<std::string> ops = {"get", "set", "append"};
+    std::string path = "both";
+    std::string json_out;
+};
+
+struct Result {
+    std::string op;
+    std::string path;
+    double seconds = 0;
+    uint64_t completed = 0;
+    uint64_t errors = 0;
+    HdrHistogram latency;
+
+    double throughput() const { return seconds > 0 ? static_cast<double>(completed) / seconds : 0; }
+};
+
+static Options parse_args(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string k = argv[i];
+        const char* v = argv[i + 1];
+        if (k == "--db") o.db = v;
+        else if (k == "--host") o.host = v;
+        else if (k == "--port") o.port = std::atoi(v);
+        else if (k == "--threads") o.threads = std::max(1, std::atoi(v));
+        else if (k == "--seconds") o.seconds = std::atof(v);
+        else if (k == "--users") o.users = std::max(1, std::atoi(v));
+        else if (k == "--path") o.path = v;
+        else if (k == "--json") o.json_out = v;
+        else if (k == "--ops") {
+            o.ops.clear();
+            std::string s = v;
+            size_t start = 0;
+            while (start < s.size()) {
+                size_t end = s.find(',', start);
+                if (end == std::string::npos) end = s.size();
+                o.ops.push_back(s.substr(start, end - start));
+                start = end + 1;
+            }
+        } else std::cerr << "unknown option " << k << "\n";
+    }
+    return o;
+}
+
+static std::string user_of(int thread, uint64_t i, int users) {
+    return "bench-user-" + std::to_string((static_cast<uint64_t>(thread) * 7919 + i) % static_cast<uint64_t>(users));
+}
+
+// One client thread's operation: true on success
+using Call = std::function<bool(const std::string& user, uint64_t i)>;
+
+// Runs `make_call(thread)` on every thread in a closed loop for o.seconds
+static Result run(const Options& o, const std::string& op, const std::string& path,
+                  const std::function<Call(int)>& make_call) {
+    std::vector<HdrHistogram> latency(o.threads);
+    std::vector<uint64_t> completed(o.threads, 0), errors(o.threads, 0);
+    std::atomic<bool> running{true};
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (int t = 0; t < o.threads; t++) {
+        threads.emplace_back([&, t] {
+            Call call = make_call(t);
+            for (uint64_t i = 0; running.load(std::memory_order_relaxed); i++) {
+                std::string user = user_of(t, i, o.users);
+                auto begin = Clock::now();
+                bool ok = call && call(user, i);
+                auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count();
+                latency[t].record(static_cast<uint64_t>(std::max<int64_t>(1, us)));
+                if (ok) completed[t]++;
+                else errors[t]++;
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(o.seconds));
+    running = false;
+    for (auto& th : threads) th.join();
+
+    Result r;
+    r.op = op;
+    r.path = path;
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (int t = 0; t < o.threads; t++) {
+        r.latency.merge(latency[t]);
+        r.completed += completed[t];
+        r.errors += errors[t];
+    }
+    return r;
+}
+
+// In-process: one session per thread, typed calls only
+static Result run_inproc(const Options& o, LumaStore& store, const std::string& op) {
+    std::vector<std::unique_ptr<StoreSession>> sessions(o.threads);
+    return run(o, op, "in_process", [&](int t) -> Call {
+        std::string error;
+        sessions[t] = store.open_session(&error);
+        if (!sessions[t]) {
+            std::cerr << "open_session: " << error << "\n";
+            return nullptr;
+        }
+        StoreSession* s = sessions[t].get();
+        if (op == "get") {
+            return [s](const std::string& user, uint64_t) {
+                UserSettings out;
+                return s->get_settings(user, out);
+            };
+        }
+        if (op == "set") {
+            return [s](const std::string& user, uint64_t i) {
+                SettingsUpdate u;
+                u.dark_mode = (i & 1) != 0;
+                return s->update_settings(user, u);
+            };
+        }
+        return [s](const std::string& user, uint64_t i) {
+            return s->append_message(user, "user", "store_bench message " + std::to_string(i));
+        };
+    });
+}
+
+// HTTP: one keep-alive client per thread, the server's routes
+static Result run_http(const Options& o, const std::string& op) {
+    const char* key = std::getenv("LUMA_API_KEY");
+    httplib::Headers headers = {{"X-API-KEY", key ? key : "secret-api-key"}};
+    std::vector<std::unique_ptr<httplib::Client>> clients(o.threads);
+    return run(o, op, "http", [&](int t) -> Call {
+        clients[t].reset(new httplib::Client(o.host, o.port));
+        clients[t]->set_keep_alive(true);
+        httplib::Client* cli = clients[t].get();
+        if (op == "get") {
+            return [cli, headers](const std::string& user, uint64_t) {
+                auto r = cli->Get(("/settings?user_id=" + user).c_str(), headers);
+                return r && r->status == 200 && !json::parse(r->body, nullptr, false).is_discarded();
+            };
+        }
+        if (op == "set") {
+            return [cli, headers](const std::string& user, uint64_t i) {
+                json body = {{"user_id", user}, {"settings", {{"dark_mode", (i & 1) != 0}}}};
+                auto r = cli->Post("/settings", headers, body.dump(), "application/json");
+                return r && r->status == 200;
+            };
+        }
+        return [cli, headers](const std::string& user, uint64_t i) {
+            json body = {{"user_id", user}, {"role", "user"}, {"message", "store_bench message " + std::to_string(i)}};
+            auto r = cli->Post("/history", headers, body.dump(), "application/json");
+            return r && r->status == 200;
+        };
+    });
+}
+
+int main(int argc, char** argv) {
+    Options o = parse_args(argc, argv);
+    bool inproc = o.path == "both" || o.path == "inproc";
+    bool http = o.path == "both" || o.path == "http";
+    for (const auto& op : o.ops) {
+        if (op != "get" && op != "set" && op != "append") {
+            std::cerr << "unknown op " << op << " (get, set, append)\n";
+            return 2;
+        }
+    }
+
+    LumaStore store(o.db);
+    std::string error;
+    if (inproc && !store.init(&error)) {
+        std::cerr << "cannot open " << o.db << ": " << error << "\n";
+        return 2;
+    }
+    if (http) {
+        httplib::Client probe(o.host, o.port);
+        auto r = probe.Get("/health");
+        if (!r || r->status != 200) {
+            std::cerr << "no server at " << o.host << ":" << o.port << " (use --path inproc to skip HTTP)\n";
+            return 2;
+        }
+    }
+
+    std::vector<Result> results;
+    for (const auto& op : o.ops) {
+        if (inproc) results.push_back(run_inproc(o, store, op));
+        if (http) results.push_back(run_http(o, op));
+    }
+
+    std::printf("%d threads, %.1fs per run, %d users, db %s\n\n", o.threads, o.seconds, o.users, o.db.c_str());
+    std::printf("%-8s %-11s %12s %9s %9s %9s %8s  %s\n", "op", "path", "ops/s", "p50 us", "p99 us", "max us", "errors", "in-process speedup");
+    uint64_t total_errors = 0;
+    for (const auto& r : results) {
+        std::string speedup;
+        if (r.path == "http") {
+            for (const auto& other : results) {
+                if (other.op == r.op && other.path == "in_process" && r.throughput() > 0) {
+                    char buf[64];
+                    std::snprintf(buf, sizeof(buf), "%.1fx throughput, %.1fx p50",
+                                  other.throughput() / r.throughput(),
+                                  static_cast<double>(r.latency.percentile(50)) /
+                                  static_cast<double>(std::max<uint64_t>(1, other.latency.percentile(50))));
+                    speedup = buf;
+                }
+            }
+        }
+        std::printf("%-8s %-11s %12.0f %9llu %9llu %9llu %8llu  %s\n", r.op.c_str(), r.path.c_str(), r.throughput(),
+                    static_cast<unsigned long long>(r.latency.percentile(50)),
+                    static_cast<unsigned long long>(r.latency.percentile(99)),
+                    static_cast<unsigned long long>(r.latency.max()),
+                    static_cast<unsigned long long>(r.errors), speedup.c_str());
+        total_errors += r.errors;
+    }
+
+    if (!o.json_out.empty()) {
+        json out = {{"tool", "store_bench"}, {"threads", o.threads}, {"seconds", o.seconds}};
+        for (const auto& r : results) {
+            out[r.path]["routes"][r.op] = {
+                    {"throughput", r.throughput()},
+                    {"errors", r.errors},
+                    {"summary", r.latency.summary()},
+                    {"buckets", r.latency.buckets()}
+            };
+        }
+        std::ofstream f(o.json_out);
+        f << out.dump(2) << "\n";
+    }
+    return total_errors ? 1 : 0;
+}
@@ -0,0 +1,342 @@
+// stress.cpp
+//
+// Concurrency scaling and deadlock stress suite for the settings server
+// - for each thread count in --threads, runs that many closed-loop clients
+//   for --seconds, each hammering every data route (settings, profile,
+//   notifications, theme, biometric, history append/list/clear, export,
+//   merge and replace import) over a small shared set of users, so requests
+//   for the same user constantly collide on db_mutex and the lanes
+// - a watchdog flags a hang when any request has been in flight for
+//   --hang-sec, or nothing has completed for --hang-sec: it then probes
+//   /health on a fresh connection, dumps /debug/locks (who holds and waits
+//   on which mutex) and exits with status 3 without waiting for the stuck
+//   clients
+// - reports throughput, latency and error counts per thread count, and the
+//   scaling efficiency relative to the first (smallest) thread count
+// - 429/503 rejections are counted separately; any other 5xx or transport
+//   error counts as an error and makes the run exit with status 1
+// - with --json FILE, writes per-run, per-route summaries and HDR buckets
+//   for bench_compare
+//
+// Usage:
+//   stress [--host H] [--port P] [--threads 1,2,4,8,16,32,64] [--seconds S]
+//          [--users N] [--hang-sec S] [--timeout-sec S] [--seed S] [--json FILE]
+// The API key is read from LUMA_API_KEY (default: the server's dev key).
+//
+// Build (example):
+// g++ stress.cpp -std=c++17 -O2 -pthread -o stress
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+
+#include "httplib.h"     // https://github.com/yhirose/cpp-httplib (single header)
+#include "json.hpp"      // nlohmann::json (single header)
+#include "hdr_histogram.h"
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    std::vector<int> threads = {1, 2, 4, 8, 16, 32, 64};
+    double seconds = 10;
+    int users = 8;
+    double hang_sec = 15;
+    int timeout_sec = 60;   // client read timeout; well above every route deadline
+    uint64_t seed = 1;
+    std::string json_out;
+};
+
+enum Op {
+    GET_SETTINGS, POST_SETTINGS, POST_PROFILE, POST_NOTIFICATIONS, POST_THEME, POST_BIOMETRIC,
+    POST_HISTORY, GET_HISTORY, CLEAR_HISTORY, EXPORT, IMPORT_MERGE, IMPORT_REPLACE, OP_COUNT
+};
+
+static const char* OP_NAMES[OP_COUNT] = {
+        "GET /settings", "POST /settings", "POST /profile", "POST /notifications", "POST /theme",
+        "POST /security/biometric", "POST /history", "GET /history", "POST /history/clear",
+        "GET /history/export", "POST /history/import", "POST /history/import?replace"
+};
+
+// Relative frequency of each route in the mix; every route is exercised
+static const int OP_WEIGHTS[OP_COUNT] = {20, 8, 4, 4, 4, 4, 25, 12, 3, 4, 6, 6};
+
+struct Worker {
+    std::atomic<int64_t> in_flight_since{0};  // steady_clock ns, 0 when idle
+    std::atomic<int> in_flight_op{-1};
+    std::atomic<uint64_t> completed{0};
+    HdrHistogram latency[OP_COUNT];
+    uint64_t errors[OP_COUNT] = {};
+    uint64_t rejected[OP_COUNT] = {};
+};
+
+struct RunResult {
+    int threads = 0;
+    double seconds = 0;
+    HdrHistogram overall;
+    HdrHistogram latency[OP_COUNT];
+    uint64_t errors[OP_COUNT] = {};
+    uint64_t rejected[OP_COUNT] = {};
+    uint64_t completed = 0;
+    uint64_t total_errors = 0;
+};
+
+static std::atomic<bool> running{false};
+
+static std::vector<int> parse_list(const std::string& s) {
+    std::vector<int> out;
+    size_t start = 0;
+    while (start < s.size()) {
+        size_t end = s.find(',', start);
+        if (end == std::string::npos) end = s.size();
+        int v = std::atoi(s.substr(start, end - start).c_str());
+        if (v > 0) out.push_back(v);
+        start = end + 1;
+    }
+    return out;
+}
+
+static Options parse_args(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string k = argv[i];
+        const char* v = argv[i + 1];
+        if (k == "--host") o.host = v;
+        else if (k == "--port") o.port = std::atoi(v);
+        else if (k == "--threads") o.threads = parse_list(v);
+        else if (k == "--seconds") o.seconds = std::atof(v);
+        else if (k == "--users") o.users = std::max(1, std::atoi(v));
+        else if (k == "--hang-sec") o.hang_sec = std::atof(v);
+        else if (k == "--timeout-sec") o.timeout_sec = std::atoi(v);
+        else if (k == "--seed") o.seed = std::strtoull(v, nullptr, 10);
+        else if (k == "--json") o.json_out = v;
+        else std::cerr << "unknown option " << k << "\n";
+    }
+    return o;
+}
+
+static int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static httplib::Result issue(httplib::Client& cli, const httplib::Headers& headers, Op op,
+                             const std::string& user, std::mt19937_64& rng) {
+    auto post = [&](const char* path, const json& body) {
+        return cli.Post(path, headers, body.dump(), "application/json");
+    };
+    switch (op) {
+    case GET_SETTINGS:
+        return cli.Get(("/settings?user_id=" + user).c_str(), headers);
+    case POST_SETTINGS:
+        return post("/settings", {{"user_id", user}, {"settings", {{"dark_mode", rng() % 2 == 0}, {"language", "English"}}}});
+    case POST_PROFILE:
+        return post("/profile", {{"user_id", user}, {"name", "Stress " + std::to_string(rng() % 100)}});
+    case POST_NOTIFICATIONS:
+        return post("/notifications", {{"user_id", user}, {"chat_notifications", rng() % 2 == 0}});
+    case POST_THEME:
+        return post("/theme", {{"user_id", user}, {"theme_mode", rng() % 2 ? "Dark" : "Light"}});
+    case POST_BIOMETRIC:
+        return post("/security/biometric", {{"user_id", user}, {"enabled", rng() % 2 == 0}});
+    case POST_HISTORY:
+        return post("/history", {{"user_id", user}, {"role", "user"}, {"message", std::string(20 + rng() % 200, 's')}});
+    case GET_HISTORY:
+        return cli.Get(("/history?user_id=" + user).c_str(), headers);
+    case CLEAR_HISTORY:
+        return post("/history/clear", {{"user_id", user}});
+    case EXPORT:
+        return cli.Get(("/history/export?user_id=" + user).c_str(), headers);
+    case IMPORT_MERGE:
+    case IMPORT_REPLACE: {
+        json history = json::array();
+        for (int i = 0; i < 50; i++) history.push_back({{"role", i % 2 ? "bot" : "user"}, {"message", "imported " + std::to_string(i)}});
+        json payload = {{"user_id", user}, {"settings", {{"language", "German"}}}, {"chat_history", history}};
+        return post(op == IMPORT_REPLACE ? "/history/import?replace=true" : "/history/import", payload);
+    }
+    default:
+        return httplib::Result();
+    }
+}
+
+static void client_loop(const Options& o, Worker& w, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::discrete_distribution<int> pick(std::begin(OP_WEIGHTS), std::end(OP_WEIGHTS));
+    httplib::Client cli(o.host, o.port);
+    cli.set_keep_alive(true);
+    cli.set_read_timeout(o.timeout_sec, 0);
+    const char* key = std::getenv("LUMA_API_KEY");
+    httplib::Headers headers = {{"X-API-KEY", key ? key : "secret-api-key"}};
+
+    while (running.load(std::memory_order_relaxed)) {
+        Op op = static_cast<Op>(pick(rng));
+        std::string user = "stress-" + std::to_string(rng() % static_cast<uint64_t>(o.users));
+        auto begin = Clock::now();
+        w.in_flight_op.store(op);
+        w.in_flight_since.store(now_ns());
+        auto res = issue(cli, headers, op, user, rng);
+        w.in_flight_since.store(0);
+        w.latency[op].record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count()));
+        if (res && (res->status == 429 || res->status == 503)) w.rejected[op]++;
+        else if (!res || res->status >= 500) w.errors[op]++;
+        w.completed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Called with clients stuck: report what the server is doing and bail out
+[[noreturn]] static void report_hang(const Options& o, const std::string& why) {
+    std::printf("\nHANG: %s\n", why.c_str());
+    const char* key = std::getenv("LUMA_API_KEY");
+    httplib::Headers headers = {{"X-API-KEY", key ? key : "secret-api-key"}};
+    httplib::Client probe(o.host, o.port);
+    probe.set_read_timeout(5, 0);
+    auto health = probe.Get("/health", headers);
+    std::printf("GET /health on a new connection: %s\n",
+                health ? std::to_string(health->status).c_str() : "no response (server wedged)");
+    auto locks = probe.Get("/debug/locks", headers);
+    if (locks && locks->status == 200) {
+        json j = json::parse(locks->body, nullptr, false);
+        std::printf("/debug/locks:\n%s\n", j.is_discarded() ? locks->body.c_str() : j.dump(2).c_str());
+    } else {
+        std::printf("/debug/locks unavailable\n");
+    }
+    std::fflush(stdout);
+    std::_Exit(3);
+}
+
+static RunResult run(const Options& o, int threads, uint64_t seed) {
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int i = 0; i < threads; i++) workers.emplace_back(new Worker);
+    running = true;
+    std::vector<std::thread> clients;
+    for (int i = 0; i < threads; i++) {
+        clients.emplace_back(client_loop, std::cref(o), std::ref(*workers[static_cast<size_t>(i)]), seed * 7919 + static_cast<uint64_t>(i));
+    }
+
+    // Watchdog: runs the clock and looks for stuck requests while the clients work
+    auto start = Clock::now();
+    auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(o.seconds));
+    int64_t hang_ns = static_cast<int64_t>(o.hang_sec * 1e9);
+    uint64_t last_total = 0;
+    auto last_progress = start;
+    while (Clock::now() < end) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        int64_t now = now_ns();
+        uint64_t total = 0;
+        for (size_t i = 0; i < workers.size(); i++) {
+            total += workers[i]->completed.load(std::memory_order_relaxed);
+            int64_t since = workers[i]->in_flight_since.load();
+            if (since && now - since > hang_ns) {
+                int op = workers[i]->in_flight_op.load();
+                report_hang(o, "client " + std::to_string(i) + " of " + std::to_string(threads) + " has waited " +
+                               std::to_string((now - since) / 1000000) + " ms on " + OP_NAMES[op]);
+            }
+        }
+        if (total != last_total) {
+            last_total = total;
+            last_progress = Clock::now();
+        } else if (Clock::now() - last_progress > std::chrono::duration<double>(o.hang_sec)) {
+            report_hang(o, "no request completed for " + std::to_string(o.hang_sec) + " s with " +
+                           std::to_string(threads) + " clients");
+        }
+    }
+    running = false;
+    // Clients finish their current request; keep watching while they drain
+    auto drain_deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(o.hang_sec));
+    for (;;) {
+        bool idle = true;
+        for (auto& w : workers) idle = idle && w->in_flight_since.load() == 0;
+        if (idle) break;
+        if (Clock::now() > drain_deadline) report_hang(o, "clients did not finish their last request after the run");
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    for (auto& c : clients) c.join();
+
+    RunResult r;
+    r.threads = threads;
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (auto& w : workers) {
+        for (int op = 0; op < OP_COUNT; op++) {
+            r.latency[op].merge(w->latency[op]);
+            r.overall.merge(w->latency[op]);
+            r.errors[op] += w->errors[op];
+            r.rejected[op] += w->rejected[op];
+            r.total_errors += w->errors[op];
+        }
+        r.completed += w->completed.load();
+    }
+    return r;
+}
+
+static unsigned long long u(uint64_t v) { return static_cast<unsigned long long>(v); }
+
+int main(int argc, char** argv) {
+    Options o = parse_args(argc, argv);
+    if (o.threads.empty()) {
+        std::cerr << "--threads needs at least one positive count\n";
+        return 2;
+    }
+
+    json runs = json::array();
+    double base_per_thread = 0;
+    uint64_t total_errors = 0;
+    std::printf("%8s %10s %10s %9s %9s %9s %8s %8s\n", "threads", "req/s", "efficiency", "p50 us", "p99 us", "max us",
+                "errors", "rejected");
+    for (size_t i = 0; i < o.threads.size(); i++) {
+        RunResult r = run(o, o.threads[i], o.seed + i);
+        double throughput = static_cast<double>(r.completed) / r.seconds;
+        if (i == 0) base_per_thread = throughput / r.threads;
+        double efficiency = base_per_thread > 0 ? throughput / (base_per_thread * r.threads) : 0;
+        uint64_t rejected = 0;
+        for (int op = 0; op < OP_COUNT; op++) rejected += r.rejected[op];
+        total_errors += r.total_errors;
+        std::printf("%8d %10.1f %9.0f%% %9llu %9llu %9llu %8llu %8llu\n", r.threads, throughput, efficiency * 100,
+                    u(r.overall.percentile(50)), u(r.overall.percentile(99)), u(r.overall.max()),
+                    u(r.total_errors), u(rejected));
+        std::fflush(stdout);
+
+        json routes = json::object();
+        for (int op = 0; op < OP_COUNT; op++) {
+            json s = r.latency[op].summary();
+            s["errors"] = r.errors[op];
+            s["rejected"] = r.rejected[op];
+            s["buckets"] = r.latency[op].buckets();
+            routes[OP_NAMES[op]] = s;
+        }
+        json overall = r.overall.summary();
+        overall["buckets"] = r.overall.buckets();
+        runs.push_back({
+                {"threads", r.threads},
+                {"seconds", r.seconds},
+                {"throughput", throughput},
+                {"efficiency", efficiency},
+                {"errors", r.total_errors},
+                {"rejected", rejected},
+                {"overall", overall},
+                {"routes", routes}
+        });
+    }
+
+    if (!o.json_out.empty()) {
+        std::ofstream f(o.json_out);
+        f << json({{"tool", "stress"}, {"target", o.host + ":" + std::to_string(o.port)}, {"users", o.users}, {"runs", runs}}).dump(2) << "\n";
+        if (!f) {
+            std::cerr << "cannot write " << o.json_out << "\n";
+            return 1;
+        }
+    }
+    if (total_errors) {
+        std::printf("FAIL: %llu requests failed with a transport error or 5xx\n", u(total_errors));
+        return 1;
+    }
+    return 0;
+}
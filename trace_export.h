@@ -0,0 +1,230 @@
+// trace_export.h
+//
+// Request traces written to a local file in OTLP-compatible JSON
+// - HTTP threads hand finished traces to a bounded lock-free ring (never block)
+// - A background thread drains the ring and appends one OTLP/JSON
+//   ExportTraceServiceRequest per line, so the file can be fed to an
+//   OpenTelemetry collector (otlpjsonfile receiver) or inspected with jq
+// - The file is rotated by size: traces.jsonl -> traces.jsonl.1 -> ...
+//
+// Which requests to keep (head/tail sampling) is decided by the caller.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "json.hpp"
+
+struct TraceSpan {
+    std::string name;
+    uint64_t span_id = 0;
+    uint64_t parent_id = 0;  // 0 = root span
+    uint64_t start_unix_ns = 0;
+    uint64_t end_unix_ns = 0;
+    bool error = false;
+    std::vector<std::pair<std::string, std::string>> attributes;
+};
+
+struct TraceRecord {
+    uint64_t trace_id_hi = 0;
+    uint64_t trace_id_lo = 0;
+    std::vector<TraceSpan> spans;
+};
+
+// Bounded multi-producer / single-consumer ring (Vyukov's sequence-numbered
+// array queue). Push and pop are lock-free; push fails when the ring is full.
+template <typename T>
+class BoundedRing {
+public:
+    explicit BoundedRing(size_t capacity_pow2) : mask_(capacity_pow2 - 1), cells_(capacity_pow2) {
+        for (size_t i = 0; i < capacity_pow2; i++) cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(T value) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // full
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Single consumer only
+    bool pop(T& out) {
+        Cell& cell = cells_[head_ & mask_];
+        size_t seq = cell.seq.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(head_ + 1) < 0) return false;  // empty
+        out = std::move(cell.value);
+        cell.seq.store(head_ + mask_ + 1, std::memory_order_release);
+        head_++;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq{0};
+        T value{};
+    };
+    const size_t mask_;
+    std::vector<Cell> cells_;
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) size_t head_ = 0;
+};
+
+class TraceExporter {
+public:
+    TraceExporter(std::string path, std::string service_name, size_t ring_size, size_t max_file_bytes, int keep_files)
+        : path_(std::move(path)), service_name_(std::move(service_name)), ring_(ring_size),
+          max_file_bytes_(max_file_bytes), keep_files_(keep_files) {}
+
+    ~TraceExporter() { stop(); }
+
+    bool start() {
+        file_ = std::fopen(path_.c_str(), "ab");
+        if (!file_) return false;
+        std::fseek(file_, 0, SEEK_END);
+        file_bytes_ = static_cast<size_t>(std::ftell(file_));
+        running_ = true;
+        writer_ = std::thread([this] { run(); });
+        return true;
+    }
+
+    void stop() {
+        if (!running_.exchange(false)) return;
+        writer_.join();
+        drain();
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+
+    // Hand a finished trace to the writer; false (and counted) if the ring is full
+    bool submit(std::unique_ptr<TraceRecord> trace) {
+        if (ring_.push(std::move(trace))) return true;
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    uint64_t exported() const { return exported_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    static std::string hex(uint64_t v) {
+        static const char digits[] = "0123456789abcdef";
+        std::string out(16, '0');
+        for (int i = 15; i >= 0; i--, v >>= 4) out[i] = digits[v & 0xf];
+        return out;
+    }
+
+private:
+    static const size_t MAX_BATCH = 64;
+
+    void run() {
+        while (running_.load(std::memory_order_relaxed)) {
+            if (drain() == 0) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+
+    // Write everything currently in the ring; returns the number of traces written
+    size_t drain() {
+        size_t written = 0;
+        std::vector<std::unique_ptr<TraceRecord>> batch;
+        std::unique_ptr<TraceRecord> trace;
+        while (ring_.pop(trace)) {
+            batch.push_back(std::move(trace));
+            if (batch.size() == MAX_BATCH) {
+                written += write_batch(batch);
+                batch.clear();
+            }
+        }
+        if (!batch.empty()) written += write_batch(batch);
+        return written;
+    }
+
+    size_t write_batch(const std::vector<std::unique_ptr<TraceRecord>>& batch) {
+        using nlohmann::json;
+        json spans = json::array();
+        for (const auto& trace : batch) {
+            std::string trace_id = hex(trace->trace_id_hi) + hex(trace->trace_id_lo);
+            for (const auto& s : trace->spans) {
+                json attrs = json::array();
+                for (const auto& kv : s.attributes) {
+                    attrs.push_back({{"key", kv.first}, {"value", {{"stringValue", kv.second}}}});
+                }
+                json span = {
+                        {"traceId", trace_id},
+                        {"spanId", hex(s.span_id)},
+                        {"name", s.name},
+                        {"kind", s.parent_id ? 1 : 2},  // INTERNAL children under a SERVER root
+                        {"startTimeUnixNano", std::to_string(s.start_unix_ns)},
+                        {"endTimeUnixNano", std::to_string(s.end_unix_ns)},
+                        {"attributes", attrs},
+                        {"status", {{"code", s.error ? 2 : 0}}}
+                };
+                if (s.parent_id) span["parentSpanId"] = hex(s.parent_id);
+                spans.push_back(std::move(span));
+            }
+        }
+        json line = {{"resourceSpans", json::array({
+                {
+                        {"resource", {{"attributes", json::array({
+                                {{"key", "service.name"}, {"value", {{"stringValue", service_name_}}}}
+                        })}}},
+                        {"scopeSpans", json::array({
+                                {{"scope", {{"name", "trace_export"}}}, {"spans", spans}}
+                        })}
+                }
+        })}};
+        std::string text = line.dump(-1, ' ', false, json::error_handler_t::replace);
+        text += '\n';
+
+        if (file_bytes_ + text.size() > max_file_bytes_ && file_bytes_ > 0) rotate();
+        if (file_) {
+            std::fwrite(text.data(), 1, text.size(), file_);
+            std::fflush(file_);
+            file_bytes_ += text.size();
+        }
+        exported_.fetch_add(batch.size(), std::memory_order_relaxed);
+        return batch.size();
+    }
+
+    // traces.jsonl.(n-1) -> traces.jsonl.n, ..., traces.jsonl -> traces.jsonl.1
+    void rotate() {
+        std::fclose(file_);
+        for (int i = keep_files_ - 1; i >= 1; i--) {
+            std::string from = i == 1 ? path_ : path_ + "." + std::to_string(i - 1);
+            std::rename(from.c_str(), (path_ + "." + std::to_string(i)).c_str());
+        }
+        if (keep_files_ <= 1) std::remove(path_.c_str());
+        file_ = std::fopen(path_.c_str(), "wb");
+        file_bytes_ = 0;
+    }
+
+    std::string path_;
+    std::string service_name_;
+    BoundedRing<std::unique_ptr<TraceRecord>> ring_;
+    size_t max_file_bytes_;
+    int keep_files_;
+    std::FILE* file_ = nullptr;
+    size_t file_bytes_ = 0;
+    std::thread writer_;
+    std::atomic<bool> running_{false};
+    std::atomic<uint64_t> exported_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
@@ -0,0 +1,275 @@
+// traffic_capture.h
+//
+// Anonymized request capture in a compact binary log, and its reader
+// - CaptureWriter takes finished requests from HTTP threads through a bounded
+//   lock-free ring (never blocks; full ring = dropped record) and appends them
+//   from a background thread
+// - Anonymizer replaces identifiers (user_id, X-Device-Id) with keyed-hash
+//   pseudonyms that are stable within one capture, keeps categorical values
+//   (theme_mode, language, role, ...), booleans and numbers, and replaces all
+//   other strings with filler of the same length, so payload shapes and sizes
+//   survive but content does not
+// - CaptureReader decodes the log for the replay tool
+//
+// File format: "LUMACAP1", u64 capture start (unix ns, little endian), then
+// records of varints and length-prefixed strings:
+//   offset_ns, method, path, query, body, app_version, device_id,
+//   status, latency_us, response_bytes
+
+#pragma once
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json.hpp"
+#include "trace_export.h"  // BoundedRing
+
+struct CaptureRecord {
+    uint64_t offset_ns = 0;  // since the capture started
+    std::string method;
+    std::string path;
+    std::string query;       // anonymized, "a=b&c=d"
+    std::string body;        // anonymized
+    std::string app_version;
+    std::string device_id;   // pseudonym
+    uint32_t status = 0;
+    uint64_t latency_us = 0;
+    uint64_t response_bytes = 0;
+};
+
+class Anonymizer {
+public:
+    // A fresh random key per capture: pseudonyms can't be linked across captures
+    Anonymizer() : key_(std::random_device{}() * 0x9E3779B97F4A7C15ull ^ std::random_device{}()) {}
+
+    std::string pseudonym(const std::string& id) const {
+        if (id.empty()) return id;
+        uint64_t h = 0xcbf29ce484222325ull ^ key_;
+        for (unsigned char c : id) h = (h ^ c) * 0x100000001b3ull;
+        h ^= h >> 29;
+        static const char digits[] = "0123456789abcdef";
+        std::string out = "anon-";
+        for (int i = 0; i < 12; i++, h >>= 4) out += digits[h & 0xf];
+        return out;
+    }
+
+    // JSON bodies are anonymized field by field; anything else becomes filler
+    std::string body(const std::string& text) const {
+        if (text.empty()) return text;
+        nlohmann::json j = nlohmann::json::parse(text, nullptr, false);
+        if (j.is_discarded()) return std::string(text.size(), 'x');
+        scrub(j, "");
+        return j.dump();
+    }
+
+    // URL-encoded query string with user_id pseudonymized and other values kept only if categorical
+    std::string query(const std::vector<std::pair<std::string, std::string>>& params) const {
+        std::string out;
+        for (const auto& kv : params) {
+            if (!out.empty()) out += '&';
+            out += encode(kv.first) + "=";
+            if (kv.first == "user_id") out += pseudonym(kv.second);
+            else if (categorical(kv.first) || numeric(kv.second)) out += encode(kv.second);
+            else out += std::string(kv.second.size(), 'x');
+        }
+        return out;
+    }
+
+private:
+    static bool categorical(const std::string& key) {
+        static const char* keys[] = {"theme_mode", "language", "role", "app_version", "replace", "limit",
+                                     "granularity", "metric", "dimension", "windows"};
+        for (const char* k : keys) {
+            if (key == k) return true;
+        }
+        return false;
+    }
+
+    static std::string encode(const std::string& v) {
+        static const char hex[] = "0123456789ABCDEF";
+        std::string out;
+        for (unsigned char c : v) {
+            if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+                out += static_cast<char>(c);
+            } else {
+                out += '%';
+                out += hex[c >> 4];
+                out += hex[c & 0xf];
+            }
+        }
+        return out;
+    }
+
+    static bool numeric(const std::string& v) {
+        return !v.empty() && v.find_first_not_of("0123456789") == std::string::npos;
+    }
+
+    void scrub(nlohmann::json& j, const std::string& key) const {
+        if (j.is_object()) {
+            for (auto it = j.begin(); it != j.end(); ++it) scrub(it.value(), it.key());
+        } else if (j.is_array()) {
+            for (auto& v : j) scrub(v, key);
+        } else if (j.is_string()) {
+            const std::string& s = j.get_ref<const std::string&>();
+            if (key == "user_id") j = pseudonym(s);
+            else if (!categorical(key)) j = std::string(s.size(), 'x');
+        }
+    }
+
+    uint64_t key_;
+};
+
+class CaptureWriter {
+public:
+    CaptureWriter(std::string path, size_t ring_size) : path_(std::move(path)), ring_(ring_size) {}
+    ~CaptureWriter() { stop(); }
+
+    bool start() {
+        file_ = std::fopen(path_.c_str(), "wb");
+        if (!file_) return false;
+        start_ = std::chrono::steady_clock::now();
+        uint64_t unix_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+        std::string header = "LUMACAP1";
+        for (int i = 0; i < 8; i++) header += static_cast<char>((unix_ns >> (8 * i)) & 0xff);
+        std::fwrite(header.data(), 1, header.size(), file_);
+        running_ = true;
+        writer_ = std::thread([this] { run(); });
+        return true;
+    }
+
+    void stop() {
+        if (!running_.exchange(false)) return;
+        writer_.join();
+        drain();
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+
+    // Offset of `t` from the start of the capture
+    uint64_t offset_ns(std::chrono::steady_clock::time_point t) const {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t - start_).count());
+    }
+
+    bool submit(std::unique_ptr<CaptureRecord> record) {
+        if (ring_.push(std::move(record))) return true;
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    void run() {
+        while (running_.load(std::memory_order_relaxed)) {
+            if (drain() == 0) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+
+    size_t drain() {
+        size_t n = 0;
+        std::unique_ptr<CaptureRecord> r;
+        std::string buf;
+        while (ring_.pop(r)) {
+            buf.clear();
+            put_varint(buf, r->offset_ns);
+            for (const std::string* s : {&r->method, &r->path, &r->query, &r->body, &r->app_version, &r->device_id}) {
+                put_varint(buf, s->size());
+                buf += *s;
+            }
+            put_varint(buf, r->status);
+            put_varint(buf, r->latency_us);
+            put_varint(buf, r->response_bytes);
+            std::fwrite(buf.data(), 1, buf.size(), file_);
+            n++;
+        }
+        if (n) {
+            std::fflush(file_);
+            written_.fetch_add(n, std::memory_order_relaxed);
+        }
+        return n;
+    }
+
+    static void put_varint(std::string& out, uint64_t v) {
+        while (v >= 0x80) {
+            out += static_cast<char>((v & 0x7f) | 0x80);
+            v >>= 7;
+        }
+        out += static_cast<char>(v);
+    }
+
+    std::string path_;
+    BoundedRing<std::unique_ptr<CaptureRecord>> ring_;
+    std::FILE* file_ = nullptr;
+    std::chrono::steady_clock::time_point start_;
+    std::thread writer_;
+    std::atomic<bool> running_{false};
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
+
+class CaptureReader {
+public:
+    // Reads the whole log; false if the file is missing or not a capture
+    bool open(const std::string& path) {
+        std::FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f) return false;
+        std::string data;
+        char chunk[65536];
+        size_t n;
+        while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0) data.append(chunk, n);
+        std::fclose(f);
+        if (data.size() < 16 || data.compare(0, 8, "LUMACAP1") != 0) return false;
+        data_ = std::move(data);
+        pos_ = 16;
+        return true;
+    }
+
+    // Next record; false at the end (a truncated tail is ignored)
+    bool next(CaptureRecord& r) {
+        size_t saved = pos_;
+        uint64_t status = 0;
+        bool ok = get_varint(r.offset_ns);
+        for (std::string* s : {&r.method, &r.path, &r.query, &r.body, &r.app_version, &r.device_id}) {
+            ok = ok && get_string(*s);
+        }
+        ok = ok && get_varint(status) && get_varint(r.latency_us) && get_varint(r.response_bytes);
+        if (!ok) {
+            pos_ = saved;
+            return false;
+        }
+        r.status = static_cast<uint32_t>(status);
+        return true;
+    }
+
+private:
+    bool get_varint(uint64_t& v) {
+        v = 0;
+        for (int shift = 0; shift < 64 && pos_ < data_.size(); shift += 7) {
+            uint8_t b = static_cast<uint8_t>(data_[pos_++]);
+            v |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool get_string(std::string& s) {
+        uint64_t len = 0;
+        if (!get_varint(len) || len > data_.size() - pos_) return false;
+        s.assign(data_, pos_, static_cast<size_t>(len));
+        pos_ += static_cast<size_t>(len);
+        return true;
+    }
+
+    std::string data_;
+    size_t pos_ = 0;
+};
@@ -0,0 +1,267 @@
+// utf8.h
+//
+// UTF-8 validation and repair for incoming text
+// - utf8_valid() checks a buffer is well-formed UTF-8 (no overlongs,
+//   surrogates, code points above U+10FFFF or truncated sequences). On x86-64
+//   CPUs with AVX2 it checks 32 bytes per step with the Keiser-Lemire lookup
+//   algorithm (three 16-entry table lookups classify every byte pair, plus a
+//   check that 3- and 4-byte leads are followed by enough continuations);
+//   all-ASCII blocks are skipped with one movemask. Elsewhere it falls back to
+//   a scalar check with an 8-byte ASCII fast path. The choice is made once,
+//   at first use
+// - utf8_invalid_offset() finds the first bad byte (scalar; for error reports)
+// - utf8_replace_invalid() rewrites a string with every maximal invalid
+//   subpart replaced by U+FFFD, as Unicode recommends (and browsers do)
+//
+// utf8_bench.cpp measures the throughput of each path in GB/s.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define LUMA_UTF8_AVX2 1
+#endif
+
+namespace utf8_detail {
+
+// Length of the valid sequence starting at p (< end), or 0
+inline size_t sequence(const unsigned char* p, const unsigned char* end) {
+    unsigned char c = p[0];
+    if (c < 0x80) return 1;
+    size_t n = c < 0xC2 ? 0 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : c < 0xF5 ? 4 : 0;
+    if (n == 0 || static_cast<size_t>(end - p) < n) return 0;
+    unsigned char c1 = p[1];
+    if ((c1 & 0xC0) != 0x80) return 0;
+    if (c == 0xE0 && c1 < 0xA0) return 0;  // overlong
+    if (c == 0xED && c1 > 0x9F) return 0;  // surrogate
+    if (c == 0xF0 && c1 < 0x90) return 0;  // overlong
+    if (c == 0xF4 && c1 > 0x8F) return 0;  // > U+10FFFF
+    for (size_t i = 2; i < n; i++) {
+        if ((p[i] & 0xC0) != 0x80) return 0;
+    }
+    return n;
+}
+
+// Bytes an invalid sequence at p spans: the lead and the continuation bytes
+// that could still have begun a valid sequence ("maximal subpart"), at least 1
+inline size_t maximal_subpart(const unsigned char* p, const unsigned char* end) {
+    unsigned char c = p[0];
+    size_t n = c < 0xC2 ? 0 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : c < 0xF5 ? 4 : 0;
+    if (n == 0) return 1;
+    unsigned char lo = c == 0xE0 ? 0xA0 : c == 0xF0 ? 0x90 : 0x80;
+    unsigned char hi = c == 0xED ? 0x9F : c == 0xF4 ? 0x8F : 0xBF;
+    size_t i = 1;
+    if (p + i == end || p[i] < lo || p[i] > hi) return 1;
+    for (i++; i < n && p + i < end && (p[i] & 0xC0) == 0x80; i++) {}
+    return i;
+}
+
+// Offset of the first invalid byte, or len
+inline size_t scalar_invalid_offset(const unsigned char* p, size_t len) {
+    const unsigned char* begin = p;
+    const unsigned char* end = p + len;
+    while (p < end) {
+        if (end - p >= 8) {
+            uint64_t word;
+            std::memcpy(&word, p, 8);
+            if ((word & 0x8080808080808080ULL) == 0) {
+                p += 8;
+                continue;
+            }
+        }
+        size_t n = sequence(p, end);
+        if (n == 0) return static_cast<size_t>(p - begin);
+        p += n;
+    }
+    return len;
+}
+
+#ifdef LUMA_UTF8_AVX2
+
+// Error classes of a (previous byte, byte) pair; a pair is invalid when all
+// three lookups agree on at least one class
+static const uint8_t TOO_SHORT = 1 << 0;   // lead not followed by a continuation
+static const uint8_t TOO_LONG = 1 << 1;    // continuation after ASCII
+static const uint8_t OVERLONG_3 = 1 << 2;
+static const uint8_t TOO_LARGE = 1 << 3;
+static const uint8_t SURROGATE = 1 << 4;
+static const uint8_t OVERLONG_2 = 1 << 5;
+static const uint8_t TOO_LARGE_1000 = 1 << 6;
+static const uint8_t OVERLONG_4 = 1 << 6;
+static const uint8_t TWO_CONTS = 1 << 7;   // continuation after continuation (checked below)
+static const uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+__attribute__((target("avx2"))) inline __m256i table(uint8_t a0, uint8_t a1, uint8_t a2, uint8_t a3,
+                                                     uint8_t a4, uint8_t a5, uint8_t a6, uint8_t a7,
+                                                     uint8_t a8, uint8_t a9, uint8_t a10, uint8_t a11,
+                                                     uint8_t a12, uint8_t a13, uint8_t a14, uint8_t a15) {
+    return _mm256_setr_epi8(
+            static_cast<char>(a0), static_cast<char>(a1), static_cast<char>(a2), static_cast<char>(a3),
+            static_cast<char>(a4), static_cast<char>(a5), static_cast<char>(a6), static_cast<char>(a7),
+            static_cast<char>(a8), static_cast<char>(a9), static_cast<char>(a10), static_cast<char>(a11),
+            static_cast<char>(a12), static_cast<char>(a13), static_cast<char>(a14), static_cast<char>(a15),
+            static_cast<char>(a0), static_cast<char>(a1), static_cast<char>(a2), static_cast<char>(a3),
+            static_cast<char>(a4), static_cast<char>(a5), static_cast<char>(a6), static_cast<char>(a7),
+            static_cast<char>(a8), static_cast<char>(a9), static_cast<char>(a10), static_cast<char>(a11),
+            static_cast<char>(a12), static_cast<char>(a13), static_cast<char>(a14), static_cast<char>(a15));
+}
+
+__attribute__((target("avx2"))) inline __m256i high_nibbles(__m256i v) {
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+// The 32 bytes ending N bytes before the end of `input` (N from `prev`)
+template <int N>
+__attribute__((target("avx2"))) inline __m256i shifted(__m256i input, __m256i prev) {
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - N);
+}
+
+struct Avx2Checker {
+    __m256i error;
+    __m256i prev_input;
+    __m256i prev_incomplete;
+
+    __attribute__((target("avx2"))) void reset() {
+        error = prev_input = prev_incomplete = _mm256_setzero_si256();
+    }
+
+    __attribute__((target("avx2"))) void block(__m256i input) {
+        if (_mm256_movemask_epi8(input) == 0) {
+            // ASCII: only a sequence cut off at the end of the last block can fail
+            error = _mm256_or_si256(error, prev_incomplete);
+            prev_incomplete = _mm256_setzero_si256();
+            prev_input = input;
+            return;
+        }
+        __m256i prev1 = shifted<1>(input, prev_input);
+        __m256i byte_1_high = _mm256_shuffle_epi8(
+                table(TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+                      TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+                      TOO_SHORT | OVERLONG_2,
+                      TOO_SHORT,
+                      TOO_SHORT | OVERLONG_3 | SURROGATE,
+                      TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4),
+                high_nibbles(prev1));
+        __m256i byte_1_low = _mm256_shuffle_epi8(
+                table(CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+                      CARRY | OVERLONG_2,
+                      CARRY,
+                      CARRY,
+                      CARRY | TOO_LARGE,
+                      CARRY | TOO_LARGE | TOO_LARGE_1000,
+                      CARRY | TOO_LARGE | TOO_LARGE_1000,
+                      CARRY | TOO_LARGE | TOO_LARGE_1000,
+                      CARRY | TOO_LARGE | TOO_LARGE_1000,
+                      CARRY | TOO_LARGE | TOO_LARGE_1000,
+                      CARRY | TOO_LARGE | TOO_LARGE_1000,
+                      CARRY | TOO_LARGE | TOO_LARGE_1000,
+                      CARRY | TOO_LARGE | TOO_LARGE_1000,
+                      CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+                      CARRY | TOO_LARGE | TOO_LARGE_1000,
+                      CARRY | TOO_LARGE | TOO_LARGE_1000),
+                _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)));
+        __m256i byte_2_high = _mm256_shuffle_epi8(
+                table(TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+                      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+                      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+                      TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+                      TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+                      TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT),
+                high_nibbles(input));
+        __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+        // Two continuations in a row are only right as the 2nd/3rd byte after
+        // a 3- or 4-byte lead: the high bit of `must23` marks exactly those
+        __m256i prev2 = shifted<2>(input, prev_input);
+        __m256i prev3 = shifted<3>(input, prev_input);
+        __m256i must23 = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80))),
+                                         _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80))));
+        __m256i must23_80 = _mm256_and_si256(must23, _mm256_set1_epi8(static_cast<char>(0x80)));
+        error = _mm256_or_si256(error, _mm256_xor_si256(must23_80, special));
+
+        // A lead in the last 3 bytes needs the next block to complete it
+        prev_incomplete = _mm256_subs_epu8(input, _mm256_setr_epi8(
+                -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1)));
+        prev_input = input;
+    }
+};
+
+__attribute__((target("avx2"))) inline bool avx2_valid(const unsigned char* p, size_t len) {
+    Avx2Checker check;
+    check.reset();
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        check.block(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)));
+    }
+    if (i < len) {
+        unsigned char tail[32] = {};
+        std::memcpy(tail, p + i, len - i);
+        check.block(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(tail)));
+    }
+    check.block(_mm256_setzero_si256());  // flushes a sequence cut off at the end
+    return _mm256_testz_si256(check.error, check.error) != 0;
+}
+
+inline bool cpu_has_avx2() {
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+
+#endif  // LUMA_UTF8_AVX2
+
+}  // namespace utf8_detail
+
+inline bool utf8_valid_scalar(const char* data, size_t len) {
+    return utf8_detail::scalar_invalid_offset(reinterpret_cast<const unsigned char*>(data), len) == len;
+}
+
+// Which utf8_valid() implementation this CPU uses
+inline const char* utf8_implementation() {
+#ifdef LUMA_UTF8_AVX2
+    if (utf8_detail::cpu_has_avx2()) return "avx2";
+#endif
+    return "scalar";
+}
+
+inline bool utf8_valid(const char* data, size_t len) {
+#ifdef LUMA_UTF8_AVX2
+    if (utf8_detail::cpu_has_avx2()) return utf8_detail::avx2_valid(reinterpret_cast<const unsigned char*>(data), len);
+#endif
+    return utf8_valid_scalar(data, len);
+}
+
+inline bool utf8_valid(const std::string& s) { return utf8_valid(s.data(), s.size()); }
+
+inline size_t utf8_invalid_offset(const char* data, size_t len) {
+    return utf8_detail::scalar_invalid_offset(reinterpret_cast<const unsigned char*>(data), len);
+}
+
+// Replaces each maximal invalid subpart of `s` with U+FFFD; returns how many
+// were replaced (0 leaves s untouched)
+inline size_t utf8_replace_invalid(std::string& s) {
+    const auto* p = reinterpret_cast<const unsigned char*>(s.data());
+    const auto* end = p + s.size();
+    size_t first = utf8_detail::scalar_invalid_offset(p, s.size());
+    if (first == s.size()) return 0;
+    std::string out;
+    out.reserve(s.size() + 16);
+    out.append(s, 0, first);
+    size_t replaced = 0;
+    for (p += first; p < end;) {
+        out += "\xEF\xBF\xBD";
+        replaced++;
+        p += utf8_detail::maximal_subpart(p, end);
+        size_t valid = utf8_detail::scalar_invalid_offset(p, static_cast<size_t>(end - p));
+        out.append(reinterpret_cast<const char*>(p), valid);
+        p += valid;
+    }
+    s.swap(out);
+    return replaced;
+}
@@ -0,0 +1,144 @@
+// utf8_bench.cpp
+//
+// Throughput of UTF-8 validation and repair (utf8.h) in GB/s
+// - inputs of --kb kilobytes: pure ASCII, chat-like text (mostly ASCII with
+//   accents and the odd emoji), Latin-1-heavy, CJK (3-byte) and emoji
+//   (4-byte) text, and chat text with an invalid byte every ~4 KB as seen
+//   from speech-to-text
+// - per input: the scalar check, utf8_valid() (AVX2 where the CPU has it)
+//   and utf8_replace_invalid(); the validators must agree on every input
+// - small --kb (e.g. 1) shows per-request cost, large (e.g. 65536) memory
+//   bandwidth
+//
+// Usage:
+//   utf8_bench [--kb N] [--millis M] [--json FILE]
+//
+// Build (example):
+// g++ utf8_bench.cpp -std=c++17 -O2 -o utf8_bench
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include "json.hpp"      // nlohmann::json (single header)
+#include "utf8.h"
+
+using json = nlohmann::json;
+
+struct Options {
+    size_t kb = 64;
+    double millis = 300;
+    std::string json_out;
+};
+
+static Options parse_args(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string k = argv[i];
+        const char* v = argv[i + 1];
+        if (k == "--kb") o.kb = static_cast<size_t>(std::max(1, std::atoi(v)));
+        else if (k == "--millis") o.millis = std::max(1.0, std::atof(v));
+        else if (k == "--json") o.json_out = v;
+        else std::cerr << "unknown option " << k << "\n";
+    }
+    return o;
+}
+
+struct Input {
+    std::string name;
+    std::string text;
+};
+
+// `pieces` repeated to `bytes`, cut on a piece boundary
+static std::string fill(const std::vector<std::string>& pieces, size_t bytes) {
+    std::string out;
+    out.reserve(bytes + 64);
+    for (size_t i = 0; out.size() < bytes; i++) {
+        const std::string& p = pieces[(i * 7 + i / 3) % pieces.size()];
+        if (out.size() + p.size() > bytes) break;
+        out += p;
+    }
+    out.append(bytes - out.size(), ' ');
+    return out;
+}
+
+static std::vector<Input> make_inputs(size_t bytes) {
+    std::vector<std::string> chat = {
+            "Remind me to call mom at 6 ", "what's the weather in M\xc3\xbcnchen tomorrow? ",
+            "play something relaxing ", "set a timer for 10 minutes ", "caf\xc3\xa9 near me ",
+            "thanks! \xf0\x9f\x98\x80 ", "turn on dark mode ", "how do I say \xe2\x80\x9cgood night\xe2\x80\x9d in French? "};
+    std::vector<Input> inputs;
+    inputs.push_back({"ascii", fill({"The quick brown fox jumps over the lazy dog. ", "Set an alarm for 7am. "}, bytes)});
+    inputs.push_back({"chat", fill(chat, bytes)});
+    inputs.push_back({"latin", fill({"\xc3\xa9t\xc3\xa9 ", "gr\xc3\xb6\xc3\x9f" "e ", "se\xc3\xb1or ", "\xc3\xa0 bient\xc3\xb4t "}, bytes)});
+    inputs.push_back({"cjk", fill({"\xe4\xbd\xa0\xe5\xa5\xbd", "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e", "\xed\x95\x9c\xea\xb5\xad\xec\x96\xb4"}, bytes)});
+    inputs.push_back({"emoji", fill({"\xf0\x9f\x98\x80", "\xf0\x9f\x8e\x89", "\xf0\x9f\x91\x8d\xf0\x9f\x8f\xbd"}, bytes)});
+    Input bad{"chat_invalid", fill(chat, bytes)};
+    for (size_t i = 4000; i < bad.text.size(); i += 4096) bad.text[i] = static_cast<char>(0xC3 + (i / 4096) % 2 * 0x3C);
+    inputs.push_back(bad);
+    return inputs;
+}
+
+// Bytes per ns (= GB/s) of `fn` over `bytes`, repeated for at least `millis`
+static double gbps(const std::function<size_t()>& fn, size_t bytes, double millis) {
+    using clock = std::chrono::steady_clock;
+    auto budget = std::chrono::duration<double, std::milli>(millis);
+    size_t runs = 0, sink = 0;
+    auto start = clock::now();
+    auto elapsed = clock::duration::zero();
+    for (size_t batch = 1; elapsed < budget; batch *= 2) {
+        for (size_t i = 0; i < batch; i++) sink += fn();
+        runs += batch;
+        elapsed = clock::now() - start;
+    }
+    if (sink == 1) std::printf(" ");  // keep the calls
+    return static_cast<double>(bytes) * static_cast<double>(runs) / std::chrono::duration<double, std::nano>(elapsed).count();
+}
+
+int main(int argc, char** argv) {
+    Options o = parse_args(argc, argv);
+    size_t bytes = o.kb * 1024;
+    std::printf("%zu KB per input, utf8_valid() uses %s\n\n", o.kb, utf8_implementation());
+    std::printf("%-14s %6s %14s %14s %14s %10s\n", "input", "valid", "scalar GB/s", "utf8_valid GB/s", "replace GB/s", "replaced");
+
+    json out = {{"tool", "utf8_bench"}, {"kb", o.kb}, {"implementation", utf8_implementation()}};
+    bool agree = true;
+    for (const auto& in : make_inputs(bytes)) {
+        bool scalar_ok = utf8_valid_scalar(in.text.data(), in.text.size());
+        bool simd_ok = utf8_valid(in.text.data(), in.text.size());
+        agree = agree && scalar_ok == simd_ok;
+        std::string repaired = in.text;
+        size_t replaced = utf8_replace_invalid(repaired);
+        agree = agree && utf8_valid(repaired) && (replaced == 0) == simd_ok;
+
+        double scalar = gbps([&] { return static_cast<size_t>(utf8_valid_scalar(in.text.data(), in.text.size())); }, bytes, o.millis);
+        double simd = gbps([&] { return static_cast<size_t>(utf8_valid(in.text.data(), in.text.size())); }, bytes, o.millis);
+        double repair = gbps([&] {
+            std::string copy = in.text;
+            return utf8_replace_invalid(copy);
+        }, bytes, o.millis);
+        std::printf("%-14s %6s %14.2f %14.2f %14.2f %10zu%s\n", in.name.c_str(), simd_ok ? "yes" : "no", scalar, simd,
+                    repair, replaced, scalar_ok == simd_ok ? "" : "  MISMATCH");
+        out["inputs"][in.name] = {
+                {"valid", simd_ok},
+                {"scalar_gbps", scalar},
+                {"utf8_valid_gbps", simd},
+                {"replace_gbps", repair},
+                {"replaced", replaced}
+        };
+    }
+    std::printf("\nreplace includes copying the input, as the server does for a bad body; on invalid\n"
+                "input the scalar check stops at the first bad byte\n");
+
+    if (!o.json_out.empty()) {
+        std::ofstream f(o.json_out);
+        f << out.dump(2) << "\n";
+    }
+    return agree ? 0 : 1;
+}
@@ -0,0 +1,540 @@
+// zerocopy_bench.cpp
+//
+// Heap allocations and bytes copied per request on the hot write paths
+// - POST /history (append) and the settings routes (/settings, /profile,
+//   /notifications, /theme) go from the request buffer to SQLite three ways:
+//     nlohmann   json::parse, get<std::string>() copies and, for settings, a
+//                second json payload rebuilt from the first (the handlers
+//                before the schema codecs)
+//     owned      the codec decoding into per-route structs of std::string
+//                members, moved field by field into a SettingsUpdate
+//     views      the codec decoding straight into the SettingsUpdateView the
+//                store applies, std::string_view members over the body (the
+//                server now)
+//   all three end in the same StoreSession call, which binds text with
+//   SQLITE_STATIC
+// - a bind-only run inserts the same row with SQLITE_TRANSIENT and with
+//   SQLITE_STATIC to show SQLite's own copy of every bound string
+// - counts C++ allocations (operator new, this binary) and SQLite's
+//   (sqlite3_config(SQLITE_CONFIG_MALLOC) wrapper) per request, split into
+//   decode and store, with bytes allocated as the measure of copying
+//
+// Usage:
+//   zerocopy_bench [--db zerocopy_bench.db] [--requests N] [--message-bytes N] [--json FILE]
+// The database is created if needed; rows go to user "zerocopy-bench".
+//
+// Build (example):
+// g++ zerocopy_bench.cpp luma_store.cpp -std=c++17 -O2 -lsqlite3 -pthread -o zerocopy_bench
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include <initializer_list>
+#include <cstdio>
+#include <cstdlib>
+
+#include "json.hpp"      // nlohmann::json (single header)
+#include "api_codecs.h"
+#include "luma_store.h"
+#include "luma_store_json.h"
+
+using json = nlohmann::json;
+
+// --- Allocation counting --- //
+
+struct AllocCounts {
+    uint64_t cxx_allocs = 0;
+    uint64_t cxx_bytes = 0;
+    uint64_t sqlite_allocs = 0;
+    uint64_t sqlite_bytes = 0;
+
+    AllocCounts operator-(const AllocCounts& o) const {
+        return {cxx_allocs - o.cxx_allocs, cxx_bytes - o.cxx_bytes, sqlite_allocs - o.sqlite_allocs,
+                sqlite_bytes - o.sqlite_bytes};
+    }
+    AllocCounts& operator+=(const AllocCounts& o) {
+        cxx_allocs += o.cxx_allocs;
+        cxx_bytes += o.cxx_bytes;
+        sqlite_allocs += o.sqlite_allocs;
+        sqlite_bytes += o.sqlite_bytes;
+        return *this;
+    }
+};
+
+static AllocCounts counts;  // single-threaded
+
+// Plain malloc/free underneath, so GCC's new/delete pairing check is moot here
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new(size_t size) {
+    counts.cxx_allocs++;
+    counts.cxx_bytes += size;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+static sqlite3_mem_methods sqlite_default;
+
+static void* sqlite_counting_malloc(int size) {
+    counts.sqlite_allocs++;
+    counts.sqlite_bytes += static_cast<uint64_t>(size);
+    return sqlite_default.xMalloc(size);
+}
+
+static void* sqlite_counting_realloc(void* p, int size) {
+    counts.sqlite_allocs++;
+    counts.sqlite_bytes += static_cast<uint64_t>(size);
+    return sqlite_default.xRealloc(p, size);
+}
+
+// Must run before SQLite initializes (before the first open)
+static void count_sqlite_allocations() {
+    sqlite3_config(SQLITE_CONFIG_GETMALLOC, &sqlite_default);
+    sqlite3_mem_methods counting = sqlite_default;
+    counting.xMalloc = sqlite_counting_malloc;
+    counting.xRealloc = sqlite_counting_realloc;
+    sqlite3_config(SQLITE_CONFIG_MALLOC, &counting);
+}
+
+// --- Options --- //
+
+struct Options {
+    std::string db = "zerocopy_bench.db";
+    int requests = 20000;
+    int message_bytes = 200;
+    std::string json_out;
+};
+
+static Options parse_args(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string k = argv[i];
+        const char* v = argv[i + 1];
+        if (k == "--db") o.db = v;
+        else if (k == "--requests") o.requests = std::max(1, std::atoi(v));
+        else if (k == "--message-bytes") o.message_bytes = std::max(1, std::atoi(v));
+        else if (k == "--json") o.json_out = v;
+        else std::cerr << "unknown option " << k << "\n";
+    }
+    return o;
+}
+
+// --- Pipelines --- //
+
+static const char* BENCH_USER = "zerocopy-bench";
+
+// The codec with owned strings, as the handlers decoded before views
+struct OwnedAppend {
+    std::string user_id;
+    std::string role;
+    std::string message;
+};
+
+struct OwnedSettings {
+    std::string user_id;
+    std::optional<SettingsUpdate> settings;
+    SettingsUpdate flat;
+};
+
+struct OwnedProfile {
+    std::string user_id;
+    std::optional<std::string> name;
+    std::optional<std::string> email;
+    std::optional<std::string> avatar_url;
+};
+
+struct OwnedNotifications {
+    std::string user_id;
+    std::optional<bool> notifications_enabled;
+    std::optional<bool> chat_notifications;
+    std::optional<bool> update_notifications;
+    std::optional<bool> reminder_notifications;
+};
+
+struct OwnedTheme {
+    std::string user_id;
+    std::string theme_mode;
+};
+
+template <>
+struct JsonSchema<OwnedAppend> {
+    static constexpr auto fields = std::make_tuple(
+            required_field("user_id", &OwnedAppend::user_id),
+            required_field("role", &OwnedAppend::role),
+            required_field("message", &OwnedAppend::message));
+};
+
+template <>
+struct JsonSchema<OwnedSettings> {
+    static constexpr auto fields = std::make_tuple(
+            required_field("user_id", &OwnedSettings::user_id),
+            optional_field("settings", &OwnedSettings::settings),
+            flatten_fields(&OwnedSettings::flat));
+};
+
+template <>
+struct JsonSchema<OwnedProfile> {
+    static constexpr auto fields = std::make_tuple(
+            required_field("user_id", &OwnedProfile::user_id),
+            optional_field("name", &OwnedProfile::name),
+            optional_field("email", &OwnedProfile::email),
+            optional_field("avatar_url", &OwnedProfile::avatar_url));
+};
+
+template <>
+struct JsonSchema<OwnedNotifications> {
+    static constexpr auto fields = std::make_tuple(
+            required_field("user_id", &OwnedNotifications::user_id),
+            optional_field("notifications_enabled", &OwnedNotifications::notifications_enabled),
+            optional_field("chat_notifications", &OwnedNotifications::chat_notifications),
+            optional_field("update_notifications", &OwnedNotifications::update_notifications),
+            optional_field("reminder_notifications", &OwnedNotifications::reminder_notifications));
+};
+
+template <>
+struct JsonSchema<OwnedTheme> {
+    static constexpr auto fields = std::make_tuple(
+            required_field("user_id", &OwnedTheme::user_id),
+            required_field("theme_mode", &OwnedTheme::theme_mode));
+};
+
+// One request: decode `body`, then call the store; false on any failure.
+// `decoded` marks the boundary between the two stages.
+using Pipeline = std::function<bool(const std::string& body, StoreSession& s, const std::function<void()>& decoded)>;
+
+static Pipeline append_pipeline(const std::string& kind) {
+    if (kind == "nlohmann") {
+        return [](const std::string& body, StoreSession& s, const std::function<void()>& decoded) {
+            try {
+                json j = json::parse(body);
+                std::string user_id = j["user_id"];
+                std::string role = j["role"];
+                std::string message = j["message"];
+                decoded();
+                return s.append_message(user_id, role, message);
+            } catch (...) {
+                return false;
+            }
+        };
+    }
+    if (kind == "owned") {
+        return [](const std::string& body, StoreSession& s, const std::function<void()>& decoded) {
+            OwnedAppend r;
+            CodecError err;
+            if (!decode(body, r, err)) return false;
+            decoded();
+            return s.append_message(r.user_id, r.role, r.message);
+        };
+    }
+    return [](const std::string& body, StoreSession& s, const std::function<void()>& decoded) {
+        AppendMessageRequest r;
+        CodecError err;
+        std::string unescaped;
+        if (!decode(body, r, err, unescaped)) return false;
+        decoded();
+        return s.append_message(r.user_id, r.role, r.message);
+    };
+}
+
+static Pipeline settings_pipeline(const std::string& kind) {
+    if (kind == "nlohmann") {
+        return [](const std::string& body, StoreSession& s, const std::function<void()>& decoded) {
+            try {
+                json j = json::parse(body);
+                std::string user_id = j["user_id"];
+                json payload = j.value("settings", j);
+                payload.erase("user_id");
+                SettingsUpdate update = settings_update_from_json(payload);
+                decoded();
+                return s.update_settings(user_id, update);
+            } catch (...) {
+                return false;
+            }
+        };
+    }
+    if (kind == "owned") {
+        return [](const std::string& body, StoreSession& s, const std::function<void()>& decoded) {
+            OwnedSettings r;
+            CodecError err;
+            if (!decode(body, r, err)) return false;
+            SettingsUpdate update = r.settings ? std::move(*r.settings) : std::move(r.flat);
+            decoded();
+            return s.update_settings(r.user_id, update);
+        };
+    }
+    return [](const std::string& body, StoreSession& s, const std::function<void()>& decoded) {
+        SettingsRequest r;
+        CodecError err;
+        std::string unescaped;
+        if (!decode(body, r, err, unescaped)) return false;
+        decoded();
+        return s.update_settings(r.user_id, r.update());
+    };
+}
+
+// /profile, /notifications and /theme as the server handles them now: the
+// route's delta decoded in place and applied
+template <typename R>
+static bool apply_delta(const std::string& body, StoreSession& s, const std::function<void()>& decoded) {
+    R r;
+    CodecError err;
+    std::string unescaped;
+    if (!decode(body, r, err, unescaped)) return false;
+    if constexpr (std::is_same_v<R, ThemeRequest>) r.dark_mode = (*r.theme_mode == "Dark");
+    decoded();
+    return s.update_settings(r.user_id, r.update());
+}
+
+// The pre-codec handlers: `keys` copied from the parsed body into a second json
+static bool apply_nlohmann(const std::string& body, StoreSession& s, const std::function<void()>& decoded,
+                           std::initializer_list<const char*> keys) {
+    try {
+        json j = json::parse(body);
+        std::string user_id = j["user_id"];
+        json payload;
+        for (const char* k : keys) {
+            if (j.contains(k)) payload[k] = j[k];
+        }
+        SettingsUpdate update = settings_update_from_json(payload);
+        decoded();
+        return s.update_settings(user_id, update);
+    } catch (...) {
+        return false;
+    }
+}
+
+static Pipeline profile_pipeline(const std::string& kind) {
+    if (kind == "nlohmann") {
+        return [](const std::string& body, StoreSession& s, const std::function<void()>& decoded) {
+            return apply_nlohmann(body, s, decoded, {"name", "email", "avatar_url"});
+        };
+    }
+    if (kind == "owned") {
+        return [](const std::string& body, StoreSession& s, const std::function<void()>& decoded) {
+            OwnedProfile r;
+            CodecError err;
+            if (!decode(body, r, err)) return false;
+            SettingsUpdate update;
+            update.name = std::move(r.name);
+            update.email = std::move(r.email);
+            update.avatar_url = std::move(r.avatar_url);
+            decoded();
+            return s.update_settings(r.user_id, update);
+        };
+    }
+    return apply_delta<ProfileRequest>;
+}
+
+static Pipeline notifications_pipeline(const std::string& kind) {
+    if (kind == "nlohmann") {
+        return [](const std::string& body, StoreSession& s, const std::function<void()>& decoded) {
+            return apply_nlohmann(body, s, decoded,
+                                  {"notifications_enabled", "chat_notifications", "update_notifications",
+                                   "reminder_notifications"});
+        };
+    }
+    if (kind == "owned") {
+        return [](const std::string& body, StoreSession& s, const std::function<void()>& decoded) {
+            OwnedNotifications r;
+            CodecError err;
+            if (!decode(body, r, err)) return false;
+            SettingsUpdate update;
+            update.notifications_enabled = r.notifications_enabled;
+            update.chat_notifications = r.chat_notifications;
+            update.update_notifications = r.update_notifications;
+            update.reminder_notifications = r.reminder_notifications;
+            decoded();
+            return s.update_settings(r.user_id, update);
+        };
+    }
+    return apply_delta<NotificationsRequest>;
+}
+
+static Pipeline theme_pipeline(const std::string& kind) {
+    if (kind == "nlohmann") {
+        return [](const std::string& body, StoreSession& s, const std::function<void()>& decoded) {
+            try {
+                json j = json::parse(body);
+                std::string user_id = j["user_id"];
+                std::string mode = j["theme_mode"];
+                json payload;
+                payload["theme_mode"] = mode;
+                payload["dark_mode"] = (mode == "Dark");
+                SettingsUpdate update = settings_update_from_json(payload);
+                decoded();
+                return s.update_settings(user_id, update);
+            } catch (...) {
+                return false;
+            }
+        };
+    }
+    if (kind == "owned") {
+        return [](const std::string& body, StoreSession& s, const std::function<void()>& decoded) {
+            OwnedTheme r;
+            CodecError err;
+            if (!decode(body, r, err)) return false;
+            SettingsUpdate update;
+            update.dark_mode = (r.theme_mode == "Dark");
+            update.theme_mode = std::move(r.theme_mode);
+            decoded();
+            return s.update_settings(r.user_id, update);
+        };
+    }
+    return apply_delta<ThemeRequest>;
+}
+
+struct Result {
+    std::string route;
+    std::string kind;
+    int requests = 0;
+    uint64_t failed = 0;
+    AllocCounts decode;
+    AllocCounts store;
+    double ns = 0;
+
+    double per(uint64_t v) const { return static_cast<double>(v) / requests; }
+};
+
+static Result run_pipeline(const Options& o, StoreSession& s, const std::string& route, const std::string& kind,
+                           const Pipeline& pipeline, const std::string& body) {
+    Result r;
+    r.route = route;
+    r.kind = kind;
+    r.requests = o.requests;
+    pipeline(body, s, [] {});  // warm the statement cache
+    AllocCounts mark;
+    auto decoded = [&] {
+        AllocCounts now = counts;
+        r.decode += now - mark;
+        mark = now;
+    };
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < o.requests; i++) {
+        mark = counts;
+        if (!pipeline(body, s, decoded)) r.failed++;
+        r.store += counts - mark;
+    }
+    r.ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / o.requests;
+    return r;
+}
+
+// The INSERT alone, with SQLite copying the text or not
+static Result run_bind(const Options& o, StoreSession& s, const std::string& message, bool transient) {
+    Result r;
+    r.route = "INSERT chat_history";
+    r.kind = transient ? "TRANSIENT" : "STATIC";
+    r.requests = o.requests;
+    sqlite3_stmt* stmt = nullptr;
+    sqlite3_prepare_v3(s.handle(), "INSERT INTO chat_history(user_id, role, message, created_at) VALUES(?, ?, ?, ?);",
+                       -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr);
+    std::string user = BENCH_USER, role = "user", created = "2026-10-18T00:00:00Z";
+    auto destructor = transient ? SQLITE_TRANSIENT : SQLITE_STATIC;
+    sqlite3_exec(s.handle(), "BEGIN;", nullptr, nullptr, nullptr);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < o.requests; i++) {
+        AllocCounts mark = counts;
+        sqlite3_bind_text(stmt, 1, user.data(), static_cast<int>(user.size()), destructor);
+        sqlite3_bind_text(stmt, 2, role.data(), static_cast<int>(role.size()), destructor);
+        sqlite3_bind_text(stmt, 3, message.data(), static_cast<int>(message.size()), destructor);
+        sqlite3_bind_text(stmt, 4, created.data(), static_cast<int>(created.size()), destructor);
+        if (sqlite3_step(stmt) != SQLITE_DONE) r.failed++;
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        r.store += counts - mark;
+    }
+    r.ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / o.requests;
+    sqlite3_exec(s.handle(), "ROLLBACK;", nullptr, nullptr, nullptr);
+    sqlite3_finalize(stmt);
+    return r;
+}
+
+int main(int argc, char** argv) {
+    Options o = parse_args(argc, argv);
+    count_sqlite_allocations();
+
+    LumaStore store(o.db);
+    std::string error;
+    std::unique_ptr<StoreSession> session;
+    if (store.init(&error)) session = store.open_session(&error);
+    if (!session) {
+        std::cerr << "cannot open " << o.db << ": " << error << "\n";
+        return 2;
+    }
+
+    std::string message;
+    while (message.size() < static_cast<size_t>(o.message_bytes)) message += "Remind me to water the plants at 7. ";
+    message.resize(static_cast<size_t>(o.message_bytes));
+    std::string append_body = json{{"user_id", BENCH_USER}, {"role", "user"}, {"message", message}}.dump();
+    std::string settings_body =
+            json{{"user_id", BENCH_USER},
+                 {"settings", {{"dark_mode", true}, {"language", "German"}, {"theme_mode", "Dark"}, {"app_version", "1.4.2"}}}}
+                    .dump();
+    std::string profile_body = json{{"user_id", BENCH_USER},
+                                    {"name", "Annemarie Schneider-Villanueva"},
+                                    {"email", "annemarie.schneider@example.com"},
+                                    {"avatar_url", "https://cdn.example.com/avatars/zerocopy-bench.png"}}
+                                       .dump();
+    std::string notifications_body =
+            json{{"user_id", BENCH_USER}, {"chat_notifications", false}, {"reminder_notifications", true}}.dump();
+    std::string theme_body = json{{"user_id", BENCH_USER}, {"theme_mode", "Dark"}}.dump();
+
+    std::vector<Result> results;
+    for (const char* kind : {"nlohmann", "owned", "views"}) {
+        results.push_back(run_pipeline(o, *session, "POST /history", kind, append_pipeline(kind), append_body));
+    }
+    for (const char* kind : {"nlohmann", "owned", "views"}) {
+        results.push_back(run_pipeline(o, *session, "POST /settings", kind, settings_pipeline(kind), settings_body));
+    }
+    for (const char* kind : {"nlohmann", "owned", "views"}) {
+        results.push_back(run_pipeline(o, *session, "POST /profile", kind, profile_pipeline(kind), profile_body));
+    }
+    for (const char* kind : {"nlohmann", "owned", "views"}) {
+        results.push_back(run_pipeline(o, *session, "POST /notifications", kind, notifications_pipeline(kind),
+                                       notifications_body));
+    }
+    for (const char* kind : {"nlohmann", "owned", "views"}) {
+        results.push_back(run_pipeline(o, *session, "POST /theme", kind, theme_pipeline(kind), theme_body));
+    }
+    results.push_back(run_bind(o, *session, message, true));
+    results.push_back(run_bind(o, *session, message, false));
+    session->clear_history(BENCH_USER);
+
+    std::printf("%d requests each, %d-byte message, db %s\n\n", o.requests, o.message_bytes, o.db.c_str());
+    std::printf("%-20s %-10s | %-23s | %-23s | %-23s | %9s\n", "", "", "decode: C++", "store: C++", "store: SQLite", "");
+    std::printf("%-20s %-10s | %10s %12s | %10s %12s | %10s %12s | %9s\n", "route", "path", "allocs", "bytes",
+                "allocs", "bytes", "allocs", "bytes", "ns/req");
+    uint64_t failed = 0;
+    json out = {{"tool", "zerocopy_bench"}, {"requests", o.requests}, {"message_bytes", o.message_bytes}};
+    for (const auto& r : results) {
+        std::printf("%-20s %-10s | %10.1f %12.1f | %10.1f %12.1f | %10.1f %12.1f | %9.0f%s\n", r.route.c_str(),
+                    r.kind.c_str(), r.per(r.decode.cxx_allocs), r.per(r.decode.cxx_bytes), r.per(r.store.cxx_allocs),
+                    r.per(r.store.cxx_bytes), r.per(r.store.sqlite_allocs), r.per(r.store.sqlite_bytes), r.ns,
+                    r.failed ? "  FAILED" : "");
+        failed += r.failed;
+        out["routes"][r.route][r.kind] = {
+                {"decode_allocs", r.per(r.decode.cxx_allocs)},
+                {"decode_bytes", r.per(r.decode.cxx_bytes)},
+                {"store_allocs", r.per(r.store.cxx_allocs)},
+                {"store_bytes", r.per(r.store.cxx_bytes)},
+                {"sqlite_allocs", r.per(r.store.sqlite_allocs)},
+                {"sqlite_bytes", r.per(r.store.sqlite_bytes)},
+                {"ns_per_request", r.ns},
+                {"failed", r.failed}
+        };
+    }
+    std::printf("\n(decode: from the body to the values handed to the store; store: the StoreSession call)\n");
+
+    if (!o.json_out.empty()) {
+        std::ofstream f(o.json_out);
+        f << out.dump(2) << "\n";
+    }
+    return failed ? 1 : 0;
+}